@@ -130,11 +130,13 @@ static int nb_frames_dup = 0;
 static unsigned dup_warning = 1000;
 static int nb_frames_drop = 0;
 static int64_t decode_error_stat[2];
+static TranscodeStats transcode_stats;
 
 static int want_sdp = 1;
 
 static int current_time;
 AVIOContext *progress_avio = NULL;
+AVIOContext *stats_json_avio = NULL;
 
 static uint8_t *subtitle_out;
 
@@ -160,6 +162,7 @@ static int restore_tty;
 
 #if HAVE_THREADS
 static void free_input_threads(void);
+static void free_encoder_threads(void);
 #endif
 
 /* sub2video hack:
@@ -483,6 +486,10 @@ static void ffmpeg_cleanup(int ret)
         av_log(NULL, AV_LOG_INFO, "bench: maxrss=%ikB\n", maxrss);
     }
 
+#if HAVE_THREADS
+    free_encoder_threads();
+#endif
+
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
         avfilter_graph_free(&fg->graph);
@@ -680,6 +687,7 @@ static void write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int u
 {
     AVFormatContext *s = of->ctx;
     AVStream *st = ost->st;
+    int64_t t;
     int ret;
 
     /*
@@ -802,7 +810,9 @@ static void write_packet(OutputFile *of, AVPacket *pkt, OutputStream *ost, int u
               );
     }
 
+    t = av_gettime_relative();
     ret = av_interleaved_write_frame(s, pkt);
+    ost->mux_time += av_gettime_relative() - t;
     if (ret < 0) {
         print_error("av_interleaved_write_frame()", ret);
         main_return_code = 1;
@@ -897,10 +907,17 @@ static int check_recording_time(OutputStream *ost)
     return 1;
 }
 
-static void do_audio_out(OutputFile *of, OutputStream *ost,
-                         AVFrame *frame)
+/*
+ * Send a frame to the encoder and get the packets it returns, with their
+ * timestamps in the muxing time base. The packets are sent to the output,
+ * or added to pkt_queue when encoding on the thread of the stream.
+ */
+static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame,
+                        int64_t sync_opts, AVFifoBuffer *pkt_queue,
+                        int *frame_size)
 {
     AVCodecContext *enc = ost->enc_ctx;
+    int video = enc->codec_type == AVMEDIA_TYPE_VIDEO;
     AVPacket pkt;
     int ret;
 
@@ -908,6 +925,399 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
     pkt.data = NULL;
     pkt.size = 0;
 
+    ret = avcodec_send_frame(enc, frame);
+    if (ret < 0)
+        return ret;
+
+    while (1) {
+        ret = avcodec_receive_packet(enc, &pkt);
+        if (video)
+            update_benchmark("encode_video %d.%d", ost->file_index, ost->index);
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+        if (ret < 0)
+            return ret;
+        if (!video)
+            update_benchmark("encode_audio %d.%d", ost->file_index, ost->index);
+
+        if (video) {
+            if (debug_ts) {
+                av_log(NULL, AV_LOG_INFO, "encoder -> type:video "
+                       "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
+                       av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &enc->time_base),
+                       av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &enc->time_base));
+            }
+
+            if (pkt.pts == AV_NOPTS_VALUE && !(enc->codec->capabilities & AV_CODEC_CAP_DELAY))
+                pkt.pts = sync_opts;
+        }
+
+        av_packet_rescale_ts(&pkt, enc->time_base, ost->mux_timebase);
+
+        if (debug_ts) {
+            av_log(NULL, AV_LOG_INFO, "encoder -> type:%s "
+                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
+                   av_get_media_type_string(enc->codec_type),
+                   av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &ost->mux_timebase),
+                   av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &ost->mux_timebase));
+        }
+
+        if (frame_size)
+            *frame_size = pkt.size;
+        if (pkt_queue) {
+            if (!av_fifo_space(pkt_queue) &&
+                (ret = av_fifo_grow(pkt_queue, sizeof(pkt))) < 0) {
+                av_packet_unref(&pkt);
+                return ret;
+            }
+            av_fifo_generic_write(pkt_queue, &pkt, sizeof(pkt), NULL);
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+        } else
+            output_packet(of, &pkt, ost, 0);
+
+        /* if two pass, output log */
+        if (ost->logfile && enc->stats_out) {
+            fprintf(ost->logfile, "%s", enc->stats_out);
+        }
+    }
+}
+
+/*
+ * Account for the encoding of a frame from start to end, read_time being
+ * the time its packet was read, or 0 if it is not known.
+ */
+static void update_encode_stats(OutputStream *ost, int64_t start, int64_t end,
+                                int64_t read_time)
+{
+    ost->encode_time += end - start;
+    if (read_time > 0)
+        ost->latency[ost->nb_latency++ % STATS_LATENCY_FRAMES] = end - read_time;
+}
+
+#if HAVE_THREADS
+typedef struct EncoderJob {
+    AVFrame *frame;
+    int64_t sync_opts;
+    /* set in the encoder before the frame is sent, if den is not 0 */
+    AVRational sample_aspect_ratio;
+} EncoderJob;
+
+typedef struct EncodedFrame {
+    AVFifoBuffer *pkts;
+    int ret;
+    int64_t start, end, read_time;  /* for update_encode_stats() */
+} EncodedFrame;
+
+/* output streams in the order the frames were sent to their encoder thread */
+static AVFifoBuffer *encoder_queue;
+
+/* set when a stream has a -max_enc_latency: the packets of each stream are
+ * then written as soon as they are encoded, and encoder_queue is not used */
+static int live_encoders;
+
+static void free_encoder_job(void *msg)
+{
+    EncoderJob *job = msg;
+    av_frame_free(&job->frame);
+}
+
+static void free_encoded_frame(void *msg)
+{
+    EncodedFrame *res = msg;
+    AVPacket pkt;
+
+    if (!res->pkts)
+        return;
+    while (av_fifo_size(res->pkts)) {
+        av_fifo_generic_read(res->pkts, &pkt, sizeof(pkt), NULL);
+        av_packet_unref(&pkt);
+    }
+    av_fifo_freep(&res->pkts);
+}
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    EncoderJob job;
+
+    while (av_thread_message_queue_recv(ost->enc_queue, &job, 0) >= 0) {
+        EncodedFrame res = { NULL };
+
+        if (job.sample_aspect_ratio.den)
+            ost->enc_ctx->sample_aspect_ratio = job.sample_aspect_ratio;
+
+        res.start     = av_gettime_relative();
+        res.read_time = job.frame->reordered_opaque;
+        res.pkts = av_fifo_alloc(sizeof(AVPacket));
+        res.ret  = res.pkts ? encode_frame(NULL, ost, job.frame, job.sync_opts,
+                                           res.pkts, NULL) : AVERROR(ENOMEM);
+        res.end  = av_gettime_relative();
+        av_frame_free(&job.frame);
+
+        if (av_thread_message_queue_send(ost->enc_out_queue, &res, 0) < 0) {
+            free_encoded_frame(&res);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int init_encoder_thread(OutputStream *ost)
+{
+    int ret;
+
+    if (!encoder_queue && !(encoder_queue = av_fifo_alloc(sizeof(ost))))
+        return AVERROR(ENOMEM);
+
+    /* a stream has at most stage_queue_size frames sent and not written, so
+     * neither queue ever blocks */
+    if ((ret = av_thread_message_queue_alloc(&ost->enc_queue, stage_queue_size,
+                                             sizeof(EncoderJob))) < 0 ||
+        (ret = av_thread_message_queue_alloc(&ost->enc_out_queue, stage_queue_size,
+                                             sizeof(EncodedFrame))) < 0)
+        goto fail;
+    if (!(ost->enc_times = av_fifo_alloc_array(stage_queue_size, sizeof(int64_t)))) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    av_thread_message_queue_set_free_func(ost->enc_queue, free_encoder_job);
+    av_thread_message_queue_set_free_func(ost->enc_out_queue, free_encoded_frame);
+
+    if ((ret = pthread_create(&ost->enc_thread, NULL, encoder_thread, ost))) {
+        av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    av_thread_message_queue_free(&ost->enc_queue);
+    av_thread_message_queue_free(&ost->enc_out_queue);
+    av_fifo_freep(&ost->enc_times);
+    return ret;
+}
+
+static void free_encoder_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (!ost || !ost->enc_queue)
+            continue;
+        av_thread_message_flush(ost->enc_queue);
+        av_thread_message_queue_set_err_recv(ost->enc_queue, AVERROR_EOF);
+        av_thread_message_queue_set_err_send(ost->enc_out_queue, AVERROR_EOF);
+        pthread_join(ost->enc_thread, NULL);
+        av_thread_message_queue_free(&ost->enc_queue);
+        av_thread_message_queue_free(&ost->enc_out_queue);
+        av_fifo_freep(&ost->enc_times);
+        ost->enc_pending = 0;
+    }
+    av_fifo_freep(&encoder_queue);
+}
+
+/*
+ * Write the packets of the oldest frame sent to the encoder thread of ost.
+ *
+ * @param wait wait for the frame to be encoded
+ * @return 1 if the packets were written, 0 if there was no frame or it was
+ *         not encoded yet
+ */
+static int write_stream_frame(OutputStream *ost, int wait)
+{
+    EncodedFrame res;
+    AVPacket pkt;
+    int ret;
+
+    if (!ost->enc_pending)
+        return 0;
+
+    ret = av_thread_message_queue_recv(ost->enc_out_queue, &res,
+                                       wait ? 0 : AV_THREAD_MESSAGE_NONBLOCK);
+    if (ret == AVERROR(EAGAIN))
+        return 0;
+    av_fifo_drain(ost->enc_times, sizeof(int64_t));
+    ost->enc_pending--;
+
+    if (ret >= 0 && res.ret < 0) {
+        free_encoded_frame(&res);
+        ret = res.ret;
+    }
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_FATAL, "%s encoding failed\n",
+               ost->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO ? "Video" : "Audio");
+        exit_program(1);
+    }
+    update_encode_stats(ost, res.start, res.end, res.read_time);
+
+    while (av_fifo_size(res.pkts)) {
+        av_fifo_generic_read(res.pkts, &pkt, sizeof(pkt), NULL);
+        output_packet(output_files[ost->file_index], &pkt, ost, 0);
+    }
+    av_fifo_freep(&res.pkts);
+    return 1;
+}
+
+/*
+ * Write the packets of the oldest frame sent to any encoder thread, so that
+ * the packets reach the muxers in the same order as when encoding on the
+ * main thread.
+ */
+static int write_encoded_frame(int wait)
+{
+    OutputStream *ost;
+    int ret;
+
+    if (!encoder_queue || !av_fifo_size(encoder_queue))
+        return 0;
+    av_fifo_generic_peek(encoder_queue, &ost, sizeof(ost), NULL);
+
+    ret = write_stream_frame(ost, wait);
+    if (ret > 0)
+        av_fifo_drain(encoder_queue, sizeof(ost));
+    return ret;
+}
+
+static void write_encoded_frames(int wait)
+{
+    int i;
+
+    if (!live_encoders) {
+        while (write_encoded_frame(wait) > 0)
+            ;
+        return;
+    }
+
+    /* a slow encoder must not hold back the packets of the other streams,
+     * the muxers interleave them by dts anyway */
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputStream *ost = output_streams[i];
+
+        if (!ost->enc_queue)
+            continue;
+        while (write_stream_frame(ost, wait) > 0)
+            ;
+    }
+}
+
+/*
+ * Check whether the encoder thread of ost lags behind: its queue is full, or
+ * the oldest frame in it was sent more than -max_enc_latency ago.
+ */
+static int encoder_overloaded(OutputStream *ost, int64_t now)
+{
+    int64_t sent;
+
+    if (!ost->enc_queue || !ost->enc_pending)
+        return 0;
+    if (ost->enc_pending >= stage_queue_size)
+        return 1;
+    if (!ost->max_enc_latency)
+        return 0;
+    av_fifo_generic_peek(ost->enc_times, &sent, sizeof(sent), NULL);
+    return now - sent > ost->max_enc_latency;
+}
+
+/*
+ * Check whether the next frame of ost should be dropped rather than making
+ * the other outputs wait for its encoder. Streams with a latency limit drop
+ * frames when their encoder lags behind, or when the encoder of a stream
+ * with a higher -enc_priority does, to leave it the CPU time.
+ */
+static int drop_frame_for_encoder(OutputStream *ost)
+{
+    int64_t now;
+    int i;
+
+    if (!ost->max_enc_latency || !ost->enc_queue)
+        return 0;
+
+    write_encoded_frames(0);
+    now = av_gettime_relative();
+    if (encoder_overloaded(ost, now))
+        return 1;
+    for (i = 0; i < nb_output_streams; i++)
+        if (output_streams[i]->enc_priority > ost->enc_priority &&
+            encoder_overloaded(output_streams[i], now))
+            return 1;
+    return 0;
+}
+
+static int send_frame_to_encoder_thread(OutputStream *ost, const AVFrame *frame,
+                                        AVRational sample_aspect_ratio)
+{
+    EncoderJob job;
+    int64_t now;
+    int ret;
+
+    while (ost->enc_pending >= stage_queue_size) {
+        if (live_encoders)
+            write_stream_frame(ost, 1);
+        else
+            write_encoded_frame(1);
+    }
+
+    if (!live_encoders && !av_fifo_space(encoder_queue) &&
+        (ret = av_fifo_grow(encoder_queue, sizeof(ost))) < 0)
+        return ret;
+
+    job.frame = av_frame_clone(frame);
+    if (!job.frame)
+        return AVERROR(ENOMEM);
+    job.sync_opts           = ost->sync_opts;
+    job.sample_aspect_ratio = sample_aspect_ratio;
+
+    ret = av_thread_message_queue_send(ost->enc_queue, &job, 0);
+    if (ret < 0) {
+        av_frame_free(&job.frame);
+        return ret;
+    }
+    if (!live_encoders)
+        av_fifo_generic_write(encoder_queue, &ost, sizeof(ost), NULL);
+    now = av_gettime_relative();
+    av_fifo_generic_write(ost->enc_times, &now, sizeof(now), NULL);
+    ost->enc_pending++;
+
+    /* write what is ready meanwhile */
+    write_encoded_frames(0);
+    return 0;
+}
+#endif
+
+/*
+ * Encode a frame on the encoder thread of the stream if it has one, or
+ * right away otherwise. frame_size is only set in the latter case.
+ */
+static int send_frame_to_encoder(OutputFile *of, OutputStream *ost, AVFrame *frame,
+                                 AVRational sample_aspect_ratio, int *frame_size)
+{
+    int64_t t;
+    int ret;
+
+#if HAVE_THREADS
+    if (ost->enc_queue)
+        return send_frame_to_encoder_thread(ost, frame, sample_aspect_ratio);
+#endif
+    if (sample_aspect_ratio.den)
+        ost->enc_ctx->sample_aspect_ratio = sample_aspect_ratio;
+
+    t   = av_gettime_relative();
+    ret = encode_frame(of, ost, frame, ost->sync_opts, NULL, frame_size);
+    update_encode_stats(ost, t, av_gettime_relative(), frame->reordered_opaque);
+    return ret;
+}
+
+static void do_audio_out(OutputFile *of, OutputStream *ost,
+                         AVFrame *frame)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    int ret;
+
     if (!check_recording_time(ost))
         return;
 
@@ -917,7 +1327,6 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
     ost->samples_encoded += frame->nb_samples;
     ost->frames_encoded++;
 
-    av_assert0(pkt.size || !pkt.data);
     update_benchmark(NULL);
     if (debug_ts) {
         av_log(NULL, AV_LOG_INFO, "encoder <- type:audio "
@@ -926,31 +1335,10 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
                enc->time_base.num, enc->time_base.den);
     }
 
-    ret = avcodec_send_frame(enc, frame);
+    ret = send_frame_to_encoder(of, ost, frame, (AVRational){ 0, 0 }, NULL);
     if (ret < 0)
         goto error;
 
-    while (1) {
-        ret = avcodec_receive_packet(enc, &pkt);
-        if (ret == AVERROR(EAGAIN))
-            break;
-        if (ret < 0)
-            goto error;
-
-        update_benchmark("encode_audio %d.%d", ost->file_index, ost->index);
-
-        av_packet_rescale_ts(&pkt, enc->time_base, ost->mux_timebase);
-
-        if (debug_ts) {
-            av_log(NULL, AV_LOG_INFO, "encoder -> type:audio "
-                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
-                   av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &enc->time_base),
-                   av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &enc->time_base));
-        }
-
-        output_packet(of, &pkt, ost, 0);
-    }
-
     return;
 error:
     av_log(NULL, AV_LOG_FATAL, "Audio encoding failed\n");
@@ -1046,7 +1434,6 @@ static void do_video_out(OutputFile *of,
                          double sync_ipts)
 {
     int ret, format_video_sync;
-    AVPacket pkt;
     AVCodecContext *enc = ost->enc_ctx;
     AVCodecParameters *mux_par = ost->st->codecpar;
     AVRational frame_rate;
@@ -1056,10 +1443,24 @@ static void do_video_out(OutputFile *of,
     int frame_size = 0;
     InputStream *ist = NULL;
     AVFilterContext *filter = ost->filter->filter;
+    AVRational sar = { 0, 0 };
 
     if (ost->source_index >= 0)
         ist = input_streams[ost->source_index];
 
+#if HAVE_THREADS
+    /* the frame is skipped as if the filters had not output it, so with
+     * constant frame rate the gap is filled by duplicating the next one */
+    if (next_picture && drop_frame_for_encoder(ost)) {
+        nb_frames_drop++;
+        ost->frames_dropped++;
+        av_log(NULL, AV_LOG_VERBOSE,
+               "*** dropping frame from stream %d at ts %"PRId64", encoder lagging behind\n",
+               ost->st->index, next_picture->pts);
+        return;
+    }
+#endif
+
     frame_rate = av_buffersink_get_frame_rate(filter);
     if (frame_rate.num > 0 && frame_rate.den > 0)
         duration = 1/(av_q2d(frame_rate) * av_q2d(enc->time_base));
@@ -1164,6 +1565,7 @@ static void do_video_out(OutputFile *of,
 
     if (nb0_frames == 0 && ost->last_dropped) {
         nb_frames_drop++;
+        ost->frames_dropped++;
         av_log(NULL, AV_LOG_VERBOSE,
                "*** dropping frame %d from stream %d at ts %"PRId64"\n",
                ost->frame_number, ost->st->index, ost->last_frame->pts);
@@ -1172,9 +1574,11 @@ static void do_video_out(OutputFile *of,
         if (nb_frames > dts_error_threshold * 30) {
             av_log(NULL, AV_LOG_ERROR, "%d frame duplication too large, skipping\n", nb_frames - 1);
             nb_frames_drop++;
+            ost->frames_dropped++;
             return;
         }
         nb_frames_dup += nb_frames - (nb0_frames && ost->last_dropped) - (nb_frames > nb0_frames);
+        ost->frames_duplicated += nb_frames - (nb0_frames && ost->last_dropped) - (nb_frames > nb0_frames);
         av_log(NULL, AV_LOG_VERBOSE, "*** %d dup!\n", nb_frames - 1);
         if (nb_frames_dup > dup_warning) {
             av_log(NULL, AV_LOG_WARNING, "More than %d frames duplicated\n", dup_warning);
@@ -1183,12 +1587,12 @@ static void do_video_out(OutputFile *of,
     }
     ost->last_dropped = nb_frames == nb0_frames && next_picture;
 
+    if (next_picture && !ost->frame_aspect_ratio.num)
+        sar = next_picture->sample_aspect_ratio;
+
   /* duplicates frame if needed */
   for (i = 0; i < nb_frames; i++) {
     AVFrame *in_picture;
-    av_init_packet(&pkt);
-    pkt.data = NULL;
-    pkt.size = 0;
 
     if (i < nb0_frames && ost->last_frame) {
         in_picture = ost->last_frame;
@@ -1275,45 +1679,9 @@ static void do_video_out(OutputFile *of,
 
         ost->frames_encoded++;
 
-        ret = avcodec_send_frame(enc, in_picture);
+        ret = send_frame_to_encoder(of, ost, in_picture, sar, &frame_size);
         if (ret < 0)
             goto error;
-
-        while (1) {
-            ret = avcodec_receive_packet(enc, &pkt);
-            update_benchmark("encode_video %d.%d", ost->file_index, ost->index);
-            if (ret == AVERROR(EAGAIN))
-                break;
-            if (ret < 0)
-                goto error;
-
-            if (debug_ts) {
-                av_log(NULL, AV_LOG_INFO, "encoder -> type:video "
-                       "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
-                       av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &enc->time_base),
-                       av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &enc->time_base));
-            }
-
-            if (pkt.pts == AV_NOPTS_VALUE && !(enc->codec->capabilities & AV_CODEC_CAP_DELAY))
-                pkt.pts = ost->sync_opts;
-
-            av_packet_rescale_ts(&pkt, enc->time_base, ost->mux_timebase);
-
-            if (debug_ts) {
-                av_log(NULL, AV_LOG_INFO, "encoder -> type:video "
-                    "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
-                    av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &ost->mux_timebase),
-                    av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &ost->mux_timebase));
-            }
-
-            frame_size = pkt.size;
-            output_packet(of, &pkt, ost, 0);
-
-            /* if two pass, output log */
-            if (ost->logfile && enc->stats_out) {
-                fprintf(ost->logfile, "%s", enc->stats_out);
-            }
-        }
     }
     ost->sync_opts++;
     /*
@@ -1444,8 +1812,10 @@ static int reap_filters(int flush)
 
         while (1) {
             double float_pts = AV_NOPTS_VALUE; // this is identical to filtered_frame.pts but with higher precision
+            int64_t t = av_gettime_relative();
             ret = av_buffersink_get_frame_flags(filter, filtered_frame,
                                                AV_BUFFERSINK_FLAG_NO_REQUEST);
+            ost->filter_time += av_gettime_relative() - t;
             if (ret < 0) {
                 if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
                     av_log(NULL, AV_LOG_WARNING,
@@ -1483,9 +1853,6 @@ static int reap_filters(int flush)
 
             switch (av_buffersink_get_type(filter)) {
             case AVMEDIA_TYPE_VIDEO:
-                if (!ost->frame_aspect_ratio.num)
-                    enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
-
                 if (debug_ts) {
                     av_log(NULL, AV_LOG_INFO, "filter -> pts:%s pts_time:%s exact:%f time_base:%d/%d\n",
                             av_ts2str(filtered_frame->pts), av_ts2timestr(filtered_frame->pts, &enc->time_base),
@@ -1633,6 +2000,104 @@ static void print_final_stats(int64_t total_size)
     }
 }
 
+static int compare_int64(const void *a, const void *b)
+{
+    return FFDIFFSIGN(*(const int64_t *)a, *(const int64_t *)b);
+}
+
+static void print_stats_json(int is_last_report, int64_t timer_start, int64_t cur_time)
+{
+    static int64_t last_time = -1;
+    int64_t latency[STATS_LATENCY_FRAMES];
+    AVBPrint buf;
+    int i, j, ret;
+
+    if (!is_last_report && last_time != -1 &&
+        cur_time - last_time < stats_json_period * AV_TIME_BASE)
+        return;
+    last_time = cur_time;
+
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&buf, "{\"time\":%"PRId64",\"final\":%s,\"inputs\":[",
+               cur_time - timer_start, is_last_report ? "true" : "false");
+    for (i = 0; i < nb_input_files; i++) {
+        InputFile *f = input_files[i];
+        int queued = -1, queue_size = -1;
+        int64_t queued_bytes = -1;
+
+#if HAVE_THREADS
+        if (f->in_thread_queue) {
+            queued       = av_thread_message_queue_nb_elems(f->in_thread_queue);
+            queue_size   = f->thread_queue_size;
+            queued_bytes = atomic_load(&f->queued_bytes);
+        }
+#endif
+        av_bprintf(&buf, "%s{\"file_index\":%d,\"demux_time\":%"PRId64","
+                   "\"queue\":%d,\"queue_size\":%d,\"queue_bytes\":%"PRId64",\"streams\":[",
+                   i ? "," : "", i, (int64_t)atomic_load(&f->demux_time),
+                   queued, queue_size, queued_bytes);
+        for (j = 0; j < f->nb_streams; j++) {
+            InputStream *ist = input_streams[f->ist_index + j];
+
+            av_bprintf(&buf, "%s{\"index\":%d,\"type\":\"%s\",\"packets\":%"PRIu64","
+                       "\"frames\":%"PRIu64",\"decode_time\":%"PRId64",\"filter_time\":%"PRId64"}",
+                       j ? "," : "", j,
+                       av_get_media_type_string(ist->st->codecpar->codec_type),
+                       ist->nb_packets, ist->frames_decoded,
+                       ist->decode_time, ist->filter_time);
+        }
+        av_bprintf(&buf, "]}");
+    }
+    av_bprintf(&buf, "],\"outputs\":[");
+    for (i = 0; i < nb_output_files; i++) {
+        OutputFile *of = output_files[i];
+
+        av_bprintf(&buf, "%s{\"file_index\":%d,\"streams\":[", i ? "," : "", i);
+        for (j = 0; j < of->ctx->nb_streams; j++) {
+            OutputStream *ost = output_streams[of->ost_index + j];
+            int nb_latency = FFMIN(ost->nb_latency, STATS_LATENCY_FRAMES);
+            int64_t p50 = -1, p99 = -1;
+            int enc_queue = -1;
+
+            if (nb_latency) {
+                memcpy(latency, ost->latency, nb_latency * sizeof(*latency));
+                qsort(latency, nb_latency, sizeof(*latency), compare_int64);
+                p50 = latency[(nb_latency - 1) * 50 / 100];
+                p99 = latency[(nb_latency - 1) * 99 / 100];
+            }
+#if HAVE_THREADS
+            if (ost->enc_queue)
+                enc_queue = ost->enc_pending;
+#endif
+
+            av_bprintf(&buf, "%s{\"index\":%d,\"type\":\"%s\",\"frames\":%"PRIu64","
+                       "\"packets\":%"PRIu64",\"filter_time\":%"PRId64",\"encode_time\":%"PRId64","
+                       "\"mux_time\":%"PRId64",\"dropped\":%"PRIu64",\"duplicated\":%"PRIu64","
+                       "\"muxing_queue\":%d,\"encoder_queue\":%d,"
+                       "\"latency_p50\":%"PRId64",\"latency_p99\":%"PRId64"}",
+                       j ? "," : "", j,
+                       av_get_media_type_string(ost->st->codecpar->codec_type),
+                       ost->frames_encoded, ost->packets_written,
+                       ost->filter_time, ost->encode_time, ost->mux_time,
+                       ost->frames_dropped + (is_last_report ? ost->last_dropped : 0),
+                       ost->frames_duplicated,
+                       ost->muxing_queue ? (int)(av_fifo_size(ost->muxing_queue) / sizeof(AVPacket)) : 0,
+                       enc_queue, p50, p99);
+        }
+        av_bprintf(&buf, "]}");
+    }
+    av_bprintf(&buf, "]}\n");
+
+    avio_write(stats_json_avio, buf.str, FFMIN(buf.len, buf.size - 1));
+    avio_flush(stats_json_avio);
+    av_bprint_finalize(&buf, NULL);
+    if (is_last_report) {
+        if ((ret = avio_closep(&stats_json_avio)) < 0)
+            av_log(NULL, AV_LOG_ERROR,
+                   "Error closing stats_json, loss of information possible: %s\n", av_err2str(ret));
+    }
+}
+
 static void print_report(int is_last_report, int64_t timer_start, int64_t cur_time)
 {
     AVBPrint buf, buf_script;
@@ -1640,7 +2105,7 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     AVFormatContext *oc;
     int64_t total_size;
     AVCodecContext *enc;
-    int frame_number, vid, i;
+    int frame_number = 0, vid, i;
     double bitrate;
     double speed;
     int64_t pts = INT64_MIN + 1;
@@ -1651,6 +2116,9 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     int ret;
     float t;
 
+    if (stats_json_avio)
+        print_stats_json(is_last_report, timer_start, cur_time);
+
     if (!print_stats && !is_last_report && !progress_avio)
         return;
 
@@ -1760,6 +2228,24 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     bitrate = pts && total_size >= 0 ? total_size * 8 / (pts / 1000.0) : -1;
     speed = t != 0.0 ? (double)pts / AV_TIME_BASE / t : -1;
 
+    if (is_last_report) {
+        transcode_stats.frames     = frame_number;
+        transcode_stats.speed      = speed;
+        transcode_stats.total_size = 0;
+        for (i = 0; i < nb_output_files; i++) {
+            AVIOContext *pb = output_files[i]->ctx->pb;
+            int64_t size;
+
+            if (!pb)
+                continue;
+            size = avio_size(pb);
+            if (size <= 0)
+                size = avio_tell(pb);
+            if (size > 0)
+                transcode_stats.total_size += size;
+        }
+    }
+
     if (total_size < 0) av_bprintf(&buf, "size=N/A time=");
     else                av_bprintf(&buf, "size=%8.0fkB time=", total_size / 1024.0);
     if (pts == AV_NOPTS_VALUE) {
@@ -1847,6 +2333,10 @@ static void flush_encoders(void)
 {
     int i, ret;
 
+#if HAVE_THREADS
+    write_encoded_frames(1);
+#endif
+
     for (i = 0; i < nb_output_streams; i++) {
         OutputStream   *ost = output_streams[i];
         AVCodecContext *enc = ost->enc_ctx;
@@ -2239,6 +2729,7 @@ static int decode(AVCodecContext *avctx, AVFrame *frame, int *got_frame, AVPacke
 
 static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
 {
+    int64_t t = av_gettime_relative();
     int i, ret;
     AVFrame *f;
 
@@ -2260,6 +2751,7 @@ static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
             break;
         }
     }
+    ist->filter_time += av_gettime_relative() - t;
     return ret;
 }
 
@@ -2270,6 +2762,7 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
     AVCodecContext *avctx = ist->dec_ctx;
     int ret, err = 0;
     AVRational decoded_frame_tb;
+    int64_t t;
 
     if (!ist->decoded_frame && !(ist->decoded_frame = av_frame_alloc()))
         return AVERROR(ENOMEM);
@@ -2278,7 +2771,9 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
     decoded_frame = ist->decoded_frame;
 
     update_benchmark(NULL);
+    t = av_gettime_relative();
     ret = decode(avctx, decoded_frame, got_output, pkt);
+    ist->decode_time += av_gettime_relative() - t;
     update_benchmark("decode_audio %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
@@ -2334,6 +2829,7 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     int i, ret = 0, err = 0;
     int64_t best_effort_timestamp;
     int64_t dts = AV_NOPTS_VALUE;
+    int64_t t;
     AVPacket avpkt;
 
     // With fate-indeo3-2, we're getting 0-sized packets before EOF for some
@@ -2365,7 +2861,9 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     }
 
     update_benchmark(NULL);
+    t = av_gettime_relative();
     ret = decode(ist->dec_ctx, decoded_frame, got_output, pkt ? &avpkt : NULL);
+    ist->decode_time += av_gettime_relative() - t;
     update_benchmark("decode_video %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
@@ -2943,11 +3441,6 @@ static InputStream *get_input_stream(OutputStream *ost)
     return NULL;
 }
 
-static int compare_int64(const void *a, const void *b)
-{
-    return FFDIFFSIGN(*(const int64_t *)a, *(const int64_t *)b);
-}
-
 /* open the muxer when all the streams are initialized */
 static int check_init_output_file(OutputFile *of, int file_index)
 {
@@ -3587,6 +4080,17 @@ static int init_output_stream(OutputStream *ost, char *error, int error_len)
     if (ret < 0)
         return ret;
 
+#if HAVE_THREADS
+    if ((stage_threads || ost->max_enc_latency) &&
+        ost->encoding_needed && !do_benchmark_all && !vstats_filename &&
+        (ost->enc_ctx->codec_type == AVMEDIA_TYPE_VIDEO ||
+         ost->enc_ctx->codec_type == AVMEDIA_TYPE_AUDIO)) {
+        ret = init_encoder_thread(ost);
+        if (ret < 0)
+            return ret;
+    }
+#endif
+
     ost->initialized = 1;
 
     ret = check_init_output_file(output_files[ost->file_index], ost->file_index);
@@ -3968,35 +4472,120 @@ static int check_keyboard_interaction(int64_t cur_time)
     return 0;
 }
 
+#if HAVE_PTHREADS
+/* signals the packets queued by the input threads, and the threads to stop */
+static pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  input_cond = PTHREAD_COND_INITIALIZER;
+static int input_queued;
+#endif
+
+/*
+ * Wait for up to timeout us for an input thread to queue a packet, or for
+ * that long if there is no input thread.
+ */
+static void wait_for_input(int64_t timeout)
+{
+#if HAVE_PTHREADS
+    int64_t t = av_gettime() + timeout;
+    struct timespec ts = { .tv_sec  =  t / 1000000,
+                           .tv_nsec = (t % 1000000) * 1000 };
+    int ret = 0;
+
+    pthread_mutex_lock(&input_lock);
+    while (!input_queued && ret != ETIMEDOUT)
+        ret = pthread_cond_timedwait(&input_cond, &input_lock, &ts);
+    input_queued = 0;
+    pthread_mutex_unlock(&input_lock);
+#else
+    av_usleep(timeout);
+#endif
+}
+
 #if HAVE_THREADS
+static void signal_input_queued(void)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&input_lock);
+    input_queued = 1;
+    pthread_cond_broadcast(&input_cond);
+    pthread_mutex_unlock(&input_lock);
+#endif
+}
+
+/*
+ * Wait for up to timeout us in an input thread, returning early if the thread
+ * is stopped.
+ *
+ * @return nonzero if the thread must exit
+ */
+static int input_thread_wait(InputFile *f, int64_t timeout)
+{
+#if HAVE_PTHREADS
+    int64_t t = av_gettime() + timeout;
+    struct timespec ts = { .tv_sec  =  t / 1000000,
+                           .tv_nsec = (t % 1000000) * 1000 };
+    int ret = 0, stop;
+
+    pthread_mutex_lock(&input_lock);
+    while (!f->stop && ret != ETIMEDOUT)
+        ret = pthread_cond_timedwait(&input_cond, &input_lock, &ts);
+    stop = f->stop;
+    pthread_mutex_unlock(&input_lock);
+    return stop;
+#else
+    av_usleep(timeout);
+    return 0;
+#endif
+}
+
 static void *input_thread(void *arg)
 {
     InputFile *f = arg;
     unsigned flags = f->non_blocking ? AV_THREAD_MESSAGE_NONBLOCK : 0;
+    int64_t eagain_wait = 1000;
+    int warned = 0;
     int ret = 0;
 
     while (1) {
         AVPacket pkt;
+        int64_t t = av_gettime_relative();
         ret = av_read_frame(f->ctx, &pkt);
+        atomic_fetch_add(&f->demux_time, av_gettime_relative() - t);
 
         if (ret == AVERROR(EAGAIN)) {
-            av_usleep(10000);
+            /* retry soon, then less often while nothing comes */
+            if (input_thread_wait(f, eagain_wait))
+                break;
+            eagain_wait = FFMIN(eagain_wait * 2, 10000);
             continue;
         }
+        eagain_wait = 1000;
         if (ret < 0) {
             av_thread_message_queue_set_err_recv(f->in_thread_queue, ret);
+            signal_input_queued();
             break;
         }
+        atomic_fetch_add(&f->queued_bytes, pkt.size);
         ret = av_thread_message_queue_send(f->in_thread_queue, &pkt, flags);
         if (flags && ret == AVERROR(EAGAIN)) {
-            flags = 0;
-            ret = av_thread_message_queue_send(f->in_thread_queue, &pkt, flags);
-            av_log(f->ctx, AV_LOG_WARNING,
-                   "Thread message queue blocking; consider raising the "
-                   "thread_queue_size option (current value: %d)\n",
-                   f->thread_queue_size);
+            /* grow the queue rather than hold the demuxer back, as long as
+             * the queued packets fit in thread_queue_bytes */
+            if (atomic_load(&f->queued_bytes) <= f->thread_queue_bytes &&
+                av_thread_message_queue_grow(f->in_thread_queue, 1) >= 0)
+                ret = av_thread_message_queue_send(f->in_thread_queue, &pkt, flags);
+            if (ret == AVERROR(EAGAIN)) {
+                ret = av_thread_message_queue_send(f->in_thread_queue, &pkt, 0);
+                if (!warned) {
+                    av_log(f->ctx, AV_LOG_WARNING,
+                           "Thread message queue blocking; consider raising the "
+                           "thread_queue_bytes option (current value: %"PRId64")\n",
+                           f->thread_queue_bytes);
+                    warned = 1;
+                }
+            }
         }
         if (ret < 0) {
+            atomic_fetch_sub(&f->queued_bytes, pkt.size);
             if (ret != AVERROR_EOF)
                 av_log(f->ctx, AV_LOG_ERROR,
                        "Unable to send packet to main thread: %s\n",
@@ -4005,6 +4594,7 @@ static void *input_thread(void *arg)
             av_thread_message_queue_set_err_recv(f->in_thread_queue, ret);
             break;
         }
+        signal_input_queued();
     }
 
     return NULL;
@@ -4020,6 +4610,12 @@ static void free_input_threads(void)
 
         if (!f || !f->in_thread_queue)
             continue;
+#if HAVE_PTHREADS
+        pthread_mutex_lock(&input_lock);
+        f->stop = 1;
+        pthread_cond_broadcast(&input_cond);
+        pthread_mutex_unlock(&input_lock);
+#endif
         av_thread_message_queue_set_err_send(f->in_thread_queue, AVERROR_EOF);
         while (av_thread_message_queue_recv(f->in_thread_queue, &pkt, 0) >= 0)
             av_packet_unref(&pkt);
@@ -4034,7 +4630,7 @@ static int init_input_threads(void)
 {
     int i, ret;
 
-    if (nb_input_files == 1)
+    if (nb_input_files == 1 && !input_files[0]->use_thread)
         return 0;
 
     for (i = 0; i < nb_input_files; i++) {
@@ -4059,14 +4655,20 @@ static int init_input_threads(void)
 
 static int get_input_packet_mt(InputFile *f, AVPacket *pkt)
 {
-    return av_thread_message_queue_recv(f->in_thread_queue, pkt,
-                                        f->non_blocking ?
-                                        AV_THREAD_MESSAGE_NONBLOCK : 0);
+    int ret = av_thread_message_queue_recv(f->in_thread_queue, pkt,
+                                           f->non_blocking ?
+                                           AV_THREAD_MESSAGE_NONBLOCK : 0);
+    if (ret >= 0)
+        atomic_fetch_sub(&f->queued_bytes, pkt->size);
+    return ret;
 }
 #endif
 
 static int get_input_packet(InputFile *f, AVPacket *pkt)
 {
+    int64_t t;
+    int ret;
+
     if (f->rate_emu) {
         int i;
         for (i = 0; i < f->nb_streams; i++) {
@@ -4079,10 +4681,13 @@ static int get_input_packet(InputFile *f, AVPacket *pkt)
     }
 
 #if HAVE_THREADS
-    if (nb_input_files > 1)
+    if (f->in_thread_queue)
         return get_input_packet_mt(f, pkt);
 #endif
-    return av_read_frame(f->ctx, pkt);
+    t = av_gettime_relative();
+    ret = av_read_frame(f->ctx, pkt);
+    atomic_fetch_add(&f->demux_time, av_gettime_relative() - t);
+    return ret;
 }
 
 static int got_eagain(void)
@@ -4277,6 +4882,11 @@ static int process_input(int file_index)
     if (ist->discard)
         goto discard_packet;
 
+    /* reordered_opaque carries the read time of the packet: the decoders
+     * pass it to the frames decoded from it, for the -stats_json latency */
+    if (stats_json_avio)
+        ist->dec_ctx->reordered_opaque = av_gettime_relative();
+
     if (exit_on_error && (pkt.flags & AV_PKT_FLAG_CORRUPT)) {
         av_log(NULL, AV_LOG_FATAL, "%s: corrupt input packet in stream %d\n", is->url, pkt.stream_index);
         exit_program(1);
@@ -4502,13 +5112,14 @@ static int transcode_step(void)
 {
     OutputStream *ost;
     InputStream  *ist = NULL;
+    int64_t t;
     int ret;
 
     ost = choose_output();
     if (!ost) {
         if (got_eagain()) {
             reset_eagain();
-            av_usleep(10000);
+            wait_for_input(10000);
             return 0;
         }
         av_log(NULL, AV_LOG_VERBOSE, "No more inputs to read from, finishing.\n");
@@ -4535,7 +5146,10 @@ static int transcode_step(void)
                 exit_program(1);
             }
         }
-        if ((ret = transcode_from_filter(ost->filter->graph, &ist)) < 0)
+        t   = av_gettime_relative();
+        ret = transcode_from_filter(ost->filter->graph, &ist);
+        ost->filter_time += av_gettime_relative() - t;
+        if (ret < 0)
             return ret;
         if (!ist)
             return 0;
@@ -4581,6 +5195,13 @@ static int transcode(void)
     InputStream *ist;
     int64_t timer_start;
     int64_t total_packets_written = 0;
+    int wait_encoders = 0, nb_sources;
+
+#if HAVE_THREADS
+    for (i = 0; i < nb_output_streams; i++)
+        if (output_streams[i]->max_enc_latency)
+            live_encoders = 1;
+#endif
 
     ret = transcode_init();
     if (ret < 0)
@@ -4595,6 +5216,25 @@ static int transcode(void)
 #if HAVE_THREADS
     if ((ret = init_input_threads()) < 0)
         goto fail;
+
+    /* the next input or filtergraph source to read depends on what was
+     * muxed so far: keep it in step with serial encoding, unless the
+     * streams are written independently anyway */
+    nb_sources = nb_input_files;
+    for (i = 0; i < nb_filtergraphs; i++)
+        if (!filtergraphs[i]->nb_inputs)
+            nb_sources++;
+    wait_encoders = nb_sources > 1 && !live_encoders;
+    /* an output is finished once what was muxed reaches its -frames or -fs
+     * limit, or with -shortest once one of its streams ends, which must not
+     * lag behind the encoders, or more would be written than asked */
+    for (i = 0; i < nb_output_streams; i++) {
+        OutputFile *of = output_files[output_streams[i]->file_index];
+
+        if (output_streams[i]->max_frames < INT64_MAX ||
+            of->limit_filesize != UINT64_MAX || of->shortest)
+            wait_encoders = 1;
+    }
 #endif
 
     while (!received_sigterm) {
@@ -4605,6 +5245,10 @@ static int transcode(void)
             if (check_keyboard_interaction(cur_time) < 0)
                 break;
 
+#if HAVE_THREADS
+        write_encoded_frames(wait_encoders);
+#endif
+
         /* check if there's any stream where output is still needed */
         if (!need_output()) {
             av_log(NULL, AV_LOG_VERBOSE, "No more output streams to write to, finishing.\n");
@@ -4632,6 +5276,9 @@ static int transcode(void)
         }
     }
     flush_encoders();
+#if HAVE_THREADS
+    free_encoder_threads();
+#endif
 
     term_exit();
 
@@ -4688,6 +5335,7 @@ static int transcode(void)
  fail:
 #if HAVE_THREADS
     free_input_threads();
+    free_encoder_threads();
 #endif
 
     if (output_streams) {
@@ -4755,39 +5403,11 @@ static void log_callback_null(void *ptr, int level, const char *fmt, va_list vl)
 {
 }
 
-int main(int argc, char **argv)
+int run_transcode(void)
 {
-    int i, ret;
+    int i;
     int64_t ti;
 
-    init_dynload();
-
-    register_exit(ffmpeg_cleanup);
-
-    setvbuf(stderr,NULL,_IONBF,0); /* win32 runtime needs this */
-
-    av_log_set_flags(AV_LOG_SKIP_REPEATED);
-    parse_loglevel(argc, argv, options);
-
-    if(argc>1 && !strcmp(argv[1], "-d")){
-        run_as_daemon=1;
-        av_log_set_callback(log_callback_null);
-        argc--;
-        argv++;
-    }
-
-#if CONFIG_AVDEVICE
-    avdevice_register_all();
-#endif
-    avformat_network_init();
-
-    show_banner(argc, argv, options);
-
-    /* parse options and open all input/output files */
-    ret = ffmpeg_parse_options(argc, argv);
-    if (ret < 0)
-        exit_program(1);
-
     if (nb_output_files <= 0 && nb_input_files == 0) {
         show_usage();
         av_log(NULL, AV_LOG_WARNING, "Use -h to get full help or, even better, run 'man %s'\n", program_name);
@@ -4822,6 +5442,49 @@ int main(int argc, char **argv)
     if ((decode_error_stat[0] + decode_error_stat[1]) * max_error_rate < decode_error_stat[1])
         exit_program(69);
 
-    exit_program(received_nb_signals ? 255 : main_return_code);
+    return received_nb_signals ? 255 : main_return_code;
+}
+
+void get_transcode_stats(TranscodeStats *stats)
+{
+    *stats = transcode_stats;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    init_dynload();
+
+    register_exit(ffmpeg_cleanup);
+
+    setvbuf(stderr,NULL,_IONBF,0); /* win32 runtime needs this */
+
+    av_log_set_flags(AV_LOG_SKIP_REPEATED);
+    parse_loglevel(argc, argv, options);
+
+    if(argc>1 && !strcmp(argv[1], "-d")){
+        run_as_daemon=1;
+        av_log_set_callback(log_callback_null);
+        argc--;
+        argv++;
+    }
+
+#if CONFIG_AVDEVICE
+    avdevice_register_all();
+#endif
+    avformat_network_init();
+
+    show_banner(argc, argv, options);
+
+    /* parse options and open all input/output files */
+    ret = ffmpeg_parse_options(argc, argv);
+    if (ret < 0)
+        exit_program(1);
+
+    if (server_url)
+        exit_program(run_server());
+
+    exit_program(run_transcode());
     return main_return_code;
 }
@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <signal.h>
+#include <stdatomic.h>
 
 #include "cmdutils.h"
 
@@ -55,6 +56,8 @@
 
 #define MAX_STREAMS 1024    /* arbitrary sanity check value */
 
+#define STATS_LATENCY_FRAMES 1024
+
 enum HWAccelID {
     HWACCEL_NONE = 0,
     HWACCEL_AUTO,
@@ -120,6 +123,8 @@ typedef struct OptionsContext {
     int rate_emu;
     int accurate_seek;
     int thread_queue_size;
+    int64_t thread_queue_bytes;
+    int input_thread;
 
     SpecifierOpt *ts_scale;
     int        nb_ts_scale;
@@ -216,6 +221,10 @@ typedef struct OptionsContext {
     int        nb_passlogfiles;
     SpecifierOpt *max_muxing_queue_size;
     int        nb_max_muxing_queue_size;
+    SpecifierOpt *max_enc_latency;
+    int        nb_max_enc_latency;
+    SpecifierOpt *enc_priority;
+    int        nb_enc_priority;
     SpecifierOpt *guess_layout_max;
     int        nb_guess_layout_max;
     SpecifierOpt *apad;
@@ -383,6 +392,9 @@ typedef struct InputStream {
     // number of frames/samples retrieved from the decoder
     uint64_t frames_decoded;
     uint64_t samples_decoded;
+    // wall time spent decoding and sending the frames to the filters, in us
+    int64_t decode_time;
+    int64_t filter_time;
 
     int64_t *dts_buffer;
     int nb_dts_buffer;
@@ -417,8 +429,14 @@ typedef struct InputFile {
     pthread_t thread;           /* thread reading from this file */
     int non_blocking;           /* reading packets from the thread should not block */
     int joined;                 /* the thread has been joined */
-    int thread_queue_size;      /* maximum number of queued packets */
+    int thread_queue_size;      /* initial maximum number of queued packets */
+    int64_t thread_queue_bytes; /* the queue grows while the queued packets are smaller */
+    atomic_int_least64_t queued_bytes; /* size of the queued packets */
+    int use_thread;             /* read in a thread even if it is the only input */
+    int stop;                   /* the thread must exit, protected by input_lock */
 #endif
+
+    atomic_int_least64_t demux_time; /* wall time spent reading packets, in us */
 } InputFile;
 
 enum forced_keyframes_const {
@@ -534,12 +552,28 @@ typedef struct OutputStream {
     // number of frames/samples sent to the encoder
     uint64_t frames_encoded;
     uint64_t samples_encoded;
+    // number of frames dropped or duplicated for the output frame rate
+    uint64_t frames_dropped;
+    uint64_t frames_duplicated;
+    // wall time spent getting the frames from the filters, encoding and muxing, in us
+    int64_t filter_time;
+    int64_t encode_time;
+    int64_t mux_time;
+    // wall time from reading a packet to the end of the encoding of the
+    // frame decoded from it, for the last STATS_LATENCY_FRAMES frames, in us
+    int64_t latency[STATS_LATENCY_FRAMES];
+    uint64_t nb_latency;
 
     /* packet quality factor */
     int quality;
 
     int max_muxing_queue_size;
 
+    /* maximum time a frame may wait for the encoder thread before the
+     * following frames are dropped, in us, 0 for no limit */
+    int64_t max_enc_latency;
+    int enc_priority;
+
     /* the packets are buffered here until the muxer is ready to be initialized */
     AVFifoBuffer *muxing_queue;
 
@@ -548,6 +582,14 @@ typedef struct OutputStream {
 
     /* frame encode sum of squared error values */
     int64_t error[4];
+
+#if HAVE_THREADS
+    AVThreadMessageQueue *enc_queue;     /* frames for the encoder thread, with -stage_threads */
+    AVThreadMessageQueue *enc_out_queue; /* packets of each frame encoded by the thread */
+    pthread_t enc_thread;
+    int enc_pending;                     /* frames sent to the thread and not written yet */
+    AVFifoBuffer *enc_times;             /* send times of the pending frames */
+#endif
 } OutputStream;
 
 typedef struct OutputFile {
@@ -603,11 +645,17 @@ extern int qp_hist;
 extern int stdin_interaction;
 extern int frame_bits_per_raw_sample;
 extern AVIOContext *progress_avio;
+extern AVIOContext *stats_json_avio;
+extern float stats_json_period;
 extern float max_error_rate;
 extern char *videotoolbox_pixfmt;
 
 extern int filter_nbthreads;
 extern int filter_complex_nbthreads;
+extern int stage_threads;
+extern int stage_queue_size;
+extern char *server_url;
+extern int server_jobs;
 extern int vstats_version;
 
 extern const AVIOInterruptCB int_cb;
@@ -651,6 +699,32 @@ int ifilter_parameters_from_frame(InputFilter *ifilter, const AVFrame *frame);
 
 int ffmpeg_parse_options(int argc, char **argv);
 
+typedef struct TranscodeStats {
+    int64_t frames;         ///< frames of the first video output stream
+    int64_t total_size;     ///< bytes written to the output files
+    double  speed;          ///< output duration divided by the elapsed time
+} TranscodeStats;
+
+/**
+ * Transcode the files opened by ffmpeg_parse_options().
+ *
+ * @return the exit code of the program
+ */
+int run_transcode(void);
+
+/**
+ * Get the stats of the last report of run_transcode(), zeroed if there was
+ * none.
+ */
+void get_transcode_stats(TranscodeStats *stats);
+
+/**
+ * Run the jobs read from server_url, each in a process of its own.
+ *
+ * @return the exit code of the program
+ */
+int run_server(void);
+
 int videotoolbox_init(AVCodecContext *s);
 int qsv_init(AVCodecContext *s);
 int cuvid_init(AVCodecContext *s);
@@ -658,6 +732,8 @@ int cuvid_init(AVCodecContext *s);
 HWDevice *hw_device_get_by_name(const char *name);
 int hw_device_init_from_string(const char *arg, HWDevice **dev);
 void hw_device_free_all(void);
+/* Check that the devices can be shared with forked processes. */
+int hw_device_check_fork_safe(void);
 
 int hw_device_setup_for_decode(InputStream *ist);
 int hw_device_setup_for_encode(OutputStream *ost);
@@ -1004,6 +1004,9 @@ int configure_filtergraph(FilterGraph *fg)
     if (!(fg->graph = avfilter_graph_alloc()))
         return AVERROR(ENOMEM);
 
+    if (stage_threads)
+        fg->graph->thread_type |= AVFILTER_THREAD_PIPELINE;
+
     if (simple) {
         OutputStream *ost = fg->outputs[0]->ost;
         char args[512];
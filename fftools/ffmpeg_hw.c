@@ -278,6 +278,23 @@ void hw_device_free_all(void)
     nb_hw_devices = 0;
 }
 
+int hw_device_check_fork_safe(void)
+{
+    int i;
+    for (i = 0; i < nb_hw_devices; i++) {
+        /* a DRM device is only an open file descriptor, the other types
+         * keep driver state which is not usable in a forked process */
+        if (hw_devices[i]->type != AV_HWDEVICE_TYPE_DRM) {
+            av_log(NULL, AV_LOG_ERROR, "Device %s of type %s cannot be "
+                   "used by the processes forked from this one.\n",
+                   hw_devices[i]->name,
+                   av_hwdevice_get_type_name(hw_devices[i]->type));
+            return AVERROR(ENOSYS);
+        }
+    }
+    return 0;
+}
+
 static HWDevice *hw_device_match_by_codec(const AVCodec *codec)
 {
     const AVCodecHWConfig *config;
@@ -107,8 +107,13 @@ int qp_hist           = 0;
 int stdin_interaction = 1;
 int frame_bits_per_raw_sample = 0;
 float max_error_rate  = 2.0/3;
+float stats_json_period = 1.0;
 int filter_nbthreads = 0;
 int filter_complex_nbthreads = 0;
+int stage_threads = 0;
+int stage_queue_size = 8;
+char *server_url      = NULL;
+int server_jobs       = 1;
 int vstats_version = 2;
 
 
@@ -166,6 +171,7 @@ static void init_options(OptionsContext *o)
     o->limit_filesize = UINT64_MAX;
     o->chapters_input_file = INT_MAX;
     o->accurate_seek  = 1;
+    o->thread_queue_bytes = 32 << 20;
 }
 
 static int show_hwaccels(void *optctx, const char *opt, const char *arg)
@@ -1162,6 +1168,8 @@ static int open_input_file(OptionsContext *o, const char *filename)
     f->time_base = (AVRational){ 1, 1 };
 #if HAVE_THREADS
     f->thread_queue_size = o->thread_queue_size > 0 ? o->thread_queue_size : 8;
+    f->thread_queue_bytes = o->thread_queue_bytes;
+    f->use_thread = o->input_thread;
 #endif
 
     /* check if all codec options have been used */
@@ -1305,7 +1313,7 @@ static OutputStream *new_output_stream(OptionsContext *o, AVFormatContext *oc, e
     int idx      = oc->nb_streams - 1, ret = 0;
     const char *bsfs = NULL, *time_base = NULL;
     char *next, *codec_tag = NULL;
-    double qscale = -1;
+    double qscale = -1, max_enc_latency = 0;
     int i;
 
     if (!st) {
@@ -1492,6 +1500,10 @@ static OutputStream *new_output_stream(OptionsContext *o, AVFormatContext *oc, e
     MATCH_PER_STREAM_OPT(max_muxing_queue_size, i, ost->max_muxing_queue_size, oc, st);
     ost->max_muxing_queue_size *= sizeof(AVPacket);
 
+    MATCH_PER_STREAM_OPT(max_enc_latency, dbl, max_enc_latency, oc, st);
+    ost->max_enc_latency = max_enc_latency * AV_TIME_BASE;
+    MATCH_PER_STREAM_OPT(enc_priority, i, ost->enc_priority, oc, st);
+
     if (oc->oformat->flags & AVFMT_GLOBALHEADER)
         ost->enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
@@ -3288,6 +3300,23 @@ static int opt_progress(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_stats_json(void *optctx, const char *opt, const char *arg)
+{
+    AVIOContext *avio = NULL;
+    int ret;
+
+    if (!strcmp(arg, "-"))
+        arg = "pipe:";
+    ret = avio_open2(&avio, arg, AVIO_FLAG_WRITE, &int_cb, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open stats_json URL \"%s\": %s\n",
+               arg, av_err2str(ret));
+        return ret;
+    }
+    stats_json_avio = avio;
+    return 0;
+}
+
 #define OFFSET(x) offsetof(OptionsContext, x)
 const OptionDef options[] = {
     /* main options */
@@ -3366,6 +3395,10 @@ const OptionDef options[] = {
       "add timings for each task" },
     { "progress",       HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
+    { "stats_json",     HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_stats_json },
+      "write per-stream processing stats in JSON", "url" },
+    { "stats_json_period", HAS_ARG | OPT_FLOAT | OPT_EXPERT,         { &stats_json_period },
+      "set the period at which -stats_json stats are written", "seconds" },
     { "stdin",          OPT_BOOL | OPT_EXPERT,                       { &stdin_interaction },
       "enable or disable interaction on standard input" },
     { "timelimit",      HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_timelimit },
@@ -3441,6 +3474,14 @@ const OptionDef options[] = {
         "create a complex filtergraph", "graph_description" },
     { "filter_complex_threads", HAS_ARG | OPT_INT,                   { &filter_complex_nbthreads },
         "number of threads for -filter_complex" },
+    { "stage_threads",  OPT_BOOL | OPT_EXPERT,                       { &stage_threads },
+        "run the encoders and the filters supporting it in their own threads" },
+    { "stage_queue_size", HAS_ARG | OPT_INT | OPT_EXPERT,            { &stage_queue_size },
+        "maximum number of frames queued for each encoder thread", "size" },
+    { "server",         HAS_ARG | OPT_STRING | OPT_EXPERT,          { &server_url },
+        "run the jobs whose command lines are read from url", "url" },
+    { "server_jobs",    HAS_ARG | OPT_INT | OPT_EXPERT,             { &server_jobs },
+        "maximum number of jobs run in parallel in server mode", "number" },
     { "lavfi",          HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
     { "filter_complex_script", HAS_ARG | OPT_EXPERT,                 { .func_arg = opt_filter_complex_script },
@@ -3468,6 +3509,11 @@ const OptionDef options[] = {
     { "thread_queue_size", HAS_ARG | OPT_INT | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
                                                                      { .off = OFFSET(thread_queue_size) },
         "set the maximum number of queued packets from the demuxer" },
+    { "thread_queue_bytes", HAS_ARG | OPT_INT64 | OPT_OFFSET | OPT_EXPERT | OPT_INPUT,
+                                                                     { .off = OFFSET(thread_queue_bytes) },
+        "let the queue of packets from the demuxer grow up to this size", "bytes" },
+    { "input_thread",   OPT_BOOL | OPT_OFFSET | OPT_EXPERT | OPT_INPUT, { .off = OFFSET(input_thread) },
+        "read the input in a thread even if it is the only one" },
     { "find_stream_info", OPT_BOOL | OPT_PERFILE | OPT_INPUT | OPT_EXPERT, { &find_stream_info },
         "read and decode the streams to fill missing information with heuristics" },
 
@@ -3654,6 +3700,10 @@ const OptionDef options[] = {
 
     { "max_muxing_queue_size", HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(max_muxing_queue_size) },
         "maximum number of packets that can be buffered while waiting for all streams to initialize", "packets" },
+    { "max_enc_latency", HAS_ARG | OPT_DOUBLE | OPT_SPEC | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(max_enc_latency) },
+        "drop the frames of the stream when its encoder lags behind more than this", "seconds" },
+    { "enc_priority", HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(enc_priority) },
+        "priority of the stream encoder when encoders lag behind", "priority" },
 
     /* data codec support */
     { "dcodec", HAS_ARG | OPT_DATA | OPT_PERFILE | OPT_EXPERT | OPT_INPUT | OPT_OUTPUT, { .func_arg = opt_data_codec },
@@ -0,0 +1,365 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Server mode: run the jobs whose command lines are read from an URL.
+ *
+ * Each job runs in a process forked from the server once it is initialized,
+ * so the jobs skip the startup of the program and the state of a job, which
+ * lives in global variables, cannot leak into the next ones. The hardware
+ * devices initialized by the server are inherited by the jobs, for the types
+ * that remain usable after fork(). Codec and filter thread pools are created
+ * by each job. A job that ends normally writes its stats to a pipe, which is
+ * read once the job has been waited for.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#if HAVE_FORK && HAVE_PTHREADS
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "libavformat/avio.h"
+#include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/dict.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "ffmpeg.h"
+#include "cmdutils.h"
+
+#if HAVE_FORK && HAVE_PTHREADS
+
+typedef struct ServerJob {
+    int     index;
+    pid_t   pid;
+    int64_t start_time;
+    int     stats_fd;   /* read end of the pipe of the job stats */
+} ServerJob;
+
+typedef struct Server {
+    ServerJob *jobs;
+    int nb_running;
+    int done;           /* no more jobs will be started */
+    int failed;         /* the jobs cannot be waited for anymore */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} Server;
+
+/**
+ * Read a line, without the line break.
+ *
+ * @return 0 on success, AVERROR_EOF at the end of the input
+ */
+static int read_job_line(AVIOContext *pb, AVBPrint *line)
+{
+    int c;
+
+    av_bprint_clear(line);
+    while ((c = avio_r8(pb)) && c != '\n')
+        if (c != '\r')
+            av_bprint_chars(line, c, 1);
+    if (!av_bprint_is_complete(line))
+        return AVERROR(ENOMEM);
+    if (!c && !line->len && avio_feof(pb))
+        return pb->error ? pb->error : AVERROR_EOF;
+    return 0;
+}
+
+/**
+ * Split a job command line into arguments, with the quoting rules of
+ * av_get_token(), argv[0] being the program name.
+ *
+ * @return the number of arguments, 1 for an empty or comment line
+ */
+static int split_job_line(const char *line, char ***argv)
+{
+    const char *p = line + strspn(line, " \t");
+    int argc = 0;
+    char *arg;
+
+    av_dynarray_add(argv, &argc, av_strdup(program_name));
+    if (*p == '#')
+        return argc;
+    while (*p) {
+        if (!(arg = av_get_token(&p, " \t")))
+            break;
+        av_dynarray_add(argv, &argc, arg);
+        p += strspn(p, " \t");
+    }
+    return argc;
+}
+
+static void free_job_args(char ***argv, int argc)
+{
+    int i;
+
+    for (i = 0; i < argc; i++)
+        av_free((*argv)[i]);
+    av_freep(argv);
+}
+
+static void run_job(int argc, char **argv, int stats_fd)
+{
+    TranscodeStats stats;
+    int ret;
+
+    /* the server input may be stdin, and the terminal is left alone */
+    stdin_interaction = 0;
+    server_url        = NULL;
+
+    if (ffmpeg_parse_options(argc, argv) < 0)
+        exit_program(1);
+    if (server_url) {
+        av_log(NULL, AV_LOG_FATAL, "A job cannot run a server\n");
+        exit_program(1);
+    }
+    ret = run_transcode();
+
+    /* smaller than PIPE_BUF, so written at once and never blocking */
+    get_transcode_stats(&stats);
+    if (write(stats_fd, &stats, sizeof(stats)) != sizeof(stats))
+        av_log(NULL, AV_LOG_WARNING, "Failed to write the job stats\n");
+    close(stats_fd);
+    exit_program(ret);
+}
+
+static void report_job(ServerJob *job, int status)
+{
+    double elapsed = (av_gettime_relative() - job->start_time) / 1000000.0;
+    TranscodeStats stats;
+    char buf[128] = "";
+
+    /* the job has ended, so the stats are already in the pipe if any */
+    if (read(job->stats_fd, &stats, sizeof(stats)) == sizeof(stats))
+        snprintf(buf, sizeof(buf), ", frames=%"PRId64" size=%"PRId64" speed=%.3gx",
+                 stats.frames, stats.total_size, stats.speed);
+    close(job->stats_fd);
+
+    if (WIFSIGNALED(status))
+        av_log(NULL, AV_LOG_ERROR, "Job %d killed by signal %d after %0.3fs%s\n",
+               job->index, WTERMSIG(status), elapsed, buf);
+    else
+        av_log(NULL, WEXITSTATUS(status) ? AV_LOG_ERROR : AV_LOG_INFO,
+               "Job %d exited with status %d after %0.3fs%s\n",
+               job->index, WEXITSTATUS(status), elapsed, buf);
+}
+
+/* wait for the jobs to end, while the main thread reads the next ones */
+static void *waiter_thread(void *arg)
+{
+    Server *s = arg;
+    pid_t pid;
+    int status, i;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->nb_running || !s->done) {
+        if (!s->nb_running) {
+            pthread_cond_wait(&s->cond, &s->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&s->lock);
+        pid = waitpid(-1, &status, 0);
+        pthread_mutex_lock(&s->lock);
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            av_log(NULL, AV_LOG_ERROR, "Failed to wait for the jobs: %s\n",
+                   strerror(errno));
+            s->failed = 1;
+            break;
+        }
+
+        /* the main thread holds the lock while starting a job, so the pid
+         * of a job is always found */
+        for (i = 0; i < server_jobs; i++) {
+            if (s->jobs[i].pid != pid)
+                continue;
+            report_job(&s->jobs[i], status);
+            s->jobs[i].pid = 0;
+            s->nb_running--;
+            pthread_cond_broadcast(&s->cond);
+            break;
+        }
+    }
+
+    /* the jobs left are not waited for, and no others are started */
+    for (i = 0; i < server_jobs; i++) {
+        if (!s->jobs[i].pid)
+            continue;
+        av_log(NULL, AV_LOG_ERROR, "Job %d, pid %d, left running\n",
+               s->jobs[i].index, (int)s->jobs[i].pid);
+        close(s->jobs[i].stats_fd);
+        s->jobs[i].pid = 0;
+    }
+    s->nb_running = 0;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+int run_server(void)
+{
+    Server s = { NULL };
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    AVBPrint line;
+    pthread_t waiter;
+    int nb_started = 0, ret = 0, read_error = 0, i;
+
+    if (nb_input_files || nb_output_files) {
+        av_log(NULL, AV_LOG_FATAL, "Input and output files are given to the "
+               "jobs, not to the server\n");
+        return 1;
+    }
+    if (server_jobs < 1) {
+        av_log(NULL, AV_LOG_FATAL, "Invalid number of jobs %d\n", server_jobs);
+        return 1;
+    }
+    /* the devices of -init_hw_device are shared with the jobs */
+    if (hw_device_check_fork_safe() < 0)
+        return 1;
+    if (!(s.jobs = av_mallocz_array(server_jobs, sizeof(*s.jobs))))
+        return 1;
+
+    /* the jobs are read line by line */
+    term_exit();
+
+    /* wait for a client with the network protocols */
+    av_dict_set(&opts, "listen", "1", 0);
+    ret = avio_open2(&pb, server_url, AVIO_FLAG_READ, &int_cb, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_FATAL, "Failed to open %s: %s\n",
+               server_url, av_err2str(ret));
+        av_free(s.jobs);
+        return 1;
+    }
+
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+    if ((ret = pthread_create(&waiter, NULL, waiter_thread, &s))) {
+        av_log(NULL, AV_LOG_FATAL, "pthread_create failed: %s\n", strerror(ret));
+        ret = 1;
+        goto end;
+    }
+
+    av_bprint_init(&line, 0, AV_BPRINT_SIZE_UNLIMITED);
+    while (!int_cb.callback(int_cb.opaque) &&
+           (ret = read_job_line(pb, &line)) >= 0) {
+        char **argv = NULL;
+        int argc = split_job_line(line.str, &argv);
+        int stats_pipe[2];
+        pid_t pid;
+
+        if (argc <= 1) {
+            free_job_args(&argv, argc);
+            continue;
+        }
+
+        pthread_mutex_lock(&s.lock);
+        while (s.nb_running == server_jobs && !s.failed)
+            pthread_cond_wait(&s.cond, &s.lock);
+        if (s.failed) {
+            pthread_mutex_unlock(&s.lock);
+            free_job_args(&argv, argc);
+            break;
+        }
+        for (i = 0; s.jobs[i].pid; i++)
+            ;
+
+        if (pipe(stats_pipe) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Failed to start job %d: %s\n",
+                   nb_started, strerror(errno));
+            pthread_mutex_unlock(&s.lock);
+            free_job_args(&argv, argc);
+            continue;
+        }
+
+        /* the buffered output would be written by both processes, and the
+         * waiter thread only logs with the lock held, so that the child does
+         * not inherit a locked log mutex */
+        fflush(NULL);
+        pid = fork();
+        if (!pid) {
+            for (i = 0; i < server_jobs; i++)
+                if (s.jobs[i].pid)
+                    close(s.jobs[i].stats_fd);
+            close(stats_pipe[0]);
+            run_job(argc, argv, stats_pipe[1]);
+        } else if (pid < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Failed to start job %d: %s\n",
+                   nb_started, strerror(errno));
+            close(stats_pipe[0]);
+        } else {
+            s.jobs[i].index      = nb_started++;
+            s.jobs[i].pid        = pid;
+            s.jobs[i].start_time = av_gettime_relative();
+            s.jobs[i].stats_fd   = stats_pipe[0];
+            s.nb_running++;
+            pthread_cond_signal(&s.cond);
+            av_log(NULL, AV_LOG_VERBOSE, "Job %d started, pid %d: %s\n",
+                   s.jobs[i].index, (int)pid, line.str);
+        }
+        close(stats_pipe[1]);
+        pthread_mutex_unlock(&s.lock);
+        free_job_args(&argv, argc);
+    }
+    if (ret < 0 && ret != AVERROR_EOF && ret != AVERROR_EXIT) {
+        av_log(NULL, AV_LOG_ERROR, "Error reading jobs from %s: %s\n",
+               server_url, av_err2str(ret));
+        read_error = 1;
+    }
+    av_bprint_finalize(&line, NULL);
+
+    pthread_mutex_lock(&s.lock);
+    s.done = 1;
+    pthread_cond_signal(&s.cond);
+    pthread_mutex_unlock(&s.lock);
+    pthread_join(waiter, NULL);
+    if (int_cb.callback(int_cb.opaque))
+        ret = 255;
+    else
+        ret = read_error || s.failed;
+
+end:
+    pthread_cond_destroy(&s.cond);
+    pthread_mutex_destroy(&s.lock);
+    avio_closep(&pb);
+    av_free(s.jobs);
+    return ret;
+}
+
+#else
+
+int run_server(void)
+{
+    av_log(NULL, AV_LOG_FATAL, "Server mode is not supported on this platform\n");
+    return 1;
+}
+
+#endif /* HAVE_FORK && HAVE_PTHREADS */
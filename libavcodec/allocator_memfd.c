@@ -0,0 +1,142 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * Allocator backed by anonymous memfd objects. The buffers follow the same
+ * conventions as the DRM dumb buffers (size in linesize[0], fd in
+ * linesize[2], mapping in data[0]), so they can be exported as DRM PRIME
+ * frames and mapped again by fd without any DRM device.
+ */
+
+/* for syscall() */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "allocator_memfd.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+typedef struct {
+    unsigned int alignment;
+} allocator_ctx_memfd;
+
+static int memfd_open(const char *name)
+{
+#ifdef SYS_memfd_create
+    return syscall(SYS_memfd_create, name, MFD_CLOEXEC);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int os_allocator_memfd_alloc(void *ctx, AVFrame *info)
+{
+    allocator_ctx_memfd *p = ctx;
+    size_t len;
+    void *ptr;
+    int fd;
+
+    if (NULL == ctx)
+        return -EINVAL;
+
+    len = (info->linesize[0] + p->alignment - 1) & ~(p->alignment - 1);
+
+    fd = memfd_open("rkvdec");
+    if (fd < 0)
+        return AVERROR(errno);
+
+    if (ftruncate(fd, len) < 0) {
+        close(fd);
+        return AVERROR(errno);
+    }
+
+    ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        close(fd);
+        return AVERROR(errno);
+    }
+
+    info->linesize[0] = len;
+    info->linesize[1] = 0;
+    info->linesize[2] = fd;
+    info->data[0] = ptr;
+
+    return 0;
+}
+
+static int os_allocator_memfd_free(void *ctx, AVFrame *info)
+{
+    if (NULL == ctx)
+        return -EINVAL;
+
+    munmap(info->data[0], info->linesize[0]);
+    close(info->linesize[2]);
+    return 0;
+}
+
+static int os_allocator_memfd_open(void **ctx, size_t alignment)
+{
+    allocator_ctx_memfd *p;
+
+    if (NULL == ctx)
+        return -EINVAL;
+
+    *ctx = NULL;
+
+    p = av_mallocz(sizeof(allocator_ctx_memfd));
+    if (NULL == p)
+        return -EINVAL;
+
+    p->alignment = FFMAX(alignment, 1);
+    *ctx = p;
+
+    return 0;
+}
+
+static int os_allocator_memfd_close(void *ctx)
+{
+    if (NULL == ctx)
+        return -EINVAL;
+
+    av_free(ctx);
+    return 0;
+}
+
+os_allocator allocator_memfd = {
+    .name = "memfd allocator",
+    .open = os_allocator_memfd_open,
+    .close = os_allocator_memfd_close,
+    .alloc = os_allocator_memfd_alloc,
+    .free = os_allocator_memfd_free,
+    .import = NULL,
+    .release = NULL,
+    .mmap = NULL,
+};
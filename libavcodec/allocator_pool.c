@@ -0,0 +1,256 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * Requests are rounded up to a size class: whole pages for small buffers,
+ * then four classes per power of two, so at most 25% is wasted (a 1080p
+ * NV12 frame loses less than 0.5%). A freed buffer goes to the idle list
+ * with its fd, handle and mapping, and is handed out again for the next
+ * request of the same class, so the steady state and resolution changes
+ * between already seen sizes do not go to the kernel at all.
+ *
+ * A pool is shared by all its openers (stream, syntax and frame buffers of
+ * every decoder instance) and is torn down when the last one closes it.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+
+#include "allocator_pool.h"
+#include "allocator_drm.h"
+#include "allocator_memfd.h"
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+
+#define POOL_PAGE_SIZE      4096
+/* idle buffers beyond this are given back to the backing allocator */
+#define POOL_MAX_IDLE       (128 * 1024 * 1024)
+
+typedef struct PoolBuffer {
+    struct PoolBuffer  *next;
+    size_t              size;
+    int                 handle;
+    int                 fd;
+    uint8_t            *ptr;
+} PoolBuffer;
+
+typedef struct PoolState {
+    os_allocator       *backing;
+    void               *backing_ctx;
+    pthread_mutex_t     lock;
+    int                 refs;
+    PoolBuffer         *idle;           // most recently freed first
+    size_t              idle_size;
+} PoolState;
+
+size_t ff_allocator_pool_class_size(size_t size)
+{
+    size_t step;
+
+    size = FFALIGN(FFMAX(size, 1), POOL_PAGE_SIZE);
+    if (size <= 4 * POOL_PAGE_SIZE)
+        return size;
+
+    step = ((size_t)1 << av_log2(size)) / 4;
+    return FFALIGN(size, step);
+}
+
+static void pool_release(PoolState *s, PoolBuffer *buf)
+{
+    AVFrame info = { { 0 } };
+
+    info.linesize[0] = buf->size;
+    info.linesize[1] = buf->handle;
+    info.linesize[2] = buf->fd;
+    info.data[0]     = buf->ptr;
+    s->backing->free(s->backing_ctx, &info);
+    av_free(buf);
+}
+
+static int pool_open(PoolState *s, void **ctx, size_t alignment)
+{
+    int ret = 0;
+
+    if (NULL == ctx)
+        return -EINVAL;
+
+    *ctx = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    if (!s->refs)
+        ret = s->backing->open(&s->backing_ctx, alignment);
+    if (!ret) {
+        s->refs++;
+        *ctx = s;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+static int pool_close(void *ctx)
+{
+    PoolState *s = ctx;
+    int ret = 0;
+
+    if (NULL == ctx)
+        return -EINVAL;
+
+    pthread_mutex_lock(&s->lock);
+    if (!--s->refs) {
+        while (s->idle) {
+            PoolBuffer *buf = s->idle;
+            s->idle = buf->next;
+            pool_release(s, buf);
+        }
+        s->idle_size = 0;
+        ret = s->backing->close(s->backing_ctx);
+        s->backing_ctx = NULL;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+static int pool_alloc(void *ctx, AVFrame *info)
+{
+    PoolState *s = ctx;
+    size_t size;
+    PoolBuffer **p, *buf = NULL;
+
+    if (NULL == ctx)
+        return -EINVAL;
+
+    size = ff_allocator_pool_class_size(info->linesize[0]);
+
+    pthread_mutex_lock(&s->lock);
+    for (p = &s->idle; *p; p = &(*p)->next) {
+        if (ff_allocator_pool_class_size((*p)->size) == size) {
+            buf = *p;
+            *p = buf->next;
+            s->idle_size -= buf->size;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    if (!buf) {
+        info->linesize[0] = size;
+        return s->backing->alloc(s->backing_ctx, info);
+    }
+
+    info->linesize[0] = buf->size;
+    info->linesize[1] = buf->handle;
+    info->linesize[2] = buf->fd;
+    info->data[0]     = buf->ptr;
+    av_free(buf);
+
+    return 0;
+}
+
+static int pool_free(void *ctx, AVFrame *info)
+{
+    PoolState *s = ctx;
+    PoolBuffer *buf, **p;
+
+    if (NULL == ctx)
+        return -EINVAL;
+
+    buf = av_malloc(sizeof(*buf));
+    if (!buf)
+        return s->backing->free(s->backing_ctx, info);
+
+    buf->size   = info->linesize[0];
+    buf->handle = info->linesize[1];
+    buf->fd     = info->linesize[2];
+    buf->ptr    = info->data[0];
+
+    pthread_mutex_lock(&s->lock);
+    buf->next = s->idle;
+    s->idle = buf;
+    s->idle_size += buf->size;
+
+    // trim the least recently freed buffers
+    while (s->idle_size > POOL_MAX_IDLE) {
+        for (p = &s->idle; (*p)->next; p = &(*p)->next);
+        buf = *p;
+        *p = NULL;
+        s->idle_size -= buf->size;
+        pool_release(s, buf);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return 0;
+}
+
+static int pool_prewarm(void *ctx, size_t size, int count)
+{
+    PoolState *s = ctx;
+    PoolBuffer *buf;
+    int ret;
+
+    if (NULL == ctx)
+        return -EINVAL;
+
+    size = ff_allocator_pool_class_size(size);
+
+    pthread_mutex_lock(&s->lock);
+    for (buf = s->idle; buf; buf = buf->next)
+        count -= ff_allocator_pool_class_size(buf->size) == size;
+    pthread_mutex_unlock(&s->lock);
+
+    for (; count > 0; count--) {
+        AVFrame info = { { 0 } };
+
+        info.linesize[0] = size;
+        ret = s->backing->alloc(s->backing_ctx, &info);
+        if (ret)
+            return ret;
+        pool_free(s, &info);
+    }
+
+    return 0;
+}
+
+#define POOL_ALLOCATOR(pool, backing_allocator)                         \
+static PoolState pool ## _state = {                                     \
+    .backing = &backing_allocator,                                      \
+    .lock    = PTHREAD_MUTEX_INITIALIZER,                               \
+};                                                                      \
+                                                                        \
+static int pool ## _open(void **ctx, size_t alignment)                  \
+{                                                                       \
+    return pool_open(&pool ## _state, ctx, alignment);                  \
+}                                                                       \
+                                                                        \
+os_allocator allocator_ ## pool = {                                     \
+    .name = #pool " allocator",                                         \
+    .open = pool ## _open,                                              \
+    .close = pool_close,                                                \
+    .alloc = pool_alloc,                                                \
+    .free = pool_free,                                                  \
+    .import = NULL,                                                     \
+    .release = NULL,                                                    \
+    .mmap = NULL,                                                       \
+    .prewarm = pool_prewarm,                                            \
+};
+
+POOL_ALLOCATOR(drm_pool,   allocator_drm)
+POOL_ALLOCATOR(memfd_pool, allocator_memfd)
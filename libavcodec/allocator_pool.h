@@ -0,0 +1,37 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _ALLOCATOR_POOL_H_
+#define _ALLOCATOR_POOL_H_
+
+#include "os_allocator.h"
+
+/*
+ * Size class pools on top of the DRM and memfd allocators. Freed buffers are
+ * kept with their fd and CPU mapping and handed out again for any request of
+ * the same size class. Each pool is shared by everyone who opened it.
+ */
+extern os_allocator allocator_drm_pool;
+extern os_allocator allocator_memfd_pool;
+
+/* size class a request of size bytes is rounded up to */
+size_t ff_allocator_pool_class_size(size_t size);
+
+#endif
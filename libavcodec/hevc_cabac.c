@@ -145,7 +145,7 @@ static const int elem_offset[sizeof(num_bins_in_se)] = {
 /**
  * Indexed by init_type
  */
-static const uint8_t init_values[3][HEVC_CONTEXTS] = {
+const uint8_t ff_hevc_cabac_init_values[3][HEVC_CONTEXTS] = {
     { // sao_merge_flag
       153,
       // sao_type_idx
@@ -486,7 +486,7 @@ static void cabac_init_state(HEVCContext *s)
         init_type ^= 3;
 
     for (i = 0; i < HEVC_CONTEXTS; i++) {
-        int init_value = init_values[init_type][i];
+        int init_value = ff_hevc_cabac_init_values[init_type][i];
         int m = (init_value >> 4) * 5 - 45;
         int n = ((init_value & 15) << 3) - 16;
         int pre = 2 * (((m * av_clip(s->sh.slice_qp, 0, 51)) >> 4) + n) - 127;
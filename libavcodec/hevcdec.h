@@ -603,6 +603,12 @@ void ff_hevc_hls_residual_coding(HEVCContext *s, int x0, int y0,
 
 void ff_hevc_hls_mvd_coding(HEVCContext *s, int x0, int y0, int log2_cb_size);
 
+/**
+ * CABAC context initValue (9.3.2.2), slopeIdx in the high nibble and
+ * offsetIdx in the low one, indexed by initType.
+ */
+extern const uint8_t ff_hevc_cabac_init_values[3][HEVC_CONTEXTS];
+
 extern const uint8_t ff_hevc_qpel_extra_before[4];
 extern const uint8_t ff_hevc_qpel_extra_after[4];
 extern const uint8_t ff_hevc_qpel_extra[4];
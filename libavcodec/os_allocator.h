@@ -35,6 +35,8 @@ typedef struct os_allocator_t {
     OsAllocatorFunc import;
     OsAllocatorFunc release;
     OsAllocatorFunc mmap;
+    /* optional, allocate count buffers of size ahead of time */
+    int (*prewarm)(void *ctx, size_t size, int count);
 } os_allocator;
 
 #endif /*__OS_ALLOCATOR_H__*/
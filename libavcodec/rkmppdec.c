@@ -36,19 +36,43 @@
 #include "libavutil/hwcontext.h"
 #include "libavutil/hwcontext_drm.h"
 #include "libavutil/imgutils.h"
+#include "libavutil/internal.h"
 #include "libavutil/log.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
 
 #define RECEIVE_FRAME_TIMEOUT   100
 #define FRAMEGROUP_MAX_FRAMES   25
+#define FRAMEGROUP_LIMIT        64
 #define INPUT_MAX_PACKETS       4
+// frames MPP holds for itself besides the DPB: current picture and display queue
+#define FRAMEGROUP_EXTRA_FRAMES 4
+#define LATENCY_QUEUE_SIZE      32
 
 typedef struct {
     MppCtx ctx;
     MppApi *mpi;
     MppBufferGroup frame_group;
+    int group_size;
 
     char first_packet;
     char eos_reached;
+    char low_delay;
+
+    // output wait currently programmed into MPP, -1 before the first setup
+    int timeout;
+
+    // send time of the recent packets, by timestamp
+    int64_t sent_pts[LATENCY_QUEUE_SIZE];
+    int64_t sent_time[LATENCY_QUEUE_SIZE];
+    int sent_idx;
+
+    // occupancy and latency statistics
+    int group_peak;
+    int nb_timeouts;
+    int nb_frames;
+    int nb_latencies;
+    int64_t latency_sum;
 
     AVBufferRef *frames_ref;
     AVBufferRef *device_ref;
@@ -57,6 +81,10 @@ typedef struct {
 typedef struct {
     AVClass *av_class;
     AVBufferRef *decoder_ref;
+
+    int buf_group_size;
+    int recv_timeout;
+    int export_stats;
 } RKMPPDecodeContext;
 
 typedef struct {
@@ -88,6 +116,94 @@ static uint32_t rkmpp_get_frameformat(MppFrameFormat mppformat)
     }
 }
 
+/* worst case number of reference frames for the stream */
+static int rkmpp_get_dpb_size(AVCodecContext *avctx, int width, int height)
+{
+    static const struct { int level, max_dpb_mbs; } h264_levels[] = {
+        { 10,    396 }, { 11,    900 }, { 12,   2376 }, { 13,   2376 },
+        { 20,   2376 }, { 21,   4752 }, { 22,   8100 }, { 30,   8100 },
+        { 31,  18000 }, { 32,  20480 }, { 40,  32768 }, { 41,  32768 },
+        { 42,  34816 }, { 50, 110400 }, { 51, 184320 }, { 52, 184320 },
+    };
+    int mbs = ((width + 15) >> 4) * ((height + 15) >> 4);
+    int i;
+
+    switch (avctx->codec_id) {
+    case AV_CODEC_ID_H264:
+        for (i = 0; i < FF_ARRAY_ELEMS(h264_levels); i++)
+            if (h264_levels[i].level == avctx->level && mbs)
+                return av_clip(h264_levels[i].max_dpb_mbs / mbs, 1, 16);
+        return 16;
+    case AV_CODEC_ID_HEVC:          return 16;
+    case AV_CODEC_ID_VP9:           return 8;
+    case AV_CODEC_ID_VP8:           return 3;
+    default:                        return 2;
+    }
+}
+
+static int rkmpp_set_group_size(AVCodecContext *avctx, int width, int height)
+{
+    RKMPPDecodeContext *rk_context = avctx->priv_data;
+    RKMPPDecoder *decoder = (RKMPPDecoder *)rk_context->decoder_ref->data;
+    int size = rk_context->buf_group_size;
+    int ret;
+
+    if (size < 0) {
+        // before the first info change the stream size is unknown
+        if (!width || !height)
+            size = FRAMEGROUP_MAX_FRAMES;
+        else
+            size = rkmpp_get_dpb_size(avctx, width, height) + FRAMEGROUP_EXTRA_FRAMES;
+        size += FFMAX(avctx->extra_hw_frames, 0);
+        size = FFMIN(size, FRAMEGROUP_LIMIT);
+    }
+
+    if (size == decoder->group_size)
+        return 0;
+
+    ret = mpp_buffer_group_limit_config(decoder->frame_group, 0, size);
+    if (ret) {
+        av_log(avctx, AV_LOG_ERROR, "Failed to set buffer group limit (code = %d)\n", ret);
+        return AVERROR_UNKNOWN;
+    }
+
+    av_log(avctx, AV_LOG_VERBOSE, "Buffer group limited to %d frames.\n", size);
+    decoder->group_size = size;
+
+    return 0;
+}
+
+static int rkmpp_set_output_timeout(AVCodecContext *avctx, int timeout)
+{
+    RKMPPDecodeContext *rk_context = avctx->priv_data;
+    RKMPPDecoder *decoder = (RKMPPDecoder *)rk_context->decoder_ref->data;
+    RK_S32 paramS32;
+    RK_S64 paramS64;
+    int ret;
+
+    if (timeout == decoder->timeout)
+        return 0;
+
+    paramS32 = timeout ? MPP_POLL_BLOCK : MPP_POLL_NON_BLOCK;
+    ret = decoder->mpi->control(decoder->ctx, MPP_SET_OUTPUT_BLOCK, &paramS32);
+    if (ret != MPP_OK) {
+        av_log(avctx, AV_LOG_ERROR, "Failed to set blocking mode on MPI (code = %d).\n", ret);
+        return AVERROR_UNKNOWN;
+    }
+
+    if (timeout > 0) {
+        paramS64 = timeout;
+        ret = decoder->mpi->control(decoder->ctx, MPP_SET_OUTPUT_BLOCK_TIMEOUT, &paramS64);
+        if (ret != MPP_OK) {
+            av_log(avctx, AV_LOG_ERROR, "Failed to set block timeout on MPI (code = %d).\n", ret);
+            return AVERROR_UNKNOWN;
+        }
+    }
+
+    decoder->timeout = timeout;
+    return 0;
+}
+
 static int rkmpp_write_data(AVCodecContext *avctx, uint8_t *buffer, int size, int64_t pts)
 {
     RKMPPDecodeContext *rk_context = avctx->priv_data;
@@ -134,6 +250,12 @@ static void rkmpp_release_decoder(void *opaque, uint8_t *data)
 {
     RKMPPDecoder *decoder = (RKMPPDecoder *)data;
 
+    if (decoder->nb_frames)
+        av_log(NULL, AV_LOG_VERBOSE, "RKMPP decoder: %d frames, buffer group peak %d/%d, %d receive timeouts, "
+               "average latency %"PRId64" us\n",
+               decoder->nb_frames, decoder->group_peak, decoder->group_size, decoder->nb_timeouts,
+               decoder->nb_latencies ? decoder->latency_sum / decoder->nb_latencies : 0);
+
     if (decoder->mpi) {
         decoder->mpi->reset(decoder->ctx);
         mpp_destroy(decoder->ctx);
@@ -157,8 +279,7 @@ static int rkmpp_init_decoder(AVCodecContext *avctx)
     RKMPPDecoder *decoder = NULL;
     MppCodingType codectype = MPP_VIDEO_CodingUnused;
     int ret;
-    RK_S64 paramS64;
-    RK_S32 paramS32;
+    RK_U32 paramU32;
 
     avctx->pix_fmt = AV_PIX_FMT_DRM_PRIME;
 
@@ -201,6 +322,19 @@ static int rkmpp_init_decoder(AVCodecContext *avctx)
         goto fail;
     }
 
+    // in low delay mode, the parser must not wait for the next packet to
+    // find the end of a picture, this has to be set before mpp_init
+    decoder->low_delay = !!(avctx->flags & AV_CODEC_FLAG_LOW_DELAY);
+    if (decoder->low_delay) {
+        paramU32 = 1;
+        ret = decoder->mpi->control(decoder->ctx, MPP_DEC_SET_PARSER_FAST_MODE, &paramU32);
+        if (ret != MPP_OK) {
+            av_log(avctx, AV_LOG_ERROR, "Failed to set fast mode on MPI (code = %d).\n", ret);
+            ret = AVERROR_UNKNOWN;
+            goto fail;
+        }
+    }
+
     // initialize mpp
     ret = mpp_init(decoder->ctx, MPP_CTX_DEC, codectype);
     if (ret != MPP_OK) {
@@ -209,22 +343,22 @@ static int rkmpp_init_decoder(AVCodecContext *avctx)
         goto fail;
     }
 
-    // make decode calls blocking with a timeout
-    paramS32 = MPP_POLL_BLOCK;
-    ret = decoder->mpi->control(decoder->ctx, MPP_SET_OUTPUT_BLOCK, &paramS32);
-    if (ret != MPP_OK) {
-        av_log(avctx, AV_LOG_ERROR, "Failed to set blocking mode on MPI (code = %d).\n", ret);
-        ret = AVERROR_UNKNOWN;
-        goto fail;
+    // output frames as soon as they are decoded instead of in display order
+    if (decoder->low_delay) {
+        paramU32 = 1;
+        ret = decoder->mpi->control(decoder->ctx, MPP_DEC_SET_IMMEDIATE_OUT, &paramU32);
+        if (ret != MPP_OK) {
+            av_log(avctx, AV_LOG_ERROR, "Failed to set immediate output on MPI (code = %d).\n", ret);
+            ret = AVERROR_UNKNOWN;
+            goto fail;
+        }
     }
 
-    paramS64 = RECEIVE_FRAME_TIMEOUT;
-    ret = decoder->mpi->control(decoder->ctx, MPP_SET_OUTPUT_BLOCK_TIMEOUT, &paramS64);
-    if (ret != MPP_OK) {
-        av_log(avctx, AV_LOG_ERROR, "Failed to set block timeout on MPI (code = %d).\n", ret);
-        ret = AVERROR_UNKNOWN;
+    // make decode calls blocking with a timeout, or not blocking at all
+    decoder->timeout = -1;
+    ret = rkmpp_set_output_timeout(avctx, rk_context->recv_timeout);
+    if (ret < 0)
         goto fail;
-    }
 
     ret = mpp_buffer_group_get_internal(&decoder->frame_group, MPP_BUFFER_TYPE_ION);
     if (ret) {
@@ -240,12 +374,9 @@ static int rkmpp_init_decoder(AVCodecContext *avctx)
         goto fail;
     }
 
-    ret = mpp_buffer_group_limit_config(decoder->frame_group, 0, FRAMEGROUP_MAX_FRAMES);
-    if (ret) {
-        av_log(avctx, AV_LOG_ERROR, "Failed to set buffer group limit (code = %d)\n", ret);
-        ret = AVERROR_UNKNOWN;
+    ret = rkmpp_set_group_size(avctx, avctx->width, avctx->height);
+    if (ret < 0)
         goto fail;
-    }
 
     decoder->first_packet = 1;
 
@@ -272,6 +403,9 @@ static int rkmpp_send_packet(AVCodecContext *avctx, const AVPacket *avpkt)
 {
     RKMPPDecodeContext *rk_context = avctx->priv_data;
     RKMPPDecoder *decoder = (RKMPPDecoder *)rk_context->decoder_ref->data;
+    int64_t pts = avpkt->pts != AV_NOPTS_VALUE ? avpkt->pts : avpkt->dts;
+    uint8_t *data = avpkt->data;
+    int size = avpkt->size;
     int ret;
 
     // handle EOF
@@ -281,29 +415,40 @@ static int rkmpp_send_packet(AVCodecContext *avctx, const AVPacket *avpkt)
         ret = rkmpp_write_data(avctx, NULL, 0, 0);
         if (ret)
             av_log(avctx, AV_LOG_ERROR, "Failed to send EOS to decoder (code = %d)\n", ret);
+
+        // the remaining frames have to be waited for, or they would be lost
+        if (!ret && !rk_context->recv_timeout)
+            ret = rkmpp_set_output_timeout(avctx, RECEIVE_FRAME_TIMEOUT);
         return ret;
     }
 
-    // on first packet, send extradata
-    if (decoder->first_packet) {
-        if (avctx->extradata_size) {
-            ret = rkmpp_write_data(avctx, avctx->extradata,
-                                            avctx->extradata_size,
-                                            avpkt->pts != AV_NOPTS_VALUE ? avpkt->pts : avpkt->dts);
-            if (ret) {
-                av_log(avctx, AV_LOG_ERROR, "Failed to write extradata to decoder (code = %d)\n", ret);
-                return ret;
-            }
-        }
-        decoder->first_packet = 0;
+    // on first packet, send extradata in front of the packet data, so the
+    // first picture is complete in a single MPP packet
+    if (decoder->first_packet && avctx->extradata_size) {
+        size = avctx->extradata_size + avpkt->size;
+        data = av_malloc(size);
+        if (!data)
+            return AVERROR(ENOMEM);
+        memcpy(data, avctx->extradata, avctx->extradata_size);
+        memcpy(data + avctx->extradata_size, avpkt->data, avpkt->size);
     }
 
     // now send packet
-    ret = rkmpp_write_data(avctx, avpkt->data, avpkt->size, avpkt->pts != AV_NOPTS_VALUE ? avpkt->pts : avpkt->dts);
-    if (ret && ret!=AVERROR(EAGAIN))
-        av_log(avctx, AV_LOG_ERROR, "Failed to write data to decoder (code = %d)\n", ret);
+    ret = rkmpp_write_data(avctx, data, size, pts);
+    if (data != avpkt->data)
+        av_free(data);
+    if (ret) {
+        if (ret != AVERROR(EAGAIN))
+            av_log(avctx, AV_LOG_ERROR, "Failed to write data to decoder (code = %d)\n", ret);
+        return ret;
+    }
+    decoder->first_packet = 0;
 
-    return ret;
+    decoder->sent_pts[decoder->sent_idx]  = pts;
+    decoder->sent_time[decoder->sent_idx] = av_gettime_relative();
+    decoder->sent_idx = (decoder->sent_idx + 1) % LATENCY_QUEUE_SIZE;
+
+    return 0;
 }
 
 static void rkmpp_release_frame(void *opaque, uint8_t *data)
@@ -319,6 +464,36 @@ static void rkmpp_release_frame(void *opaque, uint8_t *data)
     av_free(desc);
 }
 
+static void rkmpp_update_stats(AVCodecContext *avctx, AVFrame *frame)
+{
+    RKMPPDecodeContext *rk_context = avctx->priv_data;
+    RKMPPDecoder *decoder = (RKMPPDecoder *)rk_context->decoder_ref->data;
+    int used = decoder->group_size - mpp_buffer_group_unused(decoder->frame_group);
+    int64_t latency = -1;
+    int i;
+
+    decoder->nb_frames++;
+    decoder->group_peak = FFMAX(decoder->group_peak, used);
+
+    // time from sending the packet to the frame being available
+    for (i = 1; i <= LATENCY_QUEUE_SIZE; i++) {
+        int idx = (decoder->sent_idx + LATENCY_QUEUE_SIZE - i) % LATENCY_QUEUE_SIZE;
+        if (decoder->sent_time[idx] && decoder->sent_pts[idx] == frame->pts) {
+            latency = av_gettime_relative() - decoder->sent_time[idx];
+            decoder->latency_sum += latency;
+            decoder->nb_latencies++;
+            break;
+        }
+    }
+
+    if (rk_context->export_stats) {
+        av_dict_set_int(&frame->metadata, "rkmpp.buffers_used", used, 0);
+        av_dict_set_int(&frame->metadata, "rkmpp.buffers_total", decoder->group_size, 0);
+    }
+    if ((rk_context->export_stats || decoder->low_delay) && latency >= 0)
+        av_dict_set_int(&frame->metadata, "rkmpp.decode_latency", latency, 0);
+}
+
 static int rkmpp_retrieve_frame(AVCodecContext *avctx, AVFrame *frame)
 {
     RKMPPDecodeContext *rk_context = avctx->priv_data;
@@ -352,6 +527,11 @@ static int rkmpp_retrieve_frame(AVCodecContext *avctx, AVFrame *frame)
             avctx->width = mpp_frame_get_width(mppframe);
             avctx->height = mpp_frame_get_height(mppframe);
 
+            // resize the group before MPP allocates the new frames
+            ret = rkmpp_set_group_size(avctx, avctx->width, avctx->height);
+            if (ret < 0)
+                goto fail;
+
             decoder->mpi->control(decoder->ctx, MPP_DEC_SET_INFO_CHANGE_READY, NULL);
 
             av_buffer_unref(&decoder->frames_ref);
@@ -466,6 +646,8 @@ static int rkmpp_retrieve_frame(AVCodecContext *avctx, AVFrame *frame)
                 goto fail;
             }
 
+            rkmpp_update_stats(avctx, frame);
+
             return 0;
         } else {
             av_log(avctx, AV_LOG_ERROR, "Failed to retrieve the frame buffer, frame is dropped (code = %d)\n", ret);
@@ -475,6 +657,7 @@ static int rkmpp_retrieve_frame(AVCodecContext *avctx, AVFrame *frame)
         return AVERROR_EOF;
     } else if (ret == MPP_ERR_TIMEOUT) {
         av_log(avctx, AV_LOG_DEBUG, "Timeout when trying to get a frame from MPP\n");
+        decoder->nb_timeouts++;
     }
 
     return AVERROR(EAGAIN);
@@ -501,7 +684,7 @@ static int rkmpp_receive_frame(AVCodecContext *avctx, AVFrame *frame)
     RKMPPDecoder *decoder = (RKMPPDecoder *)rk_context->decoder_ref->data;
     int ret = MPP_NOK;
     AVPacket pkt = {0};
-    RK_S32 usedslots, freeslots;
+    RK_S32 usedslots, freeslots = 0;
 
     if (!decoder->eos_reached) {
         // we get the available slots in decoder
@@ -527,9 +710,16 @@ static int rkmpp_receive_frame(AVCodecContext *avctx, AVFrame *frame)
             }
         }
 
-        // make sure we keep decoder full
-        if (freeslots > 1)
+        // make sure we keep decoder full, unless frames are wanted asap
+        if (freeslots > 1 && !decoder->low_delay)
             return AVERROR(EAGAIN);
+
+        // in low delay mode, only wait for the frame of a packet just sent
+        if (decoder->low_delay) {
+            ret = rkmpp_set_output_timeout(avctx, freeslots > 0 ? rk_context->recv_timeout : 0);
+            if (ret < 0)
+                return ret;
+        }
     }
 
     return rkmpp_retrieve_frame(avctx, frame);
@@ -555,9 +745,24 @@ static const AVCodecHWConfigInternal *rkmpp_hw_configs[] = {
     NULL
 };
 
+#define OFFSET(x) offsetof(RKMPPDecodeContext, x)
+#define VD AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM
+
+static const AVOption options[] = {
+    { "buf_group_size", "Number of frames in the output buffer group, -1 to size it from the stream DPB and extra_hw_frames",
+      OFFSET(buf_group_size), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, FRAMEGROUP_LIMIT, VD },
+    { "recv_timeout", "Time to wait for a decoded frame in ms, 0 to never block",
+      OFFSET(recv_timeout), AV_OPT_TYPE_INT, { .i64 = RECEIVE_FRAME_TIMEOUT }, 0, INT_MAX, VD },
+    { "export_stats", "Export the buffer group occupancy as frame metadata",
+      OFFSET(export_stats), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, VD },
+    { NULL }
+};
+
 #define RKMPP_DEC_CLASS(NAME) \
     static const AVClass rkmpp_##NAME##_dec_class = { \
         .class_name = "rkmpp_" #NAME "_dec", \
+        .item_name  = av_default_item_name, \
+        .option     = options, \
         .version    = LIBAVUTIL_VERSION_INT, \
     };
 
@@ -0,0 +1,308 @@
+/*
+ * RockChip MPP Video Encoder
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "avcodec.h"
+#include "hwaccel.h"
+#include "internal.h"
+#include "rkmppenc.h"
+#include "libavutil/common.h"
+#include "libavutil/frame.h"
+#include "libavutil/hwcontext.h"
+#include "libavutil/internal.h"
+#include "libavutil/log.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+
+#define RECEIVE_PACKET_TIMEOUT  100
+#define MAX_FRAMES_IN_FLIGHT    16
+#define MAX_HEADER_SIZE         1024
+
+typedef struct {
+    AVClass *av_class;
+
+    const RKMPPEncOps *ops;
+    void *handle;
+
+    // input frames kept alive until their packet is out, in input order
+    AVFrame *frames[MAX_FRAMES_IN_FLIGHT];
+    int frame_head;
+    int nb_frames;
+
+    char eos_sent;
+
+    int rc_mode;
+    int qp;
+    int qp_min;
+    int qp_max;
+    int async_depth;
+} RKMPPEncodeContext;
+
+const RKMPPEncOps *ff_rkmpp_enc_ops = &ff_rkmpp_enc_mpi_ops;
+
+static enum RKMPPEncRcMode rkmpp_get_rc_mode(AVCodecContext *avctx)
+{
+    RKMPPEncodeContext *rk_context = avctx->priv_data;
+
+    if (rk_context->rc_mode >= 0)
+        return rk_context->rc_mode;
+
+    if (!avctx->bit_rate || (avctx->flags & AV_CODEC_FLAG_QSCALE))
+        return RKMPP_ENC_RC_CQP;
+    if (avctx->rc_max_rate == avctx->bit_rate)
+        return RKMPP_ENC_RC_CBR;
+    return RKMPP_ENC_RC_VBR;
+}
+
+static void rkmpp_release_frames(AVCodecContext *avctx, int64_t pts)
+{
+    RKMPPEncodeContext *rk_context = avctx->priv_data;
+
+    // MPP does not reorder, everything up to this packet has been consumed
+    do {
+        AVFrame **frame = &rk_context->frames[rk_context->frame_head];
+        int64_t frame_pts = (*frame)->pts;
+
+        av_frame_free(frame);
+        rk_context->frame_head = (rk_context->frame_head + 1) % MAX_FRAMES_IN_FLIGHT;
+        rk_context->nb_frames--;
+
+        if (pts == AV_NOPTS_VALUE || frame_pts == AV_NOPTS_VALUE || frame_pts >= pts)
+            break;
+    } while (rk_context->nb_frames);
+}
+
+static int rkmpp_close_encoder(AVCodecContext *avctx)
+{
+    RKMPPEncodeContext *rk_context = avctx->priv_data;
+
+    if (rk_context->handle)
+        rk_context->ops->close(rk_context->handle);
+    rk_context->handle = NULL;
+
+    // only free the frames once MPP is gone, it may still be reading them
+    while (rk_context->nb_frames)
+        rkmpp_release_frames(avctx, AV_NOPTS_VALUE);
+
+    return 0;
+}
+
+static int rkmpp_init_encoder(AVCodecContext *avctx)
+{
+    RKMPPEncodeContext *rk_context = avctx->priv_data;
+    RKMPPEncParams params = { 0 };
+    int ret;
+
+    rk_context->ops = ff_rkmpp_enc_ops;
+
+    params.codec_id     = avctx->codec_id;
+    params.width        = avctx->width;
+    params.height       = avctx->height;
+    params.sw_format    = avctx->pix_fmt;
+    params.hor_stride   = FFALIGN(avctx->width, 16);
+    params.ver_stride   = FFALIGN(avctx->height, 16);
+
+    if (avctx->pix_fmt == AV_PIX_FMT_DRM_PRIME) {
+        params.sw_format = AV_PIX_FMT_NV12;
+        if (avctx->hw_frames_ctx)
+            params.sw_format = ((AVHWFramesContext*)avctx->hw_frames_ctx->data)->sw_format;
+    }
+    if (params.sw_format != AV_PIX_FMT_NV12 && params.sw_format != AV_PIX_FMT_YUV420P) {
+        av_log(avctx, AV_LOG_ERROR, "Unsupported input format %s.\n",
+               av_get_pix_fmt_name(params.sw_format));
+        return AVERROR(ENOSYS);
+    }
+
+    params.rc_mode      = rkmpp_get_rc_mode(avctx);
+    params.bitrate      = avctx->bit_rate;
+    params.bitrate_max  = avctx->rc_max_rate ? avctx->rc_max_rate : avctx->bit_rate * 17 / 16;
+    params.bitrate_min  = avctx->rc_min_rate ? avctx->rc_min_rate :
+                          params.rc_mode == RKMPP_ENC_RC_CBR ? avctx->bit_rate * 15 / 16 :
+                                                               avctx->bit_rate / 16;
+
+    params.qp           = rk_context->qp;
+    if (params.qp < 0 && (avctx->flags & AV_CODEC_FLAG_QSCALE))
+        params.qp = av_clip(avctx->global_quality / FF_QP2LAMBDA, 0, 51);
+    if (params.qp < 0)
+        params.qp = 26;
+    params.qp_min       = rk_context->qp_min;
+    params.qp_max       = rk_context->qp_max;
+
+    params.gop          = avctx->gop_size;
+    params.framerate    = avctx->framerate.num ? avctx->framerate : av_inv_q(avctx->time_base);
+    params.profile      = avctx->profile;
+    params.level        = avctx->level;
+
+    av_log(avctx, AV_LOG_DEBUG, "Initializing RKMPP encoder: %dx%d, rc %d, %"PRId64" bps, qp %d, gop %d.\n",
+           params.width, params.height, params.rc_mode, params.bitrate, params.qp, params.gop);
+
+    ret = rk_context->ops->open(&rk_context->handle, avctx, &params);
+    if (ret < 0) {
+        av_log(avctx, AV_LOG_ERROR, "Failed to initialize RKMPP encoder.\n");
+        rk_context->handle = NULL;
+        return ret;
+    }
+
+    if (avctx->flags & AV_CODEC_FLAG_GLOBAL_HEADER) {
+        avctx->extradata = av_mallocz(MAX_HEADER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!avctx->extradata)
+            return AVERROR(ENOMEM);
+
+        ret = rk_context->ops->get_header(rk_context->handle, avctx->extradata, MAX_HEADER_SIZE);
+        if (ret < 0) {
+            av_log(avctx, AV_LOG_ERROR, "Failed to retrieve the stream headers.\n");
+            return ret;
+        }
+        avctx->extradata_size = ret;
+    }
+
+    av_log(avctx, AV_LOG_DEBUG, "RKMPP encoder initialized successfully.\n");
+
+    return 0;
+}
+
+static int rkmpp_send_frame(AVCodecContext *avctx, const AVFrame *frame)
+{
+    RKMPPEncodeContext *rk_context = avctx->priv_data;
+    AVFrame *ref;
+    int ret;
+
+    // handle EOF
+    if (!frame) {
+        if (rk_context->eos_sent)
+            return 0;
+
+        av_log(avctx, AV_LOG_DEBUG, "End of stream.\n");
+        ret = rk_context->ops->put_frame(rk_context->handle, NULL);
+        if (ret < 0) {
+            av_log(avctx, AV_LOG_ERROR, "Failed to send EOS to encoder (code = %d)\n", ret);
+            return ret;
+        }
+        rk_context->eos_sent = 1;
+        return 0;
+    }
+
+    if (rk_context->nb_frames >= rk_context->async_depth)
+        return AVERROR(EAGAIN);
+
+    // the encoder reads DRM PRIME frames in place, hold on to them
+    ref = av_frame_clone(frame);
+    if (!ref)
+        return AVERROR(ENOMEM);
+
+    ret = rk_context->ops->put_frame(rk_context->handle, ref);
+    if (ret < 0) {
+        av_frame_free(&ref);
+        if (ret != AVERROR(EAGAIN))
+            av_log(avctx, AV_LOG_ERROR, "Failed to send frame to encoder (code = %d)\n", ret);
+        return ret;
+    }
+
+    rk_context->frames[(rk_context->frame_head + rk_context->nb_frames) % MAX_FRAMES_IN_FLIGHT] = ref;
+    rk_context->nb_frames++;
+
+    return 0;
+}
+
+static int rkmpp_receive_packet(AVCodecContext *avctx, AVPacket *pkt)
+{
+    RKMPPEncodeContext *rk_context = avctx->priv_data;
+    int ret, wait;
+
+    // only wait when no more input can be taken
+    wait = rk_context->eos_sent || rk_context->nb_frames >= rk_context->async_depth;
+
+    do {
+        ret = rk_context->ops->get_packet(rk_context->handle, pkt, wait ? RECEIVE_PACKET_TIMEOUT : 0);
+        if (ret == AVERROR(EAGAIN) && wait)
+            av_log(avctx, AV_LOG_DEBUG, "Timeout when trying to get a packet from MPP\n");
+    } while (ret == AVERROR(EAGAIN) && wait);
+
+    if (ret < 0) {
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            av_log(avctx, AV_LOG_ERROR, "Failed to get a packet from MPP (code = %d)\n", ret);
+        return ret;
+    }
+
+    if (rk_context->nb_frames)
+        rkmpp_release_frames(avctx, pkt->pts);
+
+    return 0;
+}
+
+#define OFFSET(x) offsetof(RKMPPEncodeContext, x)
+#define VE AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_ENCODING_PARAM
+
+static const AVOption options[] = {
+    { "rc_mode", "Rate control mode", OFFSET(rc_mode), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, RKMPP_ENC_RC_CQP, VE, "rc_mode" },
+        { "auto", "CQP without a bitrate, CBR if maxrate equals it, VBR otherwise", 0, AV_OPT_TYPE_CONST, { .i64 = -1 }, 0, 0, VE, "rc_mode" },
+        { "cbr", "Constant bitrate", 0, AV_OPT_TYPE_CONST, { .i64 = RKMPP_ENC_RC_CBR }, 0, 0, VE, "rc_mode" },
+        { "vbr", "Variable bitrate", 0, AV_OPT_TYPE_CONST, { .i64 = RKMPP_ENC_RC_VBR }, 0, 0, VE, "rc_mode" },
+        { "cqp", "Constant quantizer", 0, AV_OPT_TYPE_CONST, { .i64 = RKMPP_ENC_RC_CQP }, 0, 0, VE, "rc_mode" },
+    { "qp", "Quantizer in CQP mode, initial quantizer otherwise", OFFSET(qp), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 51, VE },
+    { "qp_min", "Minimum quantizer", OFFSET(qp_min), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 51, VE },
+    { "qp_max", "Maximum quantizer", OFFSET(qp_max), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 51, VE },
+    { "async_depth", "Number of frames queued in the encoder", OFFSET(async_depth), AV_OPT_TYPE_INT, { .i64 = 4 }, 1, MAX_FRAMES_IN_FLIGHT, VE },
+    { NULL }
+};
+
+static const AVCodecDefault rkmpp_enc_defaults[] = {
+    { "b", "0" },
+    { NULL },
+};
+
+static const AVCodecHWConfigInternal *rkmpp_enc_hw_configs[] = {
+    HW_CONFIG_INTERNAL(DRM_PRIME),
+    NULL
+};
+
+#define RKMPP_ENC_CLASS(NAME) \
+    static const AVClass rkmpp_##NAME##_enc_class = { \
+        .class_name = "rkmpp_" #NAME "_enc", \
+        .item_name  = av_default_item_name, \
+        .option     = options, \
+        .version    = LIBAVUTIL_VERSION_INT, \
+    };
+
+#define RKMPP_ENC(NAME, ID) \
+    RKMPP_ENC_CLASS(NAME) \
+    AVCodec ff_##NAME##_rkmpp_encoder = { \
+        .name           = #NAME "_rkmpp", \
+        .long_name      = NULL_IF_CONFIG_SMALL(#NAME " (rkmpp)"), \
+        .type           = AVMEDIA_TYPE_VIDEO, \
+        .id             = ID, \
+        .priv_data_size = sizeof(RKMPPEncodeContext), \
+        .init           = rkmpp_init_encoder, \
+        .close          = rkmpp_close_encoder, \
+        .send_frame     = rkmpp_send_frame, \
+        .receive_packet = rkmpp_receive_packet, \
+        .priv_class     = &rkmpp_##NAME##_enc_class, \
+        .defaults       = rkmpp_enc_defaults, \
+        .capabilities   = AV_CODEC_CAP_DELAY | AV_CODEC_CAP_HARDWARE, \
+        .caps_internal  = FF_CODEC_CAP_INIT_CLEANUP, \
+        .pix_fmts       = (const enum AVPixelFormat[]) { AV_PIX_FMT_DRM_PRIME, \
+                                                         AV_PIX_FMT_NV12, \
+                                                         AV_PIX_FMT_YUV420P, \
+                                                         AV_PIX_FMT_NONE }, \
+        .hw_configs     = rkmpp_enc_hw_configs, \
+        .wrapper_name   = "rkmpp", \
+    };
+
+RKMPP_ENC(h264, AV_CODEC_ID_H264)
+RKMPP_ENC(hevc, AV_CODEC_ID_HEVC)
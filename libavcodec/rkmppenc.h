@@ -0,0 +1,99 @@
+/*
+ * RockChip MPP Video Encoder
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_RKMPPENC_H
+#define AVCODEC_RKMPPENC_H
+
+#include <stdint.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/pixfmt.h"
+#include "libavutil/rational.h"
+#include "avcodec.h"
+
+enum RKMPPEncRcMode {
+    RKMPP_ENC_RC_CBR,
+    RKMPP_ENC_RC_VBR,
+    RKMPP_ENC_RC_CQP,
+};
+
+typedef struct RKMPPEncParams {
+    enum AVCodecID      codec_id;
+    int                 width;
+    int                 height;
+    /* layout of software frames, DRM PRIME frames carry their own */
+    enum AVPixelFormat  sw_format;
+    int                 hor_stride;
+    int                 ver_stride;
+
+    enum RKMPPEncRcMode rc_mode;
+    int64_t             bitrate;
+    int64_t             bitrate_min;
+    int64_t             bitrate_max;
+    int                 qp;
+    int                 qp_min;
+    int                 qp_max;
+    int                 gop;
+    AVRational          framerate;
+    int                 profile;
+    int                 level;
+} RKMPPEncParams;
+
+/**
+ * All the calls into MPP made by the encoder. Keeping them behind this table
+ * lets the wrapper run against a stub implementation.
+ */
+typedef struct RKMPPEncOps {
+    /**
+     * Create and configure an encoder instance.
+     */
+    int  (*open)(void **handle, void *logctx, const RKMPPEncParams *params);
+    void (*close)(void *handle);
+
+    /**
+     * Retrieve the stream headers (SPS/PPS/VPS) to be used as extradata.
+     * Returns the header size, or a negative error code.
+     */
+    int  (*get_header)(void *handle, uint8_t *buf, int size);
+
+    /**
+     * Queue a frame, NULL signals the end of the stream. DRM PRIME frames
+     * are imported as they are, the caller keeps them alive until the
+     * matching packet has been returned.
+     * Returns AVERROR(EAGAIN) when the input queue is full.
+     */
+    int  (*put_frame)(void *handle, const AVFrame *frame);
+
+    /**
+     * Fetch the next packet, waiting for up to timeout ms (-1 for no
+     * limit). Returns AVERROR(EAGAIN) when none is ready yet and
+     * AVERROR_EOF after the last one.
+     */
+    int  (*get_packet)(void *handle, AVPacket *pkt, int timeout);
+} RKMPPEncOps;
+
+extern const RKMPPEncOps ff_rkmpp_enc_mpi_ops;
+
+/**
+ * Table used by newly opened encoders, can be pointed to a stub by tests.
+ */
+extern const RKMPPEncOps *ff_rkmpp_enc_ops;
+
+#endif /* AVCODEC_RKMPPENC_H */
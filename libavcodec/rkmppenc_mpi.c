@@ -0,0 +1,482 @@
+/*
+ * RockChip MPP Video Encoder, MPI backend
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <drm_fourcc.h>
+#include <rockchip/mpp_buffer.h>
+#include <rockchip/mpp_meta.h>
+#include <rockchip/rk_mpi.h>
+
+#include "avcodec.h"
+#include "rkmppenc.h"
+#include "libavutil/common.h"
+#include "libavutil/frame.h"
+#include "libavutil/hwcontext_drm.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+
+typedef struct {
+    void *logctx;
+
+    MppCtx ctx;
+    MppApi *mpi;
+    MppBufferGroup frame_group;
+
+    MppEncPrepCfg prep_cfg;
+    RKMPPEncParams params;
+
+    // output timeout currently programmed, MPP only takes it as a control
+    int timeout;
+    char eos_reached;
+} RKMPPEncoder;
+
+static MppCodingType rkmpp_enc_get_codingtype(enum AVCodecID codec_id)
+{
+    switch (codec_id) {
+    case AV_CODEC_ID_H264:          return MPP_VIDEO_CodingAVC;
+    case AV_CODEC_ID_HEVC:          return MPP_VIDEO_CodingHEVC;
+    default:                        return MPP_VIDEO_CodingUnused;
+    }
+}
+
+static MppFrameFormat rkmpp_enc_get_frameformat(enum AVPixelFormat format)
+{
+    switch (format) {
+    case AV_PIX_FMT_NV12:           return MPP_FMT_YUV420SP;
+    case AV_PIX_FMT_YUV420P:        return MPP_FMT_YUV420P;
+    default:                        return MPP_FMT_BUTT;
+    }
+}
+
+static MppFrameFormat rkmpp_enc_get_drmformat(uint32_t format)
+{
+    switch (format) {
+    case DRM_FORMAT_NV12:           return MPP_FMT_YUV420SP;
+    case DRM_FORMAT_YUV420:         return MPP_FMT_YUV420P;
+    default:                        return MPP_FMT_BUTT;
+    }
+}
+
+static int rkmpp_enc_control(RKMPPEncoder *encoder, MpiCmd cmd, MppParam param, const char *what)
+{
+    int ret = encoder->mpi->control(encoder->ctx, cmd, param);
+    if (ret != MPP_OK) {
+        av_log(encoder->logctx, AV_LOG_ERROR, "Failed to set %s (code = %d).\n", what, ret);
+        return AVERROR_UNKNOWN;
+    }
+    return 0;
+}
+
+static int rkmpp_enc_set_timeout(RKMPPEncoder *encoder, int timeout)
+{
+    RK_S32 paramS32;
+    RK_S64 paramS64;
+    int ret;
+
+    if (timeout == encoder->timeout)
+        return 0;
+
+    paramS32 = timeout ? MPP_POLL_BLOCK : MPP_POLL_NON_BLOCK;
+    ret = rkmpp_enc_control(encoder, MPP_SET_OUTPUT_BLOCK, &paramS32, "blocking mode");
+    if (ret < 0)
+        return ret;
+
+    if (timeout > 0) {
+        paramS64 = timeout;
+        ret = rkmpp_enc_control(encoder, MPP_SET_OUTPUT_BLOCK_TIMEOUT, &paramS64, "block timeout");
+        if (ret < 0)
+            return ret;
+    }
+
+    encoder->timeout = timeout;
+    return 0;
+}
+
+static int rkmpp_enc_set_prep(RKMPPEncoder *encoder, MppFrameFormat format,
+                              int hor_stride, int ver_stride)
+{
+    MppEncPrepCfg *prep_cfg = &encoder->prep_cfg;
+
+    if (prep_cfg->format == format && prep_cfg->hor_stride == hor_stride &&
+        prep_cfg->ver_stride == ver_stride)
+        return 0;
+
+    prep_cfg->change     = MPP_ENC_PREP_CFG_CHANGE_INPUT | MPP_ENC_PREP_CFG_CHANGE_FORMAT;
+    prep_cfg->width      = encoder->params.width;
+    prep_cfg->height     = encoder->params.height;
+    prep_cfg->hor_stride = hor_stride;
+    prep_cfg->ver_stride = ver_stride;
+    prep_cfg->format     = format;
+
+    return rkmpp_enc_control(encoder, MPP_ENC_SET_PREP_CFG, prep_cfg, "input format");
+}
+
+static int rkmpp_enc_set_rc(RKMPPEncoder *encoder)
+{
+    const RKMPPEncParams *params = &encoder->params;
+    MppEncRcCfg rc_cfg = { 0 };
+    MppEncCodecCfg codec_cfg = { 0 };
+    int ret;
+
+    rc_cfg.change = MPP_ENC_RC_CFG_CHANGE_ALL;
+    switch (params->rc_mode) {
+    case RKMPP_ENC_RC_CBR:
+        rc_cfg.rc_mode = MPP_ENC_RC_MODE_CBR;
+        rc_cfg.quality = MPP_ENC_RC_QUALITY_MEDIUM;
+        break;
+    case RKMPP_ENC_RC_VBR:
+        rc_cfg.rc_mode = MPP_ENC_RC_MODE_VBR;
+        rc_cfg.quality = MPP_ENC_RC_QUALITY_MEDIUM;
+        break;
+    case RKMPP_ENC_RC_CQP:
+        rc_cfg.rc_mode = MPP_ENC_RC_MODE_VBR;
+        rc_cfg.quality = MPP_ENC_RC_QUALITY_CQP;
+        break;
+    }
+
+    if (params->rc_mode == RKMPP_ENC_RC_CQP) {
+        rc_cfg.bps_target = -1;
+        rc_cfg.bps_max    = -1;
+        rc_cfg.bps_min    = -1;
+    } else {
+        rc_cfg.bps_target = params->bitrate;
+        rc_cfg.bps_max    = params->bitrate_max;
+        rc_cfg.bps_min    = params->bitrate_min;
+    }
+
+    rc_cfg.fps_in_flex    = 0;
+    rc_cfg.fps_in_num     = params->framerate.num;
+    rc_cfg.fps_in_denorm  = params->framerate.den;
+    rc_cfg.fps_out_flex   = 0;
+    rc_cfg.fps_out_num    = params->framerate.num;
+    rc_cfg.fps_out_denorm = params->framerate.den;
+    rc_cfg.gop            = params->gop;
+    rc_cfg.skip_cnt       = 0;
+
+    ret = rkmpp_enc_control(encoder, MPP_ENC_SET_RC_CFG, &rc_cfg, "rate control");
+    if (ret < 0)
+        return ret;
+
+    codec_cfg.coding = rkmpp_enc_get_codingtype(params->codec_id);
+    if (params->codec_id == AV_CODEC_ID_H264) {
+        codec_cfg.h264.change = MPP_ENC_H264_CFG_CHANGE_PROFILE |
+                                MPP_ENC_H264_CFG_CHANGE_ENTROPY |
+                                MPP_ENC_H264_CFG_CHANGE_TRANS_8x8 |
+                                MPP_ENC_H264_CFG_CHANGE_QP_LIMIT;
+        codec_cfg.h264.profile = params->profile == FF_PROFILE_UNKNOWN ?
+                                 FF_PROFILE_H264_HIGH : params->profile & 0xff;
+        codec_cfg.h264.level   = params->level == FF_LEVEL_UNKNOWN ? 40 : params->level;
+        codec_cfg.h264.entropy_coding_mode = codec_cfg.h264.profile != FF_PROFILE_H264_BASELINE;
+        codec_cfg.h264.cabac_init_idc      = 0;
+        codec_cfg.h264.transform8x8_mode   = codec_cfg.h264.profile >= FF_PROFILE_H264_HIGH;
+        codec_cfg.h264.qp_init     = params->qp;
+        codec_cfg.h264.qp_min      = params->qp_min >= 0 ? params->qp_min : 10;
+        codec_cfg.h264.qp_max      = params->qp_max >= 0 ? params->qp_max : 51;
+        codec_cfg.h264.qp_max_step = 8;
+        if (params->rc_mode == RKMPP_ENC_RC_CQP) {
+            codec_cfg.h264.qp_min      = params->qp;
+            codec_cfg.h264.qp_max      = params->qp;
+            codec_cfg.h264.qp_max_step = 0;
+        }
+    } else {
+        codec_cfg.h265.change   = MPP_ENC_H265_CFG_INTRA_QP_CHANGE;
+        codec_cfg.h265.intra_qp = params->qp;
+    }
+
+    return rkmpp_enc_control(encoder, MPP_ENC_SET_CODEC_CFG, &codec_cfg, "codec parameters");
+}
+
+static void rkmpp_enc_close(void *handle)
+{
+    RKMPPEncoder *encoder = handle;
+
+    if (encoder->mpi) {
+        encoder->mpi->reset(encoder->ctx);
+        mpp_destroy(encoder->ctx);
+        encoder->ctx = NULL;
+    }
+
+    if (encoder->frame_group) {
+        mpp_buffer_group_put(encoder->frame_group);
+        encoder->frame_group = NULL;
+    }
+
+    av_free(encoder);
+}
+
+static int rkmpp_enc_open(void **handle, void *logctx, const RKMPPEncParams *params)
+{
+    RKMPPEncoder *encoder;
+    MppCodingType codectype;
+    int ret;
+
+    encoder = av_mallocz(sizeof(RKMPPEncoder));
+    if (!encoder)
+        return AVERROR(ENOMEM);
+    *handle = encoder;
+
+    encoder->logctx = logctx;
+    encoder->params = *params;
+    encoder->timeout = -2;
+    encoder->prep_cfg.format = MPP_FMT_BUTT;
+
+    codectype = rkmpp_enc_get_codingtype(params->codec_id);
+    ret = mpp_check_support_format(MPP_CTX_ENC, codectype);
+    if (ret != MPP_OK) {
+        av_log(logctx, AV_LOG_ERROR, "Codec type (%d) unsupported by MPP\n", params->codec_id);
+        ret = AVERROR_UNKNOWN;
+        goto fail;
+    }
+
+    // Create the MPP context
+    ret = mpp_create(&encoder->ctx, &encoder->mpi);
+    if (ret != MPP_OK) {
+        av_log(logctx, AV_LOG_ERROR, "Failed to create MPP context (code = %d).\n", ret);
+        ret = AVERROR_UNKNOWN;
+        goto fail;
+    }
+
+    ret = mpp_init(encoder->ctx, MPP_CTX_ENC, codectype);
+    if (ret != MPP_OK) {
+        av_log(logctx, AV_LOG_ERROR, "Failed to initialize MPP context (code = %d).\n", ret);
+        ret = AVERROR_UNKNOWN;
+        goto fail;
+    }
+
+    ret = rkmpp_enc_set_prep(encoder, rkmpp_enc_get_frameformat(params->sw_format),
+                             params->hor_stride, params->ver_stride);
+    if (ret < 0)
+        goto fail;
+
+    ret = rkmpp_enc_set_rc(encoder);
+    if (ret < 0)
+        goto fail;
+
+    ret = rkmpp_enc_set_timeout(encoder, 0);
+    if (ret < 0)
+        goto fail;
+
+    // only used for software frames, DRM PRIME frames are imported
+    ret = mpp_buffer_group_get_internal(&encoder->frame_group, MPP_BUFFER_TYPE_ION);
+    if (ret) {
+        av_log(logctx, AV_LOG_ERROR, "Failed to retrieve buffer group (code = %d)\n", ret);
+        ret = AVERROR_UNKNOWN;
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    rkmpp_enc_close(encoder);
+    *handle = NULL;
+    return ret;
+}
+
+static int rkmpp_enc_get_header(void *handle, uint8_t *buf, int size)
+{
+    RKMPPEncoder *encoder = handle;
+    MppPacket packet = NULL;
+    int ret, len;
+
+    ret = rkmpp_enc_control(encoder, MPP_ENC_GET_EXTRA_INFO, &packet, "header retrieval");
+    if (ret < 0)
+        return ret;
+    if (!packet)
+        return 0;
+
+    // the packet belongs to the encoder
+    len = mpp_packet_get_length(packet);
+    if (len > size)
+        return AVERROR(ENOSPC);
+    memcpy(buf, mpp_packet_get_pos(packet), len);
+
+    return len;
+}
+
+static int rkmpp_enc_import_frame(RKMPPEncoder *encoder, const AVFrame *frame, MppBuffer *buffer)
+{
+    const AVDRMFrameDescriptor *desc = (const AVDRMFrameDescriptor *)frame->data[0];
+    const AVDRMLayerDescriptor *layer = &desc->layers[0];
+    MppBufferInfo info = { 0 };
+    MppFrameFormat format = rkmpp_enc_get_drmformat(layer->format);
+    int hor_stride, ver_stride, ret;
+
+    if (desc->nb_objects != 1 || format == MPP_FMT_BUTT) {
+        av_log(encoder->logctx, AV_LOG_ERROR, "Unsupported DRM frame layout.\n");
+        return AVERROR(ENOSYS);
+    }
+
+    hor_stride = layer->planes[0].pitch;
+    ver_stride = layer->nb_planes > 1 ? layer->planes[1].offset / hor_stride : encoder->params.ver_stride;
+
+    ret = rkmpp_enc_set_prep(encoder, format, hor_stride, ver_stride);
+    if (ret < 0)
+        return ret;
+
+    info.type  = MPP_BUFFER_TYPE_ION;
+    info.fd    = desc->objects[0].fd;
+    info.size  = desc->objects[0].size;
+    info.index = 0;
+
+    ret = mpp_buffer_import(buffer, &info);
+    if (ret != MPP_OK) {
+        av_log(encoder->logctx, AV_LOG_ERROR, "Failed to import DRM buffer (code = %d)\n", ret);
+        return AVERROR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static int rkmpp_enc_upload_frame(RKMPPEncoder *encoder, const AVFrame *frame, MppBuffer *buffer)
+{
+    const RKMPPEncParams *params = &encoder->params;
+    uint8_t *data[4];
+    int linesize[4];
+    int ret;
+
+    ret = rkmpp_enc_set_prep(encoder, rkmpp_enc_get_frameformat(frame->format),
+                             params->hor_stride, params->ver_stride);
+    if (ret < 0)
+        return ret;
+
+    ret = mpp_buffer_get(encoder->frame_group, buffer,
+                         av_image_get_buffer_size(frame->format, params->hor_stride, params->ver_stride, 1));
+    if (ret != MPP_OK) {
+        av_log(encoder->logctx, AV_LOG_ERROR, "Failed to get input buffer (code = %d)\n", ret);
+        return AVERROR(ENOMEM);
+    }
+
+    av_image_fill_arrays(data, linesize, mpp_buffer_get_ptr(*buffer), frame->format,
+                         params->hor_stride, params->ver_stride, 1);
+    av_image_copy(data, linesize, (const uint8_t **)frame->data, frame->linesize,
+                  frame->format, frame->width, frame->height);
+
+    return 0;
+}
+
+static int rkmpp_enc_put_frame(void *handle, const AVFrame *frame)
+{
+    RKMPPEncoder *encoder = handle;
+    MppFrame mppframe = NULL;
+    MppBuffer buffer = NULL;
+    int ret;
+
+    ret = mpp_frame_init(&mppframe);
+    if (ret != MPP_OK) {
+        av_log(encoder->logctx, AV_LOG_ERROR, "Failed to init MPP frame (code = %d)\n", ret);
+        return AVERROR_UNKNOWN;
+    }
+
+    if (!frame) {
+        mpp_frame_set_eos(mppframe, 1);
+    } else {
+        if (frame->format == AV_PIX_FMT_DRM_PRIME)
+            ret = rkmpp_enc_import_frame(encoder, frame, &buffer);
+        else
+            ret = rkmpp_enc_upload_frame(encoder, frame, &buffer);
+        if (ret < 0)
+            goto out;
+
+        mpp_frame_set_width(mppframe, encoder->params.width);
+        mpp_frame_set_height(mppframe, encoder->params.height);
+        mpp_frame_set_hor_stride(mppframe, encoder->prep_cfg.hor_stride);
+        mpp_frame_set_ver_stride(mppframe, encoder->prep_cfg.ver_stride);
+        mpp_frame_set_fmt(mppframe, encoder->prep_cfg.format);
+        mpp_frame_set_pts(mppframe, frame->pts);
+        // the frame holds its own reference to the buffer
+        mpp_frame_set_buffer(mppframe, buffer);
+        mpp_buffer_put(buffer);
+
+        if (frame->pict_type == AV_PICTURE_TYPE_I) {
+            ret = rkmpp_enc_control(encoder, MPP_ENC_SET_IDR_FRAME, NULL, "IDR request");
+            if (ret < 0)
+                goto out;
+        }
+    }
+
+    ret = encoder->mpi->encode_put_frame(encoder->ctx, mppframe);
+    if (ret != MPP_OK) {
+        if (ret == MPP_ERR_BUFFER_FULL) {
+            av_log(encoder->logctx, AV_LOG_DEBUG, "Buffer full writing frame to encoder\n");
+            ret = AVERROR(EAGAIN);
+        } else
+            ret = AVERROR_UNKNOWN;
+    }
+
+out:
+    mpp_frame_deinit(&mppframe);
+    return ret;
+}
+
+static int rkmpp_enc_get_packet(void *handle, AVPacket *pkt, int timeout)
+{
+    RKMPPEncoder *encoder = handle;
+    MppPacket packet = NULL;
+    MppMeta meta;
+    RK_S32 intra = 0;
+    int ret, len;
+
+    if (encoder->eos_reached)
+        return AVERROR_EOF;
+
+    ret = rkmpp_enc_set_timeout(encoder, timeout);
+    if (ret < 0)
+        return ret;
+
+    ret = encoder->mpi->encode_get_packet(encoder->ctx, &packet);
+    if (ret == MPP_ERR_TIMEOUT || (ret == MPP_OK && !packet))
+        return AVERROR(EAGAIN);
+    if (ret != MPP_OK) {
+        av_log(encoder->logctx, AV_LOG_ERROR, "Failed to get a packet from MPP (code = %d)\n", ret);
+        return AVERROR_UNKNOWN;
+    }
+
+    encoder->eos_reached = mpp_packet_get_eos(packet);
+    len = mpp_packet_get_length(packet);
+    if (!len) {
+        ret = encoder->eos_reached ? AVERROR_EOF : AVERROR(EAGAIN);
+        goto out;
+    }
+
+    ret = av_new_packet(pkt, len);
+    if (ret < 0)
+        goto out;
+    memcpy(pkt->data, mpp_packet_get_pos(packet), len);
+
+    pkt->pts = pkt->dts = mpp_packet_get_pts(packet);
+
+    meta = mpp_packet_get_meta(packet);
+    if (meta)
+        mpp_meta_get_s32(meta, KEY_OUTPUT_INTRA, &intra);
+    if (intra)
+        pkt->flags |= AV_PKT_FLAG_KEY;
+
+out:
+    mpp_packet_deinit(&packet);
+    return ret;
+}
+
+const RKMPPEncOps ff_rkmpp_enc_mpi_ops = {
+    .open       = rkmpp_enc_open,
+    .close      = rkmpp_enc_close,
+    .get_header = rkmpp_enc_get_header,
+    .put_frame  = rkmpp_enc_put_frame,
+    .get_packet = rkmpp_enc_get_packet,
+};
@@ -0,0 +1,635 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * Queued submission for the RKVDEC hwaccels.
+ *
+ * end_frame only prepares and submits the task, the hardware processes the
+ * tasks in submission order. A frame is reaped when it is returned to the
+ * caller (post_process) or when the queue is full. References do not need to
+ * be reaped before being used since the hardware queue is in order, their
+ * decode errors are inherited when the referencing frame is reaped.
+ *
+ * Slices are appended straight into pooled, mapped DMA stream buffers which
+ * are handed to the device as they are and recycled once the task is reaped.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/hwcontext_internal.h"
+#include "libavutil/time.h"
+#include "decode.h"
+#include "rkvdec.h"
+#include "rkvdec_drm.h"
+
+static AVBufferRef *rkvdec_frame_task(const AVFrame *frame)
+{
+    FrameDecodeData *fdd;
+
+    if (!frame || !frame->private_ref)
+        return NULL;
+
+    fdd = (FrameDecodeData*)frame->private_ref->data;
+    return fdd->hwaccel_priv;
+}
+
+static void rkvdec_frame_release(void *priv)
+{
+    AVBufferRef *task = priv;
+    av_buffer_unref(&task);
+}
+
+static void rkvdec_frame_free(void *opaque, uint8_t *data)
+{
+    RKVDECFrame *rf = (RKVDECFrame*)data;
+    RK_U32 i;
+
+    for (i = 0; i < rf->nb_refs; i++)
+        av_buffer_unref(&rf->refs[i]);
+    av_free(rf);
+}
+
+static int rkvdec_retrieve_frame(void *logctx, AVFrame *frame)
+{
+    RKVDECFrame *rf = (RKVDECFrame*)rkvdec_frame_task(frame)->data;
+    RKVDECContext *ctx = rf->ctx;
+
+    pthread_mutex_lock(&ctx->hwaccel_mutex);
+    ff_rkvdec_sync_frame(ctx, frame);
+    pthread_mutex_unlock(&ctx->hwaccel_mutex);
+
+    return 0;
+}
+
+static void rkvdec_complete(RKVDECFrame *rf, int ret)
+{
+    RK_U32 i;
+
+    if (ret)
+        rf->decode_error_flags |= FF_DECODE_ERROR_INVALID_BITSTREAM;
+
+    for (i = 0; i < rf->nb_refs; i++) {
+        RKVDECFrame *ref = (RKVDECFrame*)rf->refs[i]->data;
+        rf->decode_error_flags |= ref->decode_error_flags;
+        av_buffer_unref(&rf->refs[i]);
+    }
+    rf->nb_refs = 0;
+}
+
+static void rkvdec_stream_free(void *opaque, uint8_t *data)
+{
+    RKVDECContext *ctx = opaque;
+    AVFrame *buf = (AVFrame*)data;
+
+    ctx->allocator.free(ctx->allocator_ctx, buf);
+    av_frame_free(&buf);
+}
+
+static AVBufferRef *rkvdec_stream_alloc(void *opaque, int size)
+{
+    RKVDECContext *ctx = opaque;
+    AVFrame *buf = av_frame_alloc();
+    AVBufferRef *ref;
+
+    if (!buf)
+        return NULL;
+
+    buf->linesize[0] = size;
+    if (ctx->allocator.alloc(ctx->allocator_ctx, buf)) {
+        av_frame_free(&buf);
+        return NULL;
+    }
+
+    ref = av_buffer_create((uint8_t*)buf, sizeof(*buf), rkvdec_stream_free, ctx, 0);
+    if (!ref)
+        rkvdec_stream_free(ctx, (uint8_t*)buf);
+
+    return ref;
+}
+
+static int rkvdec_reap(RKVDECContext *ctx)
+{
+    AVBufferRef *task;
+    RKVDECFrame *rf;
+    int64_t now;
+    RK_U32 seq;
+    int ret;
+
+    if (!ctx->nb_tasks)
+        return 0;
+
+    task = ctx->tasks[ctx->task_head];
+    seq  = ctx->task_seqs[ctx->task_head];
+    ctx->tasks[ctx->task_head] = NULL;
+
+    ret = ctx->dev.wait(ctx->dev_ctx);
+    av_buffer_unref(&ctx->streams[ctx->task_head]);
+
+    ctx->task_head = (ctx->task_head + 1) % RKVDEC_MAX_TASKS;
+    ctx->nb_tasks--;
+    rf = (RKVDECFrame*)task->data;
+
+    /* the hardware starts a task once the previous one is done */
+    now = av_gettime_relative();
+    ctx->hw_time += now - FFMAX(rf->submit_time, ctx->last_reap_time);
+    ctx->last_reap_time = now;
+    rkvdec_complete(rf, ret);
+    ctx->reap_seq = FFMAX(ctx->reap_seq, seq);
+    RKVDEC_LOG(AV_LOG_DEBUG, "seq:%d|err:%d|pending:%d", seq, ret, ctx->nb_tasks);
+
+    av_buffer_unref(&task);
+    return ret;
+}
+
+const RKVDECDevice *ff_rkvdec_find_device(const RKVDECDevice * const *devices)
+{
+    const char *name = getenv("RKVDEC_DEVICE");
+    int i;
+
+    if (!name || !*name)
+        return devices[0];
+
+    for (i = 0; devices[i]; i++) {
+        if (!strcmp(devices[i]->name, name))
+            return devices[i];
+    }
+
+    return NULL;
+}
+
+void ff_rkvdec_log_stats(void *logctx, RKVDECContext *ctx)
+{
+    if (!ctx->stream_frames)
+        return;
+
+    av_log(logctx, AV_LOG_VERBOSE, "%u frames, per frame: prepare %"PRId64" us, "
+           "hardware %"PRId64" us, %"PRIu64" stream bytes copied\n", ctx->stream_frames,
+           ctx->prepare_time / ctx->stream_frames, ctx->hw_time / ctx->stream_frames,
+           ctx->stream_bytes_copied / ctx->stream_frames);
+}
+
+void ff_rkvdec_queue_init(RKVDECContext *ctx, int depth)
+{
+    ctx->task_head  = 0;
+    ctx->nb_tasks   = 0;
+    ctx->submit_seq = 0;
+    ctx->reap_seq   = 0;
+
+    if (!ctx->dev.submit || !ctx->dev.wait)
+        depth = 1;
+    ctx->async_depth = av_clip(depth, 1, RKVDEC_MAX_TASKS);
+}
+
+int ff_rkvdec_attach_frame(RKVDECContext *ctx, AVFrame *frame)
+{
+    FrameDecodeData *fdd;
+    RKVDECFrame *rf;
+    AVBufferRef *task;
+
+    if (!frame->private_ref)
+        return AVERROR(EINVAL);
+
+    fdd = (FrameDecodeData*)frame->private_ref->data;
+    if (fdd->hwaccel_priv)
+        return 0;
+
+    rf = av_mallocz(sizeof(*rf));
+    if (!rf)
+        return AVERROR(ENOMEM);
+    rf->ctx = ctx;
+
+    task = av_buffer_create((uint8_t*)rf, sizeof(*rf), rkvdec_frame_free, NULL, 0);
+    if (!task) {
+        av_free(rf);
+        return AVERROR(ENOMEM);
+    }
+
+    fdd->hwaccel_priv      = task;
+    fdd->hwaccel_priv_free = rkvdec_frame_release;
+    fdd->post_process      = rkvdec_retrieve_frame;
+
+    return 0;
+}
+
+void ff_rkvdec_add_ref(AVFrame *frame, const AVFrame *ref)
+{
+    AVBufferRef *task = rkvdec_frame_task(frame);
+    AVBufferRef *ref_task = rkvdec_frame_task(ref);
+    RKVDECFrame *rf;
+    RK_U32 i;
+
+    frame->decode_error_flags |= ref->decode_error_flags;
+
+    if (!task || !ref_task || task->data == ref_task->data)
+        return;
+
+    rf = (RKVDECFrame*)task->data;
+    if (((RKVDECFrame*)ref_task->data)->seq <= ((RKVDECContext*)rf->ctx)->reap_seq) {
+        rf->decode_error_flags |= ((RKVDECFrame*)ref_task->data)->decode_error_flags;
+        return;
+    }
+
+    for (i = 0; i < rf->nb_refs; i++) {
+        if (rf->refs[i]->data == ref_task->data)
+            return;
+    }
+    if (rf->nb_refs < FF_ARRAY_ELEMS(rf->refs)) {
+        rf->refs[rf->nb_refs] = av_buffer_ref(ref_task);
+        if (rf->refs[rf->nb_refs])
+            rf->nb_refs++;
+    }
+}
+
+int ff_rkvdec_append_stream(RKVDECContext *ctx, const uint8_t *prefix, int prefix_size,
+                            const uint8_t *data, uint32_t size)
+{
+    RK_U32 needed = ctx->pkt.size + prefix_size + size + AV_INPUT_BUFFER_PADDING_SIZE;
+
+    if (!ctx->pkt.buf || ff_rkvdec_get_dma_size((AVFrame*)ctx->pkt.buf->data) < needed) {
+        AVBufferRef *ref;
+
+        if (!ctx->stream_pool || ctx->stream_pool_size < needed) {
+            RK_U32 pool_size = FFMAX(ctx->stream_pool_size, RKVDEC_STREAM_SIZE);
+
+            while (pool_size < needed)
+                pool_size *= 2;
+
+            /* buffers still in flight go back to the old pool and die there */
+            av_buffer_pool_uninit(&ctx->stream_pool);
+            ctx->stream_pool = av_buffer_pool_init2(pool_size, ctx, rkvdec_stream_alloc, NULL);
+            if (!ctx->stream_pool)
+                return AVERROR(ENOMEM);
+            ctx->stream_pool_size = pool_size;
+        }
+
+        ref = av_buffer_pool_get(ctx->stream_pool);
+        if (!ref)
+            return AVERROR(ENOMEM);
+
+        if (ctx->pkt.size) {
+            memcpy(ff_rkvdec_get_dma_ptr((AVFrame*)ref->data), ctx->pkt.data, ctx->pkt.size);
+            ctx->stream_bytes_copied += ctx->pkt.size;
+        }
+        av_buffer_unref(&ctx->pkt.buf);
+        ctx->pkt.buf  = ref;
+        ctx->pkt.data = ff_rkvdec_get_dma_ptr((AVFrame*)ref->data);
+    }
+
+    if (prefix_size)
+        memcpy(ctx->pkt.data + ctx->pkt.size, prefix, prefix_size);
+    ctx->pkt.size += prefix_size;
+    memcpy(ctx->pkt.data + ctx->pkt.size, data, size);
+    ctx->pkt.size += size;
+    ctx->stream_bytes_copied += prefix_size + size;
+
+    return 0;
+}
+
+int ff_rkvdec_submit_frame(RKVDECContext *ctx, AVFrame *frame)
+{
+    AVBufferRef *task = rkvdec_frame_task(frame);
+    RKVDECFrame *rf;
+    int64_t t;
+    int slot, ret;
+
+    if (!task || !ctx->pkt.buf)
+        return AVERROR(EINVAL);
+    rf = (RKVDECFrame*)task->data;
+
+    while (ctx->nb_tasks >= ctx->async_depth)
+        rkvdec_reap(ctx);
+
+    t = av_gettime_relative();
+    ret = ctx->dev.prepare(ctx->dev_ctx, &ctx->pkt, ctx->pic_param);
+    rf->submit_time = av_gettime_relative();
+    ctx->prepare_time += rf->submit_time - t;
+    if (ret < 0) {
+        rkvdec_complete(rf, ret);
+        return ret;
+    }
+
+    rf->seq = ++ctx->submit_seq;
+    ctx->stream_frames++;
+
+    if (ctx->async_depth <= 1) {
+        ret = ctx->dev.perform(ctx->dev_ctx);
+        ctx->hw_time += av_gettime_relative() - rf->submit_time;
+        rkvdec_complete(rf, ret);
+        ctx->reap_seq = rf->seq;
+        goto done;
+    }
+
+    task = av_buffer_ref(task);
+    if (!task)
+        return AVERROR(ENOMEM);
+
+    ret = ctx->dev.submit(ctx->dev_ctx);
+    if (ret) {
+        rkvdec_complete(rf, ret);
+        ctx->reap_seq = rf->seq;
+        av_buffer_unref(&task);
+        goto done;
+    }
+
+    /* the stream buffer stays with the task until it is reaped */
+    slot = (ctx->task_head + ctx->nb_tasks) % RKVDEC_MAX_TASKS;
+    ctx->tasks[slot]     = task;
+    ctx->task_seqs[slot] = rf->seq;
+    ctx->streams[slot]   = ctx->pkt.buf;
+    ctx->pkt.buf         = NULL;
+    ctx->nb_tasks++;
+
+done:
+    if (ctx->pkt.buf)
+        av_buffer_unref(&ctx->pkt.buf);
+    ctx->pkt.data = NULL;
+    ctx->pkt.size = 0;
+
+    return 0;
+}
+
+int ff_rkvdec_sync_frame(RKVDECContext *ctx, AVFrame *frame)
+{
+    AVBufferRef *task = rkvdec_frame_task(frame);
+    RKVDECFrame *rf;
+
+    if (!task)
+        return 0;
+    rf = (RKVDECFrame*)task->data;
+
+    while (ctx->nb_tasks && ctx->reap_seq < rf->seq)
+        rkvdec_reap(ctx);
+
+    frame->decode_error_flags |= rf->decode_error_flags;
+
+    return 0;
+}
+
+void ff_rkvdec_flush(RKVDECContext *ctx)
+{
+    while (ctx->nb_tasks)
+        rkvdec_reap(ctx);
+}
+
+void ff_rkvdec_stream_uninit(RKVDECContext *ctx)
+{
+    int i;
+
+    if (ctx->stream_frames)
+        RKVDEC_LOG(AV_LOG_DEBUG, "frames:%d|copied:%"PRIu64" bytes/frame", ctx->stream_frames,
+                   ctx->stream_bytes_copied / ctx->stream_frames);
+
+    for (i = 0; i < RKVDEC_MAX_TASKS; i++)
+        av_buffer_unref(&ctx->streams[i]);
+    av_buffer_unref(&ctx->pkt.buf);
+    ctx->pkt.data = NULL;
+    ctx->pkt.size = 0;
+    av_buffer_pool_uninit(&ctx->stream_pool);
+    ctx->stream_pool_size = 0;
+}
+
+int ff_rkvdec_context_init(AVCodecContext *avctx, const RKVDECDevice * const *devices,
+                           size_t pic_param_size)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
+    const RKVDECDevice *dev = ff_rkvdec_find_device(devices);
+    int ret;
+
+    if (!dev) {
+        av_log(avctx, AV_LOG_ERROR, "Unknown RKVDEC device requested.\n");
+        return AVERROR(EINVAL);
+    }
+
+    ctx->dev = *dev;
+    ctx->dev_ctx = av_mallocz(ctx->dev.priv_data_size);
+    if (!ctx->dev_ctx)
+        return AVERROR(ENOMEM);
+
+    ret = ctx->dev.init(ctx->dev_ctx);
+    if (ret) {
+        av_log(avctx, AV_LOG_ERROR, "Failed to open RKVDEC device %s.\n", ctx->dev.name);
+        ctx->dev.uninit(ctx->dev_ctx);
+        av_freep(&ctx->dev_ctx);
+        return ret;
+    }
+
+    pthread_mutex_init(&ctx->hwaccel_mutex, NULL);
+    ff_rkvdec_queue_init(ctx, RKVDEC_ASYNC_DEPTH);
+
+    ctx->allocator = *ctx->dev.allocator;
+    ctx->allocator.open(&ctx->allocator_ctx, 1);
+    if (ctx->allocator.prewarm)
+        ctx->allocator.prewarm(ctx->allocator_ctx, RKVDEC_STREAM_SIZE, ctx->async_depth + 1);
+
+    if (!avctx->hw_frames_ctx)
+        ff_decode_get_hw_frames_ctx(avctx, AV_HWDEVICE_TYPE_DRM);
+    ((AVHWFramesContext*)avctx->hw_frames_ctx->data)->user_opaque = ctx;
+
+    av_init_packet(&ctx->pkt);
+    ctx->pkt.data = NULL;
+    ctx->pkt.size = 0;
+    ctx->pic_param = av_mallocz(pic_param_size);
+    if (!ctx->pic_param)
+        return AVERROR(ENOMEM);
+
+    RKVDEC_LOG(AV_LOG_DEBUG, "dev:%s|allocator:%s", ctx->dev.name, ctx->allocator.name);
+
+    return 0;
+}
+
+int ff_rkvdec_context_uninit(AVCodecContext *avctx)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
+
+    if (!ctx->dev_ctx)
+        return 0;
+
+    pthread_mutex_lock(&ctx->hwaccel_mutex);
+    ff_rkvdec_flush(ctx);
+    ff_rkvdec_log_stats(avctx, ctx);
+    ff_rkvdec_stream_uninit(ctx);
+    pthread_mutex_unlock(&ctx->hwaccel_mutex);
+
+    ctx->dev.uninit(ctx->dev_ctx);
+    av_freep(&ctx->dev_ctx);
+    av_freep(&ctx->pic_param);
+
+    if (ctx->internal_pool)
+        av_buffer_pool_uninit(&ctx->internal_pool);
+
+    ctx->allocator.close(ctx->allocator_ctx);
+
+    pthread_mutex_destroy(&ctx->hwaccel_mutex);
+
+    return 0;
+}
+
+int ff_rkvdec_frame_params(AVCodecContext *avctx, AVBufferRef *hw_frames_ctx, int nb_frames)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
+    AVHWFramesContext *hw_frames = (AVHWFramesContext*)hw_frames_ctx->data;
+    RK_U32 size;
+
+    hw_frames->format = AV_PIX_FMT_DRM_PRIME;
+    hw_frames->sw_format = AV_PIX_FMT_NV12;
+    hw_frames->width  = avctx->coded_width;
+    hw_frames->height = avctx->coded_height;
+    hw_frames->user_opaque = ctx;
+    hw_frames->initial_pool_size = 0;
+
+    // NV12 with the 16 aligned strides the hardware writes
+    size = ALIGN(hw_frames->width, 16) * ALIGN(hw_frames->height, 16) * 3 / 2;
+    hw_frames->internal->pool_internal = av_buffer_pool_init2(size, hw_frames,
+                                            rkvdec_alloc_drm_buffer, NULL);
+    if (!hw_frames->internal->pool_internal)
+        return AVERROR(ENOMEM);
+
+    if (ctx->allocator.prewarm && nb_frames > 0)
+        ctx->allocator.prewarm(ctx->allocator_ctx, size, nb_frames);
+    return 0;
+}
+
+static void rkvdec_picture_buffer_free(void *opaque, uint8_t *data)
+{
+    RKVDECContext *ctx = opaque;
+    AVFrame *buf = (AVFrame*)data;
+
+    ctx->allocator.free(ctx->allocator_ctx, buf);
+    av_frame_free(&buf);
+}
+
+static AVBufferRef *rkvdec_picture_buffer_alloc(void *opaque, int size)
+{
+    RKVDECContext *ctx = opaque;
+    AVFrame *buf = av_frame_alloc();
+    AVBufferRef *ref;
+
+    if (!buf)
+        return NULL;
+
+    buf->linesize[0] = size;
+    if (ctx->allocator.alloc(ctx->allocator_ctx, buf)) {
+        av_frame_free(&buf);
+        return NULL;
+    }
+
+    ref = av_buffer_create((uint8_t*)buf, sizeof(*buf), rkvdec_picture_buffer_free, ctx, 0);
+    if (!ref)
+        rkvdec_picture_buffer_free(ctx, (uint8_t*)buf);
+
+    return ref;
+}
+
+int ff_rkvdec_alloc_picture_buffer(RKVDECContext *ctx, AVBufferRef **buf, void **priv, int size)
+{
+    AVBufferRef *ref;
+
+    if (!ctx->internal_pool || ctx->internal_pool_size != size) {
+        /* buffers of the old size go away with the pictures holding them */
+        av_buffer_pool_uninit(&ctx->internal_pool);
+        ctx->internal_pool = av_buffer_pool_init2(size, ctx, rkvdec_picture_buffer_alloc, NULL);
+        if (!ctx->internal_pool)
+            return AVERROR(ENOMEM);
+        ctx->internal_pool_size = size;
+    }
+
+    ref = av_buffer_pool_get(ctx->internal_pool);
+    if (!ref)
+        return AVERROR(ENOMEM);
+
+    av_buffer_unref(buf);
+    *buf  = ref;
+    *priv = ref->data;
+
+    return 0;
+}
+
+int ff_rkvdec_capture_open(RKVDECCapture *cap)
+{
+    const char *path = getenv("RKVDEC_CAPTURE");
+
+    memset(cap, 0, sizeof(*cap));
+
+    if (!path || !*path)
+        return 0;
+
+    cap->file = fopen(path, "w");
+    if (!cap->file) {
+        RKVDEC_LOG(AV_LOG_ERROR, "cannot open %s", path);
+        return AVERROR(errno);
+    }
+
+    return 0;
+}
+
+static void rkvdec_capture_hex(FILE *f, const RK_U8 *data, RK_U32 size)
+{
+    RK_U32 i;
+
+    for (i = 0; i < size; i++)
+        fprintf(f, "%02x%s", data[i], (i % 32 == 31 || i == size - 1) ? "\n" : "");
+}
+
+void ff_rkvdec_capture_task(RKVDECCapture *cap, const char *name,
+                            const void *regs, int nb_regs,
+                            const AVFrame *tables, const AVFrame *stream)
+{
+    const RK_U32 *reg = regs;
+    int i;
+
+    cap->regs    = regs;
+    cap->nb_regs = nb_regs;
+    cap->tables  = tables;
+    cap->stream  = stream;
+    cap->nb_tasks++;
+
+    if (!cap->file)
+        return;
+
+    fprintf(cap->file, "# %s task %u\n", name, cap->nb_tasks);
+
+    fprintf(cap->file, "regs %d\n", nb_regs);
+    for (i = 0; i < nb_regs; i++)
+        fprintf(cap->file, "%08x%s", reg[i], (i % 8 == 7 || i == nb_regs - 1) ? "\n" : " ");
+
+    if (tables) {
+        fprintf(cap->file, "tables %d\n", ff_rkvdec_get_dma_size((AVFrame*)tables));
+        rkvdec_capture_hex(cap->file, ff_rkvdec_get_dma_ptr((AVFrame*)tables),
+                           ff_rkvdec_get_dma_size((AVFrame*)tables));
+    }
+
+    if (stream) {
+        fprintf(cap->file, "stream %d\n", stream->pkt_size);
+        rkvdec_capture_hex(cap->file, ff_rkvdec_get_dma_ptr((AVFrame*)stream), stream->pkt_size);
+    }
+
+    fflush(cap->file);
+}
+
+void ff_rkvdec_capture_close(RKVDECCapture *cap)
+{
+    if (cap->file)
+        fclose(cap->file);
+    cap->file = NULL;
+}
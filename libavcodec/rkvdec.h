@@ -22,6 +22,9 @@
 #ifndef AVCODEC_RKVDEC_H
 #define AVCODEC_RKVDEC_H
 
+#include <pthread.h>
+#include <stdio.h>
+
 #include "libavutil/hwcontext.h"
 #include "libavutil/hwcontext_drm.h"
 #include "libavcodec/avcodec.h"
@@ -33,6 +36,7 @@
 typedef unsigned int            RK_U32;
 typedef signed int              RK_S32;
 typedef signed short            RK_S16;
+typedef signed char             RK_S8;
 typedef unsigned char           RK_U8;
 typedef unsigned short          RK_U16;
 typedef signed long long int    RK_S64;
@@ -49,6 +53,13 @@ typedef signed long long int    RK_S64;
 
 #define ALIGN(value, x) ((value + (x - 1)) & (~(x - 1)))
 
+/* number of register/bitstream sets a device keeps for queued submission */
+#define RKVDEC_MAX_TASKS                       4
+/* default number of frames in flight in the hardware queue, 1 means synchronous */
+#define RKVDEC_ASYNC_DEPTH                     2
+/* initial size of the pooled DMA stream buffers, doubled when a frame does not fit */
+#define RKVDEC_STREAM_SIZE                     (1024 * 1024)
+
 #define RKVDEC_LOG(level, format,...) av_log(NULL, level,  "[%d|%s@%s,%d] " format "\n", level, __func__, __FILE__, __LINE__, ##__VA_ARGS__ )
 
 typedef struct RKVDECPicEntry {
@@ -80,13 +91,28 @@ typedef struct RKVDECHwReq {
 typedef struct RKVDECDevice {
     const char  *name;
     const char  *dev;
+    os_allocator *allocator;
     RK_U32      priv_data_size;
     RK_S32      (*init)(void *ctx);
     RK_S32      (*prepare)(void *ctx, void* data, void* param);
     RK_S32      (*perform)(void *ctx);
     RK_S32      (*uninit)(void *ctx);
+    /* optional queued interface: submit the prepared task without waiting,
+     * wait for the oldest submitted task and return its decode status.
+     * Tasks complete in submission order. */
+    RK_S32      (*submit)(void *ctx);
+    RK_S32      (*wait)(void *ctx);
 } RKVDECDevice;
 
+typedef struct RKVDECFrame {
+    void                *ctx;
+    RK_U32              seq;
+    int64_t             submit_time;
+    int                 decode_error_flags;
+    AVBufferRef         *refs[16];
+    RK_U32              nb_refs;
+} RKVDECFrame;
+
 typedef struct RKVDECContext{
     RKVDECDevice        dev;
     void                *dev_ctx;
@@ -95,12 +121,51 @@ typedef struct RKVDECContext{
     os_allocator        allocator;
     void                *allocator_ctx;
     AVBufferPool        *internal_pool;
+    RK_U32              internal_pool_size;
     AVHWDeviceContext   *hwdc;
     AVHWFramesContext   *hwfc;    
     pthread_mutex_t     hwaccel_mutex;    
-    RK_U8               err_info;
+    AVBufferRef         *tasks[RKVDEC_MAX_TASKS];
+    /* submit sequence of each queued task, the frame's moves on when its
+     * second field is submitted */
+    RK_U32              task_seqs[RKVDEC_MAX_TASKS];
+    RK_U32              task_head;
+    RK_U32              nb_tasks;
+    RK_U32              async_depth;
+    RK_U32              submit_seq;
+    RK_U32              reap_seq;
+    AVBufferPool        *stream_pool;
+    RK_U32              stream_pool_size;
+    AVBufferRef         *streams[RKVDEC_MAX_TASKS];
+    uint64_t            stream_bytes_copied;
+    RK_U32              stream_frames;
+    int64_t             prepare_time;
+    int64_t             hw_time;
+    int64_t             last_reap_time;
 } RKVDECContext;
 
+/**
+ * Register capture, to validate the parameter and bitstream preparation of
+ * a device without the hardware.
+ *
+ * A device opened in capture mode runs its prepare callback as usual but
+ * hands the task to ff_rkvdec_capture_task() instead of the kernel driver,
+ * nothing gets decoded. It keeps an RKVDECCapture as the first member of
+ * its private context so that tests can look at the last task.
+ *
+ * Buffer addresses appear the way the kernel expects them: dma-buf fd in
+ * the low 10 bits, offset into the buffer above.
+ */
+typedef struct RKVDECCapture {
+    FILE                *file;
+    RK_U32              nb_tasks;
+    /* last captured task, valid until the device reuses its slot */
+    const RK_U32        *regs;
+    RK_U32              nb_regs;
+    const AVFrame       *tables;
+    const AVFrame       *stream;
+} RKVDECCapture;
+
 static inline void* ff_rkvdec_get_context(AVCodecContext *avctx)
 {
     return avctx->internal->hwaccel_priv_data;
@@ -126,7 +191,113 @@ static inline uint8_t* ff_rkvdec_get_dma_ptr(AVFrame *f)
     return f->data[0];
 }
 
-static int get_rkvdec_picture_index2(RKVDECPicture DPB[], const RKVDECPicture* pic) {
+/**
+ * Pick the device to use from a NULL terminated list: the one named by the
+ * RKVDEC_DEVICE environment variable if set, the first one otherwise.
+ */
+const RKVDECDevice *ff_rkvdec_find_device(const RKVDECDevice * const *devices);
+
+/**
+ * Log the per frame CPU time spent in prepare and the time the hardware
+ * took, as seen from the queue.
+ */
+void ff_rkvdec_log_stats(void *logctx, RKVDECContext *ctx);
+
+/**
+ * Set up the in-flight queue. depth is clamped to what the device supports.
+ */
+void ff_rkvdec_queue_init(RKVDECContext *ctx, int depth);
+
+/**
+ * Attach the per-frame submission state to a frame about to be decoded and
+ * make sure it is synchronized before being returned to the caller.
+ */
+int ff_rkvdec_attach_frame(RKVDECContext *ctx, AVFrame *frame);
+
+/**
+ * Record that frame predicts from ref, so that decode errors of ref are
+ * inherited once both have been reaped.
+ */
+void ff_rkvdec_add_ref(AVFrame *frame, const AVFrame *ref);
+
+/**
+ * Append a NAL unit, preceded by prefix (e.g. a start code, may be NULL if
+ * prefix_size is 0), to the bitstream of the current frame. The bitstream is
+ * written directly into a pooled DMA buffer: ctx->pkt.buf->data is the
+ * AVFrame describing that buffer and ctx->pkt.data/size the mapped bytes
+ * written so far.
+ * Must be called with hwaccel_mutex held.
+ */
+int ff_rkvdec_append_stream(RKVDECContext *ctx, const uint8_t *prefix, int prefix_size,
+                            const uint8_t *data, uint32_t size);
+
+/**
+ * Prepare ctx->pkt/ctx->pic_param for the device and queue it for frame,
+ * reaping the oldest task first if the queue is full.
+ * Must be called with hwaccel_mutex held.
+ */
+int ff_rkvdec_submit_frame(RKVDECContext *ctx, AVFrame *frame);
+
+/**
+ * Wait until the task decoding frame has completed and merge its error flags.
+ * Must be called with hwaccel_mutex held.
+ */
+int ff_rkvdec_sync_frame(RKVDECContext *ctx, AVFrame *frame);
+
+/**
+ * Reap all queued tasks. Must be called with hwaccel_mutex held.
+ */
+void ff_rkvdec_flush(RKVDECContext *ctx);
+
+/**
+ * Release the stream buffers, after ff_rkvdec_flush().
+ */
+void ff_rkvdec_stream_uninit(RKVDECContext *ctx);
+
+/**
+ * Common hwaccel init: pick the device from devices, open it and its
+ * allocator, set up the queue and allocate pic_param_size bytes of
+ * parameters.
+ */
+int ff_rkvdec_context_init(AVCodecContext *avctx, const RKVDECDevice * const *devices,
+                           size_t pic_param_size);
+
+/**
+ * Common hwaccel uninit: reap the queue and close the device.
+ */
+int ff_rkvdec_context_uninit(AVCodecContext *avctx);
+
+/**
+ * Set up hw_frames_ctx for NV12 DRM PRIME frames with the 16 aligned layout
+ * the hardware writes, preallocating nb_frames of them if the allocator can.
+ */
+int ff_rkvdec_frame_params(AVCodecContext *avctx, AVBufferRef *hw_frames_ctx, int nb_frames);
+
+/**
+ * Replace *buf with a size bytes DMA buffer from the internal pool and point
+ * *priv to its descriptor, for the per picture data the hardware keeps next
+ * to the frame (co-located motion vectors, segmentation map).
+ */
+int ff_rkvdec_alloc_picture_buffer(RKVDECContext *ctx, AVBufferRef **buf, void **priv, int size);
+
+/**
+ * Open the file named by the RKVDEC_CAPTURE environment variable, if set,
+ * for ff_rkvdec_capture_task() to write to.
+ */
+int ff_rkvdec_capture_open(RKVDECCapture *cap);
+
+/**
+ * Record a task in place of submitting it: remember it in cap and append
+ * the registers, the syntax tables and the bitstream to the capture file as
+ * hex dumps.
+ */
+void ff_rkvdec_capture_task(RKVDECCapture *cap, const char *name,
+                            const void *regs, int nb_regs,
+                            const AVFrame *tables, const AVFrame *stream);
+
+void ff_rkvdec_capture_close(RKVDECCapture *cap);
+
+static inline int get_rkvdec_picture_index2(RKVDECPicture DPB[], const RKVDECPicture* pic) {
     int i;
     if (pic->index) {
         for(i = 0; i < 16; i++) {
@@ -22,259 +22,14 @@
 #include "libavutil/avassert.h"
 #include "libavcodec/avcodec.h"
 #include "libavcodec/internal.h"
-#include "rkvdec_h264.h"
+#include "rkvdec341_h264.h"
 #include "put_bits64.h"
-#include "allocator_drm.h"
+#include "allocator_pool.h"
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 
-#define RKVDEC341H264_CABAC_TAB_SIZE        (3680*4 + 128)         /* bytes */
-#define RKVDEC341H264_SPSPPS_SIZE           (256*32 + 128)         /* bytes */
-#define RKVDEC341H264_RPS_SIZE              (128 + 128)            /* bytes */
-#define RKVDEC341H264_SCALING_LIST_SIZE     (6*16 + 2*64 + 128)    /* bytes */
-#define RKVDEC341H264_ERROR_INFO_SIZE       (256*144*4)            /* bytes */
-#define RKVDEC341H264_DATA_SIZE             (2048 * 1024)          /* bytes */
-
-typedef struct RKVDEC341RegH264 {
-    struct {
-        RK_U32    minor_ver : 8;
-        RK_U32    level : 1;
-        RK_U32    dec_support : 3;
-        RK_U32    profile : 1;
-        RK_U32    reserve0 : 1;
-        RK_U32    codec_flag : 1;
-        RK_U32    reserve1 : 1;
-        RK_U32    prod_num : 16;
-    } swreg0_id;
-
-    struct {
-        RK_U32    sw_dec_e : 1;
-        RK_U32    sw_dec_clkgate_e : 1;
-        RK_U32    reserve0 : 1;
-        RK_U32    sw_timeout_mode : 1;
-        RK_U32    sw_dec_irq_dis : 1;
-        RK_U32    sw_dec_timeout_e : 1;
-        RK_U32    sw_buf_empty_en : 1;
-        RK_U32    sw_stmerror_waitdecfifo_empty : 1;
-        RK_U32    sw_dec_irq : 1;
-        RK_U32    sw_dec_irq_raw : 1;
-        RK_U32    reserve2 : 2;
-        RK_U32    sw_dec_rdy_sta : 1;
-        RK_U32    sw_dec_bus_sta : 1;
-        RK_U32    sw_dec_error_sta : 1;
-        RK_U32    sw_dec_timeout_sta : 1;
-        RK_U32    sw_dec_empty_sta : 1;
-        RK_U32    sw_colmv_ref_error_sta : 1;
-        RK_U32    sw_cabu_end_sta : 1;
-        RK_U32    sw_h264orvp9_error_mode : 1;
-        RK_U32    sw_softrst_en_p : 1;
-        RK_U32    sw_force_softreset_valid : 1;
-        RK_U32    sw_softreset_rdy : 1;
-    } swreg1_int;
-
-    struct {
-        RK_U32    sw_in_endian : 1;
-        RK_U32    sw_in_swap32_e : 1;
-        RK_U32    sw_in_swap64_e : 1;
-        RK_U32    sw_str_endian : 1;
-        RK_U32    sw_str_swap32_e : 1;
-        RK_U32    sw_str_swap64_e : 1;
-        RK_U32    sw_out_endian : 1;
-        RK_U32    sw_out_swap32_e : 1;
-        RK_U32    sw_out_cbcr_swap : 1;
-        RK_U32    reserve0 : 1;
-        RK_U32    sw_rlc_mode_direct_write : 1;
-        RK_U32    sw_rlc_mode : 1;
-        RK_U32    sw_strm_start_bit : 7;
-        RK_U32    reserve1 : 1;
-        RK_U32    sw_dec_mode : 2;
-        RK_U32    reserve2 : 2;
-        RK_U32    sw_h264_rps_mode : 1;
-        RK_U32    sw_h264_stream_mode : 1;
-        RK_U32    sw_h264_stream_lastpacket : 1;
-        RK_U32    sw_h264_firstslice_flag : 1;
-        RK_U32    sw_h264_frame_orslice : 1;
-        RK_U32    sw_buspr_slot_disable : 1;
-        RK_U32    sw_colmv_mode : 1;
-        RK_U32    sw_ycacherd_prior : 1;
-    } swreg2_sysctrl;
-
-    struct {
-        RK_U32    sw_y_hor_virstride : 9;
-        RK_U32    reserve : 2;
-        RK_U32    sw_slice_num_highbit : 1;
-        RK_U32    sw_uv_hor_virstride : 9;
-        RK_U32    sw_slice_num_lowbits : 11;
-    } swreg3_picpar;
-
-    struct {
-        RK_U32    sw_strm_rlc_base;
-    } swreg4_strm_rlc_base;
-
-    struct {
-        RK_U32 sw_stream_len : 27;
-    } swreg5_stream_rlc_len;
-
-    struct {
-        RK_U32    sw_cabactbl_base;
-    } swreg6_cabactbl_prob_base;
-
-    struct {
-        RK_U32    sw_decout_base;
-    } swreg7_decout_base;
-
-    struct {
-        RK_U32    sw_y_virstride : 20;
-    } swreg8_y_virstride;
-
-    struct {
-        RK_U32    sw_yuv_virstride : 21;
-    } swreg9_yuv_virstride;
-
-    struct {
-        RK_U32 sw_refer_base : 10;
-        RK_U32 sw_ref_field : 1;
-        RK_U32 sw_ref_topfield_used : 1;
-        RK_U32 sw_ref_botfield_used : 1;
-        RK_U32 sw_ref_colmv_use_flag : 1;
-
-    } swreg10_24_refer0_14_base[15];
-
-    RK_U32   swreg25_39_refer0_14_poc[15];
-
-    struct {
-        RK_U32 sw_cur_poc : 32;
-    } swreg40_cur_poc;
-
-    struct {
-        RK_U32 sw_rlcwrite_base;
-    } swreg41_rlcwrite_base;
-
-    struct {
-        RK_U32 sw_pps_base;
-    } swreg42_pps_base;
-
-    struct swreg_sw_rps_base {
-        RK_U32 sw_rps_base;
-    } swreg43_rps_base;
-
-    struct swreg_strmd_error_e {
-        RK_U32 sw_strmd_error_e : 28;
-        RK_U32 reserve : 4;
-    } swreg44_strmd_error_en;
-
-    struct {
-        RK_U32 sw_strmd_error_status : 28;
-        RK_U32 sw_colmv_error_ref_picidx : 4;
-    } swreg45_strmd_error_status;
-
-    struct {
-        RK_U32 sw_strmd_error_ctu_xoffset : 8;
-        RK_U32 sw_strmd_error_ctu_yoffset : 8;
-        RK_U32 sw_streamfifo_space2full : 7;
-        RK_U32 reserve : 1;
-        RK_U32 sw_vp9_error_ctu0_en : 1;
-    } swreg46_strmd_error_ctu;
-
-    struct {
-        RK_U32 sw_saowr_xoffet : 9;
-        RK_U32 reserve : 7;
-        RK_U32 sw_saowr_yoffset : 10;
-    } swreg47_sao_ctu_position;
-
-    struct {
-        RK_U32 sw_refer_base : 10;
-        RK_U32 sw_ref_field : 1;
-        RK_U32 sw_ref_topfield_used : 1;
-        RK_U32 sw_ref_botfield_used : 1;
-        RK_U32 sw_ref_colmv_use_flag : 1;
-
-    } swreg48_refer15_base;
-
-    RK_U32   swreg49_63_refer15_29_poc[15];
-
-    struct {
-        RK_U32 sw_performance_cycle : 32;
-    } swreg64_performance_cycle;
-
-    struct {
-        RK_U32 sw_axi_ddr_rdata : 32;
-    } swreg65_axi_ddr_rdata;
-
-    struct {
-        RK_U32 sw_axi_ddr_rdata : 32;
-    } swreg66_axi_ddr_wdata;
-
-    struct {
-        union {
-            struct {
-                RK_U32 sw_busifd_resetn : 1;
-                RK_U32 sw_cabac_resetn : 1;
-                RK_U32 sw_dec_ctrl_resetn : 1;
-                RK_U32 sw_transd_resetn : 1;
-                RK_U32 sw_intra_resetn : 1;
-                RK_U32 sw_inter_resetn : 1;
-                RK_U32 sw_recon_resetn : 1;
-                RK_U32 sw_filer_resetn : 1;
-            };
-            RK_U32 sw_resetn : 8;
-        }
-    } swreg67_fpgadebug_reset;
-
-    struct {
-        RK_U32 perf_cnt0_sel : 6;
-        RK_U32 reserve0 : 2;
-        RK_U32 perf_cnt1_sel : 6;
-        RK_U32 reserve1 : 2;
-        RK_U32 perf_cnt2_sel : 6;
-    } swreg68_performance_sel;
-
-    struct {
-        RK_U32 perf_cnt0 : 32;
-    } swreg69_performance_cnt0;
-
-    struct {
-        RK_U32 perf_cnt1 : 32;
-    } swreg70_performance_cnt1;
-
-    struct {
-        RK_U32 perf_cnt2 : 32;
-    } swreg71_performance_cnt2;
-
-    RK_U32   swreg72_refer30_poc;
-    RK_U32   swreg73_refer31_poc;
-
-    struct {
-        RK_U32 sw_h264_cur_poc1 : 32;
-    } swreg74_h264_cur_poc1;
-
-    struct {
-        RK_U32 sw_errorinfo_base : 32;
-    } swreg75_h264_errorinfo_base;
-
-    struct {
-        RK_U32 sw_slicedec_num : 14;
-        RK_U32 reserve : 1;
-        RK_U32 sw_strmd_detect_error_flag : 1;
-        RK_U32 sw_error_packet_num : 14;
-    } swreg76_h264_errorinfo_num;
-
-    struct {
-        RK_U32 sw_h264_error_en_highbits : 30;
-        RK_U32 reserve : 2;
-    } swreg77_h264_error_e;
-
-    struct {
-        RK_U32 sw_colmv_base;
-    } swreg78_colmv_cur_base;
-
-    struct {
-        RK_U32 sw_colmv_base;
-    } swreg79_94_colmv0_15_base[16];
-}RKVDEC341RegH264;
-
 static RK_U32 RKVDEC341_cabac_table[926 * 4] = {
     0x3602f114, 0xf1144a03, 0x4a033602, 0x68e97fe4, 0x36ff35fa, 0x21173307,
     0x00150217, 0x31000901, 0x390576db, 0x41f54ef3, 0x310c3e01, 0x321149fc,
@@ -433,41 +188,27 @@ static RK_U32 RKVDEC341_cabac_table[926 * 4] = {
     0x1423091d, 0x430e241d,
 };
 
-typedef struct RKVDEC341H264Context {
-    RK_S32              dev_fd;
-    RKVDEC341RegH264    reg;
-    os_allocator        dma_allocator;
-    void*               dma_allocator_ctx;
-    AVFrame             *syntax_data;
-    AVFrame             *cabac_data;
-    AVFrame             *pps_data;
-    AVFrame             *rps_data;
-    AVFrame             *scaling_list_data;
-    AVFrame             *errorinfo_data;
-    AVFrame             *stream_data;
-} RKVDEC341H264Context;
-
 extern struct RKVDECDevice rkvdec341_h264;
 
-static RK_S32 rkvdec341_h264_prepare(RKVDEC341H264Context *ctx, AVPacket* data, RKVDECPicParamsH264 *pp) {
+RK_S32 ff_rkvdec341_h264_prepare(void *p, void *pkt, void *param) {
+    RKVDEC341H264Context *ctx = (RKVDEC341H264Context*)p;
+    AVPacket *data = (AVPacket*)pkt;
+    RKVDECPicParamsH264 *pp = (RKVDECPicParamsH264*)param;
+    RKVDEC341H264Task *task = &ctx->task[ctx->prepare_idx];
     PutBitContext64 bp;    
-    RK_U8 *ptr, *tmp_data;
+    uint64_t spspps[5];
+    RK_U8 *ptr;
     RK_S32 i, j;
 
-    //stream
-    if (ff_rkvdec_get_dma_size(ctx->stream_data) < data->size) {
-        ctx->dma_allocator.free(ctx->dma_allocator_ctx, ctx->stream_data);
-        ctx->stream_data->linesize[0] = data->size + RKVDEC341H264_DATA_SIZE; 
-        ctx->dma_allocator.alloc(ctx->dma_allocator_ctx, ctx->stream_data);
-    }
-    ptr = ff_rkvdec_get_dma_ptr(ctx->stream_data);
-    memcpy(ptr, data->data, data->size);
-    ctx->stream_data->pkt_size = data->size;
+    //stream, already written in place by the hwaccel
+    task->stream_data = (AVFrame*)data->buf->data;
+    task->stream_data->pkt_size = data->size;
+    // the hardware reads the stream by 16 bytes, do not leave stale data there
+    memset(data->data + data->size, 0, ALIGN(data->size, 16) - data->size);
 
     //sps
-    ptr = ff_rkvdec_get_dma_ptr(ctx->pps_data);
-    tmp_data = av_mallocz(32 + 10);
-    init_put_bits_a64(&bp, tmp_data, 32);
+    memset(spspps, 0, sizeof(spspps));
+    init_put_bits_a64(&bp, spspps, FF_ARRAY_ELEMS(spspps));
     
     put_bits_a64(&bp, 4, -1);
     put_bits_a64(&bp, 8, -1);
@@ -529,8 +270,8 @@ static RK_S32 rkvdec341_h264_prepare(RKVDEC341H264Context *ctx, AVPacket* data,
     put_bits_a64(&bp, 1, pp->transform_8x8_mode_flag);
     put_bits_a64(&bp, 5, pp->second_chroma_qp_index_offset);
     put_bits_a64(&bp, 1, pp->scaleing_list_enable_flag);
-    put_bits_a64(&bp, 32, ff_rkvdec_get_dma_fd(ctx->syntax_data) | 
-        ((ff_rkvdec_get_dma_ptr(ctx->scaling_list_data) - ff_rkvdec_get_dma_ptr(ctx->syntax_data))<< 10));
+    put_bits_a64(&bp, 32, ff_rkvdec_get_dma_fd(task->syntax_data) | 
+        ((ff_rkvdec_get_dma_ptr(task->scaling_list_data) - ff_rkvdec_get_dma_ptr(task->syntax_data))<< 10));
 
     for (i = 0; i < 16; i++) {
         int is_long_term = pp->DPB[i].valid ? pp->DPB[i].lt : 0;
@@ -542,13 +283,17 @@ static RK_S32 rkvdec341_h264_prepare(RKVDEC341H264Context *ctx, AVPacket* data,
     }
     put_align_a64(&bp, 64, 0);
 
-    for(i = 0; i < 256; i++) {
-        memcpy(ptr + i * 32, tmp_data, 32);
+    // the same entry for all 256 pps ids, only uploaded when it changed
+    if (memcmp(task->spspps, spspps, sizeof(task->spspps))) {
+        ptr = ff_rkvdec_get_dma_ptr(task->pps_data);
+        for(i = 0; i < 256; i++) {
+            memcpy(ptr + i * 32, spspps, 32);
+        }
+        memcpy(task->spspps, spspps, sizeof(task->spspps));
     }
-    av_free(tmp_data);
 
     //rps
-    ptr = ff_rkvdec_get_dma_ptr(ctx->rps_data);
+    ptr = ff_rkvdec_get_dma_ptr(task->rps_data);
     init_put_bits_a64(&bp, ptr, RKVDEC341H264_RPS_SIZE);
     
     for (i = 0; i < 16; i++) {
@@ -609,8 +354,11 @@ static RK_S32 rkvdec341_h264_prepare(RKVDEC341H264Context *ctx, AVPacket* data,
     put_align_a64(&bp, 128, 0);
 
     // scaling list
-    if (pp->scaleing_list_enable_flag) {
-        ptr = ff_rkvdec_get_dma_ptr(ctx->scaling_list_data);
+    if (pp->scaleing_list_enable_flag && (!task->scaling_valid ||
+        memcmp(task->scaling_lists4x4, pp->scaling_lists4x4, sizeof(task->scaling_lists4x4)) ||
+        memcmp(task->scaling_lists8x8[0], pp->scaling_lists8x8[0], sizeof(task->scaling_lists8x8[0])) ||
+        memcmp(task->scaling_lists8x8[1], pp->scaling_lists8x8[3], sizeof(task->scaling_lists8x8[1])))) {
+        ptr = ff_rkvdec_get_dma_ptr(task->scaling_list_data);
 
         init_put_bits_a64(&bp, ptr, RKVDEC341H264_SCALING_LIST_SIZE);
         memset(ptr, 0, RKVDEC341H264_SCALING_LIST_SIZE);
@@ -624,127 +372,223 @@ static RK_S32 rkvdec341_h264_prepare(RKVDEC341H264Context *ctx, AVPacket* data,
 
         for (j = 0; j < 64; j++)
             put_bits_a64(&bp, 8, pp->scaling_lists8x8[3][j]);
+
+        memcpy(task->scaling_lists4x4, pp->scaling_lists4x4, sizeof(task->scaling_lists4x4));
+        memcpy(task->scaling_lists8x8[0], pp->scaling_lists8x8[0], sizeof(task->scaling_lists8x8[0]));
+        memcpy(task->scaling_lists8x8[1], pp->scaling_lists8x8[3], sizeof(task->scaling_lists8x8[1]));
+        task->scaling_valid = 1;
     }
 
     // regs
-    memset(&ctx->reg, 0, sizeof(RKVDEC341RegH264));
-
-    ctx->reg.swreg2_sysctrl.sw_dec_mode = 1;
-    ctx->reg.swreg3_picpar.sw_slice_num_lowbits = 0x7ff;
-    ctx->reg.swreg3_picpar.sw_slice_num_highbit = 1;    
-    ctx->reg.swreg5_stream_rlc_len.sw_stream_len = ALIGN(ctx->stream_data->pkt_size, 16);
-    ctx->reg.swreg3_picpar.sw_y_hor_virstride = ALIGN(pp->frame_width, 16) / 16;
-    ctx->reg.swreg3_picpar.sw_uv_hor_virstride =  ALIGN(pp->frame_width, 16) / 16;
-    ctx->reg.swreg8_y_virstride.sw_y_virstride = ALIGN(ALIGN(pp->frame_width, 16) * ALIGN(pp->frame_height, 16), 16) / 16;
-    ctx->reg.swreg9_yuv_virstride.sw_yuv_virstride = ALIGN(ALIGN(pp->frame_width, 16) * ALIGN(pp->frame_height, 16) * 3 / 2, 16) / 16;
-    ctx->reg.swreg40_cur_poc.sw_cur_poc = pp->curr_pic.field_poc[0];
-    ctx->reg.swreg74_h264_cur_poc1.sw_h264_cur_poc1 = pp->curr_pic.field_poc[1];
-    ctx->reg.swreg7_decout_base.sw_decout_base = pp->curr_pic.index;
-    ctx->reg.swreg78_colmv_cur_base.sw_colmv_base = pp->curr_mv;
+    memset(&task->reg, 0, sizeof(RKVDEC341RegH264));
+
+    task->reg.swreg2_sysctrl.sw_dec_mode = 1;
+    task->reg.swreg3_picpar.sw_slice_num_lowbits = 0x7ff;
+    task->reg.swreg3_picpar.sw_slice_num_highbit = 1;    
+    task->reg.swreg5_stream_rlc_len.sw_stream_len = ALIGN(task->stream_data->pkt_size, 16);
+    task->reg.swreg3_picpar.sw_y_hor_virstride = ALIGN(pp->frame_width, 16) / 16;
+    task->reg.swreg3_picpar.sw_uv_hor_virstride =  ALIGN(pp->frame_width, 16) / 16;
+    task->reg.swreg8_y_virstride.sw_y_virstride = ALIGN(ALIGN(pp->frame_width, 16) * ALIGN(pp->frame_height, 16), 16) / 16;
+    task->reg.swreg9_yuv_virstride.sw_yuv_virstride = ALIGN(ALIGN(pp->frame_width, 16) * ALIGN(pp->frame_height, 16) * 3 / 2, 16) / 16;
+    task->reg.swreg40_cur_poc.sw_cur_poc = pp->curr_pic.field_poc[0];
+    task->reg.swreg74_h264_cur_poc1.sw_h264_cur_poc1 = pp->curr_pic.field_poc[1];
+    task->reg.swreg7_decout_base.sw_decout_base = pp->curr_pic.index;
+    task->reg.swreg78_colmv_cur_base.sw_colmv_base = pp->curr_mv;
 
     for (i = 0; i < 15; i++) {
-        ctx->reg.swreg25_39_refer0_14_poc[i] = (i & 1) ? pp->DPB[i / 2].field_poc[1] : pp->DPB[i / 2].field_poc[0];
-        ctx->reg.swreg49_63_refer15_29_poc[i] = (i & 1) ? pp->DPB[(i + 15) / 2].field_poc[0] : pp->DPB[(i + 15) / 2].field_poc[1];
-        ctx->reg.swreg10_24_refer0_14_base[i].sw_ref_field = pp->DPB[i].field_picture;
-        ctx->reg.swreg10_24_refer0_14_base[i].sw_ref_topfield_used = !!(pp->DPB[i].reference & 1);
-        ctx->reg.swreg10_24_refer0_14_base[i].sw_ref_botfield_used = !!(pp->DPB[i].reference & 2);
-        ctx->reg.swreg25_39_refer0_14_poc[i] = ctx->reg.swreg25_39_refer0_14_poc[i];
-        ctx->reg.swreg10_24_refer0_14_base[i].sw_ref_colmv_use_flag = 0x01;
+        task->reg.swreg25_39_refer0_14_poc[i] = (i & 1) ? pp->DPB[i / 2].field_poc[1] : pp->DPB[i / 2].field_poc[0];
+        task->reg.swreg49_63_refer15_29_poc[i] = (i & 1) ? pp->DPB[(i + 15) / 2].field_poc[0] : pp->DPB[(i + 15) / 2].field_poc[1];
+        task->reg.swreg10_24_refer0_14_base[i].sw_ref_field = pp->DPB[i].field_picture;
+        task->reg.swreg10_24_refer0_14_base[i].sw_ref_topfield_used = !!(pp->DPB[i].reference & 1);
+        task->reg.swreg10_24_refer0_14_base[i].sw_ref_botfield_used = !!(pp->DPB[i].reference & 2);
+        task->reg.swreg25_39_refer0_14_poc[i] = task->reg.swreg25_39_refer0_14_poc[i];
+        task->reg.swreg10_24_refer0_14_base[i].sw_ref_colmv_use_flag = 0x01;
 
         if (pp->DPB[i].valid)
-            ctx->reg.swreg10_24_refer0_14_base[i].sw_refer_base = pp->DPB[i].index;
+            task->reg.swreg10_24_refer0_14_base[i].sw_refer_base = pp->DPB[i].index;
         else
-            ctx->reg.swreg10_24_refer0_14_base[i].sw_refer_base = 
-                i ? ctx->reg.swreg10_24_refer0_14_base[i - 1].sw_refer_base : pp->curr_pic.index;
+            task->reg.swreg10_24_refer0_14_base[i].sw_refer_base = 
+                i ? task->reg.swreg10_24_refer0_14_base[i - 1].sw_refer_base : pp->curr_pic.index;
     }
-    ctx->reg.swreg72_refer30_poc = pp->DPB[15].field_poc[0];
-    ctx->reg.swreg73_refer31_poc = pp->DPB[15].field_poc[1];
-    ctx->reg.swreg48_refer15_base.sw_ref_field = pp->DPB[15].field_picture;
-    ctx->reg.swreg48_refer15_base.sw_ref_topfield_used = !!(pp->DPB[i].reference & 1);
-    ctx->reg.swreg48_refer15_base.sw_ref_botfield_used = !!(pp->DPB[i].reference & 2);
-    ctx->reg.swreg48_refer15_base.sw_ref_colmv_use_flag = 0x01;
+    task->reg.swreg72_refer30_poc = pp->DPB[15].field_poc[0];
+    task->reg.swreg73_refer31_poc = pp->DPB[15].field_poc[1];
+    task->reg.swreg48_refer15_base.sw_ref_field = pp->DPB[15].field_picture;
+    task->reg.swreg48_refer15_base.sw_ref_topfield_used = !!(pp->DPB[i].reference & 1);
+    task->reg.swreg48_refer15_base.sw_ref_botfield_used = !!(pp->DPB[i].reference & 2);
+    task->reg.swreg48_refer15_base.sw_ref_colmv_use_flag = 0x01;
     if (pp->DPB[15].valid)
-        ctx->reg.swreg48_refer15_base.sw_refer_base = pp->DPB[15].index;
+        task->reg.swreg48_refer15_base.sw_refer_base = pp->DPB[15].index;
     else
-        ctx->reg.swreg48_refer15_base.sw_refer_base = ctx->reg.swreg10_24_refer0_14_base[14].sw_refer_base;
+        task->reg.swreg48_refer15_base.sw_refer_base = task->reg.swreg10_24_refer0_14_base[14].sw_refer_base;
 
-    ctx->reg.swreg4_strm_rlc_base.sw_strm_rlc_base = ff_rkvdec_get_dma_fd(ctx->stream_data);
-    ctx->reg.swreg6_cabactbl_prob_base.sw_cabactbl_base = ff_rkvdec_get_dma_fd(ctx->syntax_data);
-    ctx->reg.swreg41_rlcwrite_base.sw_rlcwrite_base = ctx->reg.swreg4_strm_rlc_base.sw_strm_rlc_base;
+    task->reg.swreg4_strm_rlc_base.sw_strm_rlc_base = ff_rkvdec_get_dma_fd(task->stream_data);
+    task->reg.swreg6_cabactbl_prob_base.sw_cabactbl_base = ff_rkvdec_get_dma_fd(task->syntax_data);
+    task->reg.swreg41_rlcwrite_base.sw_rlcwrite_base = task->reg.swreg4_strm_rlc_base.sw_strm_rlc_base;
 
-    ctx->reg.swreg42_pps_base.sw_pps_base = ff_rkvdec_get_dma_fd(ctx->syntax_data) + 
-        ((ff_rkvdec_get_dma_ptr(ctx->pps_data) - ff_rkvdec_get_dma_ptr(ctx->syntax_data)) << 10);
-    ctx->reg.swreg43_rps_base.sw_rps_base = ff_rkvdec_get_dma_fd(ctx->syntax_data) + 
-        ((ff_rkvdec_get_dma_ptr(ctx->rps_data) - ff_rkvdec_get_dma_ptr(ctx->syntax_data)) << 10);
-    ctx->reg.swreg75_h264_errorinfo_base.sw_errorinfo_base = ff_rkvdec_get_dma_fd(ctx->syntax_data) + 
-        ((ff_rkvdec_get_dma_ptr(ctx->errorinfo_data) - ff_rkvdec_get_dma_ptr(ctx->syntax_data)) << 10);
+    task->reg.swreg42_pps_base.sw_pps_base = ff_rkvdec_get_dma_fd(task->syntax_data) + 
+        ((ff_rkvdec_get_dma_ptr(task->pps_data) - ff_rkvdec_get_dma_ptr(task->syntax_data)) << 10);
+    task->reg.swreg43_rps_base.sw_rps_base = ff_rkvdec_get_dma_fd(task->syntax_data) + 
+        ((ff_rkvdec_get_dma_ptr(task->rps_data) - ff_rkvdec_get_dma_ptr(task->syntax_data)) << 10);
+    task->reg.swreg75_h264_errorinfo_base.sw_errorinfo_base = ff_rkvdec_get_dma_fd(task->syntax_data) + 
+        ((ff_rkvdec_get_dma_ptr(task->errorinfo_data) - ff_rkvdec_get_dma_ptr(task->syntax_data)) << 10);
 
     for (i = 0; i < 16; i++) {
         if (pp->ref_colmv_list[i] > 0)
-            ctx->reg.swreg79_94_colmv0_15_base[i].sw_colmv_base = pp->ref_colmv_list[i];
+            task->reg.swreg79_94_colmv0_15_base[i].sw_colmv_base = pp->ref_colmv_list[i];
         else
-            ctx->reg.swreg79_94_colmv0_15_base[i].sw_colmv_base = i ? 
-            ctx->reg.swreg79_94_colmv0_15_base[i - 1].sw_colmv_base : pp->curr_mv;
+            task->reg.swreg79_94_colmv0_15_base[i].sw_colmv_base = i ? 
+            task->reg.swreg79_94_colmv0_15_base[i - 1].sw_colmv_base : pp->curr_mv;
     }
 
-    if (ctx->reg.swreg78_colmv_cur_base.sw_colmv_base)
-        ctx->reg.swreg2_sysctrl.sw_colmv_mode = 1;
+    if (task->reg.swreg78_colmv_cur_base.sw_colmv_base)
+        task->reg.swreg2_sysctrl.sw_colmv_mode = 1;
 
-    ctx->reg.swreg67_fpgadebug_reset.sw_resetn = 0xff;
-    ctx->reg.swreg44_strmd_error_en.sw_strmd_error_e = 0xfffffff;
-    ctx->reg.swreg77_h264_error_e.sw_h264_error_en_highbits = 0x3fffffff;
-    ctx->reg.swreg1_int.sw_dec_e = 1;
-    ctx->reg.swreg1_int.sw_dec_timeout_e = 1;
-    ctx->reg.swreg1_int.sw_buf_empty_en = 1;
+    task->reg.swreg67_fpgadebug_reset.sw_resetn = 0xff;
+    task->reg.swreg44_strmd_error_en.sw_strmd_error_e = 0xfffffff;
+    task->reg.swreg77_h264_error_e.sw_h264_error_en_highbits = 0x3fffffff;
+    task->reg.swreg1_int.sw_dec_e = 1;
+    task->reg.swreg1_int.sw_dec_timeout_e = 1;
+    task->reg.swreg1_int.sw_buf_empty_en = 1;
 
     return 0;
 }
 
-static RK_S32 rkvdec341_h264_perform(void *p) {    
+static RK_S32 rkvdec341_h264_submit(void *p) {
     RKVDEC341H264Context *ctx = (RKVDEC341H264Context*)p;
+    RKVDEC341H264Task *task = &ctx->task[ctx->prepare_idx];
     RKVDECHwReq req;
 
-    req.req = (RK_U32*)&ctx->reg;
-    req.size = 95 * sizeof(RK_U32);
+    req.req = (RK_U32*)&task->reg;
+    req.size = RKVDEC341H264_REG_NUM * sizeof(RK_U32);
 
     if (ioctl(ctx->dev_fd, RKVDEC_IOC_SET_REG, &req))
         return AVERROR_INVALIDDATA;
+
+    ctx->prepare_idx = (ctx->prepare_idx + 1) % RKVDEC_MAX_TASKS;
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_h264_wait(void *p) {
+    RKVDEC341H264Context *ctx = (RKVDEC341H264Context*)p;
+    RKVDEC341H264Task *task = &ctx->task[ctx->wait_idx];
+    RKVDECHwReq req;
+
+    req.req = (RK_U32*)&task->reg;
+    req.size = RKVDEC341H264_REG_NUM * sizeof(RK_U32);
+
+    ctx->wait_idx = (ctx->wait_idx + 1) % RKVDEC_MAX_TASKS;
+
     if (ioctl(ctx->dev_fd, RKVDEC_IOC_GET_REG, &req))
         return AVERROR_INVALIDDATA;
 
-    if (ctx->reg.swreg1_int.sw_dec_error_sta
-        || (!ctx->reg.swreg1_int.sw_dec_rdy_sta)
-        || ctx->reg.swreg1_int.sw_dec_empty_sta
-        || ctx->reg.swreg45_strmd_error_status.sw_strmd_error_status
-        || ctx->reg.swreg45_strmd_error_status.sw_colmv_error_ref_picidx
-        || ctx->reg.swreg76_h264_errorinfo_num.sw_strmd_detect_error_flag)
+    return ff_rkvdec341_h264_check_status(&task->reg);
+}
+
+RK_S32 ff_rkvdec341_h264_check_status(const RKVDEC341RegH264 *reg) {
+    if (reg->swreg1_int.sw_dec_error_sta
+        || (!reg->swreg1_int.sw_dec_rdy_sta)
+        || reg->swreg1_int.sw_dec_empty_sta
+        || reg->swreg45_strmd_error_status.sw_strmd_error_status
+        || reg->swreg45_strmd_error_status.sw_colmv_error_ref_picidx
+        || reg->swreg76_h264_errorinfo_num.sw_strmd_detect_error_flag)
         return AVERROR_INVALIDDATA;
 
     return 0;
 }
 
-static RK_S32 rkvdec341_h264_uninit(void* p) {
+static RK_S32 rkvdec341_h264_perform(void *p) {    
     RKVDEC341H264Context *ctx = (RKVDEC341H264Context*)p;
-    if (ctx->dev_fd) {
+
+    if (rkvdec341_h264_submit(ctx))
+        return AVERROR_INVALIDDATA;
+
+    return rkvdec341_h264_wait(ctx);
+}
+
+static void rkvdec341_h264_free_task(RKVDEC341H264Context *ctx, RKVDEC341H264Task *task) {
+    if (task->syntax_data)
+        ctx->dma_allocator.free(ctx->dma_allocator_ctx, task->syntax_data);
+    av_freep(&task->syntax_data);
+    av_freep(&task->cabac_data);
+    av_freep(&task->pps_data);
+    av_freep(&task->rps_data);
+    av_freep(&task->scaling_list_data);
+    av_freep(&task->errorinfo_data);
+    task->stream_data = NULL;
+}
+
+RK_S32 ff_rkvdec341_h264_uninit(void* p) {
+    RKVDEC341H264Context *ctx = (RKVDEC341H264Context*)p;
+    RK_S32 i;
+
+    if (ctx->dev_fd > 0) {
         close(ctx->dev_fd);
         ctx->dev_fd = -1;
     }
-    ctx->dma_allocator.free(ctx->dma_allocator_ctx, ctx->syntax_data);
-    ctx->dma_allocator.free(ctx->dma_allocator_ctx, ctx->stream_data);
-    ctx->dma_allocator.close(ctx->dma_allocator_ctx);
-    av_freep(&ctx->syntax_data);
-    av_freep(&ctx->cabac_data);
-    av_freep(&ctx->pps_data);
-    av_freep(&ctx->rps_data);
-    av_freep(&ctx->scaling_list_data);
-    av_freep(&ctx->errorinfo_data);
-    av_freep(&ctx->stream_data);
+    for (i = 0; i < RKVDEC_MAX_TASKS; i++)
+        rkvdec341_h264_free_task(ctx, &ctx->task[i]);
+    if (ctx->dma_allocator_ctx)
+        ctx->dma_allocator.close(ctx->dma_allocator_ctx);
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_h264_init_task(RKVDEC341H264Context *ctx, RKVDEC341H264Task *task) {
+    task->syntax_data = av_frame_alloc();
+    task->syntax_data->linesize[0] = RKVDEC341H264_CABAC_TAB_SIZE + 
+                                     RKVDEC341H264_SPSPPS_SIZE + 
+                                     RKVDEC341H264_RPS_SIZE + 
+                                     RKVDEC341H264_SCALING_LIST_SIZE + 
+                                     RKVDEC341H264_ERROR_INFO_SIZE;
+    if (ctx->dma_allocator.alloc(ctx->dma_allocator_ctx, task->syntax_data))
+        return AVERROR(ENOMEM);
+
+    task->cabac_data = av_frame_alloc();
+    task->cabac_data->linesize[0] = RKVDEC341H264_CABAC_TAB_SIZE;
+    task->cabac_data->data[0] = ff_rkvdec_get_dma_ptr(task->syntax_data);
+    memcpy(task->cabac_data->data[0], RKVDEC341_cabac_table, sizeof(RKVDEC341_cabac_table));
+
+    task->pps_data = av_frame_alloc();
+    task->pps_data->linesize[0] = RKVDEC341H264_SPSPPS_SIZE;
+    task->pps_data->data[0] = ff_rkvdec_get_dma_ptr(task->syntax_data) + RKVDEC341H264_CABAC_TAB_SIZE;
+
+    task->rps_data = av_frame_alloc();
+    task->rps_data->linesize[0] = RKVDEC341H264_RPS_SIZE;
+    task->rps_data->data[0] = ff_rkvdec_get_dma_ptr(task->pps_data) + RKVDEC341H264_SPSPPS_SIZE;
+
+    task->scaling_list_data = av_frame_alloc();
+    task->scaling_list_data->linesize[0] = RKVDEC341H264_SCALING_LIST_SIZE;
+    task->scaling_list_data->data[0] = ff_rkvdec_get_dma_ptr(task->rps_data) + RKVDEC341H264_RPS_SIZE;
+
+    task->errorinfo_data = av_frame_alloc();
+    task->errorinfo_data->linesize[0] = RKVDEC341H264_ERROR_INFO_SIZE;
+    task->errorinfo_data->data[0] = ff_rkvdec_get_dma_ptr(task->scaling_list_data) + RKVDEC341H264_SCALING_LIST_SIZE;
+
+    return 0;
+}
+
+RK_S32 ff_rkvdec341_h264_init_tasks(RKVDEC341H264Context *ctx, const RKVDECDevice *dev) {
+    RK_S32 i, ret;
+
+    ctx->dma_allocator = *dev->allocator;
+    if (ctx->dma_allocator.open(&ctx->dma_allocator_ctx, 1))
+        return AVERROR_UNKNOWN;
+
+    for (i = 0; i < RKVDEC_MAX_TASKS; i++) {
+        ret = rkvdec341_h264_init_task(ctx, &ctx->task[i]);
+        if (ret)
+            return ret;
+    }
+    ctx->prepare_idx = 0;
+    ctx->wait_idx = 0;
 
     return 0;
 }
 
 static RK_S32 rkvdec341_h264_init(void *p) {
     RKVDEC341H264Context *ctx = (RKVDEC341H264Context*)p;
+
     ctx->dev_fd = open(rkvdec341_h264.dev, O_RDWR);
     if (ctx->dev_fd <= 0)
         return AVERROR_DECODER_NOT_FOUND;
@@ -755,53 +599,19 @@ static RK_S32 rkvdec341_h264_init(void *p) {
         }
     }
 
-    ctx->dma_allocator = allocator_drm;
-    if (ctx->dma_allocator.open(&ctx->dma_allocator_ctx, 1))
-        return AVERROR_UNKNOWN;
-
-    ctx->syntax_data = av_frame_alloc();
-    ctx->syntax_data->linesize[0] = RKVDEC341H264_CABAC_TAB_SIZE + 
-                                    RKVDEC341H264_SPSPPS_SIZE + 
-                                    RKVDEC341H264_RPS_SIZE + 
-                                    RKVDEC341H264_SCALING_LIST_SIZE + 
-                                    RKVDEC341H264_ERROR_INFO_SIZE;
-    ctx->dma_allocator.alloc(ctx->dma_allocator_ctx, ctx->syntax_data);
-
-    ctx->cabac_data = av_frame_alloc();
-    ctx->cabac_data->linesize[0] = RKVDEC341H264_CABAC_TAB_SIZE;
-    ctx->cabac_data->data[0] = ff_rkvdec_get_dma_ptr(ctx->syntax_data);
-    memcpy(ctx->cabac_data->data[0], RKVDEC341_cabac_table, sizeof(RKVDEC341_cabac_table));
-
-    ctx->pps_data = av_frame_alloc();
-    ctx->pps_data->linesize[0] = RKVDEC341H264_SPSPPS_SIZE;
-    ctx->pps_data->data[0] = ff_rkvdec_get_dma_ptr(ctx->syntax_data) + RKVDEC341H264_CABAC_TAB_SIZE;
-
-    ctx->rps_data = av_frame_alloc();
-    ctx->rps_data->linesize[0] = RKVDEC341H264_RPS_SIZE;
-    ctx->rps_data->data[0] = ff_rkvdec_get_dma_ptr(ctx->pps_data) + RKVDEC341H264_SPSPPS_SIZE;
-
-    ctx->scaling_list_data = av_frame_alloc();
-    ctx->scaling_list_data->linesize[0] = RKVDEC341H264_SCALING_LIST_SIZE;
-    ctx->scaling_list_data->data[0] = ff_rkvdec_get_dma_ptr(ctx->rps_data) + RKVDEC341H264_RPS_SIZE;
-
-    ctx->errorinfo_data = av_frame_alloc();
-    ctx->errorinfo_data->linesize[0] = RKVDEC341H264_ERROR_INFO_SIZE;
-    ctx->errorinfo_data->data[0] = ff_rkvdec_get_dma_ptr(ctx->scaling_list_data) + RKVDEC341H264_SCALING_LIST_SIZE;
-
-    ctx->stream_data = av_frame_alloc();
-    ctx->stream_data->linesize[0] = RKVDEC341H264_DATA_SIZE;
-    ctx->dma_allocator.alloc(ctx->dma_allocator_ctx, ctx->stream_data);
-
-    return 0;
+    return ff_rkvdec341_h264_init_tasks(ctx, &rkvdec341_h264);
 }
 
 struct RKVDECDevice rkvdec341_h264 = {
     .name   = "vdpu341",
     .dev    = "/dev/rkvdec",
+    .allocator = &allocator_drm_pool,
     .priv_data_size = sizeof(RKVDEC341H264Context),
     .init       = rkvdec341_h264_init,
-    .uninit     = rkvdec341_h264_uninit,
-    .prepare    = rkvdec341_h264_prepare,
+    .uninit     = ff_rkvdec341_h264_uninit,
+    .prepare    = ff_rkvdec341_h264_prepare,
     .perform    = rkvdec341_h264_perform,
+    .submit     = rkvdec341_h264_submit,
+    .wait       = rkvdec341_h264_wait,
 };
 
@@ -0,0 +1,315 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *     Author: James Lin<james.lin@rock-chips.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef AVCODEC_RKVDEC341_H264_H
+#define AVCODEC_RKVDEC341_H264_H
+
+#include "rkvdec_h264.h"
+
+#define RKVDEC341H264_CABAC_TAB_SIZE        (3680*4 + 128)         /* bytes */
+#define RKVDEC341H264_SPSPPS_SIZE           (256*32 + 128)         /* bytes */
+#define RKVDEC341H264_RPS_SIZE              (128 + 128)            /* bytes */
+#define RKVDEC341H264_SCALING_LIST_SIZE     (6*16 + 2*64 + 128)    /* bytes */
+
+#define RKVDEC341H264_REG_NUM               95
+#define RKVDEC341H264_ERROR_INFO_SIZE       (256*144*4)            /* bytes */
+
+typedef struct RKVDEC341RegH264 {
+    struct {
+        RK_U32    minor_ver : 8;
+        RK_U32    level : 1;
+        RK_U32    dec_support : 3;
+        RK_U32    profile : 1;
+        RK_U32    reserve0 : 1;
+        RK_U32    codec_flag : 1;
+        RK_U32    reserve1 : 1;
+        RK_U32    prod_num : 16;
+    } swreg0_id;
+
+    struct {
+        RK_U32    sw_dec_e : 1;
+        RK_U32    sw_dec_clkgate_e : 1;
+        RK_U32    reserve0 : 1;
+        RK_U32    sw_timeout_mode : 1;
+        RK_U32    sw_dec_irq_dis : 1;
+        RK_U32    sw_dec_timeout_e : 1;
+        RK_U32    sw_buf_empty_en : 1;
+        RK_U32    sw_stmerror_waitdecfifo_empty : 1;
+        RK_U32    sw_dec_irq : 1;
+        RK_U32    sw_dec_irq_raw : 1;
+        RK_U32    reserve2 : 2;
+        RK_U32    sw_dec_rdy_sta : 1;
+        RK_U32    sw_dec_bus_sta : 1;
+        RK_U32    sw_dec_error_sta : 1;
+        RK_U32    sw_dec_timeout_sta : 1;
+        RK_U32    sw_dec_empty_sta : 1;
+        RK_U32    sw_colmv_ref_error_sta : 1;
+        RK_U32    sw_cabu_end_sta : 1;
+        RK_U32    sw_h264orvp9_error_mode : 1;
+        RK_U32    sw_softrst_en_p : 1;
+        RK_U32    sw_force_softreset_valid : 1;
+        RK_U32    sw_softreset_rdy : 1;
+    } swreg1_int;
+
+    struct {
+        RK_U32    sw_in_endian : 1;
+        RK_U32    sw_in_swap32_e : 1;
+        RK_U32    sw_in_swap64_e : 1;
+        RK_U32    sw_str_endian : 1;
+        RK_U32    sw_str_swap32_e : 1;
+        RK_U32    sw_str_swap64_e : 1;
+        RK_U32    sw_out_endian : 1;
+        RK_U32    sw_out_swap32_e : 1;
+        RK_U32    sw_out_cbcr_swap : 1;
+        RK_U32    reserve0 : 1;
+        RK_U32    sw_rlc_mode_direct_write : 1;
+        RK_U32    sw_rlc_mode : 1;
+        RK_U32    sw_strm_start_bit : 7;
+        RK_U32    reserve1 : 1;
+        RK_U32    sw_dec_mode : 2;
+        RK_U32    reserve2 : 2;
+        RK_U32    sw_h264_rps_mode : 1;
+        RK_U32    sw_h264_stream_mode : 1;
+        RK_U32    sw_h264_stream_lastpacket : 1;
+        RK_U32    sw_h264_firstslice_flag : 1;
+        RK_U32    sw_h264_frame_orslice : 1;
+        RK_U32    sw_buspr_slot_disable : 1;
+        RK_U32    sw_colmv_mode : 1;
+        RK_U32    sw_ycacherd_prior : 1;
+    } swreg2_sysctrl;
+
+    struct {
+        RK_U32    sw_y_hor_virstride : 9;
+        RK_U32    reserve : 2;
+        RK_U32    sw_slice_num_highbit : 1;
+        RK_U32    sw_uv_hor_virstride : 9;
+        RK_U32    sw_slice_num_lowbits : 11;
+    } swreg3_picpar;
+
+    struct {
+        RK_U32    sw_strm_rlc_base;
+    } swreg4_strm_rlc_base;
+
+    struct {
+        RK_U32 sw_stream_len : 27;
+    } swreg5_stream_rlc_len;
+
+    struct {
+        RK_U32    sw_cabactbl_base;
+    } swreg6_cabactbl_prob_base;
+
+    struct {
+        RK_U32    sw_decout_base;
+    } swreg7_decout_base;
+
+    struct {
+        RK_U32    sw_y_virstride : 20;
+    } swreg8_y_virstride;
+
+    struct {
+        RK_U32    sw_yuv_virstride : 21;
+    } swreg9_yuv_virstride;
+
+    struct {
+        RK_U32 sw_refer_base : 10;
+        RK_U32 sw_ref_field : 1;
+        RK_U32 sw_ref_topfield_used : 1;
+        RK_U32 sw_ref_botfield_used : 1;
+        RK_U32 sw_ref_colmv_use_flag : 1;
+
+    } swreg10_24_refer0_14_base[15];
+
+    RK_U32   swreg25_39_refer0_14_poc[15];
+
+    struct {
+        RK_U32 sw_cur_poc : 32;
+    } swreg40_cur_poc;
+
+    struct {
+        RK_U32 sw_rlcwrite_base;
+    } swreg41_rlcwrite_base;
+
+    struct {
+        RK_U32 sw_pps_base;
+    } swreg42_pps_base;
+
+    struct swreg_sw_rps_base {
+        RK_U32 sw_rps_base;
+    } swreg43_rps_base;
+
+    struct swreg_strmd_error_e {
+        RK_U32 sw_strmd_error_e : 28;
+        RK_U32 reserve : 4;
+    } swreg44_strmd_error_en;
+
+    struct {
+        RK_U32 sw_strmd_error_status : 28;
+        RK_U32 sw_colmv_error_ref_picidx : 4;
+    } swreg45_strmd_error_status;
+
+    struct {
+        RK_U32 sw_strmd_error_ctu_xoffset : 8;
+        RK_U32 sw_strmd_error_ctu_yoffset : 8;
+        RK_U32 sw_streamfifo_space2full : 7;
+        RK_U32 reserve : 1;
+        RK_U32 sw_vp9_error_ctu0_en : 1;
+    } swreg46_strmd_error_ctu;
+
+    struct {
+        RK_U32 sw_saowr_xoffet : 9;
+        RK_U32 reserve : 7;
+        RK_U32 sw_saowr_yoffset : 10;
+    } swreg47_sao_ctu_position;
+
+    struct {
+        RK_U32 sw_refer_base : 10;
+        RK_U32 sw_ref_field : 1;
+        RK_U32 sw_ref_topfield_used : 1;
+        RK_U32 sw_ref_botfield_used : 1;
+        RK_U32 sw_ref_colmv_use_flag : 1;
+
+    } swreg48_refer15_base;
+
+    RK_U32   swreg49_63_refer15_29_poc[15];
+
+    struct {
+        RK_U32 sw_performance_cycle : 32;
+    } swreg64_performance_cycle;
+
+    struct {
+        RK_U32 sw_axi_ddr_rdata : 32;
+    } swreg65_axi_ddr_rdata;
+
+    struct {
+        RK_U32 sw_axi_ddr_rdata : 32;
+    } swreg66_axi_ddr_wdata;
+
+    struct {
+        union {
+            struct {
+                RK_U32 sw_busifd_resetn : 1;
+                RK_U32 sw_cabac_resetn : 1;
+                RK_U32 sw_dec_ctrl_resetn : 1;
+                RK_U32 sw_transd_resetn : 1;
+                RK_U32 sw_intra_resetn : 1;
+                RK_U32 sw_inter_resetn : 1;
+                RK_U32 sw_recon_resetn : 1;
+                RK_U32 sw_filer_resetn : 1;
+            };
+            RK_U32 sw_resetn : 8;
+        };
+    } swreg67_fpgadebug_reset;
+
+    struct {
+        RK_U32 perf_cnt0_sel : 6;
+        RK_U32 reserve0 : 2;
+        RK_U32 perf_cnt1_sel : 6;
+        RK_U32 reserve1 : 2;
+        RK_U32 perf_cnt2_sel : 6;
+    } swreg68_performance_sel;
+
+    struct {
+        RK_U32 perf_cnt0 : 32;
+    } swreg69_performance_cnt0;
+
+    struct {
+        RK_U32 perf_cnt1 : 32;
+    } swreg70_performance_cnt1;
+
+    struct {
+        RK_U32 perf_cnt2 : 32;
+    } swreg71_performance_cnt2;
+
+    RK_U32   swreg72_refer30_poc;
+    RK_U32   swreg73_refer31_poc;
+
+    struct {
+        RK_U32 sw_h264_cur_poc1 : 32;
+    } swreg74_h264_cur_poc1;
+
+    struct {
+        RK_U32 sw_errorinfo_base : 32;
+    } swreg75_h264_errorinfo_base;
+
+    struct {
+        RK_U32 sw_slicedec_num : 14;
+        RK_U32 reserve : 1;
+        RK_U32 sw_strmd_detect_error_flag : 1;
+        RK_U32 sw_error_packet_num : 14;
+    } swreg76_h264_errorinfo_num;
+
+    struct {
+        RK_U32 sw_h264_error_en_highbits : 30;
+        RK_U32 reserve : 2;
+    } swreg77_h264_error_e;
+
+    struct {
+        RK_U32 sw_colmv_base;
+    } swreg78_colmv_cur_base;
+
+    struct {
+        RK_U32 sw_colmv_base;
+    } swreg79_94_colmv0_15_base[16];
+}RKVDEC341RegH264;
+
+typedef struct RKVDEC341H264Task {
+    RKVDEC341RegH264    reg;
+    AVFrame             *syntax_data;
+    AVFrame             *cabac_data;
+    AVFrame             *pps_data;
+    AVFrame             *rps_data;
+    AVFrame             *scaling_list_data;
+    AVFrame             *errorinfo_data;
+    AVFrame             *stream_data;
+    /* what is currently uploaded in pps_data and scaling_list_data */
+    RK_U8               spspps[32];
+    RK_U8               scaling_lists4x4[6][16];
+    RK_U8               scaling_lists8x8[2][64];
+    RK_U8               scaling_valid;
+} RKVDEC341H264Task;
+
+typedef struct RKVDEC341H264Context {
+    RK_S32              dev_fd;
+    os_allocator        dma_allocator;
+    void*               dma_allocator_ctx;
+    RKVDEC341H264Task   task[RKVDEC_MAX_TASKS];
+    RK_U32              prepare_idx;
+    RK_U32              wait_idx;
+} RKVDEC341H264Context;
+
+/**
+ * Fill the registers and the syntax tables of the task in the prepare slot.
+ */
+RK_S32 ff_rkvdec341_h264_prepare(void *ctx, void *data, void *param);
+
+/**
+ * Open the allocator of dev and allocate the tasks, dev_fd is left alone.
+ */
+RK_S32 ff_rkvdec341_h264_init_tasks(RKVDEC341H264Context *ctx, const RKVDECDevice *dev);
+
+RK_S32 ff_rkvdec341_h264_uninit(void *ctx);
+
+/**
+ * @return 0 if the status registers of a completed task report no error
+ */
+RK_S32 ff_rkvdec341_h264_check_status(const RKVDEC341RegH264 *reg);
+
+#endif /* AVCODEC_RKVDEC341_H264_H */
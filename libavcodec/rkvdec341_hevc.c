@@ -0,0 +1,679 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * HEVC on the vdpu341 (RKVDEC) block. The hardware parses the slice
+ * headers itself, it gets the parameter sets as a packed table, the CABAC
+ * initial states for every slice QP and the reference lists of each slice.
+ *
+ * The "capture" device runs the same preparation without the kernel driver,
+ * see RKVDECCapture.
+ */
+
+#include "libavutil/frame.h"
+#include "libavutil/avassert.h"
+#include "libavcodec/avcodec.h"
+#include "libavcodec/internal.h"
+#include "hevcdec.h"
+#include "rkvdec_hevc.h"
+#include "put_bits64.h"
+#include "allocator_pool.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#define RKVDEC341HEVC_CABAC_CTX_NUM         208                       /* HEVC_CONTEXTS, 16 aligned */
+#define RKVDEC341HEVC_CABAC_TAB_SIZE        (3 * 52 * RKVDEC341HEVC_CABAC_CTX_NUM + 128)  /* bytes */
+#define RKVDEC341HEVC_PPS_ENTRY_SIZE        96                        /* bytes */
+#define RKVDEC341HEVC_PPS_SIZE              (64 * RKVDEC341HEVC_PPS_ENTRY_SIZE + 128)     /* bytes */
+#define RKVDEC341HEVC_RPS_ENTRY_SIZE        32                        /* bytes */
+#define RKVDEC341HEVC_RPS_SIZE              (RKVDEC_HEVC_MAX_SLICES * RKVDEC341HEVC_RPS_ENTRY_SIZE + 128) /* bytes */
+#define RKVDEC341HEVC_SCALING_LIST_SIZE     (1024 + 128)              /* bytes */
+
+#define RKVDEC341HEVC_REG_NUM               95
+
+typedef struct RKVDEC341RegHEVC {
+    struct {
+        RK_U32    minor_ver : 8;
+        RK_U32    level : 1;
+        RK_U32    dec_support : 3;
+        RK_U32    profile : 1;
+        RK_U32    reserve0 : 1;
+        RK_U32    codec_flag : 1;
+        RK_U32    reserve1 : 1;
+        RK_U32    prod_num : 16;
+    } swreg0_id;
+
+    struct {
+        RK_U32    sw_dec_e : 1;
+        RK_U32    sw_dec_clkgate_e : 1;
+        RK_U32    reserve0 : 1;
+        RK_U32    sw_timeout_mode : 1;
+        RK_U32    sw_dec_irq_dis : 1;
+        RK_U32    sw_dec_timeout_e : 1;
+        RK_U32    sw_buf_empty_en : 1;
+        RK_U32    sw_stmerror_waitdecfifo_empty : 1;
+        RK_U32    sw_dec_irq : 1;
+        RK_U32    sw_dec_irq_raw : 1;
+        RK_U32    reserve2 : 2;
+        RK_U32    sw_dec_rdy_sta : 1;
+        RK_U32    sw_dec_bus_sta : 1;
+        RK_U32    sw_dec_error_sta : 1;
+        RK_U32    sw_dec_timeout_sta : 1;
+        RK_U32    sw_dec_empty_sta : 1;
+        RK_U32    sw_colmv_ref_error_sta : 1;
+        RK_U32    sw_cabu_end_sta : 1;
+        RK_U32    sw_h264orvp9_error_mode : 1;
+        RK_U32    sw_softrst_en_p : 1;
+        RK_U32    sw_force_softreset_valid : 1;
+        RK_U32    sw_softreset_rdy : 1;
+    } swreg1_int;
+
+    struct {
+        RK_U32    sw_in_endian : 1;
+        RK_U32    sw_in_swap32_e : 1;
+        RK_U32    sw_in_swap64_e : 1;
+        RK_U32    sw_str_endian : 1;
+        RK_U32    sw_str_swap32_e : 1;
+        RK_U32    sw_str_swap64_e : 1;
+        RK_U32    sw_out_endian : 1;
+        RK_U32    sw_out_swap32_e : 1;
+        RK_U32    sw_out_cbcr_swap : 1;
+        RK_U32    reserve0 : 1;
+        RK_U32    sw_rlc_mode_direct_write : 1;
+        RK_U32    sw_rlc_mode : 1;
+        RK_U32    sw_strm_start_bit : 7;
+        RK_U32    reserve1 : 1;
+        RK_U32    sw_dec_mode : 2;
+        RK_U32    reserve2 : 2;
+        RK_U32    reserve3 : 5;
+        RK_U32    sw_buspr_slot_disable : 1;
+        RK_U32    sw_colmv_mode : 1;
+        RK_U32    sw_ycacherd_prior : 1;
+    } swreg2_sysctrl;
+
+    struct {
+        RK_U32    sw_y_hor_virstride : 9;
+        RK_U32    reserve : 2;
+        RK_U32    sw_slice_num_highbit : 1;
+        RK_U32    sw_uv_hor_virstride : 9;
+        RK_U32    sw_slice_num_lowbits : 11;
+    } swreg3_picpar;
+
+    struct {
+        RK_U32    sw_strm_rlc_base;
+    } swreg4_strm_rlc_base;
+
+    struct {
+        RK_U32 sw_stream_len : 27;
+    } swreg5_stream_rlc_len;
+
+    struct {
+        RK_U32    sw_cabactbl_base;
+    } swreg6_cabactbl_prob_base;
+
+    struct {
+        RK_U32    sw_decout_base;
+    } swreg7_decout_base;
+
+    struct {
+        RK_U32    sw_y_virstride : 20;
+    } swreg8_y_virstride;
+
+    struct {
+        RK_U32    sw_yuv_virstride : 21;
+    } swreg9_yuv_virstride;
+
+    struct {
+        RK_U32 sw_refer_base : 10;
+        RK_U32 sw_ref_field : 1;
+        RK_U32 sw_ref_topfield_used : 1;
+        RK_U32 sw_ref_botfield_used : 1;
+        RK_U32 sw_ref_colmv_use_flag : 1;
+    } swreg10_24_refer0_14_base[15];
+
+    RK_S32   swreg25_39_refer0_14_poc[15];
+
+    struct {
+        RK_S32 sw_cur_poc : 32;
+    } swreg40_cur_poc;
+
+    struct {
+        RK_U32 sw_rlcwrite_base;
+    } swreg41_rlcwrite_base;
+
+    struct {
+        RK_U32 sw_pps_base;
+    } swreg42_pps_base;
+
+    struct {
+        RK_U32 sw_rps_base;
+    } swreg43_rps_base;
+
+    struct {
+        RK_U32 sw_strmd_error_e : 28;
+        RK_U32 reserve : 4;
+    } swreg44_strmd_error_en;
+
+    struct {
+        RK_U32 sw_strmd_error_status : 28;
+        RK_U32 sw_colmv_error_ref_picidx : 4;
+    } swreg45_strmd_error_status;
+
+    struct {
+        RK_U32 sw_strmd_error_ctu_xoffset : 8;
+        RK_U32 sw_strmd_error_ctu_yoffset : 8;
+        RK_U32 sw_streamfifo_space2full : 7;
+        RK_U32 reserve : 1;
+        RK_U32 sw_vp9_error_ctu0_en : 1;
+    } swreg46_strmd_error_ctu;
+
+    struct {
+        RK_U32 sw_saowr_xoffet : 9;
+        RK_U32 reserve : 7;
+        RK_U32 sw_saowr_yoffset : 10;
+    } swreg47_sao_ctu_position;
+
+    struct {
+        RK_U32 sw_ref_valid : 15;
+    } swreg48_ref_valid;
+
+    RK_U32   swreg49_63_reserved[15];
+
+    RK_U32   swreg64_71_performance[8];
+
+    RK_U32   swreg72_77_reserved[6];
+
+    struct {
+        RK_U32 sw_colmv_base;
+    } swreg78_colmv_cur_base;
+
+    struct {
+        RK_U32 sw_colmv_base;
+    } swreg79_93_colmv0_14_base[15];
+
+    RK_U32   swreg94_reserved;
+} RKVDEC341RegHEVC;
+
+typedef struct RKVDEC341HEVCTask {
+    RKVDEC341RegHEVC    reg;
+    AVFrame             *syntax_data;
+    AVFrame             *cabac_data;
+    AVFrame             *pps_data;
+    AVFrame             *rps_data;
+    AVFrame             *scaling_list_data;
+    AVFrame             *stream_data;
+} RKVDEC341HEVCTask;
+
+typedef struct RKVDEC341HEVCContext {
+    /* must be first, see RKVDECCapture */
+    RKVDECCapture       capture;
+    RK_S32              capture_mode;
+    RK_S32              dev_fd;
+    os_allocator        dma_allocator;
+    void*               dma_allocator_ctx;
+    RKVDEC341HEVCTask   task[RKVDEC_MAX_TASKS];
+    RK_U32              prepare_idx;
+    RK_U32              wait_idx;
+} RKVDEC341HEVCContext;
+
+extern struct RKVDECDevice rkvdec341_hevc;
+extern struct RKVDECDevice rkvdec341_hevc_capture;
+
+static RK_U32 rkvdec341_hevc_offset(AVFrame *base, AVFrame *sub) {
+    return ff_rkvdec_get_dma_fd(base) +
+           ((ff_rkvdec_get_dma_ptr(sub) - ff_rkvdec_get_dma_ptr(base)) << 10);
+}
+
+/* initial context states for each init type and slice QP, as in 9.3.2.2 */
+static void rkvdec341_hevc_fill_cabac(RK_U8 *ptr) {
+    RK_S32 init_type, qp, i;
+
+    for (init_type = 0; init_type < 3; init_type++) {
+        for (qp = 0; qp < 52; qp++) {
+            for (i = 0; i < HEVC_CONTEXTS; i++) {
+                RK_S32 init_value = ff_hevc_cabac_init_values[init_type][i];
+                RK_S32 m = (init_value >> 4) * 5 - 45;
+                RK_S32 n = ((init_value & 15) << 3) - 16;
+                RK_S32 pre = 2 * (((m * qp) >> 4) + n) - 127;
+
+                pre ^= pre >> 31;
+                if (pre > 124)
+                    pre = 124 + (pre & 1);
+                ptr[i] = pre;
+            }
+            ptr += RKVDEC341HEVC_CABAC_CTX_NUM;
+        }
+    }
+}
+
+static void rkvdec341_hevc_fill_pps(RKVDEC341HEVCTask *task, RKVDECPicParamsHEVC *pp) {
+    PutBitContext64 bp;
+    uint64_t entry[RKVDEC341HEVC_PPS_ENTRY_SIZE / 8];
+    RK_U8 *ptr;
+    RK_S32 i;
+
+    memset(entry, 0, sizeof(entry));
+    init_put_bits_a64(&bp, entry, FF_ARRAY_ELEMS(entry));
+
+    // sps
+    put_bits_a64(&bp, 4, pp->video_parameter_set_id);
+    put_bits_a64(&bp, 4, pp->sps_id);
+    put_bits_a64(&bp, 2, pp->chroma_format_idc);
+    put_bits_a64(&bp, 13, pp->frame_width);
+    put_bits_a64(&bp, 13, pp->frame_height);
+    put_bits_a64(&bp, 4, pp->bit_depth_luma_minus8 + 8);
+    put_bits_a64(&bp, 4, pp->bit_depth_chroma_minus8 + 8);
+    put_bits_a64(&bp, 5, pp->log2_max_pic_order_cnt_lsb_minus4 + 4);
+    put_bits_a64(&bp, 2, pp->log2_diff_max_min_luma_coding_block_size);
+    put_bits_a64(&bp, 3, pp->log2_min_luma_coding_block_size_minus3 + 3);
+    put_bits_a64(&bp, 3, pp->log2_min_transform_block_size_minus2 + 2);
+    put_bits_a64(&bp, 2, pp->log2_diff_max_min_transform_block_size);
+    put_bits_a64(&bp, 3, pp->max_transform_hierarchy_depth_inter);
+    put_bits_a64(&bp, 3, pp->max_transform_hierarchy_depth_intra);
+    put_bits_a64(&bp, 1, pp->scaling_list_enabled_flag);
+    put_bits_a64(&bp, 1, pp->amp_enabled_flag);
+    put_bits_a64(&bp, 1, pp->sample_adaptive_offset_enabled_flag);
+    put_bits_a64(&bp, 1, pp->pcm_enabled_flag);
+    put_bits_a64(&bp, 4, pp->pcm_enabled_flag ? pp->pcm_sample_bit_depth_luma_minus1 + 1 : 0);
+    put_bits_a64(&bp, 4, pp->pcm_enabled_flag ? pp->pcm_sample_bit_depth_chroma_minus1 + 1 : 0);
+    put_bits_a64(&bp, 1, pp->pcm_loop_filter_disabled_flag);
+    put_bits_a64(&bp, 3, pp->log2_diff_max_min_pcm_luma_coding_block_size);
+    put_bits_a64(&bp, 3, pp->pcm_enabled_flag ? pp->log2_min_pcm_luma_coding_block_size_minus3 + 3 : 0);
+    put_bits_a64(&bp, 7, pp->num_short_term_ref_pic_sets);
+    put_bits_a64(&bp, 1, pp->long_term_ref_pics_present_flag);
+    put_bits_a64(&bp, 6, pp->num_long_term_ref_pics_sps);
+    put_bits_a64(&bp, 1, pp->sps_temporal_mvp_enabled_flag);
+    put_bits_a64(&bp, 1, pp->strong_intra_smoothing_enabled_flag);
+    put_bits_a64(&bp, 7, 0);
+    put_align_a64(&bp, 32, 0);
+
+    // pps
+    put_bits_a64(&bp, 6, pp->pps_id);
+    put_bits_a64(&bp, 4, pp->sps_id);
+    put_bits_a64(&bp, 1, pp->dependent_slice_segments_enabled_flag);
+    put_bits_a64(&bp, 1, pp->output_flag_present_flag);
+    put_bits_a64(&bp, 13, pp->num_extra_slice_header_bits);
+    put_bits_a64(&bp, 1, pp->sign_data_hiding_enabled_flag);
+    put_bits_a64(&bp, 1, pp->cabac_init_present_flag);
+    put_bits_a64(&bp, 4, pp->num_ref_idx_l0_default_active_minus1 + 1);
+    put_bits_a64(&bp, 4, pp->num_ref_idx_l1_default_active_minus1 + 1);
+    put_bits_a64(&bp, 7, pp->init_qp_minus26);
+    put_bits_a64(&bp, 1, pp->constrained_intra_pred_flag);
+    put_bits_a64(&bp, 1, pp->transform_skip_enabled_flag);
+    put_bits_a64(&bp, 1, pp->cu_qp_delta_enabled_flag);
+    put_bits_a64(&bp, 3, pp->log2_min_luma_coding_block_size_minus3 + 3 +
+                         pp->log2_diff_max_min_luma_coding_block_size - pp->diff_cu_qp_delta_depth);
+    put_bits_a64(&bp, 5, pp->pps_cb_qp_offset);
+    put_bits_a64(&bp, 5, pp->pps_cr_qp_offset);
+    put_bits_a64(&bp, 1, pp->pps_slice_chroma_qp_offsets_present_flag);
+    put_bits_a64(&bp, 1, pp->weighted_pred_flag);
+    put_bits_a64(&bp, 1, pp->weighted_bipred_flag);
+    put_bits_a64(&bp, 1, pp->transquant_bypass_enabled_flag);
+    put_bits_a64(&bp, 1, pp->tiles_enabled_flag);
+    put_bits_a64(&bp, 1, pp->entropy_coding_sync_enabled_flag);
+    put_bits_a64(&bp, 1, pp->pps_loop_filter_across_slices_enabled_flag);
+    put_bits_a64(&bp, 1, pp->loop_filter_across_tiles_enabled_flag);
+    put_bits_a64(&bp, 1, pp->deblocking_filter_override_enabled_flag);
+    put_bits_a64(&bp, 1, pp->pps_deblocking_filter_disabled_flag);
+    put_bits_a64(&bp, 4, pp->pps_beta_offset_div2);
+    put_bits_a64(&bp, 4, pp->pps_tc_offset_div2);
+    put_bits_a64(&bp, 1, pp->lists_modification_present_flag);
+    put_bits_a64(&bp, 3, pp->log2_parallel_merge_level_minus2 + 2);
+    put_bits_a64(&bp, 1, pp->slice_segment_header_extension_present_flag);
+    put_bits_a64(&bp, 3, 0);
+    put_bits_a64(&bp, 5, pp->tiles_enabled_flag ? pp->num_tile_columns_minus1 + 1 : 0);
+    put_bits_a64(&bp, 5, pp->tiles_enabled_flag ? pp->num_tile_rows_minus1 + 1 : 0);
+    put_bits_a64(&bp, 2, 0);
+    put_align_a64(&bp, 64, 0);
+
+    // tile sizes in CTBs
+    for (i = 0; i < 20; i++)
+        put_bits_a64(&bp, 8, pp->tiles_enabled_flag && i <= pp->num_tile_columns_minus1 ?
+                              pp->column_width_minus1[i] + 1 : 0);
+    for (i = 0; i < 22; i++)
+        put_bits_a64(&bp, 8, pp->tiles_enabled_flag && i <= pp->num_tile_rows_minus1 ?
+                              pp->row_height_minus1[i] + 1 : 0);
+
+    put_bits_a64(&bp, 32, rkvdec341_hevc_offset(task->syntax_data, task->scaling_list_data));
+    put_align_a64(&bp, 64, 0);
+
+    // the same entry for all 64 pps ids
+    ptr = ff_rkvdec_get_dma_ptr(task->pps_data);
+    for (i = 0; i < 64; i++)
+        memcpy(ptr + i * RKVDEC341HEVC_PPS_ENTRY_SIZE, entry, RKVDEC341HEVC_PPS_ENTRY_SIZE);
+}
+
+static void rkvdec341_hevc_fill_rps(RKVDEC341HEVCTask *task, RKVDECPicParamsHEVC *pp) {
+    RK_U8 *ptr = ff_rkvdec_get_dma_ptr(task->rps_data);
+    PutBitContext64 bp;
+    RK_U32 s;
+    RK_S32 list, i;
+
+    memset(ptr, 0, pp->nb_slices * RKVDEC341HEVC_RPS_ENTRY_SIZE);
+
+    for (s = 0; s < pp->nb_slices; s++) {
+        const RKVDECSliceRefsHEVC *refs = &pp->slices[s];
+
+        init_put_bits_a64(&bp, ptr + s * RKVDEC341HEVC_RPS_ENTRY_SIZE,
+                          RKVDEC341HEVC_RPS_ENTRY_SIZE / 8);
+        for (list = 0; list < 2; list++) {
+            put_bits_a64(&bp, 4, refs->nb_refs[list]);
+            for (i = 0; i < 15; i++) {
+                RK_U32 idx = refs->ref_idx[list][i];
+                RK_U32 valid = i < refs->nb_refs[list] && idx < 16;
+
+                put_bits_a64(&bp, 4, valid ? idx : 0);
+                put_bits_a64(&bp, 1, valid ? pp->DPB[idx].lt : 0);
+            }
+        }
+    }
+}
+
+static void rkvdec341_hevc_fill_scaling_list(RKVDEC341HEVCTask *task, RKVDECPicParamsHEVC *pp) {
+    RK_U8 *ptr = ff_rkvdec_get_dma_ptr(task->scaling_list_data);
+
+    memset(ptr, 0, RKVDEC341HEVC_SCALING_LIST_SIZE);
+    if (!pp->scaling_list_enabled_flag)
+        return;
+
+    memcpy(ptr, pp->scaling_lists4x4, sizeof(pp->scaling_lists4x4));
+    ptr += sizeof(pp->scaling_lists4x4);
+    memcpy(ptr, pp->scaling_lists8x8, sizeof(pp->scaling_lists8x8));
+    ptr += sizeof(pp->scaling_lists8x8);
+    memcpy(ptr, pp->scaling_lists16x16, sizeof(pp->scaling_lists16x16));
+    ptr += sizeof(pp->scaling_lists16x16);
+    memcpy(ptr, pp->scaling_lists32x32, sizeof(pp->scaling_lists32x32));
+    ptr += sizeof(pp->scaling_lists32x32);
+    memcpy(ptr, pp->scaling_list_dc16x16, sizeof(pp->scaling_list_dc16x16));
+    ptr += sizeof(pp->scaling_list_dc16x16);
+    memcpy(ptr, pp->scaling_list_dc32x32, sizeof(pp->scaling_list_dc32x32));
+}
+
+static RK_S32 rkvdec341_hevc_prepare(void *p, void *pkt, void *param) {
+    RKVDEC341HEVCContext *ctx = (RKVDEC341HEVCContext*)p;
+    AVPacket *data = (AVPacket*)pkt;
+    RKVDECPicParamsHEVC *pp = (RKVDECPicParamsHEVC*)param;
+    RKVDEC341HEVCTask *task = &ctx->task[ctx->prepare_idx];
+    RKVDEC341RegHEVC *reg = &task->reg;
+    RK_U32 stride = ALIGN(pp->frame_width, 16);
+    RK_U32 height = ALIGN(pp->frame_height, 16);
+    RK_S32 i;
+
+    if (pp->chroma_format_idc != 1 || pp->bit_depth_luma_minus8 || pp->bit_depth_chroma_minus8)
+        return AVERROR_PATCHWELCOME;
+
+    //stream, already written in place by the hwaccel
+    task->stream_data = (AVFrame*)data->buf->data;
+    task->stream_data->pkt_size = data->size;
+
+    rkvdec341_hevc_fill_pps(task, pp);
+    rkvdec341_hevc_fill_rps(task, pp);
+    rkvdec341_hevc_fill_scaling_list(task, pp);
+
+    // regs
+    memset(reg, 0, sizeof(RKVDEC341RegHEVC));
+
+    reg->swreg2_sysctrl.sw_dec_mode = 0;
+    reg->swreg3_picpar.sw_slice_num_lowbits = 0x7ff;
+    reg->swreg3_picpar.sw_slice_num_highbit = 1;
+    reg->swreg3_picpar.sw_y_hor_virstride = stride / 16;
+    reg->swreg3_picpar.sw_uv_hor_virstride = stride / 16;
+    reg->swreg5_stream_rlc_len.sw_stream_len = ALIGN(task->stream_data->pkt_size, 16);
+    reg->swreg8_y_virstride.sw_y_virstride = stride * height / 16;
+    reg->swreg9_yuv_virstride.sw_yuv_virstride = stride * height * 3 / 2 / 16;
+    reg->swreg40_cur_poc.sw_cur_poc = pp->curr_pic.field_poc[0];
+    reg->swreg7_decout_base.sw_decout_base = pp->curr_pic.index;
+    reg->swreg78_colmv_cur_base.sw_colmv_base = pp->curr_mv;
+
+    for (i = 0; i < 15; i++) {
+        if (pp->DPB[i].valid) {
+            reg->swreg10_24_refer0_14_base[i].sw_refer_base = pp->DPB[i].index;
+            reg->swreg25_39_refer0_14_poc[i] = pp->DPB[i].field_poc[0];
+            reg->swreg48_ref_valid.sw_ref_valid |= 1 << i;
+        } else {
+            // unused entries point to a valid buffer
+            reg->swreg10_24_refer0_14_base[i].sw_refer_base = pp->curr_pic.index;
+        }
+        reg->swreg10_24_refer0_14_base[i].sw_ref_colmv_use_flag = pp->sps_temporal_mvp_enabled_flag;
+
+        reg->swreg79_93_colmv0_14_base[i].sw_colmv_base =
+            pp->DPB[i].valid && pp->ref_colmv_list[i] ? pp->ref_colmv_list[i] : pp->curr_mv;
+    }
+
+    reg->swreg4_strm_rlc_base.sw_strm_rlc_base = ff_rkvdec_get_dma_fd(task->stream_data);
+    reg->swreg41_rlcwrite_base.sw_rlcwrite_base = reg->swreg4_strm_rlc_base.sw_strm_rlc_base;
+    reg->swreg6_cabactbl_prob_base.sw_cabactbl_base = ff_rkvdec_get_dma_fd(task->syntax_data);
+    reg->swreg42_pps_base.sw_pps_base = rkvdec341_hevc_offset(task->syntax_data, task->pps_data);
+    reg->swreg43_rps_base.sw_rps_base = rkvdec341_hevc_offset(task->syntax_data, task->rps_data);
+
+    if (reg->swreg78_colmv_cur_base.sw_colmv_base)
+        reg->swreg2_sysctrl.sw_colmv_mode = 1;
+
+    reg->swreg44_strmd_error_en.sw_strmd_error_e = 0xfffffff;
+    reg->swreg1_int.sw_dec_e = 1;
+    reg->swreg1_int.sw_dec_timeout_e = 1;
+    reg->swreg1_int.sw_buf_empty_en = 1;
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_hevc_submit(void *p) {
+    RKVDEC341HEVCContext *ctx = (RKVDEC341HEVCContext*)p;
+    RKVDEC341HEVCTask *task = &ctx->task[ctx->prepare_idx];
+    RKVDECHwReq req;
+
+    if (ctx->capture_mode) {
+        ff_rkvdec_capture_task(&ctx->capture, "vdpu341 hevc", &task->reg, RKVDEC341HEVC_REG_NUM,
+                               task->syntax_data, task->stream_data);
+    } else {
+        req.req = (RK_U32*)&task->reg;
+        req.size = RKVDEC341HEVC_REG_NUM * sizeof(RK_U32);
+
+        if (ioctl(ctx->dev_fd, RKVDEC_IOC_SET_REG, &req))
+            return AVERROR_INVALIDDATA;
+    }
+
+    ctx->prepare_idx = (ctx->prepare_idx + 1) % RKVDEC_MAX_TASKS;
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_hevc_wait(void *p) {
+    RKVDEC341HEVCContext *ctx = (RKVDEC341HEVCContext*)p;
+    RKVDEC341HEVCTask *task = &ctx->task[ctx->wait_idx];
+    RKVDECHwReq req;
+
+    ctx->wait_idx = (ctx->wait_idx + 1) % RKVDEC_MAX_TASKS;
+
+    if (ctx->capture_mode)
+        return 0;
+
+    req.req = (RK_U32*)&task->reg;
+    req.size = RKVDEC341HEVC_REG_NUM * sizeof(RK_U32);
+
+    if (ioctl(ctx->dev_fd, RKVDEC_IOC_GET_REG, &req))
+        return AVERROR_INVALIDDATA;
+
+    if (task->reg.swreg1_int.sw_dec_error_sta
+        || (!task->reg.swreg1_int.sw_dec_rdy_sta)
+        || task->reg.swreg1_int.sw_dec_empty_sta
+        || task->reg.swreg45_strmd_error_status.sw_strmd_error_status
+        || task->reg.swreg45_strmd_error_status.sw_colmv_error_ref_picidx)
+        return AVERROR_INVALIDDATA;
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_hevc_perform(void *p) {
+    RKVDEC341HEVCContext *ctx = (RKVDEC341HEVCContext*)p;
+
+    if (rkvdec341_hevc_submit(ctx))
+        return AVERROR_INVALIDDATA;
+
+    return rkvdec341_hevc_wait(ctx);
+}
+
+static void rkvdec341_hevc_free_task(RKVDEC341HEVCContext *ctx, RKVDEC341HEVCTask *task) {
+    if (task->syntax_data && ff_rkvdec_get_dma_ptr(task->syntax_data))
+        ctx->dma_allocator.free(ctx->dma_allocator_ctx, task->syntax_data);
+    av_frame_free(&task->syntax_data);
+    av_frame_free(&task->cabac_data);
+    av_frame_free(&task->pps_data);
+    av_frame_free(&task->rps_data);
+    av_frame_free(&task->scaling_list_data);
+    task->stream_data = NULL;
+}
+
+static RK_S32 rkvdec341_hevc_uninit(void* p) {
+    RKVDEC341HEVCContext *ctx = (RKVDEC341HEVCContext*)p;
+    RK_S32 i;
+
+    if (ctx->dev_fd > 0) {
+        close(ctx->dev_fd);
+        ctx->dev_fd = -1;
+    }
+    for (i = 0; i < RKVDEC_MAX_TASKS; i++)
+        rkvdec341_hevc_free_task(ctx, &ctx->task[i]);
+    if (ctx->dma_allocator_ctx)
+        ctx->dma_allocator.close(ctx->dma_allocator_ctx);
+    ff_rkvdec_capture_close(&ctx->capture);
+
+    return 0;
+}
+
+static AVFrame *rkvdec341_hevc_sub_buffer(AVFrame *prev, RK_U32 prev_size, RK_U32 size) {
+    AVFrame *sub = av_frame_alloc();
+
+    if (!sub)
+        return NULL;
+    sub->linesize[0] = size;
+    sub->data[0] = ff_rkvdec_get_dma_ptr(prev) + prev_size;
+
+    return sub;
+}
+
+static RK_S32 rkvdec341_hevc_init_task(RKVDEC341HEVCContext *ctx, RKVDEC341HEVCTask *task) {
+    task->syntax_data = av_frame_alloc();
+    if (!task->syntax_data)
+        return AVERROR(ENOMEM);
+    task->syntax_data->linesize[0] = RKVDEC341HEVC_CABAC_TAB_SIZE +
+                                     RKVDEC341HEVC_PPS_SIZE +
+                                     RKVDEC341HEVC_RPS_SIZE +
+                                     RKVDEC341HEVC_SCALING_LIST_SIZE;
+    if (ctx->dma_allocator.alloc(ctx->dma_allocator_ctx, task->syntax_data))
+        return AVERROR(ENOMEM);
+
+    task->cabac_data = rkvdec341_hevc_sub_buffer(task->syntax_data, 0, RKVDEC341HEVC_CABAC_TAB_SIZE);
+    if (!task->cabac_data)
+        return AVERROR(ENOMEM);
+    rkvdec341_hevc_fill_cabac(ff_rkvdec_get_dma_ptr(task->cabac_data));
+
+    task->pps_data = rkvdec341_hevc_sub_buffer(task->cabac_data, RKVDEC341HEVC_CABAC_TAB_SIZE,
+                                               RKVDEC341HEVC_PPS_SIZE);
+    if (!task->pps_data)
+        return AVERROR(ENOMEM);
+
+    task->rps_data = rkvdec341_hevc_sub_buffer(task->pps_data, RKVDEC341HEVC_PPS_SIZE,
+                                               RKVDEC341HEVC_RPS_SIZE);
+    if (!task->rps_data)
+        return AVERROR(ENOMEM);
+
+    task->scaling_list_data = rkvdec341_hevc_sub_buffer(task->rps_data, RKVDEC341HEVC_RPS_SIZE,
+                                                        RKVDEC341HEVC_SCALING_LIST_SIZE);
+    if (!task->scaling_list_data)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_hevc_init_common(RKVDEC341HEVCContext *ctx, const RKVDECDevice *dev) {
+    RK_S32 i, ret;
+
+    ctx->dma_allocator = *dev->allocator;
+    if (ctx->dma_allocator.open(&ctx->dma_allocator_ctx, 1))
+        return AVERROR_UNKNOWN;
+
+    for (i = 0; i < RKVDEC_MAX_TASKS; i++) {
+        ret = rkvdec341_hevc_init_task(ctx, &ctx->task[i]);
+        if (ret)
+            return ret;
+    }
+    ctx->prepare_idx = 0;
+    ctx->wait_idx = 0;
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_hevc_init(void *p) {
+    RKVDEC341HEVCContext *ctx = (RKVDEC341HEVCContext*)p;
+
+    ctx->dev_fd = open(rkvdec341_hevc.dev, O_RDWR);
+    if (ctx->dev_fd <= 0)
+        return AVERROR_DECODER_NOT_FOUND;
+
+    if(ioctl(ctx->dev_fd, RKVDEC_IOC_SET_CLIENT_TYPE, 0x1)) {
+        if (ioctl(ctx->dev_fd, RKVDEC_IOC_SET_CLIENT_TYPE_U32, 0x1)) {
+            return AVERROR_DECODER_NOT_FOUND;
+        }
+    }
+
+    return rkvdec341_hevc_init_common(ctx, &rkvdec341_hevc);
+}
+
+static RK_S32 rkvdec341_hevc_capture_init(void *p) {
+    RKVDEC341HEVCContext *ctx = (RKVDEC341HEVCContext*)p;
+    RK_S32 ret;
+
+    ctx->dev_fd = -1;
+    ctx->capture_mode = 1;
+
+    ret = ff_rkvdec_capture_open(&ctx->capture);
+    if (ret)
+        return ret;
+
+    return rkvdec341_hevc_init_common(ctx, &rkvdec341_hevc_capture);
+}
+
+struct RKVDECDevice rkvdec341_hevc = {
+    .name   = "vdpu341",
+    .dev    = "/dev/rkvdec",
+    .allocator = &allocator_drm_pool,
+    .priv_data_size = sizeof(RKVDEC341HEVCContext),
+    .init       = rkvdec341_hevc_init,
+    .uninit     = rkvdec341_hevc_uninit,
+    .prepare    = rkvdec341_hevc_prepare,
+    .perform    = rkvdec341_hevc_perform,
+    .submit     = rkvdec341_hevc_submit,
+    .wait       = rkvdec341_hevc_wait,
+};
+
+struct RKVDECDevice rkvdec341_hevc_capture = {
+    .name   = "capture",
+    .allocator = &allocator_memfd_pool,
+    .priv_data_size = sizeof(RKVDEC341HEVCContext),
+    .init       = rkvdec341_hevc_capture_init,
+    .uninit     = rkvdec341_hevc_uninit,
+    .prepare    = rkvdec341_hevc_prepare,
+    .perform    = rkvdec341_hevc_perform,
+    .submit     = rkvdec341_hevc_submit,
+    .wait       = rkvdec341_hevc_wait,
+};
@@ -0,0 +1,626 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * VP9 on the vdpu341 (RKVDEC) block. The hardware decodes the compressed
+ * header and the tiles, it gets the probabilities the compressed header
+ * starts from as a packed table and writes back the symbol counts for the
+ * backward adaptation.
+ *
+ * The "capture" device runs the same preparation without the kernel driver,
+ * see RKVDECCapture.
+ */
+
+#include "libavutil/frame.h"
+#include "libavutil/avassert.h"
+#include "libavcodec/avcodec.h"
+#include "libavcodec/internal.h"
+#include "vp9data.h"
+#include "rkvdec_vp9.h"
+#include "put_bits64.h"
+#include "allocator_pool.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#define RKVDEC341VP9_PROB_SIZE              4864                      /* bytes */
+#define RKVDEC341VP9_COUNT_SIZE             ALIGN(sizeof(RKVDECCountsVP9), 128) /* bytes */
+
+#define RKVDEC341VP9_REG_NUM                95
+
+typedef struct RKVDEC341RegVP9 {
+    RK_U32  swreg0_id;
+
+    struct {
+        RK_U32    sw_dec_e : 1;
+        RK_U32    sw_dec_clkgate_e : 1;
+        RK_U32    reserve0 : 1;
+        RK_U32    sw_timeout_mode : 1;
+        RK_U32    sw_dec_irq_dis : 1;
+        RK_U32    sw_dec_timeout_e : 1;
+        RK_U32    sw_buf_empty_en : 1;
+        RK_U32    sw_stmerror_waitdecfifo_empty : 1;
+        RK_U32    sw_dec_irq : 1;
+        RK_U32    sw_dec_irq_raw : 1;
+        RK_U32    reserve2 : 2;
+        RK_U32    sw_dec_rdy_sta : 1;
+        RK_U32    sw_dec_bus_sta : 1;
+        RK_U32    sw_dec_error_sta : 1;
+        RK_U32    sw_dec_timeout_sta : 1;
+        RK_U32    sw_dec_empty_sta : 1;
+        RK_U32    sw_colmv_ref_error_sta : 1;
+        RK_U32    sw_cabu_end_sta : 1;
+        RK_U32    sw_h264orvp9_error_mode : 1;
+        RK_U32    sw_softrst_en_p : 1;
+        RK_U32    sw_force_softreset_valid : 1;
+        RK_U32    sw_softreset_rdy : 1;
+    } swreg1_int;
+
+    struct {
+        RK_U32    sw_in_endian : 1;
+        RK_U32    sw_in_swap32_e : 1;
+        RK_U32    sw_in_swap64_e : 1;
+        RK_U32    sw_str_endian : 1;
+        RK_U32    sw_str_swap32_e : 1;
+        RK_U32    sw_str_swap64_e : 1;
+        RK_U32    sw_out_endian : 1;
+        RK_U32    sw_out_swap32_e : 1;
+        RK_U32    sw_out_cbcr_swap : 1;
+        RK_U32    reserve0 : 1;
+        RK_U32    sw_rlc_mode_direct_write : 1;
+        RK_U32    sw_rlc_mode : 1;
+        RK_U32    sw_strm_start_bit : 7;
+        RK_U32    reserve1 : 1;
+        RK_U32    sw_dec_mode : 2;
+        RK_U32    reserve2 : 2;
+        RK_U32    reserve3 : 5;
+        RK_U32    sw_buspr_slot_disable : 1;
+        RK_U32    sw_colmv_mode : 1;
+        RK_U32    sw_ycacherd_prior : 1;
+    } swreg2_sysctrl;
+
+    struct {
+        RK_U32    sw_y_hor_virstride : 9;
+        RK_U32    reserve : 3;
+        RK_U32    sw_uv_hor_virstride : 9;
+        RK_U32    sw_slice_num : 11;
+    } swreg3_picpar;
+
+    RK_U32  swreg4_strm_rlc_base;
+
+    struct {
+        RK_U32 sw_stream_len : 27;
+    } swreg5_stream_rlc_len;
+
+    RK_U32  swreg6_cabactbl_prob_base;
+
+    RK_U32  swreg7_decout_base;
+
+    struct {
+        RK_U32 sw_y_virstride : 20;
+    } swreg8_y_virstride;
+
+    struct {
+        RK_U32 sw_yuv_virstride : 21;
+    } swreg9_yuv_virstride;
+
+    struct {
+        RK_U32 sw_vp9_cprheader_offset : 16;
+    } swreg10_vp9_cprheader_offset;
+
+    /* last, golden, altref */
+    RK_U32  swreg11_13_vp9_refer_base[3];
+
+    RK_U32  swreg14_vp9_count_base;
+
+    RK_U32  swreg15_vp9_segidlast_base;
+
+    RK_U32  swreg16_vp9_segidcur_base;
+
+    struct {
+        RK_U32 sw_framewidth : 16;
+        RK_U32 sw_frameheight : 16;
+    } swreg17_19_vp9_frame_size[3];
+
+    struct {
+        RK_U32 sw_vp9segid_abs_delta : 1;
+        RK_U32 sw_vp9segid_frame_qp_delta_en : 1;
+        RK_U32 sw_vp9segid_frame_qp_delta : 9;
+        RK_U32 sw_vp9segid_frame_loopfilter_value_en : 1;
+        RK_U32 sw_vp9segid_frame_loopfilter_value : 7;
+        RK_U32 sw_vp9segid_referinfo_en : 1;
+        RK_U32 sw_vp9segid_referinfo : 2;
+        RK_U32 sw_vp9segid_frame_skip_en : 1;
+    } swreg20_27_vp9_segid_grp[8];
+
+    struct {
+        RK_U32 sw_vp9_tx_mode : 3;
+        RK_U32 sw_vp9_frame_reference_mode : 2;
+    } swreg28_vp9_cprheader_config;
+
+    struct {
+        RK_U32 sw_hor_scale : 16;
+        RK_U32 sw_ver_scale : 16;
+    } swreg29_31_vp9_ref_scale[3];
+
+    struct {
+        RK_U32 sw_vp9_ref_deltas_lastframe : 28;
+    } swreg32_vp9_ref_deltas_lastframe;
+
+    struct {
+        RK_U32 sw_vp9_mode_deltas_lastframe : 14;
+        RK_U32 reserve0 : 2;
+        RK_U32 sw_segmentation_enable_lstframe : 1;
+        RK_U32 sw_vp9_last_show_frame : 1;
+        RK_U32 sw_vp9_last_intra_only : 1;
+        RK_U32 sw_vp9_last_widthheight_eqcur : 1;
+        RK_U32 sw_vp9_color_space_lastkeyframe : 3;
+    } swreg33_vp9_info_lastframe;
+
+    RK_U32  swreg34_vp9_intercmd_base;
+
+    struct {
+        RK_U32 sw_vp9_intercmd_num : 24;
+    } swreg35_vp9_intercmd_num;
+
+    struct {
+        RK_U32 sw_vp9_lasttile_size : 24;
+    } swreg36_vp9_lasttile_size;
+
+    struct {
+        RK_U32 sw_y_hor_virstride : 9;
+        RK_U32 reserve : 7;
+        RK_U32 sw_uv_hor_virstride : 9;
+    } swreg37_39_vp9_ref_hor_virstride[3];
+
+    RK_U32  swreg40_cur_poc;
+
+    RK_U32  swreg41_rlcwrite_base;
+
+    RK_U32  swreg42_pps_base;
+
+    RK_U32  swreg43_rps_base;
+
+    struct {
+        RK_U32 sw_strmd_error_e : 28;
+        RK_U32 reserve : 4;
+    } swreg44_strmd_error_en;
+
+    struct {
+        RK_U32 sw_strmd_error_status : 28;
+        RK_U32 sw_colmv_error_ref_picidx : 4;
+    } swreg45_strmd_error_status;
+
+    RK_U32  swreg46_strmd_error_ctu;
+
+    RK_U32  swreg47_sao_ctu_position;
+
+    struct {
+        RK_U32 sw_y_virstride : 20;
+    } swreg48_50_vp9_ref_y_virstride[3];
+
+    struct {
+        RK_U32 sw_yuv_virstride : 21;
+    } swreg51_vp9_lastref_yuv_virstride;
+
+    RK_U32  swreg52_vp9_refcolmv_base;
+
+    RK_U32  swreg53_63_reserved[11];
+
+    RK_U32  swreg64_71_performance[8];
+
+    RK_U32  swreg72_94_reserved[23];
+} RKVDEC341RegVP9;
+
+typedef struct RKVDEC341VP9Task {
+    RKVDEC341RegVP9     reg;
+    AVFrame             *prob_data;
+    AVFrame             *count_data;
+    AVFrame             *stream_data;
+    /* where the counts go once decoded, NULL if not needed */
+    RKVDECCountsVP9     *counts;
+} RKVDEC341VP9Task;
+
+typedef struct RKVDEC341VP9Context {
+    /* must be first, see RKVDECCapture */
+    RKVDECCapture       capture;
+    RK_S32              capture_mode;
+    RK_S32              dev_fd;
+    os_allocator        dma_allocator;
+    void*               dma_allocator_ctx;
+    RKVDEC341VP9Task    task[RKVDEC_MAX_TASKS];
+    RK_U32              prepare_idx;
+    RK_U32              wait_idx;
+} RKVDEC341VP9Context;
+
+extern struct RKVDECDevice rkvdec341_vp9;
+extern struct RKVDECDevice rkvdec341_vp9_capture;
+
+static void rkvdec341_vp9_put_bytes(PutBitContext64 *bp, const RK_U8 *p, int n) {
+    RK_S32 i;
+
+    for (i = 0; i < n; i++)
+        put_bits_a64(bp, 8, p[i]);
+}
+
+/* coefficient probabilities of one transform size and plane, 5 contexts per 128 bits */
+static void rkvdec341_vp9_put_coef(PutBitContext64 *bp, const RK_U8 (*coef)[6][6][3], RK_S32 nb_refs) {
+    RK_S32 ref, band, ctx, n = 0;
+
+    for (ref = 0; ref < nb_refs; ref++) {
+        for (band = 0; band < 6; band++) {
+            for (ctx = 0; ctx < (band ? 6 : 3); ctx++) {
+                rkvdec341_vp9_put_bytes(bp, coef[ref][band][ctx], 3);
+                if (++n == 5) {
+                    put_align_a64(bp, 128, 0);
+                    n = 0;
+                }
+            }
+        }
+    }
+    put_align_a64(bp, 128, 0);
+}
+
+static void rkvdec341_vp9_fill_probs(RKVDEC341VP9Task *task, RKVDECPicParamsVP9 *pp) {
+    const RKVDECProbsVP9 *p = &pp->probs;
+    RK_S32 intra = pp->keyframe || pp->intra_only;
+    PutBitContext64 bp;
+    RK_S32 i, j, tx, plane;
+
+    memset(ff_rkvdec_get_dma_ptr(task->prob_data), 0, RKVDEC341VP9_PROB_SIZE);
+    init_put_bits_a64(&bp, ff_rkvdec_get_dma_ptr(task->prob_data), RKVDEC341VP9_PROB_SIZE / 8);
+
+    // partition, segmentation, transform size and skip
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 4; j++)
+            rkvdec341_vp9_put_bytes(&bp, intra ? ff_vp9_default_kf_partition_probs[i][j] :
+                                                 p->partition[i][j], 3);
+    rkvdec341_vp9_put_bytes(&bp, pp->seg.tree_probs, 7);
+    rkvdec341_vp9_put_bytes(&bp, pp->seg.pred_probs, 3);
+    for (i = 0; i < 2; i++)
+        put_bits_a64(&bp, 8, p->tx8p[i]);
+    for (i = 0; i < 2; i++)
+        rkvdec341_vp9_put_bytes(&bp, p->tx16p[i], 2);
+    for (i = 0; i < 2; i++)
+        rkvdec341_vp9_put_bytes(&bp, p->tx32p[i], 3);
+    rkvdec341_vp9_put_bytes(&bp, p->skip, 3);
+    put_align_a64(&bp, 128, 0);
+
+    // intra frames only have intra blocks
+    for (tx = 0; tx < 4; tx++)
+        for (plane = 0; plane < 2; plane++)
+            rkvdec341_vp9_put_coef(&bp, (const RK_U8 (*)[6][6][3])p->coef[tx][plane], intra ? 1 : 2);
+
+    if (intra) {
+        for (i = 0; i < 10; i++)
+            for (j = 0; j < 10; j++)
+                rkvdec341_vp9_put_bytes(&bp, ff_vp9_default_kf_ymode_probs[i][j], 9);
+        put_align_a64(&bp, 128, 0);
+        for (i = 0; i < 10; i++)
+            rkvdec341_vp9_put_bytes(&bp, ff_vp9_default_kf_uvmode_probs[i], 9);
+        put_align_a64(&bp, 128, 0);
+        return;
+    }
+
+    for (i = 0; i < 7; i++)
+        rkvdec341_vp9_put_bytes(&bp, p->mv_mode[i], 3);
+    for (i = 0; i < 4; i++)
+        rkvdec341_vp9_put_bytes(&bp, p->filter[i], 2);
+    rkvdec341_vp9_put_bytes(&bp, p->intra, 4);
+    rkvdec341_vp9_put_bytes(&bp, p->comp, 5);
+    for (i = 0; i < 5; i++)
+        rkvdec341_vp9_put_bytes(&bp, p->single_ref[i], 2);
+    rkvdec341_vp9_put_bytes(&bp, p->comp_ref, 5);
+    put_align_a64(&bp, 128, 0);
+    for (i = 0; i < 4; i++)
+        rkvdec341_vp9_put_bytes(&bp, p->y_mode[i], 9);
+    put_align_a64(&bp, 128, 0);
+    for (i = 0; i < 10; i++)
+        rkvdec341_vp9_put_bytes(&bp, p->uv_mode[i], 9);
+    put_align_a64(&bp, 128, 0);
+
+    rkvdec341_vp9_put_bytes(&bp, p->mv_joint, 3);
+    for (i = 0; i < 2; i++) {
+        put_bits_a64(&bp, 8, p->mv_comp[i].sign);
+        rkvdec341_vp9_put_bytes(&bp, p->mv_comp[i].classes, 10);
+        put_bits_a64(&bp, 8, p->mv_comp[i].class0);
+        rkvdec341_vp9_put_bytes(&bp, p->mv_comp[i].bits, 10);
+    }
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 2; j++)
+            rkvdec341_vp9_put_bytes(&bp, p->mv_comp[i].class0_fp[j], 3);
+        rkvdec341_vp9_put_bytes(&bp, p->mv_comp[i].fp, 3);
+    }
+    for (i = 0; i < 2; i++) {
+        put_bits_a64(&bp, 8, p->mv_comp[i].class0_hp);
+        put_bits_a64(&bp, 8, p->mv_comp[i].hp);
+    }
+    put_align_a64(&bp, 128, 0);
+}
+
+static RK_S32 rkvdec341_vp9_prepare(void *p, void *pkt, void *param) {
+    RKVDEC341VP9Context *ctx = (RKVDEC341VP9Context*)p;
+    AVPacket *data = (AVPacket*)pkt;
+    RKVDECPicParamsVP9 *pp = (RKVDECPicParamsVP9*)param;
+    RKVDEC341VP9Task *task = &ctx->task[ctx->prepare_idx];
+    RKVDEC341RegVP9 *reg = &task->reg;
+    RK_U32 stride = ALIGN(pp->frame_width, 16);
+    RK_U32 height = ALIGN(pp->frame_height, 16);
+    RK_S32 i;
+
+    if (pp->bit_depth != 8 || !pp->subsampling_x || !pp->subsampling_y)
+        return AVERROR_PATCHWELCOME;
+
+    //stream, already written in place by the hwaccel
+    task->stream_data = (AVFrame*)data->buf->data;
+    task->stream_data->pkt_size = data->size;
+
+    rkvdec341_vp9_fill_probs(task, pp);
+
+    task->counts = pp->need_counts ? &pp->counts : NULL;
+
+    // regs
+    memset(reg, 0, sizeof(RKVDEC341RegVP9));
+
+    reg->swreg2_sysctrl.sw_dec_mode = 2;
+    reg->swreg3_picpar.sw_y_hor_virstride = stride / 16;
+    reg->swreg3_picpar.sw_uv_hor_virstride = stride / 16;
+    reg->swreg8_y_virstride.sw_y_virstride = stride * height / 16;
+    reg->swreg9_yuv_virstride.sw_yuv_virstride = stride * height * 3 / 2 / 16;
+
+    reg->swreg4_strm_rlc_base = ff_rkvdec_get_dma_fd(task->stream_data);
+    reg->swreg41_rlcwrite_base = reg->swreg4_strm_rlc_base;
+    reg->swreg5_stream_rlc_len.sw_stream_len = ALIGN(task->stream_data->pkt_size, 16);
+    reg->swreg10_vp9_cprheader_offset.sw_vp9_cprheader_offset = pp->uncompressed_header_size;
+
+    reg->swreg6_cabactbl_prob_base = ff_rkvdec_get_dma_fd(task->prob_data);
+    reg->swreg14_vp9_count_base = ff_rkvdec_get_dma_fd(task->count_data);
+    reg->swreg7_decout_base = pp->curr_pic.index;
+    reg->swreg15_vp9_segidlast_base = pp->segid_last;
+    reg->swreg16_vp9_segidcur_base = pp->segid_cur;
+    reg->swreg52_vp9_refcolmv_base = pp->colmv_ref;
+
+    for (i = 0; i < 3; i++) {
+        RK_U32 ref_w = pp->refs[i].valid ? pp->ref_width[i] : pp->frame_width;
+        RK_U32 ref_h = pp->refs[i].valid ? pp->ref_height[i] : pp->frame_height;
+        RK_U32 ref_stride = ALIGN(ref_w, 16);
+
+        // missing references point to a valid buffer
+        reg->swreg11_13_vp9_refer_base[i] = pp->refs[i].valid ? pp->refs[i].index : pp->curr_pic.index;
+        reg->swreg17_19_vp9_frame_size[i].sw_framewidth = ref_w;
+        reg->swreg17_19_vp9_frame_size[i].sw_frameheight = ref_h;
+        reg->swreg29_31_vp9_ref_scale[i].sw_hor_scale = (ref_w << 14) / pp->frame_width;
+        reg->swreg29_31_vp9_ref_scale[i].sw_ver_scale = (ref_h << 14) / pp->frame_height;
+        reg->swreg37_39_vp9_ref_hor_virstride[i].sw_y_hor_virstride = ref_stride / 16;
+        reg->swreg37_39_vp9_ref_hor_virstride[i].sw_uv_hor_virstride = ref_stride / 16;
+        reg->swreg48_50_vp9_ref_y_virstride[i].sw_y_virstride = ref_stride * ALIGN(ref_h, 16) / 16;
+        if (!i)
+            reg->swreg51_vp9_lastref_yuv_virstride.sw_yuv_virstride = ref_stride * ALIGN(ref_h, 16) * 3 / 2 / 16;
+    }
+
+    for (i = 0; i < 8; i++) {
+        reg->swreg20_27_vp9_segid_grp[i].sw_vp9segid_abs_delta = pp->seg.abs_delta;
+        if (!pp->seg.enabled)
+            continue;
+        reg->swreg20_27_vp9_segid_grp[i].sw_vp9segid_frame_qp_delta_en = pp->seg.q_enabled[i];
+        reg->swreg20_27_vp9_segid_grp[i].sw_vp9segid_frame_qp_delta = pp->seg.q_val[i];
+        reg->swreg20_27_vp9_segid_grp[i].sw_vp9segid_frame_loopfilter_value_en = pp->seg.lf_enabled[i];
+        reg->swreg20_27_vp9_segid_grp[i].sw_vp9segid_frame_loopfilter_value = pp->seg.lf_val[i];
+        reg->swreg20_27_vp9_segid_grp[i].sw_vp9segid_referinfo_en = pp->seg.ref_enabled[i];
+        reg->swreg20_27_vp9_segid_grp[i].sw_vp9segid_referinfo = pp->seg.ref_val[i];
+        reg->swreg20_27_vp9_segid_grp[i].sw_vp9segid_frame_skip_en = pp->seg.skip_enabled[i];
+    }
+
+    reg->swreg28_vp9_cprheader_config.sw_vp9_tx_mode = pp->tx_mode;
+    reg->swreg28_vp9_cprheader_config.sw_vp9_frame_reference_mode = pp->comp_pred_mode;
+
+    if (pp->last.valid) {
+        for (i = 0; i < 4; i++)
+            reg->swreg32_vp9_ref_deltas_lastframe.sw_vp9_ref_deltas_lastframe |= (pp->last.ref_deltas[i] & 0x7f) << (7 * i);
+        for (i = 0; i < 2; i++)
+            reg->swreg33_vp9_info_lastframe.sw_vp9_mode_deltas_lastframe |= (pp->last.mode_deltas[i] & 0x7f) << (7 * i);
+        reg->swreg33_vp9_info_lastframe.sw_segmentation_enable_lstframe = pp->last.segmentation_enabled;
+        reg->swreg33_vp9_info_lastframe.sw_vp9_last_show_frame = pp->last.show_frame;
+        reg->swreg33_vp9_info_lastframe.sw_vp9_last_intra_only = pp->last.intra_only;
+        reg->swreg33_vp9_info_lastframe.sw_vp9_last_widthheight_eqcur =
+            pp->last.frame_width == pp->frame_width && pp->last.frame_height == pp->frame_height;
+    }
+
+    reg->swreg44_strmd_error_en.sw_strmd_error_e = 0xfffffff;
+    reg->swreg1_int.sw_dec_e = 1;
+    reg->swreg1_int.sw_dec_timeout_e = 1;
+    reg->swreg1_int.sw_buf_empty_en = 1;
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_vp9_submit(void *p) {
+    RKVDEC341VP9Context *ctx = (RKVDEC341VP9Context*)p;
+    RKVDEC341VP9Task *task = &ctx->task[ctx->prepare_idx];
+    RKVDECHwReq req;
+
+    if (ctx->capture_mode) {
+        ff_rkvdec_capture_task(&ctx->capture, "vdpu341 vp9", &task->reg, RKVDEC341VP9_REG_NUM,
+                               task->prob_data, task->stream_data);
+    } else {
+        req.req = (RK_U32*)&task->reg;
+        req.size = RKVDEC341VP9_REG_NUM * sizeof(RK_U32);
+
+        if (ioctl(ctx->dev_fd, RKVDEC_IOC_SET_REG, &req))
+            return AVERROR_INVALIDDATA;
+    }
+
+    ctx->prepare_idx = (ctx->prepare_idx + 1) % RKVDEC_MAX_TASKS;
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_vp9_wait(void *p) {
+    RKVDEC341VP9Context *ctx = (RKVDEC341VP9Context*)p;
+    RKVDEC341VP9Task *task = &ctx->task[ctx->wait_idx];
+    RKVDECHwReq req;
+
+    ctx->wait_idx = (ctx->wait_idx + 1) % RKVDEC_MAX_TASKS;
+
+    if (!ctx->capture_mode) {
+        req.req = (RK_U32*)&task->reg;
+        req.size = RKVDEC341VP9_REG_NUM * sizeof(RK_U32);
+
+        if (ioctl(ctx->dev_fd, RKVDEC_IOC_GET_REG, &req))
+            return AVERROR_INVALIDDATA;
+
+        if (task->reg.swreg1_int.sw_dec_error_sta
+            || (!task->reg.swreg1_int.sw_dec_rdy_sta)
+            || task->reg.swreg1_int.sw_dec_empty_sta
+            || task->reg.swreg45_strmd_error_status.sw_strmd_error_status)
+            return AVERROR_INVALIDDATA;
+    }
+
+    if (task->counts) {
+        memcpy(task->counts, ff_rkvdec_get_dma_ptr(task->count_data), sizeof(RKVDECCountsVP9));
+        task->counts = NULL;
+    }
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_vp9_perform(void *p) {
+    RKVDEC341VP9Context *ctx = (RKVDEC341VP9Context*)p;
+
+    if (rkvdec341_vp9_submit(ctx))
+        return AVERROR_INVALIDDATA;
+
+    return rkvdec341_vp9_wait(ctx);
+}
+
+static void rkvdec341_vp9_free_buffer(RKVDEC341VP9Context *ctx, AVFrame **buf) {
+    if (*buf && ff_rkvdec_get_dma_ptr(*buf))
+        ctx->dma_allocator.free(ctx->dma_allocator_ctx, *buf);
+    av_frame_free(buf);
+}
+
+static RK_S32 rkvdec341_vp9_uninit(void* p) {
+    RKVDEC341VP9Context *ctx = (RKVDEC341VP9Context*)p;
+    RK_S32 i;
+
+    if (ctx->dev_fd > 0) {
+        close(ctx->dev_fd);
+        ctx->dev_fd = -1;
+    }
+    for (i = 0; i < RKVDEC_MAX_TASKS; i++) {
+        rkvdec341_vp9_free_buffer(ctx, &ctx->task[i].prob_data);
+        rkvdec341_vp9_free_buffer(ctx, &ctx->task[i].count_data);
+        ctx->task[i].stream_data = NULL;
+    }
+    if (ctx->dma_allocator_ctx)
+        ctx->dma_allocator.close(ctx->dma_allocator_ctx);
+    ff_rkvdec_capture_close(&ctx->capture);
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_vp9_alloc_buffer(RKVDEC341VP9Context *ctx, AVFrame **buf, RK_U32 size) {
+    *buf = av_frame_alloc();
+    if (!*buf)
+        return AVERROR(ENOMEM);
+    (*buf)->linesize[0] = size;
+    if (ctx->dma_allocator.alloc(ctx->dma_allocator_ctx, *buf))
+        return AVERROR(ENOMEM);
+    memset(ff_rkvdec_get_dma_ptr(*buf), 0, size);
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_vp9_init_common(RKVDEC341VP9Context *ctx, const RKVDECDevice *dev) {
+    RK_S32 i, ret;
+
+    ctx->dma_allocator = *dev->allocator;
+    if (ctx->dma_allocator.open(&ctx->dma_allocator_ctx, 1))
+        return AVERROR_UNKNOWN;
+
+    for (i = 0; i < RKVDEC_MAX_TASKS; i++) {
+        ret = rkvdec341_vp9_alloc_buffer(ctx, &ctx->task[i].prob_data, RKVDEC341VP9_PROB_SIZE);
+        if (ret)
+            return ret;
+        ret = rkvdec341_vp9_alloc_buffer(ctx, &ctx->task[i].count_data, RKVDEC341VP9_COUNT_SIZE);
+        if (ret)
+            return ret;
+    }
+    ctx->prepare_idx = 0;
+    ctx->wait_idx = 0;
+
+    return 0;
+}
+
+static RK_S32 rkvdec341_vp9_init(void *p) {
+    RKVDEC341VP9Context *ctx = (RKVDEC341VP9Context*)p;
+
+    ctx->dev_fd = open(rkvdec341_vp9.dev, O_RDWR);
+    if (ctx->dev_fd <= 0)
+        return AVERROR_DECODER_NOT_FOUND;
+
+    if(ioctl(ctx->dev_fd, RKVDEC_IOC_SET_CLIENT_TYPE, 0x1)) {
+        if (ioctl(ctx->dev_fd, RKVDEC_IOC_SET_CLIENT_TYPE_U32, 0x1)) {
+            return AVERROR_DECODER_NOT_FOUND;
+        }
+    }
+
+    return rkvdec341_vp9_init_common(ctx, &rkvdec341_vp9);
+}
+
+static RK_S32 rkvdec341_vp9_capture_init(void *p) {
+    RKVDEC341VP9Context *ctx = (RKVDEC341VP9Context*)p;
+    RK_S32 ret;
+
+    ctx->dev_fd = -1;
+    ctx->capture_mode = 1;
+
+    ret = ff_rkvdec_capture_open(&ctx->capture);
+    if (ret)
+        return ret;
+
+    return rkvdec341_vp9_init_common(ctx, &rkvdec341_vp9_capture);
+}
+
+struct RKVDECDevice rkvdec341_vp9 = {
+    .name   = "vdpu341",
+    .dev    = "/dev/rkvdec",
+    .allocator = &allocator_drm_pool,
+    .priv_data_size = sizeof(RKVDEC341VP9Context),
+    .init       = rkvdec341_vp9_init,
+    .uninit     = rkvdec341_vp9_uninit,
+    .prepare    = rkvdec341_vp9_prepare,
+    .perform    = rkvdec341_vp9_perform,
+    .submit     = rkvdec341_vp9_submit,
+    .wait       = rkvdec341_vp9_wait,
+};
+
+struct RKVDECDevice rkvdec341_vp9_capture = {
+    .name   = "capture",
+    .allocator = &allocator_memfd_pool,
+    .priv_data_size = sizeof(RKVDEC341VP9Context),
+    .init       = rkvdec341_vp9_capture_init,
+    .uninit     = rkvdec341_vp9_uninit,
+    .prepare    = rkvdec341_vp9_prepare,
+    .perform    = rkvdec341_vp9_perform,
+    .submit     = rkvdec341_vp9_submit,
+    .wait       = rkvdec341_vp9_wait,
+};
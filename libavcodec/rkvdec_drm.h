@@ -64,10 +64,10 @@ static AVBufferRef* rkvdec_alloc_drm_buffer(void* opaque, RK_U32 size) {
 
     layer->planes[0].object_index = 0;
     layer->planes[0].offset = 0;
-    layer->planes[0].pitch = hwfc->width;
+    layer->planes[0].pitch = ALIGN(hwfc->width, 16);
 
     layer->planes[1].object_index = 0;
-    layer->planes[1].offset = layer->planes[0].pitch * hwfc->height;
+    layer->planes[1].offset = layer->planes[0].pitch * ALIGN(hwfc->height, 16);
     layer->planes[1].pitch = layer->planes[0].pitch;
 
     buf_ctx->buf = buf;
@@ -22,12 +22,9 @@
 #include "h264.h"
 #include "h264dec.h"
 #include "rkvdec_h264.h"
-#include "rkvdec_drm.h"
-#include "allocator_drm.h"
 #include "hwaccel.h"
 #include "decode.h"
 #include "libavutil/time.h"
-#include "libavutil/hwcontext_internal.h"
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -57,47 +54,19 @@ static void rkvdec_h264_init_picture(RKVDECPicture* dec_pic)
     dec_pic->field_poc[0] = dec_pic->field_poc[1] = 0;
 }
 
-static void rkvdec_h264_free_dmabuffer(void* opaque, uint8_t *data)
-{
-    RKVDECContext * const ctx = opaque;
-    AVFrame* buf = (AVFrame*)data;
-    RKVDEC_LOG(LOG_LEVEL, "size:%d", ff_rkvdec_get_dma_size(buf));
-
-    if (!ctx || !buf)
-        return;
-    ctx->allocator.free(ctx->allocator_ctx, buf);
-    av_freep(&buf);
-}
-
-static AVBufferRef* rkvdec_h264_alloc_dmabuffer(void* opaque, int size)
-{
-    RKVDECContext * const ctx = opaque;
-    AVFrame* buf = av_frame_alloc();
-    RKVDEC_LOG(LOG_LEVEL, "size:%d", size);
-
-    buf->linesize[0] = size;
-    ctx->allocator.alloc(ctx->allocator_ctx, buf);
-    return av_buffer_create((uint8_t*)buf, size, rkvdec_h264_free_dmabuffer, ctx, 0);
-}
-
 static int rkvdec_h264_alloc_colmv(const H264Context* h)
 {
     RKVDECContext * const ctx = ff_rkvdec_get_context(h->avctx);
     H264Picture *current_picture = h->cur_pic_ptr;
 
-    if (current_picture->f->width >= 3840) {        
-        AVBufferRef* prev_ref   = current_picture->hwaccel_priv_buf;
+    if (current_picture->f->width >= 3840) {
         const int b4_stride     = h->mb_width * 4 + 1;
         const int b4_array_size = b4_stride * h->mb_height * 4;
         const int colmv_size    = 2 * 2 * (b4_array_size + 4) * sizeof(int16_t);
 
-        if (!ctx->internal_pool)
-            ctx->internal_pool = av_buffer_pool_init2(colmv_size, ctx, rkvdec_h264_alloc_dmabuffer, NULL);
-
-        current_picture->hwaccel_priv_buf = av_buffer_pool_get(ctx->internal_pool);
-        current_picture->hwaccel_picture_private = current_picture->hwaccel_priv_buf->data;
-        if (prev_ref)
-            av_buffer_unref(&prev_ref);
+        return ff_rkvdec_alloc_picture_buffer(ctx, &current_picture->hwaccel_priv_buf,
+                                              &current_picture->hwaccel_picture_private,
+                                              colmv_size);
     }
 
     return 0;
@@ -114,7 +83,7 @@ static int rkvdec_h264_start_frame(AVCodecContext          *avctx,
     const PPS *pps = h->ps.pps;
     const SPS *sps = h->ps.sps;
     RKVDECPicParamsH264 *pp = ctx->pic_param;
-    int i, j;
+    int i, j, ret;
 
     RKVDEC_LOG(LOG_LEVEL, "type:%d|struct:%d",
         sl->slice_type, h->picture_structure);
@@ -123,16 +92,10 @@ static int rkvdec_h264_start_frame(AVCodecContext          *avctx,
 
     memset(pp, 0, sizeof(RKVDECPicParamsH264));
 
-    if (ctx->err_info) {
-        if (h->avctx->active_thread_type & FF_THREAD_FRAME) {
-            for (int i = 0; i < H264_MAX_PICTURE_COUNT; i++) {
-                if (h->DPB[i].frame_num == h->poc.prev_frame_num) {
-                    h->DPB[i].f->decode_error_flags |= FF_DECODE_ERROR_INVALID_BITSTREAM;
-                    break;
-                }
-            }
-        }
-        ctx->err_info = 0;
+    ret = ff_rkvdec_attach_frame(ctx, current_picture->f);
+    if (ret < 0) {
+        pthread_mutex_unlock(&ctx->hwaccel_mutex);
+        return ret;
     }
 
     rkvdec_h264_fill_picture(&pp->curr_pic, current_picture, h->picture_structure);
@@ -239,7 +202,7 @@ static int rkvdec_h264_start_frame(AVCodecContext          *avctx,
         for (i = 0; i < 32 ; i++) {
             const H264Picture *r = sl->ref_list[0][i].parent;
             if (r && r->f && i < sl->ref_count[0])
-                current_picture->f->decode_error_flags |= r->f->decode_error_flags;
+                ff_rkvdec_add_ref(current_picture->f, r->f);
         }
     }
 
@@ -248,7 +211,7 @@ static int rkvdec_h264_start_frame(AVCodecContext          *avctx,
             for (i = 0; i < 32 ; i++) {
                 const H264Picture *r = sl->ref_list[j][i].parent;
                 if (r && r->f && i < sl->ref_count[j])
-                    current_picture->f->decode_error_flags |= r->f->decode_error_flags;
+                    ff_rkvdec_add_ref(current_picture->f, r->f);
             }
         }
     }
@@ -269,18 +232,15 @@ static int rkvdec_h264_end_frame(AVCodecContext *avctx)
     if (ctx->pkt.size <= 0) {
         if (pic && pic->f)
             pic->f->decode_error_flags |= FF_DECODE_ERROR_INVALID_BITSTREAM;
+        pthread_mutex_unlock(&ctx->hwaccel_mutex);
         return 0;
     }
 
-    ctx->dev.prepare(ctx->dev_ctx, &ctx->pkt, ctx->pic_param);
-
     begin = av_gettime();
-    if (ctx->dev.perform(ctx->dev_ctx)) {
+    if (ff_rkvdec_submit_frame(ctx, pic->f) < 0)
         pic->f->decode_error_flags |= FF_DECODE_ERROR_INVALID_BITSTREAM;
-        ctx->err_info = pic->f->decode_error_flags;
-    }
 
-    RKVDEC_LOG(LOG_LEVEL, "err:%d|cost:%dns", ctx->err_info, av_gettime() - begin);
+    RKVDEC_LOG(LOG_LEVEL, "pending:%d|cost:%dus", ctx->nb_tasks, (int)(av_gettime() - begin));
     pthread_mutex_unlock(&ctx->hwaccel_mutex);
 
     return 0;
@@ -294,84 +254,40 @@ static int rkvdec_h264_decode_slice(AVCodecContext *avctx,
     static const RK_U8 start_code[] = {0, 0, 1 }; 
     RKVDEC_LOG(LOG_LEVEL, "size:%d", size);
 
-    if (ctx->pkt.buf->size - ctx->pkt.size < size + sizeof(start_code)) {
-        av_buffer_realloc(&ctx->pkt.buf, ctx->pkt.size + size + 1024);
-        ctx->pkt.data = ctx->pkt.buf->data;
-    }
-
-    memcpy(ctx->pkt.data + ctx->pkt.size, start_code, sizeof(start_code));
-    ctx->pkt.size += sizeof(start_code);
-    memcpy(ctx->pkt.data + ctx->pkt.size, buffer, size);
-    ctx->pkt.size += size;
-
-    return 0;
+    return ff_rkvdec_append_stream(ctx, start_code, sizeof(start_code), buffer, size);
 }
 
 extern struct RKVDECDevice rkvdec341_h264;
+extern struct RKVDECDevice rkvdec_soft_h264;
+
+static const RKVDECDevice * const rkvdec_h264_devices[] = {
+    &rkvdec341_h264,
+    &rkvdec_soft_h264,
+    NULL,
+};
 
 static int rkvdec_h264_context_init(AVCodecContext *avctx)
 {
-    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
     RKVDEC_LOG(LOG_LEVEL, "");
 
-    pthread_mutex_init(&ctx->hwaccel_mutex, NULL);
-    ctx->dev = rkvdec341_h264;
-    ctx->dev_ctx = av_mallocz(ctx->dev.priv_data_size);
-    ctx->dev.init(ctx->dev_ctx);
-
-    ctx->allocator = allocator_drm;
-    ctx->allocator.open(&ctx->allocator_ctx, 1);
-
-    if (!avctx->hw_frames_ctx) 
-        ff_decode_get_hw_frames_ctx(avctx, AV_HWDEVICE_TYPE_DRM);
-    ((AVHWFramesContext*)avctx->hw_frames_ctx->data)->user_opaque = ctx;
-
-    av_init_packet(&ctx->pkt);
-    ctx->pkt.size = 0;
-    ctx->pkt.buf = av_buffer_alloc(1024*1024);
-    ctx->pkt.data = ctx->pkt.buf->data;
-    ctx->pic_param = av_mallocz(sizeof(RKVDECPicParamsH264));
-
-    RKVDEC_LOG(LOG_LEVEL, "dev:%s|allocator:%s", ctx->dev.name, ctx->allocator.name);
-
-    return 0;
+    return ff_rkvdec_context_init(avctx, rkvdec_h264_devices, sizeof(RKVDECPicParamsH264));
 }
 
 static int rkvdec_h264_context_uninit(AVCodecContext *avctx)
 {
-    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
     RKVDEC_LOG(LOG_LEVEL, "");
 
-    ctx->dev.uninit(ctx->dev_ctx);
-    av_freep(&ctx->dev_ctx);
-    av_freep(&ctx->pic_param);
-
-    if (ctx->internal_pool)
-        av_buffer_pool_uninit(&ctx->internal_pool);
-
-    ctx->allocator.close(ctx->allocator_ctx);
-
-    av_buffer_unref(&ctx->pkt.buf);
-
-    pthread_mutex_destroy(&ctx->hwaccel_mutex);
-
-    return 0;
+    return ff_rkvdec_context_uninit(avctx);
 }
 
 static int rkvdec_h264_frame_params(AVCodecContext *avctx, AVBufferRef *hw_frames_ctx)
 {
-    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);    
-    AVHWFramesContext *hw_frames = (AVHWFramesContext*)hw_frames_ctx->data;
+    const H264Context *h = avctx->priv_data;
     RKVDEC_LOG(LOG_LEVEL, "");
-    hw_frames->format = AV_PIX_FMT_DRM_PRIME;
-    hw_frames->sw_format = AV_PIX_FMT_NV12;
-    hw_frames->width  = avctx->coded_width;
-    hw_frames->height = avctx->coded_height;
-    hw_frames->user_opaque = ctx;
-    hw_frames->initial_pool_size = 0;
-    hw_frames->internal->pool_internal = av_buffer_pool_init2(hw_frames->width * hw_frames->height * 2, hw_frames,
-                                            rkvdec_alloc_drm_buffer, NULL);
-    return 0;
+
+    // the references, the current picture and the reorder delay
+    return ff_rkvdec_frame_params(avctx, hw_frames_ctx, h->ps.sps ?
+                                  h->ps.sps->ref_frame_count + 1 + avctx->has_b_frames : 0);
 }
 
 const AVHWAccel ff_h264_rkvdec_hwaccel = {
@@ -0,0 +1,336 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "hevcdec.h"
+#include "rkvdec_hevc.h"
+#include "hwaccel.h"
+#include "decode.h"
+#include "libavutil/time.h"
+
+#undef LOG_LEVEL
+#define LOG_LEVEL AV_LOG_DEBUG
+
+static void rkvdec_hevc_fill_picture(RKVDECPicture *dec_pic, const HEVCFrame *pic)
+{
+    dec_pic->valid = 1;
+    dec_pic->index = ff_rkvdec_get_dma_fd(pic->frame);
+    dec_pic->lt = !!(pic->flags & HEVC_FRAME_FLAG_LONG_REF);
+    dec_pic->reference = !!(pic->flags & (HEVC_FRAME_FLAG_SHORT_REF | HEVC_FRAME_FLAG_LONG_REF));
+    dec_pic->field_poc[0] = pic->poc;
+    dec_pic->field_poc[1] = pic->poc;
+}
+
+static int rkvdec_hevc_alloc_colmv(const HEVCContext *h)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(h->avctx);
+    const HEVCSPS *sps = h->ps.sps;
+    HEVCFrame *pic = h->ref;
+    // 16 bytes per 16x16 block, with the picture padded to whole 64x64 CTBs
+    const int colmv_size = (ALIGN(sps->width, 64) / 16) * (ALIGN(sps->height, 64) / 16) * 16;
+
+    return ff_rkvdec_alloc_picture_buffer(ctx, &pic->hwaccel_priv_buf,
+                                          &pic->hwaccel_picture_private, colmv_size);
+}
+
+static int rkvdec_hevc_find_ref(const RKVDECPicParamsHEVC *pp, const HEVCFrame *ref)
+{
+    RKVDECPicture pic = { 0 };
+    int idx;
+
+    if (!ref || !ref->frame || !ref->frame->buf[0])
+        return 0xff;
+
+    pic.index = ff_rkvdec_get_dma_fd(ref->frame);
+    idx = get_rkvdec_picture_index2((RKVDECPicture*)pp->DPB, &pic);
+
+    return idx < 0 ? 0xff : idx;
+}
+
+static void rkvdec_hevc_fill_scaling_lists(RKVDECPicParamsHEVC *pp, const ScalingList *sl)
+{
+    int i;
+
+    for (i = 0; i < 6; i++) {
+        memcpy(pp->scaling_lists4x4[i],   sl->sl[0][i], 16);
+        memcpy(pp->scaling_lists8x8[i],   sl->sl[1][i], 64);
+        memcpy(pp->scaling_lists16x16[i], sl->sl[2][i], 64);
+        pp->scaling_list_dc16x16[i] = sl->sl_dc[0][i];
+    }
+    for (i = 0; i < 2; i++) {
+        memcpy(pp->scaling_lists32x32[i], sl->sl[3][i * 3], 64);
+        pp->scaling_list_dc32x32[i] = sl->sl_dc[1][i * 3];
+    }
+}
+
+static int rkvdec_hevc_start_frame(AVCodecContext          *avctx,
+                                   av_unused const uint8_t *buffer,
+                                   av_unused uint32_t       size)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
+    const HEVCContext *h = avctx->priv_data;
+    const HEVCFrame *current_picture = h->ref;
+    const HEVCSPS *sps = h->ps.sps;
+    const HEVCPPS *pps = h->ps.pps;
+    RKVDECPicParamsHEVC *pp = ctx->pic_param;
+    int i, j, ret;
+
+    RKVDEC_LOG(LOG_LEVEL, "poc:%d|nal:%d", h->poc, h->nal_unit_type);
+
+    pthread_mutex_lock(&ctx->hwaccel_mutex);
+
+    memset(pp, 0, sizeof(RKVDECPicParamsHEVC));
+
+    ret = ff_rkvdec_attach_frame(ctx, current_picture->frame);
+    if (ret < 0) {
+        pthread_mutex_unlock(&ctx->hwaccel_mutex);
+        return ret;
+    }
+
+    rkvdec_hevc_fill_picture(&pp->curr_pic, current_picture);
+
+    ret = rkvdec_hevc_alloc_colmv(h);
+    if (ret < 0) {
+        pthread_mutex_unlock(&ctx->hwaccel_mutex);
+        return ret;
+    }
+    pp->curr_mv = ff_rkvdec_get_dma_fd(current_picture->hwaccel_picture_private);
+
+    for (i = 0, j = 0; i < FF_ARRAY_ELEMS(h->DPB) && j < FF_ARRAY_ELEMS(pp->DPB); i++) {
+        const HEVCFrame *r = &h->DPB[i];
+
+        if (r == current_picture || !r->frame || !r->frame->buf[0] ||
+            !(r->flags & (HEVC_FRAME_FLAG_SHORT_REF | HEVC_FRAME_FLAG_LONG_REF)))
+            continue;
+
+        rkvdec_hevc_fill_picture(&pp->DPB[j], r);
+        if (r->hwaccel_picture_private)
+            pp->ref_colmv_list[j] = ff_rkvdec_get_dma_fd(r->hwaccel_picture_private);
+        j++;
+    }
+
+    for (i = ST_CURR_BEF; i <= LT_CURR; i++) {
+        if (i == ST_FOLL)
+            continue;
+        for (j = 0; j < h->rps[i].nb_refs; j++) {
+            const HEVCFrame *r = h->rps[i].ref[j];
+            if (r && r->frame)
+                ff_rkvdec_add_ref(current_picture->frame, r->frame);
+        }
+    }
+
+    pp->frame_width                                  = sps->width;
+    pp->frame_height                                 = sps->height;
+
+    pp->video_parameter_set_id                       = sps->vps_id;
+    pp->chroma_format_idc                            = sps->chroma_format_idc;
+    pp->bit_depth_luma_minus8                        = sps->bit_depth - 8;
+    pp->bit_depth_chroma_minus8                      = sps->bit_depth_chroma - 8;
+    pp->log2_max_pic_order_cnt_lsb_minus4            = sps->log2_max_poc_lsb - 4;
+    pp->log2_min_luma_coding_block_size_minus3       = sps->log2_min_cb_size - 3;
+    pp->log2_diff_max_min_luma_coding_block_size     = sps->log2_diff_max_min_coding_block_size;
+    pp->log2_min_transform_block_size_minus2         = sps->log2_min_tb_size - 2;
+    pp->log2_diff_max_min_transform_block_size       = sps->log2_max_trafo_size - sps->log2_min_tb_size;
+    pp->max_transform_hierarchy_depth_inter          = sps->max_transform_hierarchy_depth_inter;
+    pp->max_transform_hierarchy_depth_intra          = sps->max_transform_hierarchy_depth_intra;
+    pp->scaling_list_enabled_flag                    = sps->scaling_list_enable_flag;
+    pp->amp_enabled_flag                             = sps->amp_enabled_flag;
+    pp->sample_adaptive_offset_enabled_flag          = sps->sao_enabled;
+    pp->pcm_enabled_flag                             = sps->pcm_enabled_flag;
+    if (sps->pcm_enabled_flag) {
+        pp->pcm_sample_bit_depth_luma_minus1             = sps->pcm.bit_depth - 1;
+        pp->pcm_sample_bit_depth_chroma_minus1           = sps->pcm.bit_depth_chroma - 1;
+        pp->log2_min_pcm_luma_coding_block_size_minus3   = sps->pcm.log2_min_pcm_cb_size - 3;
+        pp->log2_diff_max_min_pcm_luma_coding_block_size = sps->pcm.log2_max_pcm_cb_size -
+                                                           sps->pcm.log2_min_pcm_cb_size;
+        pp->pcm_loop_filter_disabled_flag                = sps->pcm.loop_filter_disable_flag;
+    }
+    pp->num_short_term_ref_pic_sets                  = sps->nb_st_rps;
+    pp->long_term_ref_pics_present_flag              = sps->long_term_ref_pics_present_flag;
+    pp->num_long_term_ref_pics_sps                   = sps->num_long_term_ref_pics_sps;
+    pp->sps_temporal_mvp_enabled_flag                = sps->sps_temporal_mvp_enabled_flag;
+    pp->strong_intra_smoothing_enabled_flag          = sps->sps_strong_intra_smoothing_enable_flag;
+
+    pp->pps_id                                       = h->sh.pps_id;
+    pp->sps_id                                       = pps->sps_id;
+    pp->dependent_slice_segments_enabled_flag        = pps->dependent_slice_segments_enabled_flag;
+    pp->output_flag_present_flag                     = pps->output_flag_present_flag;
+    pp->num_extra_slice_header_bits                  = pps->num_extra_slice_header_bits;
+    pp->sign_data_hiding_enabled_flag                = pps->sign_data_hiding_flag;
+    pp->cabac_init_present_flag                      = pps->cabac_init_present_flag;
+    pp->num_ref_idx_l0_default_active_minus1         = pps->num_ref_idx_l0_default_active - 1;
+    pp->num_ref_idx_l1_default_active_minus1         = pps->num_ref_idx_l1_default_active - 1;
+    pp->init_qp_minus26                              = pps->pic_init_qp_minus26;
+    pp->constrained_intra_pred_flag                  = pps->constrained_intra_pred_flag;
+    pp->transform_skip_enabled_flag                  = pps->transform_skip_enabled_flag;
+    pp->cu_qp_delta_enabled_flag                     = pps->cu_qp_delta_enabled_flag;
+    pp->diff_cu_qp_delta_depth                       = pps->diff_cu_qp_delta_depth;
+    pp->pps_cb_qp_offset                             = pps->cb_qp_offset;
+    pp->pps_cr_qp_offset                             = pps->cr_qp_offset;
+    pp->pps_slice_chroma_qp_offsets_present_flag     = pps->pic_slice_level_chroma_qp_offsets_present_flag;
+    pp->weighted_pred_flag                           = pps->weighted_pred_flag;
+    pp->weighted_bipred_flag                         = pps->weighted_bipred_flag;
+    pp->transquant_bypass_enabled_flag               = pps->transquant_bypass_enable_flag;
+    pp->tiles_enabled_flag                           = pps->tiles_enabled_flag;
+    pp->entropy_coding_sync_enabled_flag             = pps->entropy_coding_sync_enabled_flag;
+    pp->pps_loop_filter_across_slices_enabled_flag   = pps->seq_loop_filter_across_slices_enabled_flag;
+    pp->loop_filter_across_tiles_enabled_flag        = pps->loop_filter_across_tiles_enabled_flag;
+    pp->deblocking_filter_override_enabled_flag      = pps->deblocking_filter_override_enabled_flag;
+    pp->pps_deblocking_filter_disabled_flag          = pps->disable_dbf;
+    pp->pps_beta_offset_div2                         = pps->beta_offset / 2;
+    pp->pps_tc_offset_div2                           = pps->tc_offset / 2;
+    pp->lists_modification_present_flag             = pps->lists_modification_present_flag;
+    pp->log2_parallel_merge_level_minus2             = pps->log2_parallel_merge_level - 2;
+    pp->slice_segment_header_extension_present_flag  = pps->slice_header_extension_present_flag;
+
+    if (pps->tiles_enabled_flag) {
+        pp->num_tile_columns_minus1 = FFMIN(pps->num_tile_columns, 20) - 1;
+        pp->num_tile_rows_minus1    = FFMIN(pps->num_tile_rows, 22) - 1;
+        for (i = 0; i <= pp->num_tile_columns_minus1; i++)
+            pp->column_width_minus1[i] = pps->column_width[i] - 1;
+        for (i = 0; i <= pp->num_tile_rows_minus1; i++)
+            pp->row_height_minus1[i] = pps->row_height[i] - 1;
+    }
+
+    if (pps->scaling_list_data_present_flag)
+        rkvdec_hevc_fill_scaling_lists(pp, &pps->scaling_list);
+    else if (sps->scaling_list_enable_flag)
+        rkvdec_hevc_fill_scaling_lists(pp, &sps->scaling_list);
+
+    pp->IrapPicFlag  = IS_IRAP(h);
+    pp->IdrPicFlag   = IS_IDR(h);
+    pp->IntraPicFlag = IS_IRAP(h);
+
+    ctx->pkt.size = 0;
+
+    return 0;
+}
+
+static int rkvdec_hevc_end_frame(AVCodecContext *avctx)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
+    const HEVCContext *h = avctx->priv_data;
+    const HEVCFrame *pic = h->ref;
+    int64_t begin;
+    RKVDEC_LOG(LOG_LEVEL, "");
+
+    if (ctx->pkt.size <= 0) {
+        if (pic && pic->frame)
+            pic->frame->decode_error_flags |= FF_DECODE_ERROR_INVALID_BITSTREAM;
+        pthread_mutex_unlock(&ctx->hwaccel_mutex);
+        return 0;
+    }
+
+    begin = av_gettime();
+    if (ff_rkvdec_submit_frame(ctx, pic->frame) < 0)
+        pic->frame->decode_error_flags |= FF_DECODE_ERROR_INVALID_BITSTREAM;
+
+    RKVDEC_LOG(LOG_LEVEL, "pending:%d|cost:%dus", ctx->nb_tasks, (int)(av_gettime() - begin));
+    pthread_mutex_unlock(&ctx->hwaccel_mutex);
+
+    return 0;
+}
+
+static int rkvdec_hevc_decode_slice(AVCodecContext *avctx,
+                                    const uint8_t  *buffer,
+                                    uint32_t        size)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
+    const HEVCContext *h = avctx->priv_data;
+    const SliceHeader *sh = &h->sh;
+    RKVDECPicParamsHEVC *pp = ctx->pic_param;
+    static const RK_U8 start_code[] = { 0, 0, 1 };
+    RK_S32 nb_list, list, i;
+    RKVDEC_LOG(LOG_LEVEL, "size:%d", size);
+
+    // the hardware parses the slice headers, only the lists it cannot build
+    // from the parameter sets are passed
+    if (!sh->dependent_slice_segment_flag) {
+        RKVDECSliceRefsHEVC *refs;
+
+        if (pp->nb_slices >= RKVDEC_HEVC_MAX_SLICES) {
+            h->ref->frame->decode_error_flags |= FF_DECODE_ERROR_INVALID_BITSTREAM;
+            return 0;
+        }
+
+        refs = &pp->slices[pp->nb_slices++];
+        nb_list = sh->slice_type == HEVC_SLICE_B ? 2 :
+                  sh->slice_type == HEVC_SLICE_P ? 1 : 0;
+        memset(refs->ref_idx, 0xff, sizeof(refs->ref_idx));
+        for (list = 0; list < nb_list; list++) {
+            const RefPicList *rpl = &h->ref->refPicList[list];
+
+            refs->nb_refs[list] = FFMIN(rpl->nb_refs, 15);
+            for (i = 0; i < refs->nb_refs[list]; i++)
+                refs->ref_idx[list][i] = rkvdec_hevc_find_ref(pp, rpl->ref[i]);
+        }
+    }
+
+    return ff_rkvdec_append_stream(ctx, start_code, sizeof(start_code), buffer, size);
+}
+
+extern struct RKVDECDevice rkvdec341_hevc;
+extern struct RKVDECDevice rkvdec341_hevc_capture;
+
+static const RKVDECDevice * const rkvdec_hevc_devices[] = {
+    &rkvdec341_hevc,
+    &rkvdec341_hevc_capture,
+    NULL,
+};
+
+static int rkvdec_hevc_context_init(AVCodecContext *avctx)
+{
+    RKVDEC_LOG(LOG_LEVEL, "");
+
+    return ff_rkvdec_context_init(avctx, rkvdec_hevc_devices, sizeof(RKVDECPicParamsHEVC));
+}
+
+static int rkvdec_hevc_context_uninit(AVCodecContext *avctx)
+{
+    RKVDEC_LOG(LOG_LEVEL, "");
+
+    return ff_rkvdec_context_uninit(avctx);
+}
+
+static int rkvdec_hevc_frame_params(AVCodecContext *avctx, AVBufferRef *hw_frames_ctx)
+{
+    const HEVCContext *h = avctx->priv_data;
+    const HEVCSPS *sps = h->ps.sps;
+    RKVDEC_LOG(LOG_LEVEL, "");
+
+    // the decoded picture buffer and the current picture
+    return ff_rkvdec_frame_params(avctx, hw_frames_ctx, sps ?
+                                  sps->temporal_layer[sps->max_sub_layers - 1].max_dec_pic_buffering + 1 : 0);
+}
+
+const AVHWAccel ff_hevc_rkvdec_hwaccel = {
+    .name                 = "hevc_rkvdec",
+    .type                 = AVMEDIA_TYPE_VIDEO,
+    .id                   = AV_CODEC_ID_HEVC,
+    .pix_fmt              = AV_PIX_FMT_DRM_PRIME,
+    .start_frame          = rkvdec_hevc_start_frame,
+    .end_frame            = rkvdec_hevc_end_frame,
+    .decode_slice         = rkvdec_hevc_decode_slice,
+    .init                 = rkvdec_hevc_context_init,
+    .uninit               = rkvdec_hevc_context_uninit,
+    .frame_params         = rkvdec_hevc_frame_params,
+    .priv_data_size       = sizeof(RKVDECContext),
+    .frame_priv_data_size = sizeof(AVFrame),
+    .caps_internal        = HWACCEL_CAP_ASYNC_SAFE,
+};
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef AVCODEC_RKVDEC_HEVC_H
+#define AVCODEC_RKVDEC_HEVC_H
+
+#include "rkvdec.h"
+
+/* slices of a picture the reference lists are passed for */
+#define RKVDEC_HEVC_MAX_SLICES                  256
+
+typedef struct RKVDECSliceRefsHEVC {
+    RK_U8   nb_refs[2];
+    /* index into DPB, 0xff for a missing reference */
+    RK_U8   ref_idx[2][15];
+} RKVDECSliceRefsHEVC;
+
+typedef struct RKVDECPicParamsHEVC {
+    RK_U32  frame_width;
+    RK_U32  frame_height;
+
+    /* sequence parameter set */
+    RK_U8   video_parameter_set_id;
+    RK_U8   chroma_format_idc;
+    RK_U8   bit_depth_luma_minus8;
+    RK_U8   bit_depth_chroma_minus8;
+    RK_U8   log2_max_pic_order_cnt_lsb_minus4;
+    RK_U8   log2_min_luma_coding_block_size_minus3;
+    RK_U8   log2_diff_max_min_luma_coding_block_size;
+    RK_U8   log2_min_transform_block_size_minus2;
+    RK_U8   log2_diff_max_min_transform_block_size;
+    RK_U8   max_transform_hierarchy_depth_inter;
+    RK_U8   max_transform_hierarchy_depth_intra;
+    RK_U8   scaling_list_enabled_flag;
+    RK_U8   amp_enabled_flag;
+    RK_U8   sample_adaptive_offset_enabled_flag;
+    RK_U8   pcm_enabled_flag;
+    RK_U8   pcm_sample_bit_depth_luma_minus1;
+    RK_U8   pcm_sample_bit_depth_chroma_minus1;
+    RK_U8   log2_min_pcm_luma_coding_block_size_minus3;
+    RK_U8   log2_diff_max_min_pcm_luma_coding_block_size;
+    RK_U8   pcm_loop_filter_disabled_flag;
+    RK_U8   num_short_term_ref_pic_sets;
+    RK_U8   long_term_ref_pics_present_flag;
+    RK_U8   num_long_term_ref_pics_sps;
+    RK_U8   sps_temporal_mvp_enabled_flag;
+    RK_U8   strong_intra_smoothing_enabled_flag;
+
+    /* picture parameter set */
+    RK_U8   pps_id;
+    RK_U8   sps_id;
+    RK_U8   dependent_slice_segments_enabled_flag;
+    RK_U8   output_flag_present_flag;
+    RK_U8   num_extra_slice_header_bits;
+    RK_U8   sign_data_hiding_enabled_flag;
+    RK_U8   cabac_init_present_flag;
+    RK_U8   num_ref_idx_l0_default_active_minus1;
+    RK_U8   num_ref_idx_l1_default_active_minus1;
+    RK_S16  init_qp_minus26;
+    RK_U8   constrained_intra_pred_flag;
+    RK_U8   transform_skip_enabled_flag;
+    RK_U8   cu_qp_delta_enabled_flag;
+    RK_U8   diff_cu_qp_delta_depth;
+    RK_S16  pps_cb_qp_offset;
+    RK_S16  pps_cr_qp_offset;
+    RK_U8   pps_slice_chroma_qp_offsets_present_flag;
+    RK_U8   weighted_pred_flag;
+    RK_U8   weighted_bipred_flag;
+    RK_U8   transquant_bypass_enabled_flag;
+    RK_U8   tiles_enabled_flag;
+    RK_U8   entropy_coding_sync_enabled_flag;
+    RK_U8   pps_loop_filter_across_slices_enabled_flag;
+    RK_U8   loop_filter_across_tiles_enabled_flag;
+    RK_U8   deblocking_filter_override_enabled_flag;
+    RK_U8   pps_deblocking_filter_disabled_flag;
+    RK_S16  pps_beta_offset_div2;
+    RK_S16  pps_tc_offset_div2;
+    RK_U8   lists_modification_present_flag;
+    RK_U8   log2_parallel_merge_level_minus2;
+    RK_U8   slice_segment_header_extension_present_flag;
+    RK_U8   num_tile_columns_minus1;
+    RK_U8   num_tile_rows_minus1;
+    RK_U16  column_width_minus1[20];
+    RK_U16  row_height_minus1[22];
+
+    /* from the PPS if present there, the SPS otherwise */
+    RK_U8   scaling_lists4x4[6][16];
+    RK_U8   scaling_lists8x8[6][64];
+    RK_U8   scaling_lists16x16[6][64];
+    RK_U8   scaling_lists32x32[2][64];
+    RK_U8   scaling_list_dc16x16[6];
+    RK_U8   scaling_list_dc32x32[2];
+
+    RK_U8   IrapPicFlag;
+    RK_U8   IdrPicFlag;
+    RK_U8   IntraPicFlag;
+
+    /* field_poc[0] holds the picture order count */
+    RKVDECPicture   curr_pic;
+    RK_U32          curr_mv;
+    RKVDECPicture   DPB[16];
+    RK_U32          ref_colmv_list[16];
+
+    RK_U32              nb_slices;
+    RKVDECSliceRefsHEVC slices[RKVDEC_HEVC_MAX_SLICES];
+} RKVDECPicParamsHEVC;
+
+#endif
@@ -0,0 +1,479 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/*
+ * Software stand-in for the vdpu341 H.264 block, selected with
+ * RKVDEC_DEVICE=soft. Tasks are prepared by the vdpu341 code, and instead
+ * of the kernel driver a model consumes what it produced: the buffers are
+ * found through the fd|offset<<10 addresses of the registers, the SPS/PPS
+ * are rebuilt from the packed entry the pps base points at (indexed by the
+ * pps id of the first slice) and from the scaling list table, and the
+ * slices of the stream buffer are decoded by the native H.264 decoder. The
+ * picture is written as NV12 at the decout base with the strides of the
+ * registers, then the status registers are set the way the hardware would.
+ * This allows running the hwaccel, its queue and the DRM PRIME output path
+ * on machines without the hardware.
+ *
+ * The references are not read from the registers, the native decoder keeps
+ * its own. The packed table does not carry the offsets of POC type 1, such
+ * streams fail with AVERROR_PATCHWELCOME. The cropping is not in the table
+ * either, but it only applies on output, and the MBAFF flag it holds for
+ * field pictures is only used by frame pictures.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "libavutil/common.h"
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/internal.h"
+#include "avcodec.h"
+#include "golomb.h"
+#include "h264.h"
+#include "mathops.h"
+#include "put_bits.h"
+#include "rkvdec341_h264.h"
+#include "allocator_pool.h"
+
+#define SOFT_PARAM_SETS_SIZE    2048
+
+typedef struct RKVDECSoftH264Map {
+    RK_U8              *base;
+    size_t              size;
+} RKVDECSoftH264Map;
+
+/* reads the tables the way put_bits_a64() writes them */
+typedef struct RKVDECSoftH264Bits {
+    const uint64_t     *buf;
+    RK_U32              pos;
+} RKVDECSoftH264Bits;
+
+typedef struct RKVDECSoftH264Context {
+    RKVDEC341H264Context hw; /* must be first, the tasks are prepared by vdpu341 */
+    AVCodecContext     *dec;
+    AVFrame            *frame;
+    AVFrame            *cur;
+    AVPacket           *pkt;
+    uint8_t            *data;
+    unsigned int        data_alloc;
+} RKVDECSoftH264Context;
+
+extern AVCodec ff_h264_decoder;
+extern struct RKVDECDevice rkvdec_soft_h264;
+
+static int rkvdec_soft_h264_get_buffer(AVCodecContext *avctx, AVFrame *frame, int flags)
+{
+    RKVDECSoftH264Context *ctx = avctx->opaque;
+    int ret = avcodec_default_get_buffer2(avctx, frame, flags);
+
+    // the picture being decoded, second fields reuse it
+    av_frame_unref(ctx->cur);
+    if (!ret)
+        ret = av_frame_ref(ctx->cur, frame);
+    return ret;
+}
+
+static RK_U8 *rkvdec_soft_h264_map(RKVDECSoftH264Map *m, RK_U32 addr, size_t len)
+{
+    RK_S32 fd = addr & 0x3ff;
+    size_t offset = addr >> 10;
+    off_t size = lseek(fd, 0, SEEK_END);
+
+    if (size <= 0 || offset + len > size)
+        return NULL;
+
+    m->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m->base == MAP_FAILED) {
+        m->base = NULL;
+        return NULL;
+    }
+    m->size = size;
+
+    return m->base + offset;
+}
+
+static void rkvdec_soft_h264_unmap(RKVDECSoftH264Map *m)
+{
+    if (m->base)
+        munmap(m->base, m->size);
+    m->base = NULL;
+}
+
+static RK_U32 rkvdec_soft_h264_bits(RKVDECSoftH264Bits *b, int n)
+{
+    RK_U32 v = 0;
+    int i;
+
+    for (i = 0; i < n; i++, b->pos++)
+        v |= ((b->buf[b->pos >> 6] >> (b->pos & 63)) & 1) << i;
+    return v;
+}
+
+/* pps id of the first slice, the stream holds NAL units with start codes */
+static int rkvdec_soft_h264_slice_pps_id(const RK_U8 *data, RK_S32 size)
+{
+    RK_U8 rbsp[16];
+    GetBitContext gb;
+    RK_S32 i, len, zeros;
+
+    for (i = 0; i + 3 < size; i++) {
+        int type = data[i + 3] & 0x1f;
+
+        if (data[i] || data[i + 1] || data[i + 2] != 1)
+            continue;
+        if (type != H264_NAL_SLICE && type != H264_NAL_IDR_SLICE)
+            continue;
+
+        for (i += 4, len = zeros = 0; i < size && len < sizeof(rbsp); i++) {
+            if (zeros == 2 && data[i] == 3) {
+                zeros = 0;
+                continue;
+            }
+            rbsp[len++] = data[i];
+            zeros = data[i] ? 0 : zeros + 1;
+        }
+        init_get_bits8(&gb, rbsp, len);
+        get_ue_golomb_long(&gb); // first_mb_in_slice
+        get_ue_golomb_31(&gb);   // slice_type
+        return get_ue_golomb(&gb);
+    }
+
+    return AVERROR_INVALIDDATA;
+}
+
+/* add the start code and the emulation prevention bytes */
+static RK_U8 *rkvdec_soft_h264_put_nal(RK_U8 *dst, int type, PutBitContext *pb)
+{
+    const RK_U8 *rbsp = pb->buf;
+    RK_S32 i, zeros = 0, size;
+
+    put_bits(pb, 1, 1); // rbsp_stop_one_bit
+    flush_put_bits(pb);
+    size = put_bits_count(pb) >> 3;
+
+    AV_WB32(dst, 1);
+    dst += 4;
+    *dst++ = (3 << 5) | type;
+    for (i = 0; i < size; i++) {
+        if (zeros == 2 && rbsp[i] <= 3) {
+            *dst++ = 3;
+            zeros = 0;
+        }
+        *dst++ = rbsp[i];
+        zeros = rbsp[i] ? 0 : zeros + 1;
+    }
+
+    return dst;
+}
+
+static void rkvdec_soft_h264_put_scaling_list(PutBitContext *pb, const RK_U8 *list, int size)
+{
+    const uint8_t *scan = size == 16 ? ff_zigzag_scan : ff_zigzag_direct;
+    int i, last = 8;
+
+    put_bits(pb, 1, 1); // scaling_list_present_flag
+    for (i = 0; i < size; i++) {
+        set_se_golomb(pb, (int8_t)(list[scan[i]] - last));
+        last = list[scan[i]];
+    }
+}
+
+/**
+ * Rebuild the SPS and PPS from the packed entry of the vdpu341 table.
+ *
+ * @param dst where to write the NAL units, set to their end on success
+ * @return 0 on success, a negative error code otherwise
+ */
+static int rkvdec_soft_h264_param_sets(void *logctx, RK_U8 **dst,
+                                       const RK_U8 *entry, RK_S32 pps_id)
+{
+    RKVDECSoftH264Bits b = { (const uint64_t*)entry };
+    RK_U8 rbsp[SOFT_PARAM_SETS_SIZE / 2];
+    RKVDECSoftH264Map scaling_map = { NULL };
+    const RK_U8 *scaling = NULL;
+    PutBitContext pb;
+    RK_U32 chroma_format_idc, poc_type, frame_mbs_only, transform_8x8, scaling_addr;
+    RK_S32 i, j, k;
+
+    // sps
+    init_put_bits(&pb, rbsp, sizeof(rbsp));
+    rkvdec_soft_h264_bits(&b, 4 + 8 + 1); // sps id, profile, constraint_set3
+    put_bits(&pb, 8, 100);                // profile_idc, high
+    put_bits(&pb, 8, 0);                  // constraint_set_flags
+    put_bits(&pb, 8, 51);                 // level_idc
+    set_ue_golomb(&pb, 0);                // seq_parameter_set_id
+    chroma_format_idc = rkvdec_soft_h264_bits(&b, 2);
+    set_ue_golomb(&pb, chroma_format_idc);
+    if (chroma_format_idc == 3)
+        put_bits(&pb, 1, 0);              // separate_colour_plane_flag
+    // bit depths are packed as depth + 8 in 3 bits
+    set_ue_golomb(&pb, (rkvdec_soft_h264_bits(&b, 3) - 8) & 7);
+    set_ue_golomb(&pb, (rkvdec_soft_h264_bits(&b, 3) - 8) & 7);
+    rkvdec_soft_h264_bits(&b, 1);
+    put_bits(&pb, 1, 0);                  // qpprime_y_zero_transform_bypass_flag
+    put_bits(&pb, 1, 0);                  // seq_scaling_matrix_present_flag
+    set_ue_golomb(&pb, rkvdec_soft_h264_bits(&b, 4)); // log2_max_frame_num_minus4
+    i = rkvdec_soft_h264_bits(&b, 5);     // max_num_ref_frames
+    poc_type = rkvdec_soft_h264_bits(&b, 2);
+    if (poc_type == 1) {
+        avpriv_request_sample(logctx, "POC type 1");
+        return AVERROR_PATCHWELCOME;
+    }
+    set_ue_golomb(&pb, poc_type);
+    if (poc_type == 0)
+        set_ue_golomb(&pb, rkvdec_soft_h264_bits(&b, 4));
+    else
+        rkvdec_soft_h264_bits(&b, 4);
+    rkvdec_soft_h264_bits(&b, 1);         // delta_pic_order_always_zero_flag
+    set_ue_golomb(&pb, i);
+    put_bits(&pb, 1, 0);                  // gaps_in_frame_num_value_allowed_flag
+    set_ue_golomb(&pb, rkvdec_soft_h264_bits(&b, 9) - 1);
+    set_ue_golomb(&pb, rkvdec_soft_h264_bits(&b, 9) - 1);
+    frame_mbs_only = rkvdec_soft_h264_bits(&b, 1);
+    put_bits(&pb, 1, frame_mbs_only);
+    i = rkvdec_soft_h264_bits(&b, 1);
+    if (!frame_mbs_only)
+        put_bits(&pb, 1, i);              // mb_adaptive_frame_field_flag
+    put_bits(&pb, 1, rkvdec_soft_h264_bits(&b, 1)); // direct_8x8_inference_flag
+    put_bits(&pb, 1, 0);                  // frame_cropping_flag
+    put_bits(&pb, 1, 0);                  // vui_parameters_present_flag
+    *dst = rkvdec_soft_h264_put_nal(*dst, H264_NAL_SPS, &pb);
+
+    // pps, after the mvc fields and the alignment
+    b.pos = 128;
+    init_put_bits(&pb, rbsp, sizeof(rbsp));
+    rkvdec_soft_h264_bits(&b, 8 + 5);     // pps id, sps id
+    set_ue_golomb(&pb, pps_id);
+    set_ue_golomb(&pb, 0);
+    put_bits(&pb, 1, rkvdec_soft_h264_bits(&b, 1)); // entropy_coding_mode_flag
+    put_bits(&pb, 1, rkvdec_soft_h264_bits(&b, 1)); // bottom_field_pic_order_in_frame_present_flag
+    set_ue_golomb(&pb, 0);                // num_slice_groups_minus1
+    set_ue_golomb(&pb, rkvdec_soft_h264_bits(&b, 5));
+    set_ue_golomb(&pb, rkvdec_soft_h264_bits(&b, 5));
+    put_bits(&pb, 1, rkvdec_soft_h264_bits(&b, 1)); // weighted_pred_flag
+    put_bits(&pb, 2, rkvdec_soft_h264_bits(&b, 2)); // weighted_bipred_idc
+    set_se_golomb(&pb, sign_extend(rkvdec_soft_h264_bits(&b, 7), 7));
+    set_se_golomb(&pb, sign_extend(rkvdec_soft_h264_bits(&b, 6), 6));
+    set_se_golomb(&pb, sign_extend(rkvdec_soft_h264_bits(&b, 5), 5));
+    put_bits(&pb, 1, rkvdec_soft_h264_bits(&b, 1)); // deblocking_filter_control_present_flag
+    put_bits(&pb, 1, rkvdec_soft_h264_bits(&b, 1)); // constrained_intra_pred_flag
+    put_bits(&pb, 1, rkvdec_soft_h264_bits(&b, 1)); // redundant_pic_cnt_present_flag
+    transform_8x8 = rkvdec_soft_h264_bits(&b, 1);
+    put_bits(&pb, 1, transform_8x8);
+    i = sign_extend(rkvdec_soft_h264_bits(&b, 5), 5); // second_chroma_qp_index_offset
+    if (rkvdec_soft_h264_bits(&b, 1)) {
+        scaling_addr = rkvdec_soft_h264_bits(&b, 32);
+        scaling = rkvdec_soft_h264_map(&scaling_map, scaling_addr, 6 * 16 + 2 * 64);
+        if (!scaling)
+            return AVERROR_INVALIDDATA;
+    }
+    put_bits(&pb, 1, !!scaling);          // pic_scaling_matrix_present_flag
+    if (scaling) {
+        b.buf = (const uint64_t*)scaling;
+        b.pos = 0;
+        for (j = 0; j < 6 + 2 * transform_8x8; j++) {
+            RK_U8 list[64];
+            int size = j < 6 ? 16 : 64;
+            for (k = 0; k < size; k++)
+                list[k] = rkvdec_soft_h264_bits(&b, 8);
+            rkvdec_soft_h264_put_scaling_list(&pb, list, size);
+        }
+        rkvdec_soft_h264_unmap(&scaling_map);
+    }
+    set_se_golomb(&pb, i);
+    *dst = rkvdec_soft_h264_put_nal(*dst, H264_NAL_PPS, &pb);
+
+    return 0;
+}
+
+static RK_S32 rkvdec_soft_h264_write_nv12(RKVDECSoftH264Context *ctx, const RKVDEC341RegH264 *reg) {
+    const AVFrame *src = ctx->cur;
+    RK_S32 pitch = reg->swreg3_picpar.sw_y_hor_virstride * 16;
+    RK_S32 y_size = reg->swreg8_y_virstride.sw_y_virstride * 16;
+    RK_S32 w, h;
+    RKVDECSoftH264Map map = { NULL };
+    RK_U8 *dst, *uv;
+    RK_S32 x, y;
+
+    if (src->format != AV_PIX_FMT_YUV420P && src->format != AV_PIX_FMT_YUVJ420P)
+        return AVERROR_PATCHWELCOME;
+
+    if (!pitch)
+        return AVERROR(EINVAL);
+    w = FFMIN(src->width, pitch);
+    h = FFMIN(src->height, y_size / pitch);
+
+    dst = rkvdec_soft_h264_map(&map, reg->swreg7_decout_base.sw_decout_base,
+                               reg->swreg9_yuv_virstride.sw_yuv_virstride * 16);
+    if (!dst)
+        return AVERROR(EINVAL);
+
+    av_image_copy_plane(dst, pitch, src->data[0], src->linesize[0], w, h);
+
+    uv = dst + y_size;
+    for (y = 0; y < h / 2; y++) {
+        const RK_U8 *u = src->data[1] + y * src->linesize[1];
+        const RK_U8 *v = src->data[2] + y * src->linesize[2];
+        for (x = 0; x < w / 2; x++) {
+            uv[2 * x]     = u[x];
+            uv[2 * x + 1] = v[x];
+        }
+        uv += reg->swreg3_picpar.sw_uv_hor_virstride * 16;
+    }
+
+    rkvdec_soft_h264_unmap(&map);
+
+    return 0;
+}
+
+static RK_S32 rkvdec_soft_h264_decode(RKVDECSoftH264Context *ctx, const RKVDEC341RegH264 *reg) {
+    RKVDECSoftH264Map stream_map = { NULL }, pps_map = { NULL };
+    RK_S32 len = reg->swreg5_stream_rlc_len.sw_stream_len;
+    const RK_U8 *stream, *pps;
+    RK_U8 *end;
+    RK_S32 pps_id, ret;
+
+    stream = rkvdec_soft_h264_map(&stream_map, reg->swreg4_strm_rlc_base.sw_strm_rlc_base, len);
+    pps = rkvdec_soft_h264_map(&pps_map, reg->swreg42_pps_base.sw_pps_base, 256 * 32);
+    ret = AVERROR_INVALIDDATA;
+    if (!stream || !pps)
+        goto fail;
+
+    pps_id = rkvdec_soft_h264_slice_pps_id(stream, len);
+    if (pps_id < 0 || pps_id > 255)
+        goto fail;
+
+    ret = AVERROR(ENOMEM);
+    av_fast_padded_malloc(&ctx->data, &ctx->data_alloc, SOFT_PARAM_SETS_SIZE + len);
+    if (!ctx->data)
+        goto fail;
+
+    end = ctx->data;
+    ret = rkvdec_soft_h264_param_sets(ctx->dec, &end, pps + pps_id * 32, pps_id);
+    if (ret < 0)
+        goto fail;
+    memcpy(end, stream, len);
+
+    ctx->pkt->data = ctx->data;
+    ctx->pkt->size = end - ctx->data + len;
+
+    // the picture is fully decoded once the packet has been sent, output
+    // order does not matter here
+    ret = avcodec_send_packet(ctx->dec, ctx->pkt);
+    while (avcodec_receive_frame(ctx->dec, ctx->frame) >= 0)
+        av_frame_unref(ctx->frame);
+    if (ret >= 0 && !ctx->cur->buf[0])
+        ret = AVERROR_INVALIDDATA;
+    if (ret >= 0)
+        ret = rkvdec_soft_h264_write_nv12(ctx, reg);
+
+fail:
+    rkvdec_soft_h264_unmap(&stream_map);
+    rkvdec_soft_h264_unmap(&pps_map);
+    return ret;
+}
+
+static RK_S32 rkvdec_soft_h264_submit(void *p) {
+    RKVDECSoftH264Context *ctx = (RKVDECSoftH264Context*)p;
+
+    ctx->hw.prepare_idx = (ctx->hw.prepare_idx + 1) % RKVDEC_MAX_TASKS;
+
+    return 0;
+}
+
+static RK_S32 rkvdec_soft_h264_wait(void *p) {
+    RKVDECSoftH264Context *ctx = (RKVDECSoftH264Context*)p;
+    RKVDEC341RegH264 *reg = &ctx->hw.task[ctx->hw.wait_idx].reg;
+    RK_S32 ret;
+
+    ctx->hw.wait_idx = (ctx->hw.wait_idx + 1) % RKVDEC_MAX_TASKS;
+
+    reg->swreg1_int.sw_dec_e = 0;
+    reg->swreg1_int.sw_dec_irq = 1;
+    ret = rkvdec_soft_h264_decode(ctx, reg);
+    if (ret < 0)
+        reg->swreg1_int.sw_dec_error_sta = 1;
+    else
+        reg->swreg1_int.sw_dec_rdy_sta = 1;
+
+    // what the model cannot handle is not reported as a hardware error
+    if (ret == AVERROR_PATCHWELCOME)
+        return ret;
+    return ff_rkvdec341_h264_check_status(reg);
+}
+
+static RK_S32 rkvdec_soft_h264_perform(void *p) {
+    RKVDECSoftH264Context *ctx = (RKVDECSoftH264Context*)p;
+
+    rkvdec_soft_h264_submit(ctx);
+
+    return rkvdec_soft_h264_wait(ctx);
+}
+
+static RK_S32 rkvdec_soft_h264_uninit(void* p) {
+    RKVDECSoftH264Context *ctx = (RKVDECSoftH264Context*)p;
+
+    ff_rkvdec341_h264_uninit(&ctx->hw);
+
+    av_freep(&ctx->data);
+    avcodec_free_context(&ctx->dec);
+    av_frame_free(&ctx->frame);
+    av_frame_free(&ctx->cur);
+    av_packet_free(&ctx->pkt);
+
+    return 0;
+}
+
+static RK_S32 rkvdec_soft_h264_init(void *p) {
+    RKVDECSoftH264Context *ctx = (RKVDECSoftH264Context*)p;
+    RK_S32 ret;
+
+    ctx->hw.dev_fd = -1;
+    ret = ff_rkvdec341_h264_init_tasks(&ctx->hw, &rkvdec_soft_h264);
+    if (ret)
+        return ret;
+
+    ctx->frame = av_frame_alloc();
+    ctx->cur = av_frame_alloc();
+    ctx->pkt = av_packet_alloc();
+    ctx->dec = avcodec_alloc_context3(&ff_h264_decoder);
+    if (!ctx->frame || !ctx->cur || !ctx->pkt || !ctx->dec)
+        return AVERROR(ENOMEM);
+
+    ctx->dec->opaque = ctx;
+    ctx->dec->get_buffer2 = rkvdec_soft_h264_get_buffer;
+    ctx->dec->thread_count = 1;
+
+    return avcodec_open2(ctx->dec, &ff_h264_decoder, NULL);
+}
+
+struct RKVDECDevice rkvdec_soft_h264 = {
+    .name   = "soft",
+    .allocator = &allocator_memfd_pool,
+    .priv_data_size = sizeof(RKVDECSoftH264Context),
+    .init       = rkvdec_soft_h264_init,
+    .uninit     = rkvdec_soft_h264_uninit,
+    .prepare    = ff_rkvdec341_h264_prepare,
+    .perform    = rkvdec_soft_h264_perform,
+    .submit     = rkvdec_soft_h264_submit,
+    .wait       = rkvdec_soft_h264_wait,
+};
@@ -0,0 +1,367 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "libavutil/avassert.h"
+#include "vp9dec.h"
+#include "rkvdec_vp9.h"
+#include "hwaccel.h"
+#include "decode.h"
+#include "libavutil/time.h"
+
+#undef LOG_LEVEL
+#define LOG_LEVEL AV_LOG_DEBUG
+
+/* segmentation map of a picture, a byte per 8x8 block */
+static int rkvdec_vp9_segid_size(const VP9Context *s)
+{
+    return ALIGN(64 * s->sb_cols * s->sb_rows, 4096);
+}
+
+/* the segmentation map and the motion vectors the next frame may predict from */
+static int rkvdec_vp9_alloc_picture_buffer(RKVDECContext *ctx, const VP9Context *s, VP9Frame *f)
+{
+    const int colmv_size = 64 * s->sb_cols * s->sb_rows * 16;
+
+    return ff_rkvdec_alloc_picture_buffer(ctx, &f->hwaccel_priv_buf, &f->hwaccel_picture_private,
+                                          rkvdec_vp9_segid_size(s) + colmv_size);
+}
+
+static RK_U32 rkvdec_vp9_colmv(const VP9Context *s, const VP9Frame *f)
+{
+    return ff_rkvdec_get_dma_fd(f->hwaccel_picture_private) + (rkvdec_vp9_segid_size(s) << 10);
+}
+
+static void rkvdec_vp9_fill_picture(RKVDECPicture *dec_pic, AVFrame *frame)
+{
+    dec_pic->valid = 1;
+    dec_pic->index = ff_rkvdec_get_dma_fd(frame);
+    dec_pic->reference = 1;
+}
+
+static void rkvdec_vp9_fill_probs(RKVDECProbsVP9 *probs, const VP9Context *s)
+{
+    const ProbContext *p = &s->prob.p;
+    int i, j, k, l, m;
+
+#define COPY(field) memcpy(probs->field, p->field, sizeof(probs->field))
+    COPY(y_mode);
+    COPY(uv_mode);
+    COPY(filter);
+    COPY(mv_mode);
+    COPY(intra);
+    COPY(comp);
+    COPY(single_ref);
+    COPY(comp_ref);
+    COPY(tx32p);
+    COPY(tx16p);
+    COPY(tx8p);
+    COPY(skip);
+    COPY(mv_joint);
+    COPY(partition);
+#undef COPY
+
+    for (i = 0; i < 2; i++) {
+        probs->mv_comp[i].sign      = p->mv_comp[i].sign;
+        probs->mv_comp[i].class0    = p->mv_comp[i].class0;
+        probs->mv_comp[i].class0_hp = p->mv_comp[i].class0_hp;
+        probs->mv_comp[i].hp        = p->mv_comp[i].hp;
+        memcpy(probs->mv_comp[i].classes, p->mv_comp[i].classes, sizeof(probs->mv_comp[i].classes));
+        memcpy(probs->mv_comp[i].bits, p->mv_comp[i].bits, sizeof(probs->mv_comp[i].bits));
+        memcpy(probs->mv_comp[i].class0_fp, p->mv_comp[i].class0_fp, sizeof(probs->mv_comp[i].class0_fp));
+        memcpy(probs->mv_comp[i].fp, p->mv_comp[i].fp, sizeof(probs->mv_comp[i].fp));
+    }
+
+    // only the first 3 of the 11 model probabilities are coded
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 2; j++)
+            for (k = 0; k < 2; k++)
+                for (l = 0; l < 6; l++)
+                    for (m = 0; m < 6; m++)
+                        memcpy(probs->coef[i][j][k][l][m], s->prob.coef[i][j][k][l][m], 3);
+}
+
+static int rkvdec_vp9_start_frame(AVCodecContext          *avctx,
+                                  av_unused const uint8_t *buffer,
+                                  av_unused uint32_t       size)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
+    VP9Context *s = avctx->priv_data;
+    const VP9BitstreamHeader *h = &s->s.h;
+    VP9Frame *cur = &s->s.frames[CUR_FRAME];
+    VP9Frame *segmap = &s->s.frames[REF_FRAME_SEGMAP];
+    VP9Frame *mvpair = &s->s.frames[REF_FRAME_MVPAIR];
+    RKVDECPicParamsVP9 *pp = ctx->pic_param;
+    RKVDECLastFrameVP9 last;
+    int i, ret;
+
+    RKVDEC_LOG(LOG_LEVEL, "key:%d|intra:%d|show:%d", h->keyframe, h->intraonly, !h->invisible);
+
+    pthread_mutex_lock(&ctx->hwaccel_mutex);
+
+    // the state of the previous frame survives the reset
+    last = pp->last;
+    memset(pp, 0, sizeof(RKVDECPicParamsVP9));
+    pp->last = last;
+
+    ret = ff_rkvdec_attach_frame(ctx, cur->tf.f);
+    if (ret < 0) {
+        pthread_mutex_unlock(&ctx->hwaccel_mutex);
+        return ret;
+    }
+
+    ret = rkvdec_vp9_alloc_picture_buffer(ctx, s, cur);
+    if (ret < 0) {
+        pthread_mutex_unlock(&ctx->hwaccel_mutex);
+        return ret;
+    }
+
+    rkvdec_vp9_fill_picture(&pp->curr_pic, cur->tf.f);
+    pp->segid_cur = ff_rkvdec_get_dma_fd(cur->hwaccel_picture_private);
+    pp->colmv_cur = rkvdec_vp9_colmv(s, cur);
+
+    // fall back to the current picture where nothing is predicted from
+    pp->segid_last = pp->segid_cur;
+    if (segmap->tf.f->buf[0] && segmap->hwaccel_priv_buf)
+        pp->segid_last = ff_rkvdec_get_dma_fd(segmap->hwaccel_picture_private);
+    pp->colmv_ref = pp->colmv_cur;
+    if (mvpair->tf.f->buf[0] && mvpair->hwaccel_priv_buf)
+        pp->colmv_ref = rkvdec_vp9_colmv(s, mvpair);
+
+    if (!h->keyframe && !h->intraonly) {
+        for (i = 0; i < 3; i++) {
+            AVFrame *ref = s->s.refs[h->refidx[i]].f;
+
+            if (!ref->buf[0])
+                continue;
+            rkvdec_vp9_fill_picture(&pp->refs[i], ref);
+            pp->ref_width[i]  = ref->width;
+            pp->ref_height[i] = ref->height;
+            ff_rkvdec_add_ref(cur->tf.f, ref);
+        }
+    }
+
+    pp->frame_width                  = avctx->width;
+    pp->frame_height                 = avctx->height;
+
+    pp->profile                      = h->profile;
+    pp->bit_depth                    = h->bpp;
+    pp->subsampling_x                = s->ss_h;
+    pp->subsampling_y                = s->ss_v;
+    pp->keyframe                     = h->keyframe;
+    pp->intra_only                   = h->intraonly;
+    pp->show_frame                   = !h->invisible;
+    pp->error_resilient_mode         = h->errorres;
+    pp->refresh_frame_context        = h->refreshctx;
+    pp->frame_parallel_decoding_mode = h->parallelmode;
+    pp->frame_context_idx            = h->framectxid;
+    pp->allow_high_precision_mv      = h->keyframe || h->intraonly ? 0 : h->highprecisionmvs;
+    pp->interp_filter                = h->filtermode;
+    pp->use_prev_frame_mvs           = h->use_last_frame_mvs;
+    pp->comp_pred_mode               = h->comppredmode;
+    pp->comp_fixed_ref               = h->fixcompref;
+    pp->tx_mode                      = h->txfmmode;
+    for (i = 0; i < 3; i++)
+        pp->ref_frame_sign_bias[i]   = h->signbias[i];
+    for (i = 0; i < 2; i++)
+        pp->comp_var_ref[i]          = h->varcompref[i];
+
+    pp->filter_level                 = h->filter.level;
+    pp->sharpness_level              = h->filter.sharpness;
+    pp->mode_ref_delta_enabled       = h->lf_delta.enabled;
+    for (i = 0; i < 4; i++)
+        pp->ref_deltas[i]            = h->lf_delta.ref[i];
+    for (i = 0; i < 2; i++)
+        pp->mode_deltas[i]           = h->lf_delta.mode[i];
+
+    pp->base_qindex                  = h->yac_qi;
+    pp->y_dc_delta_q                 = h->ydc_qdelta;
+    pp->uv_dc_delta_q                = h->uvdc_qdelta;
+    pp->uv_ac_delta_q                = h->uvac_qdelta;
+    pp->lossless                     = h->lossless;
+
+    pp->seg.enabled                  = h->segmentation.enabled;
+    pp->seg.update_map               = h->segmentation.update_map;
+    pp->seg.temporal_update          = h->segmentation.temporal;
+    pp->seg.abs_delta                = h->segmentation.absolute_vals;
+    memcpy(pp->seg.tree_probs, h->segmentation.prob, sizeof(pp->seg.tree_probs));
+    memcpy(pp->seg.pred_probs, h->segmentation.pred_prob, sizeof(pp->seg.pred_probs));
+    for (i = 0; i < MAX_SEGMENT; i++) {
+        pp->seg.q_enabled[i]         = h->segmentation.feat[i].q_enabled;
+        pp->seg.q_val[i]             = h->segmentation.feat[i].q_val;
+        pp->seg.lf_enabled[i]        = h->segmentation.feat[i].lf_enabled;
+        pp->seg.lf_val[i]            = h->segmentation.feat[i].lf_val;
+        pp->seg.ref_enabled[i]       = h->segmentation.feat[i].ref_enabled;
+        pp->seg.ref_val[i]           = h->segmentation.feat[i].ref_val;
+        pp->seg.skip_enabled[i]      = h->segmentation.feat[i].skip_enabled;
+    }
+
+    pp->log2_tile_cols               = h->tiling.log2_tile_cols;
+    pp->log2_tile_rows               = h->tiling.log2_tile_rows;
+
+    pp->uncompressed_header_size     = h->uncompressed_header_size;
+    pp->compressed_header_size       = h->compressed_header_size;
+
+    rkvdec_vp9_fill_probs(&pp->probs, s);
+
+    // backward adaptation is done here from the counts of the hardware
+    pp->need_counts = h->refreshctx && !h->parallelmode;
+
+    ctx->pkt.size = 0;
+
+    return 0;
+}
+
+static void rkvdec_vp9_save_last(RKVDECPicParamsVP9 *pp)
+{
+    RKVDECLastFrameVP9 *last = &pp->last;
+
+    last->valid                = 1;
+    last->frame_width          = pp->frame_width;
+    last->frame_height         = pp->frame_height;
+    last->show_frame           = pp->show_frame;
+    last->intra_only           = pp->keyframe || pp->intra_only;
+    last->segmentation_enabled = pp->seg.enabled;
+    memcpy(last->ref_deltas, pp->ref_deltas, sizeof(last->ref_deltas));
+    memcpy(last->mode_deltas, pp->mode_deltas, sizeof(last->mode_deltas));
+}
+
+/* what vp9.c does after the tile decoding loop when there is no hwaccel */
+static int rkvdec_vp9_refresh_context(RKVDECContext *ctx, VP9Context *s, AVFrame *frame)
+{
+    RKVDECPicParamsVP9 *pp = ctx->pic_param;
+    int i, j, k, l, m, ret;
+
+    if (!s->s.h.refreshctx)
+        return 0;
+
+    if (s->s.h.parallelmode) {
+        for (i = 0; i < 4; i++) {
+            for (j = 0; j < 2; j++)
+                for (k = 0; k < 2; k++)
+                    for (l = 0; l < 6; l++)
+                        for (m = 0; m < 6; m++)
+                            memcpy(s->prob_ctx[s->s.h.framectxid].coef[i][j][k][l][m],
+                                   s->prob.coef[i][j][k][l][m], 3);
+            if (s->s.h.txfmmode == i)
+                break;
+        }
+        s->prob_ctx[s->s.h.framectxid].p = s->prob.p;
+        return 0;
+    }
+
+    // the next frame cannot be set up before the counts are known
+    ret = ff_rkvdec_sync_frame(ctx, frame);
+    if (ret < 0)
+        return ret;
+
+    av_assert0(sizeof(pp->counts) == sizeof(s->td[0].counts));
+    memcpy(&s->td[0].counts, &pp->counts, sizeof(s->td[0].counts));
+    ff_vp9_adapt_probs(s);
+
+    return 0;
+}
+
+static int rkvdec_vp9_end_frame(AVCodecContext *avctx)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
+    VP9Context *s = avctx->priv_data;
+    AVFrame *frame = s->s.frames[CUR_FRAME].tf.f;
+    RKVDECPicParamsVP9 *pp = ctx->pic_param;
+    int64_t begin;
+    int ret;
+    RKVDEC_LOG(LOG_LEVEL, "");
+
+    if (ctx->pkt.size <= 0) {
+        frame->decode_error_flags |= FF_DECODE_ERROR_INVALID_BITSTREAM;
+        pthread_mutex_unlock(&ctx->hwaccel_mutex);
+        return 0;
+    }
+
+    begin = av_gettime();
+    if (ff_rkvdec_submit_frame(ctx, frame) < 0)
+        frame->decode_error_flags |= FF_DECODE_ERROR_INVALID_BITSTREAM;
+
+    rkvdec_vp9_save_last(pp);
+
+    ret = rkvdec_vp9_refresh_context(ctx, s, frame);
+
+    RKVDEC_LOG(LOG_LEVEL, "pending:%d|cost:%dus", ctx->nb_tasks, (int)(av_gettime() - begin));
+    pthread_mutex_unlock(&ctx->hwaccel_mutex);
+
+    return ret;
+}
+
+static int rkvdec_vp9_decode_slice(AVCodecContext *avctx,
+                                   const uint8_t  *buffer,
+                                   uint32_t        size)
+{
+    RKVDECContext * const ctx = ff_rkvdec_get_context(avctx);
+    RKVDEC_LOG(LOG_LEVEL, "size:%d", size);
+
+    // the whole frame, the hardware skips the uncompressed header itself
+    return ff_rkvdec_append_stream(ctx, NULL, 0, buffer, size);
+}
+
+extern struct RKVDECDevice rkvdec341_vp9;
+extern struct RKVDECDevice rkvdec341_vp9_capture;
+
+static const RKVDECDevice * const rkvdec_vp9_devices[] = {
+    &rkvdec341_vp9,
+    &rkvdec341_vp9_capture,
+    NULL,
+};
+
+static int rkvdec_vp9_context_init(AVCodecContext *avctx)
+{
+    RKVDEC_LOG(LOG_LEVEL, "");
+
+    return ff_rkvdec_context_init(avctx, rkvdec_vp9_devices, sizeof(RKVDECPicParamsVP9));
+}
+
+static int rkvdec_vp9_context_uninit(AVCodecContext *avctx)
+{
+    RKVDEC_LOG(LOG_LEVEL, "");
+
+    return ff_rkvdec_context_uninit(avctx);
+}
+
+static int rkvdec_vp9_frame_params(AVCodecContext *avctx, AVBufferRef *hw_frames_ctx)
+{
+    RKVDEC_LOG(LOG_LEVEL, "");
+
+    // the 8 reference slots and the current picture
+    return ff_rkvdec_frame_params(avctx, hw_frames_ctx, 8 + 1);
+}
+
+const AVHWAccel ff_vp9_rkvdec_hwaccel = {
+    .name                 = "vp9_rkvdec",
+    .type                 = AVMEDIA_TYPE_VIDEO,
+    .id                   = AV_CODEC_ID_VP9,
+    .pix_fmt              = AV_PIX_FMT_DRM_PRIME,
+    .start_frame          = rkvdec_vp9_start_frame,
+    .end_frame            = rkvdec_vp9_end_frame,
+    .decode_slice         = rkvdec_vp9_decode_slice,
+    .init                 = rkvdec_vp9_context_init,
+    .uninit               = rkvdec_vp9_context_uninit,
+    .frame_params         = rkvdec_vp9_frame_params,
+    .priv_data_size       = sizeof(RKVDECContext),
+    .frame_priv_data_size = sizeof(AVFrame),
+    .caps_internal        = HWACCEL_CAP_ASYNC_SAFE,
+};
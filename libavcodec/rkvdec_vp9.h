@@ -0,0 +1,177 @@
+/*
+ * Copyright 2018 Rockchip Electronics Co., Ltd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef AVCODEC_RKVDEC_VP9_H
+#define AVCODEC_RKVDEC_VP9_H
+
+#include "rkvdec.h"
+
+/* frame probabilities, same layout as ProbContext */
+typedef struct RKVDECProbsVP9 {
+    RK_U8   y_mode[4][9];
+    RK_U8   uv_mode[10][9];
+    RK_U8   filter[4][2];
+    RK_U8   mv_mode[7][3];
+    RK_U8   intra[4];
+    RK_U8   comp[5];
+    RK_U8   single_ref[5][2];
+    RK_U8   comp_ref[5];
+    RK_U8   tx32p[2][3];
+    RK_U8   tx16p[2][2];
+    RK_U8   tx8p[2];
+    RK_U8   skip[3];
+    RK_U8   mv_joint[3];
+    struct {
+        RK_U8   sign;
+        RK_U8   classes[10];
+        RK_U8   class0;
+        RK_U8   bits[10];
+        RK_U8   class0_fp[2][3];
+        RK_U8   fp[3];
+        RK_U8   class0_hp;
+        RK_U8   hp;
+    } mv_comp[2];
+    RK_U8   partition[4][4][3];
+    RK_U8   coef[4][2][2][6][6][3];
+} RKVDECProbsVP9;
+
+/* symbol counts of a frame for the backward adaptation, same layout as the
+ * counts of VP9TileData */
+typedef struct RKVDECCountsVP9 {
+    RK_U32  y_mode[4][10];
+    RK_U32  uv_mode[10][10];
+    RK_U32  filter[4][3];
+    RK_U32  mv_mode[7][4];
+    RK_U32  intra[4][2];
+    RK_U32  comp[5][2];
+    RK_U32  single_ref[5][2][2];
+    RK_U32  comp_ref[5][2];
+    RK_U32  tx32p[2][4];
+    RK_U32  tx16p[2][3];
+    RK_U32  tx8p[2][2];
+    RK_U32  skip[3][2];
+    RK_U32  mv_joint[4];
+    struct {
+        RK_U32  sign[2];
+        RK_U32  classes[11];
+        RK_U32  class0[2];
+        RK_U32  bits[10][2];
+        RK_U32  class0_fp[2][4];
+        RK_U32  fp[4];
+        RK_U32  class0_hp[2];
+        RK_U32  hp[2];
+    } mv_comp[2];
+    RK_U32  partition[4][4][4];
+    RK_U32  coef[4][2][2][6][6][3];
+    RK_U32  eob[4][2][2][6][6][2];
+} RKVDECCountsVP9;
+
+/* what the hardware needs to know about the previously decoded frame */
+typedef struct RKVDECLastFrameVP9 {
+    RK_U32  frame_width;
+    RK_U32  frame_height;
+    RK_U8   valid;
+    RK_U8   show_frame;
+    RK_U8   intra_only;
+    RK_U8   segmentation_enabled;
+    RK_S8   ref_deltas[4];
+    RK_S8   mode_deltas[2];
+} RKVDECLastFrameVP9;
+
+typedef struct RKVDECPicParamsVP9 {
+    RK_U32  frame_width;
+    RK_U32  frame_height;
+
+    RK_U8   profile;
+    RK_U8   bit_depth;
+    RK_U8   subsampling_x;
+    RK_U8   subsampling_y;
+    RK_U8   keyframe;
+    RK_U8   intra_only;
+    RK_U8   show_frame;
+    RK_U8   error_resilient_mode;
+    RK_U8   refresh_frame_context;
+    RK_U8   frame_parallel_decoding_mode;
+    RK_U8   frame_context_idx;
+    RK_U8   allow_high_precision_mv;
+    RK_U8   interp_filter;
+    RK_U8   use_prev_frame_mvs;
+    RK_U8   ref_frame_sign_bias[3];
+    RK_U8   comp_pred_mode;
+    RK_U8   comp_fixed_ref;
+    RK_U8   comp_var_ref[2];
+    RK_U8   tx_mode;
+
+    RK_U8   filter_level;
+    RK_U8   sharpness_level;
+    RK_U8   mode_ref_delta_enabled;
+    RK_S8   ref_deltas[4];
+    RK_S8   mode_deltas[2];
+
+    RK_U8   base_qindex;
+    RK_S8   y_dc_delta_q;
+    RK_S8   uv_dc_delta_q;
+    RK_S8   uv_ac_delta_q;
+    RK_U8   lossless;
+
+    struct {
+        RK_U8   enabled;
+        RK_U8   update_map;
+        RK_U8   temporal_update;
+        RK_U8   abs_delta;
+        RK_U8   tree_probs[7];
+        RK_U8   pred_probs[3];
+        RK_U8   q_enabled[8];
+        RK_S16  q_val[8];
+        RK_U8   lf_enabled[8];
+        RK_S8   lf_val[8];
+        RK_U8   ref_enabled[8];
+        RK_U8   ref_val[8];
+        RK_U8   skip_enabled[8];
+    } seg;
+
+    RK_U8   log2_tile_cols;
+    RK_U8   log2_tile_rows;
+
+    RK_U32  uncompressed_header_size;
+    RK_U32  compressed_header_size;
+
+    RKVDECPicture   curr_pic;
+    /* last, golden, altref */
+    RKVDECPicture   refs[3];
+    RK_U32          ref_width[3];
+    RK_U32          ref_height[3];
+
+    /* per picture buffer: segmentation map, then co-located motion vectors */
+    RK_U32          segid_cur;
+    RK_U32          segid_last;
+    RK_U32          colmv_cur;
+    RK_U32          colmv_ref;
+
+    RKVDECLastFrameVP9  last;
+
+    RKVDECProbsVP9  probs;
+
+    /* when set, the device fills counts once the frame is decoded */
+    RK_U8           need_counts;
+    RKVDECCountsVP9 counts;
+} RKVDECPicParamsVP9;
+
+#endif
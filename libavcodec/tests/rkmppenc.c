@@ -0,0 +1,304 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Run the h264_rkmpp/hevc_rkmpp wrappers against a stand-in for MPP.
+ *
+ * Check the rate control parameters derived from the codec options, that
+ * DRM PRIME frames reach MPP as they are and stay alive until their packet
+ * has been returned, the input backpressure and draining.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/hwcontext_drm.h"
+#include "libavutil/opt.h"
+#include "libavcodec/avcodec.h"
+#include "libavcodec/rkmppenc.h"
+
+#define NB_FRAMES 10
+#define LATENCY   2
+
+typedef struct StubEncoder {
+    RKMPPEncParams params;
+    const void *queue[NB_FRAMES];
+    int64_t pts[NB_FRAMES];
+    int nb_put, nb_got;
+    int eos;
+} StubEncoder;
+
+static StubEncoder *stub;
+static int nb_released;
+
+static int stub_open(void **handle, void *logctx, const RKMPPEncParams *params)
+{
+    stub = av_mallocz(sizeof(*stub));
+    if (!stub)
+        return AVERROR(ENOMEM);
+    stub->params = *params;
+    *handle = stub;
+    return 0;
+}
+
+static void stub_close(void *handle)
+{
+    av_free(handle);
+}
+
+static int stub_get_header(void *handle, uint8_t *buf, int size)
+{
+    static const uint8_t header[] = { 0, 0, 0, 1, 0x67, 0x42 };
+    memcpy(buf, header, sizeof(header));
+    return sizeof(header);
+}
+
+static int stub_put_frame(void *handle, const AVFrame *frame)
+{
+    StubEncoder *s = handle;
+
+    if (!frame) {
+        s->eos = 1;
+        return 0;
+    }
+    if (s->nb_put == NB_FRAMES)
+        return AVERROR(EAGAIN);
+
+    s->queue[s->nb_put] = frame->data[0];
+    s->pts[s->nb_put++] = frame->pts;
+    return 0;
+}
+
+static int stub_get_packet(void *handle, AVPacket *pkt, int timeout)
+{
+    StubEncoder *s = handle;
+    int ret;
+
+    if (s->nb_got == s->nb_put)
+        return s->eos ? AVERROR_EOF : AVERROR(EAGAIN);
+
+    // the hardware keeps a few frames in its pipeline unless waited for
+    if (!timeout && !s->eos && s->nb_put - s->nb_got <= LATENCY)
+        return AVERROR(EAGAIN);
+
+    ret = av_new_packet(pkt, 16);
+    if (ret < 0)
+        return ret;
+    pkt->pts = pkt->dts = s->pts[s->nb_got++];
+    return 0;
+}
+
+static const RKMPPEncOps stub_ops = {
+    .open       = stub_open,
+    .close      = stub_close,
+    .get_header = stub_get_header,
+    .put_frame  = stub_put_frame,
+    .get_packet = stub_get_packet,
+};
+
+static AVCodecContext *open_encoder(const char *name, const char *opts)
+{
+    AVCodec *codec = avcodec_find_encoder_by_name(name);
+    AVCodecContext *avctx;
+    AVDictionary *dict = NULL;
+    int ret;
+
+    if (!codec)
+        return NULL;
+
+    avctx = avcodec_alloc_context3(codec);
+    if (!avctx)
+        return NULL;
+
+    avctx->width     = 1920;
+    avctx->height    = 1080;
+    avctx->pix_fmt   = AV_PIX_FMT_DRM_PRIME;
+    avctx->time_base = (AVRational){ 1, 25 };
+
+    av_dict_parse_string(&dict, opts, "=", ":", 0);
+    ret = avcodec_open2(avctx, codec, &dict);
+    av_dict_free(&dict);
+    if (ret < 0)
+        avcodec_free_context(&avctx);
+    return avctx;
+}
+
+static int check_params(const char *opts, enum RKMPPEncRcMode rc_mode,
+                        int64_t bitrate, int64_t bitrate_min, int64_t bitrate_max,
+                        int qp, int gop)
+{
+    AVCodecContext *avctx = open_encoder("h264_rkmpp", opts);
+    const RKMPPEncParams *p;
+    int ret = 0;
+
+    if (!avctx) {
+        fprintf(stderr, "'%s': failed to open the encoder\n", opts);
+        return 1;
+    }
+
+    p = &stub->params;
+    if (p->rc_mode != rc_mode || p->bitrate != bitrate || p->qp != qp ||
+        (rc_mode != RKMPP_ENC_RC_CQP && (p->bitrate_min != bitrate_min ||
+                                         p->bitrate_max != bitrate_max)) ||
+        p->gop != gop || p->hor_stride != 1920 || p->ver_stride != 1088 ||
+        p->framerate.num != 25 || p->framerate.den != 1) {
+        fprintf(stderr, "'%s': got rc %d, %"PRId64" [%"PRId64", %"PRId64"] bps, qp %d, gop %d\n",
+                opts, p->rc_mode, p->bitrate, p->bitrate_min, p->bitrate_max, p->qp, p->gop);
+        ret = 1;
+    }
+
+    avcodec_free_context(&avctx);
+    return ret;
+}
+
+static void release_desc(void *opaque, uint8_t *data)
+{
+    nb_released++;
+    av_free(data);
+}
+
+static AVFrame *alloc_prime_frame(int64_t pts)
+{
+    AVFrame *frame = av_frame_alloc();
+    AVDRMFrameDescriptor *desc = av_mallocz(sizeof(*desc));
+
+    if (!frame || !desc)
+        goto fail;
+
+    frame->buf[0] = av_buffer_create((uint8_t *)desc, sizeof(*desc), release_desc, NULL, 0);
+    if (!frame->buf[0])
+        goto fail;
+    frame->data[0] = (uint8_t *)desc;
+    frame->format  = AV_PIX_FMT_DRM_PRIME;
+    frame->width   = 1920;
+    frame->height  = 1080;
+    frame->pts     = pts;
+    return frame;
+
+fail:
+    av_free(desc);
+    av_frame_free(&frame);
+    return NULL;
+}
+
+static int check_pipeline(const char *name)
+{
+    AVCodecContext *avctx = open_encoder(name, "async_depth=4");
+    const void *sent[NB_FRAMES];
+    AVPacket pkt;
+    int i = 0, nb_packets = 0, ret = 0, err;
+
+    if (!avctx) {
+        fprintf(stderr, "%s: failed to open the encoder\n", name);
+        return 1;
+    }
+    av_init_packet(&pkt);
+    nb_released = 0;
+
+    while (nb_packets < NB_FRAMES) {
+        if (i < NB_FRAMES) {
+            AVFrame *frame = alloc_prime_frame(i);
+            if (!frame) {
+                ret = 1;
+                break;
+            }
+            sent[i] = frame->data[0];
+            err = avcodec_send_frame(avctx, frame);
+            av_frame_free(&frame);
+            if (err == AVERROR(EAGAIN)) {
+                if (i - nb_packets < 4) {
+                    fprintf(stderr, "%s: EAGAIN with %d frames queued\n", name, i - nb_packets);
+                    ret = 1;
+                }
+            } else if (err < 0) {
+                fprintf(stderr, "%s: send_frame failed\n", name);
+                ret = 1;
+                break;
+            } else {
+                i++;
+            }
+            if (i == NB_FRAMES)
+                avcodec_send_frame(avctx, NULL);
+        }
+
+        err = avcodec_receive_packet(avctx, &pkt);
+        if (err == AVERROR(EAGAIN)) {
+            if (i - nb_packets >= 4) {
+                fprintf(stderr, "%s: EAGAIN from both send and receive\n", name);
+                ret = 1;
+                break;
+            }
+            continue;
+        }
+        if (err < 0) {
+            fprintf(stderr, "%s: receive_packet failed\n", name);
+            ret = 1;
+            break;
+        }
+
+        if (pkt.pts != nb_packets) {
+            fprintf(stderr, "%s: packet %d has pts %"PRId64"\n", name, nb_packets, pkt.pts);
+            ret = 1;
+        }
+        nb_packets++;
+        av_packet_unref(&pkt);
+
+        // frames whose packet is out may go, the others must stay
+        if (nb_released != nb_packets) {
+            fprintf(stderr, "%s: %d frames released after %d packets\n",
+                    name, nb_released, nb_packets);
+            ret = 1;
+        }
+    }
+
+    if (avcodec_receive_packet(avctx, &pkt) != AVERROR_EOF) {
+        fprintf(stderr, "%s: no EOF after the last packet\n", name);
+        ret = 1;
+    }
+
+    for (i = 0; i < NB_FRAMES && i < stub->nb_put; i++) {
+        if (stub->queue[i] != sent[i]) {
+            fprintf(stderr, "%s: frame %d was not passed through\n", name, i);
+            ret = 1;
+        }
+    }
+
+    avcodec_free_context(&avctx);
+    return ret;
+}
+
+int main(void)
+{
+    int ret = 0;
+
+    ff_rkmpp_enc_ops = &stub_ops;
+
+    ret |= check_params("",                       RKMPP_ENC_RC_CQP, 0, 0, 0, 26, 12);
+    ret |= check_params("b=2000000:maxrate=2000000", RKMPP_ENC_RC_CBR,
+                        2000000, 1875000, 2000000, 26, 12);
+    ret |= check_params("b=2000000:g=50",         RKMPP_ENC_RC_VBR,
+                        2000000, 125000, 2125000, 26, 50);
+    ret |= check_params("b=2000000:rc_mode=cqp:qp=30", RKMPP_ENC_RC_CQP,
+                        2000000, 0, 0, 30, 12);
+
+    ret |= check_pipeline("h264_rkmpp");
+    ret |= check_pipeline("hevc_rkmpp");
+
+    return ret;
+}
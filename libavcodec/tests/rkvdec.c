@@ -0,0 +1,637 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Exercise the RKVDEC submission queue against a stand-in device which
+ * behaves like the in-order /dev/rkvdec SET_REG/GET_REG interface, also
+ * with the two fields of a frame queued as separate tasks.
+ *
+ * Check that the memfd buffer pool recycles buffers with their fd and mapping.
+ *
+ * Run the HEVC and VP9 preparation through the capture devices and check
+ * the register words and tables they would hand to the kernel.
+ *
+ * With -b, run a micro-benchmark of the bitstream path and report the
+ * bytes copied per decoded frame.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/time.h"
+#include "libavcodec/allocator_pool.h"
+#include "libavcodec/decode.h"
+#include "libavcodec/rkvdec.h"
+#if CONFIG_HEVC_RKVDEC_HWACCEL
+#include "libavcodec/hevcdec.h"
+#include "libavcodec/rkvdec_hevc.h"
+#endif
+#if CONFIG_VP9_RKVDEC_HWACCEL
+#include "libavcodec/rkvdec_vp9.h"
+#endif
+
+#define NB_FRAMES 8
+
+typedef struct StubDevice {
+    int prepared;
+    int fifo[RKVDEC_MAX_TASKS];
+    int fifo_head, nb_fifo;
+    int max_pending;
+    int completed[NB_FRAMES + 1];
+    int nb_completed;
+    int bad_task;
+    int nb_perform;
+} StubDevice;
+
+static RK_S32 stub_init(void *p)    { return 0; }
+static RK_S32 stub_uninit(void *p)  { return 0; }
+
+static RK_S32 stub_prepare(void *p, void *data, void *param)
+{
+    StubDevice *s = p;
+    AVPacket *pkt = data;
+    AVFrame *stream = (AVFrame*)pkt->buf->data;
+
+    /* the device must be handed the mapped DMA buffer itself */
+    if (pkt->data != stream->data[0] || pkt->size > stream->linesize[0])
+        return AVERROR_BUG;
+
+    s->prepared++;
+    return 0;
+}
+
+static RK_S32 stub_submit(void *p)
+{
+    StubDevice *s = p;
+    if (s->nb_fifo == RKVDEC_MAX_TASKS)
+        return AVERROR_BUG;
+    s->fifo[(s->fifo_head + s->nb_fifo++) % RKVDEC_MAX_TASKS] = s->prepared;
+    s->max_pending = FFMAX(s->max_pending, s->nb_fifo);
+    return 0;
+}
+
+static RK_S32 stub_wait(void *p)
+{
+    StubDevice *s = p;
+    int task;
+    if (!s->nb_fifo)
+        return AVERROR_BUG;
+    task = s->fifo[s->fifo_head];
+    s->fifo_head = (s->fifo_head + 1) % RKVDEC_MAX_TASKS;
+    s->nb_fifo--;
+    if (s->nb_completed < FF_ARRAY_ELEMS(s->completed))
+        s->completed[s->nb_completed] = task;
+    s->nb_completed++;
+    return task == s->bad_task ? AVERROR_INVALIDDATA : 0;
+}
+
+static RK_S32 stub_perform(void *p)
+{
+    StubDevice *s = p;
+    s->nb_perform++;
+    stub_submit(p);
+    return stub_wait(p);
+}
+
+static int stub_alloc_open(void **ctx, size_t alignment)
+{
+    *ctx = NULL;
+    return 0;
+}
+
+static int stub_alloc_close(void *ctx)
+{
+    return 0;
+}
+
+static int stub_alloc(void *ctx, AVFrame *info)
+{
+    info->data[0] = av_malloc(info->linesize[0]);
+    info->linesize[2] = -1;
+    return info->data[0] ? 0 : AVERROR(ENOMEM);
+}
+
+static int stub_free(void *ctx, AVFrame *info)
+{
+    av_freep(&info->data[0]);
+    return 0;
+}
+
+static const os_allocator stub_allocator = {
+    .name  = "stub",
+    .open  = stub_alloc_open,
+    .close = stub_alloc_close,
+    .alloc = stub_alloc,
+    .free  = stub_free,
+};
+
+static const RKVDECDevice stub_device = {
+    .name    = "stub",
+    .init    = stub_init,
+    .prepare = stub_prepare,
+    .perform = stub_perform,
+    .uninit  = stub_uninit,
+    .submit  = stub_submit,
+    .wait    = stub_wait,
+};
+
+static void context_init(RKVDECContext *ctx, StubDevice *s, int depth, int async)
+{
+    ctx->dev = stub_device;
+    if (!async)
+        ctx->dev.submit = ctx->dev.wait = NULL;
+    ctx->dev_ctx = s;
+    ctx->allocator = stub_allocator;
+    ctx->allocator.open(&ctx->allocator_ctx, 1);
+    av_init_packet(&ctx->pkt);
+    ctx->pkt.data = NULL;
+    ctx->pkt.size = 0;
+    pthread_mutex_init(&ctx->hwaccel_mutex, NULL);
+    ff_rkvdec_queue_init(ctx, depth);
+}
+
+static void context_uninit(RKVDECContext *ctx)
+{
+    ff_rkvdec_flush(ctx);
+    ff_rkvdec_stream_uninit(ctx);
+    ctx->allocator.close(ctx->allocator_ctx);
+    pthread_mutex_destroy(&ctx->hwaccel_mutex);
+}
+
+static int run(int depth, int async)
+{
+    static const uint8_t start_code[] = { 0, 0, 1 };
+    static uint8_t slice[3 * RKVDEC_STREAM_SIZE / 4];
+    RKVDECContext ctx = { 0 };
+    StubDevice s = { 0 };
+    AVFrame *frames[NB_FRAMES] = { NULL };
+    FrameDecodeData *fdd;
+    int i, j, ret = 1;
+
+    context_init(&ctx, &s, depth, async);
+    s.bad_task = 3;
+
+    for (i = 0; i < NB_FRAMES; i++) {
+        frames[i] = av_frame_alloc();
+        if (!frames[i] || ff_attach_decode_data(frames[i]) < 0 ||
+            ff_rkvdec_attach_frame(&ctx, frames[i]) < 0)
+            goto end;
+        if (i)
+            ff_rkvdec_add_ref(frames[i], frames[i - 1]);
+        /* frame 4 outgrows the initial stream buffer size */
+        for (j = 0; j < (i == 4 ? 3 : 1); j++) {
+            memset(slice, i, sizeof(slice));
+            if (ff_rkvdec_append_stream(&ctx, start_code, sizeof(start_code),
+                                        slice, sizeof(slice)) < 0)
+                goto end;
+            if (ctx.pkt.data[ctx.pkt.size - 1] != i ||
+                memcmp(ctx.pkt.data, start_code, sizeof(start_code))) {
+                printf("depth %d: frame %d bitstream corrupted\n", depth, i);
+                goto end;
+            }
+        }
+        if (ff_rkvdec_submit_frame(&ctx, frames[i]) < 0)
+            goto end;
+        if (s.nb_fifo > depth) {
+            printf("depth %d: %d tasks pending\n", depth, s.nb_fifo);
+            goto end;
+        }
+    }
+
+    /* output of frame 5 must reap everything submitted before it */
+    fdd = (FrameDecodeData*)frames[5]->private_ref->data;
+    fdd->post_process(NULL, frames[5]);
+    if (s.nb_completed < 6) {
+        printf("depth %d: frame 5 returned before being decoded\n", depth);
+        goto end;
+    }
+
+    pthread_mutex_lock(&ctx.hwaccel_mutex);
+    ff_rkvdec_flush(&ctx);
+    pthread_mutex_unlock(&ctx.hwaccel_mutex);
+
+    for (i = 0; i < NB_FRAMES; i++) {
+        int expected = i + 1 >= s.bad_task ? FF_DECODE_ERROR_INVALID_BITSTREAM : 0;
+        ff_rkvdec_sync_frame(&ctx, frames[i]);
+        if (s.completed[i] != i + 1) {
+            printf("depth %d: task %d completed out of order\n", depth, i + 1);
+            goto end;
+        }
+        if (frames[i]->decode_error_flags != expected) {
+            printf("depth %d: frame %d error flags %d, expected %d\n",
+                   depth, i, frames[i]->decode_error_flags, expected);
+            goto end;
+        }
+    }
+
+    if (s.nb_fifo || s.nb_completed != NB_FRAMES ||
+        s.max_pending != (async ? depth : 1) ||
+        s.nb_perform != (async && depth > 1 ? 0 : NB_FRAMES)) {
+        printf("depth %d: %d pending, %d completed, %d max pending, %d perform\n",
+               depth, s.nb_fifo, s.nb_completed, s.max_pending, s.nb_perform);
+        goto end;
+    }
+
+    if (ctx.stream_pool_size != 4 * RKVDEC_STREAM_SIZE) {
+        printf("depth %d: stream pool size %d\n", depth, ctx.stream_pool_size);
+        goto end;
+    }
+
+    ret = 0;
+end:
+    for (i = 0; i < NB_FRAMES; i++)
+        av_frame_free(&frames[i]);
+    context_uninit(&ctx);
+    return ret;
+}
+
+/* the fields of a frame are separate tasks, the frame waits for the last */
+static int field_test(int depth)
+{
+    static const uint8_t slice[16];
+    RKVDECContext ctx = { 0 };
+    StubDevice s = { 0 };
+    AVFrame *frame = av_frame_alloc();
+    FrameDecodeData *fdd;
+    int i, ret = 1;
+
+    context_init(&ctx, &s, depth, 1);
+    if (!frame || ff_attach_decode_data(frame) < 0 ||
+        ff_rkvdec_attach_frame(&ctx, frame) < 0)
+        goto end;
+
+    for (i = 0; i < 2; i++) {
+        if (ff_rkvdec_append_stream(&ctx, NULL, 0, slice, sizeof(slice)) < 0 ||
+            ff_rkvdec_submit_frame(&ctx, frame) < 0)
+            goto end;
+    }
+
+    fdd = (FrameDecodeData*)frame->private_ref->data;
+    fdd->post_process(NULL, frame);
+    if (s.nb_completed != 2) {
+        printf("depth %d: frame returned after %d of its 2 fields\n",
+               depth, s.nb_completed);
+        goto end;
+    }
+
+    ret = 0;
+end:
+    av_frame_free(&frame);
+    context_uninit(&ctx);
+    return ret;
+}
+
+static int pool_test(void)
+{
+    const int nv12_1080p = 1920 * 1088 * 3 / 2;
+    os_allocator pool = allocator_memfd_pool;
+    void *ctx, *ctx2;
+    AVFrame a = { { 0 } }, b = { { 0 } };
+    int fd, ret = 1;
+    uint8_t *ptr;
+
+    if (ff_allocator_pool_class_size(nv12_1080p) != 3 << 20 ||
+        ff_allocator_pool_class_size(RKVDEC_STREAM_SIZE) != RKVDEC_STREAM_SIZE ||
+        ff_allocator_pool_class_size(1) != 4096) {
+        printf("pool: unexpected size classes\n");
+        return 1;
+    }
+
+    /* every opener shares the same pool */
+    if (pool.open(&ctx, 1) || pool.open(&ctx2, 1) || ctx != ctx2)
+        return 1;
+
+    a.linesize[0] = nv12_1080p;
+    if (pool.alloc(ctx, &a) || a.linesize[0] != 3 << 20) {
+        printf("pool: allocation failed\n");
+        goto end;
+    }
+    fd  = a.linesize[2];
+    ptr = a.data[0];
+    memset(ptr, 0x55, a.linesize[0]);
+    pool.free(ctx, &a);
+
+    /* the same size class gets the idle buffer back, a different one does not */
+    b.linesize[0] = nv12_1080p - 4096;
+    a.linesize[0] = RKVDEC_STREAM_SIZE;
+    if (pool.alloc(ctx2, &b) || pool.alloc(ctx2, &a) ||
+        b.linesize[2] != fd || b.data[0] != ptr || a.data[0] == ptr ||
+        ptr[b.linesize[0] - 1] != 0x55) {
+        printf("pool: buffer not recycled\n");
+        goto end;
+    }
+    pool.free(ctx2, &a);
+    pool.free(ctx2, &b);
+
+    if (pool.prewarm(ctx, nv12_1080p, 3))
+        goto end;
+
+    ret = 0;
+end:
+    pool.close(ctx2);
+    pool.close(ctx);
+    return ret;
+}
+
+#if CONFIG_HEVC_RKVDEC_HWACCEL || CONFIG_VP9_RKVDEC_HWACCEL
+typedef struct CaptureTest {
+    const RKVDECDevice *dev;
+    void *dev_ctx;
+    os_allocator pool;
+    void *pool_ctx;
+    AVFrame stream;
+    AVPacket pkt;
+} CaptureTest;
+
+static void capture_buffer_free(void *opaque, uint8_t *data)
+{
+}
+
+static int capture_init(CaptureTest *t, const RKVDECDevice *dev, int stream_size)
+{
+    memset(t, 0, sizeof(*t));
+    t->dev = dev;
+    t->pool = allocator_memfd_pool;
+    if (t->pool.open(&t->pool_ctx, 1))
+        return 1;
+    t->stream.linesize[0] = 4096;
+    if (t->pool.alloc(t->pool_ctx, &t->stream))
+        return 1;
+    memset(t->stream.data[0], 0x5a, stream_size);
+
+    av_init_packet(&t->pkt);
+    t->pkt.buf  = av_buffer_create((uint8_t*)&t->stream, sizeof(t->stream),
+                                   capture_buffer_free, NULL, 0);
+    t->pkt.data = t->stream.data[0];
+    t->pkt.size = stream_size;
+
+    t->dev_ctx = av_mallocz(dev->priv_data_size);
+    if (!t->pkt.buf || !t->dev_ctx || dev->init(t->dev_ctx)) {
+        printf("%s: cannot open the capture device\n", dev->name);
+        return 1;
+    }
+    return 0;
+}
+
+static void capture_uninit(CaptureTest *t)
+{
+    if (t->dev_ctx)
+        t->dev->uninit(t->dev_ctx);
+    av_freep(&t->dev_ctx);
+    av_buffer_unref(&t->pkt.buf);
+    if (t->stream.data[0])
+        t->pool.free(t->pool_ctx, &t->stream);
+    if (t->pool_ctx)
+        t->pool.close(t->pool_ctx);
+}
+
+static int capture_run(CaptureTest *t, void *pic_param, const RKVDECCapture **cap)
+{
+    *cap = t->dev_ctx;
+    if (t->dev->prepare(t->dev_ctx, &t->pkt, pic_param) ||
+        t->dev->submit(t->dev_ctx) || t->dev->wait(t->dev_ctx))
+        return 1;
+    if ((*cap)->nb_tasks != 1 || !(*cap)->regs || (*cap)->stream != &t->stream)
+        return 1;
+    return 0;
+}
+#endif
+
+#if CONFIG_HEVC_RKVDEC_HWACCEL
+extern RKVDECDevice rkvdec341_hevc_capture;
+
+static int hevc_capture_test(void)
+{
+    const int width = 1280, height = 720, stream_size = 1000;
+    RKVDECPicParamsHEVC *pp = av_mallocz(sizeof(*pp));
+    const RKVDECCapture *cap;
+    CaptureTest t;
+    const RK_U32 *regs;
+    const uint8_t *tables;
+    int ret = 1;
+
+    if (!pp || capture_init(&t, &rkvdec341_hevc_capture, stream_size))
+        goto end;
+
+    pp->frame_width  = width;
+    pp->frame_height = height;
+    pp->chroma_format_idc = 1;
+    pp->log2_min_luma_coding_block_size_minus3 = 0;
+    pp->log2_diff_max_min_luma_coding_block_size = 3;
+    pp->sps_temporal_mvp_enabled_flag = 1;
+    pp->curr_pic.valid = 1;
+    pp->curr_pic.index = 11;
+    pp->curr_pic.field_poc[0] = 8;
+    pp->curr_mv = 12;
+    pp->DPB[0].valid = 1;
+    pp->DPB[0].index = 13;
+    pp->DPB[0].field_poc[0] = 4;
+    pp->ref_colmv_list[0] = 14;
+    pp->nb_slices = 1;
+    memset(pp->slices[0].ref_idx, 0xff, sizeof(pp->slices[0].ref_idx));
+    pp->slices[0].nb_refs[0] = 1;
+    pp->slices[0].ref_idx[0][0] = 0;
+
+    if (capture_run(&t, pp, &cap)) {
+        printf("hevc: capture failed\n");
+        goto end;
+    }
+    regs   = cap->regs;
+    tables = cap->tables->data[0];
+
+    if ((regs[2] >> 20 & 3) != 0 || (regs[3] & 0x1ff) != width / 16 ||
+        regs[4] != t.stream.linesize[2] || regs[5] != FFALIGN(stream_size, 16) ||
+        regs[7] != 11 || regs[8] != width * height / 16 ||
+        regs[9] != width * height * 3 / 2 / 16) {
+        printf("hevc: wrong picture registers\n");
+        goto end;
+    }
+    /* reference 0 and the fallback of the unused ones */
+    if ((regs[10] & 0x3ff) != 13 || (regs[11] & 0x3ff) != 11 ||
+        regs[25] != 4 || regs[40] != 8 || regs[48] != 1 ||
+        regs[78] != 12 || regs[79] != 14 || regs[80] != 12) {
+        printf("hevc: wrong reference registers\n");
+        goto end;
+    }
+    if (regs[6] != cap->tables->linesize[2] ||
+        (regs[42] & 0x3ff) != regs[6] || (regs[43] & 0x3ff) != regs[6] ||
+        !(regs[42] >> 10) || regs[43] >> 10 <= regs[42] >> 10) {
+        printf("hevc: wrong table addresses\n");
+        goto end;
+    }
+    /* sao_merge_flag, initType 0, QP 26 */
+    if (ff_hevc_cabac_init_values[0][0] != 153 || tables[26 * 208] != 14) {
+        printf("hevc: wrong cabac table\n");
+        goto end;
+    }
+    /* one reference in list 0, at DPB index 0 */
+    if (tables[regs[43] >> 10] != 0x01) {
+        printf("hevc: wrong rps table\n");
+        goto end;
+    }
+
+    ret = 0;
+end:
+    capture_uninit(&t);
+    av_free(pp);
+    return ret;
+}
+#endif
+
+#if CONFIG_VP9_RKVDEC_HWACCEL
+extern RKVDECDevice rkvdec341_vp9_capture;
+
+static int vp9_capture_test(void)
+{
+    const int width = 352, height = 288, stream_size = 2000;
+    RKVDECPicParamsVP9 *pp = av_mallocz(sizeof(*pp));
+    const RKVDECCapture *cap;
+    CaptureTest t;
+    const RK_U32 *regs;
+    int ret = 1;
+
+    if (!pp || capture_init(&t, &rkvdec341_vp9_capture, stream_size))
+        goto end;
+
+    pp->frame_width  = width;
+    pp->frame_height = height;
+    pp->bit_depth = 8;
+    pp->subsampling_x = pp->subsampling_y = 1;
+    pp->curr_pic.valid = 1;
+    pp->curr_pic.index = 21;
+    pp->refs[0].valid = 1;
+    pp->refs[0].index = 22;
+    pp->ref_width[0]  = width / 2;
+    pp->ref_height[0] = height / 2;
+    pp->segid_cur  = 23;
+    pp->segid_last = 24;
+    pp->colmv_ref  = 25;
+    pp->tx_mode = 4;
+    pp->uncompressed_header_size = 19;
+    pp->compressed_header_size = 100;
+    pp->probs.partition[0][0][0] = 0x42;
+    pp->need_counts = 1;
+    memset(&pp->counts, 0xff, sizeof(pp->counts));
+
+    if (capture_run(&t, pp, &cap)) {
+        printf("vp9: capture failed\n");
+        goto end;
+    }
+    regs = cap->regs;
+
+    if ((regs[2] >> 20 & 3) != 2 || regs[4] != t.stream.linesize[2] ||
+        regs[5] != FFALIGN(stream_size, 16) || regs[7] != 21 || regs[10] != 19 ||
+        regs[6] != cap->tables->linesize[2]) {
+        printf("vp9: wrong picture registers\n");
+        goto end;
+    }
+    /* last is half size, golden and altref are missing */
+    if (regs[11] != 22 || regs[12] != 21 || regs[13] != 21 ||
+        regs[17] != (width / 2 | (height / 2) << 16) ||
+        regs[18] != (width | height << 16) ||
+        (regs[29] & 0xffff) != 1 << 13 || regs[15] != 24 || regs[16] != 23 ||
+        regs[52] != 25 || (regs[28] & 7) != 4) {
+        printf("vp9: wrong reference registers\n");
+        goto end;
+    }
+    if (cap->tables->data[0][0] != 0x42) {
+        printf("vp9: wrong probability table\n");
+        goto end;
+    }
+    /* the counts of the capture device are all zero */
+    if (pp->counts.y_mode[0][0] || pp->counts.eob[3][1][1][5][5][1]) {
+        printf("vp9: counts not read back\n");
+        goto end;
+    }
+
+    ret = 0;
+end:
+    capture_uninit(&t);
+    av_free(pp);
+    return ret;
+}
+#endif
+
+static int bench(void)
+{
+    static const uint8_t start_code[] = { 0, 0, 1 };
+    const int nb_frames = 256, nb_slices = 8;
+    const int slice_size = 1 << 18;
+    RKVDECContext ctx = { 0 };
+    StubDevice s = { 0 };
+    uint8_t *slice = av_mallocz(slice_size);
+    int64_t t;
+    int i, j;
+
+    if (!slice)
+        return 1;
+
+    context_init(&ctx, &s, RKVDEC_ASYNC_DEPTH, 1);
+
+    t = av_gettime_relative();
+    for (i = 0; i < nb_frames; i++) {
+        AVFrame *frame = av_frame_alloc();
+        if (!frame || ff_attach_decode_data(frame) < 0 ||
+            ff_rkvdec_attach_frame(&ctx, frame) < 0) {
+            av_frame_free(&frame);
+            break;
+        }
+        for (j = 0; j < nb_slices; j++)
+            ff_rkvdec_append_stream(&ctx, start_code, sizeof(start_code), slice, slice_size);
+        ff_rkvdec_submit_frame(&ctx, frame);
+        ff_rkvdec_sync_frame(&ctx, frame);
+        av_frame_free(&frame);
+    }
+    t = av_gettime_relative() - t;
+
+    printf("%d frames of %d bytes: %"PRIu64" bytes copied/frame, %"PRId64" us/frame "
+           "(prepare %"PRId64" us, hardware %"PRId64" us)\n",
+           ctx.stream_frames, nb_slices * (slice_size + (int)sizeof(start_code)),
+           ctx.stream_bytes_copied / FFMAX(ctx.stream_frames, 1),
+           t / FFMAX(ctx.stream_frames, 1),
+           ctx.prepare_time / FFMAX(ctx.stream_frames, 1),
+           ctx.hw_time / FFMAX(ctx.stream_frames, 1));
+
+    context_uninit(&ctx);
+    av_free(slice);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int depth, ret = 0;
+
+    if (argc > 1 && !strcmp(argv[1], "-b"))
+        return bench();
+
+    for (depth = 1; depth <= RKVDEC_MAX_TASKS; depth++)
+        ret |= run(depth, 1);
+    ret |= run(RKVDEC_MAX_TASKS, 0);
+    for (depth = 2; depth <= RKVDEC_MAX_TASKS; depth++)
+        ret |= field_test(depth);
+    ret |= pool_test();
+#if CONFIG_HEVC_RKVDEC_HWACCEL
+    ret |= hevc_capture_test();
+#endif
+#if CONFIG_VP9_RKVDEC_HWACCEL
+    ret |= vp9_capture_test();
+#endif
+
+    return ret;
+}
@@ -627,8 +627,9 @@ static const AVClass *filter_child_class_next(const AVClass *prev)
 #define FLAGS AV_OPT_FLAG_FILTERING_PARAM
 static const AVOption avfilter_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
-        { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, FLAGS, "thread_type" },
+        { .i64 = AVFILTER_THREAD_SLICE | AVFILTER_THREAD_PIPELINE }, 0, INT_MAX, FLAGS, "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .unit = "thread_type" },
+        { "pipeline", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_PIPELINE }, .unit = "thread_type" },
     { "enable", "set enable expression", OFFSET(enable_str), AV_OPT_TYPE_STRING, {.str=NULL}, .flags = FLAGS },
     { "threads", "Allowed number of threads", OFFSET(nb_threads), AV_OPT_TYPE_INT,
         { .i64 = 0 }, 0, INT_MAX, FLAGS },
@@ -764,6 +765,8 @@ void avfilter_free(AVFilterContext *filter)
     if (!filter)
         return;
 
+    if (filter->graph && filter->internal->pipeline)
+        ff_graph_pipeline_free(filter->graph);
     if (filter->graph)
         ff_filter_graph_remove_filter(filter->graph, filter);
 
@@ -886,7 +889,7 @@ static int process_options(AVFilterContext *ctx, AVDictionary **options,
 
 int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
 {
-    int ret = 0;
+    int ret = 0, thread_type;
 
     ret = av_opt_set_dict(ctx, options);
     if (ret < 0) {
@@ -894,14 +897,19 @@ int avfilter_init_dict(AVFilterContext *ctx, AVDictionary **options)
         return ret;
     }
 
+    thread_type      = ctx->thread_type & ctx->graph->thread_type;
+    ctx->thread_type = 0;
     if (ctx->filter->flags & AVFILTER_FLAG_SLICE_THREADS &&
-        ctx->thread_type & ctx->graph->thread_type & AVFILTER_THREAD_SLICE &&
+        thread_type & AVFILTER_THREAD_SLICE &&
         ctx->graph->internal->thread_execute) {
         ctx->thread_type       = AVFILTER_THREAD_SLICE;
         ctx->internal->execute = ctx->graph->internal->thread_execute;
-    } else {
-        ctx->thread_type = 0;
     }
+    /* Whether the filter actually gets its own thread is only known once
+     * the graph is configured, see ff_graph_pipeline_init(). */
+    if (ctx->filter->flags_internal & FF_FILTER_FLAG_PIPELINE &&
+        thread_type & AVFILTER_THREAD_PIPELINE)
+        ctx->thread_type |= AVFILTER_THREAD_PIPELINE;
 
     if (ctx->filter->priv_class) {
         ret = av_opt_set_dict2(ctx->priv, options, AV_OPT_SEARCH_CHILDREN);
@@ -1046,7 +1054,7 @@ static int default_filter_frame(AVFilterLink *link, AVFrame *frame)
     return ff_filter_frame(link->dst->outputs[0], frame);
 }
 
-static int ff_filter_frame_framed(AVFilterLink *link, AVFrame *frame)
+int ff_filter_frame_framed(AVFilterLink *link, AVFrame *frame)
 {
     int (*filter_frame)(AVFilterLink *, AVFrame *);
     AVFilterContext *dstctx = link->dst;
@@ -1077,9 +1085,24 @@ fail:
     return ret;
 }
 
-int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
+static int link_add_frame(AVFilterLink *link, AVFrame *frame)
 {
     int ret;
+
+    link->frame_blocked_in = link->frame_wanted_out = 0;
+    link->frame_count_in++;
+    filter_unblock(link->dst);
+    ret = ff_framequeue_add(&link->fifo, frame);
+    if (ret < 0) {
+        av_frame_free(&frame);
+        return ret;
+    }
+    ff_filter_set_ready(link->dst, 300);
+    return 0;
+}
+
+int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
+{
     FF_TPRINTF_START(NULL, filter_frame); ff_tlog_link(NULL, link, 1); ff_tlog(NULL, " "); ff_tlog_ref(NULL, frame, 1);
 
     /* Consistency checks */
@@ -1112,16 +1135,12 @@ int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
         }
     }
 
-    link->frame_blocked_in = link->frame_wanted_out = 0;
-    link->frame_count_in++;
-    filter_unblock(link->dst);
-    ret = ff_framequeue_add(&link->fifo, frame);
-    if (ret < 0) {
-        av_frame_free(&frame);
-        return ret;
-    }
-    ff_filter_set_ready(link->dst, 300);
-    return 0;
+    /* The thread running the graph adds it to the link, see
+       pipeline_collect(). */
+    if (link->src->internal->pipeline)
+        return ff_filter_pipeline_output(link, frame);
+
+    return link_add_frame(link, frame);
 
 error:
     av_frame_free(&frame);
@@ -1283,6 +1302,74 @@ static int ff_filter_activate_default(AVFilterContext *filter)
     return FFERROR_NOT_READY;
 }
 
+/**
+ * Add the frames output by a pipeline thread to the output link, and report
+ * what filter_frame() returned for the input frames as
+ * ff_filter_frame_to_filter() does.
+ */
+static int pipeline_collect(AVFilterContext *filter)
+{
+    AVFilterLink *inlink = filter->inputs[0];
+    AVFrame *frame;
+    int ret;
+
+    while (ff_filter_pipeline_receive(filter, &frame, &ret)) {
+        if (frame)
+            ret = link_add_frame(filter->outputs[0], frame);
+        if (ret < 0 && ret != inlink->status_out) {
+            inlink->frame_wanted_out = 0;
+            ff_avfilter_link_set_out_status(inlink, ret, AV_NOPTS_VALUE);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Activation of a filter running on its own thread: input frames are
+ * handed to the thread, everything else is done here once the thread is
+ * done with them, so that the filter sees the same calls as it would
+ * without threading.
+ */
+static int pipeline_activate(AVFilterContext *filter)
+{
+    AVFilterLink *inlink  = filter->inputs[0];
+    AVFilterLink *outlink = filter->outputs[0];
+    AVFrame *frame;
+    int ret, pending;
+
+    ret = pipeline_collect(filter);
+    if (ret < 0)
+        return ret;
+
+    if (ff_framequeue_queued_frames(&inlink->fifo)) {
+        frame = ff_framequeue_take(&inlink->fifo);
+        /* frame_count_out is updated by the filter thread */
+        ff_update_link_current_pts(inlink, frame->pts);
+        filter_unblock(filter);
+        ff_filter_set_ready(filter, 300);
+        return ff_filter_pipeline_submit(filter, frame);
+    }
+
+    pending = ff_filter_pipeline_pending(filter);
+    if (pending) {
+        if (!inlink->status_in && !outlink->srcpad->request_frame) {
+            /* Forward the request while the thread is busy, so that the
+               next frame is there when it is done. */
+            if (pending < FF_PIPELINE_QUEUE_SIZE &&
+                outlink->frame_wanted_out && !outlink->frame_blocked_in)
+                return ff_request_frame_to_filter(outlink);
+            return 0;
+        }
+        ff_filter_pipeline_wait(filter);
+        ret = pipeline_collect(filter);
+        if (ret < 0)
+            return ret;
+    }
+
+    return ff_filter_activate_default(filter);
+}
+
 /*
    Filter scheduling and activation
 
@@ -1427,6 +1514,7 @@ int ff_filter_activate(AVFilterContext *filter)
                  filter->filter->activate));
     filter->ready = 0;
     ret = filter->filter->activate ? filter->filter->activate(filter) :
+          filter->internal->pipeline ? pipeline_activate(filter) :
           ff_filter_activate_default(filter);
     if (ret == FFERROR_NOT_READY)
         ret = 0;
@@ -332,6 +332,14 @@ typedef struct AVFilter {
  */
 #define AVFILTER_THREAD_SLICE (1 << 0)
 
+/**
+ * Run the filter on its own thread, so that it works on a frame while the
+ * filters after it work on the previous ones. The output is the same as
+ * without threading. Only filters supporting it with one video input and one
+ * video output are run this way.
+ */
+#define AVFILTER_THREAD_PIPELINE (1 << 1)
+
 typedef struct AVFilterInternal AVFilterInternal;
 
 /** An instance of a filter */
@@ -642,6 +650,19 @@ struct AVFilterLink {
      */
     int status_out;
 
+    /**
+     * Border, in pixels, to allocate around the video frames of this link:
+     * left, top, right, bottom. It lets a filter downstream extend the
+     * frames in place, see ff_video_link_request_border().
+     */
+    int alloc_border[4];
+
+    /**
+     * Lock of frame_pool, set when the graph has pipeline threads, which
+     * can allocate frames on this link from different threads.
+     */
+    void *frame_pool_lock;
+
 #endif /* FF_INTERNAL_FIELDS */
 
 };
@@ -852,7 +873,9 @@ typedef struct AVFilterGraph {
      * of AVFILTER_THREAD_* flags.
      *
      * May be set by the caller at any point, the setting will apply to all
-     * filters initialized after that. The default is allowing everything.
+     * filters initialized after that. The default is allowing everything but
+     * AVFILTER_THREAD_PIPELINE, which is decided on when the graph is
+     * configured.
      *
      * When a filter in this graph is initialized, this field is combined using
      * bit AND with AVFilterContext.thread_type to get the final mask used for
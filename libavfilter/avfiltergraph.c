@@ -50,6 +50,7 @@ static const AVOption filtergraph_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
         { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, F|V|A, "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = F|V|A, .unit = "thread_type" },
+        { "pipeline", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_PIPELINE }, .flags = F|V|A, .unit = "thread_type" },
     { "threads",     "Maximum number of threads", OFFSET(nb_threads),
         AV_OPT_TYPE_INT,   { .i64 = 0 }, 0, INT_MAX, F|V|A },
     {"scale_sws_opts"       , "default scale filter options"        , OFFSET(scale_sws_opts)        ,
@@ -78,6 +79,54 @@ int ff_graph_thread_init(AVFilterGraph *graph)
     graph->nb_threads  = 1;
     return 0;
 }
+
+int ff_graph_pipeline_init(AVFilterGraph *graph)
+{
+    return 0;
+}
+
+void ff_graph_pipeline_free(AVFilterGraph *graph)
+{
+}
+
+int ff_graph_pipeline_poll(AVFilterGraph *graph, int wait)
+{
+    return AVERROR(EAGAIN);
+}
+
+void ff_link_pipeline_lock(AVFilterLink *link)
+{
+}
+
+void ff_link_pipeline_unlock(AVFilterLink *link)
+{
+}
+
+int ff_filter_pipeline_submit(AVFilterContext *ctx, AVFrame *frame)
+{
+    av_frame_free(&frame);
+    return AVERROR_BUG;
+}
+
+int ff_filter_pipeline_output(AVFilterLink *link, AVFrame *frame)
+{
+    av_frame_free(&frame);
+    return AVERROR_BUG;
+}
+
+int ff_filter_pipeline_receive(AVFilterContext *ctx, AVFrame **frame, int *ret)
+{
+    return 0;
+}
+
+int ff_filter_pipeline_pending(AVFilterContext *ctx)
+{
+    return 0;
+}
+
+void ff_filter_pipeline_wait(AVFilterContext *ctx)
+{
+}
 #endif
 
 AVFilterGraph *avfilter_graph_alloc(void)
@@ -122,6 +171,8 @@ void avfilter_graph_free(AVFilterGraph **graph)
     if (!*graph)
         return;
 
+    ff_graph_pipeline_free(*graph);
+
     while ((*graph)->nb_filters)
         avfilter_free((*graph)->filters[0]);
 
@@ -1279,6 +1330,8 @@ int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
         return ret;
     if ((ret = graph_config_pointers(graphctx, log_ctx)))
         return ret;
+    if ((ret = ff_graph_pipeline_init(graphctx)) < 0)
+        return ret;
 
     return 0;
 }
@@ -1302,6 +1355,8 @@ int avfilter_graph_send_command(AVFilterGraph *graph, const char *target, const
     for (i = 0; i < graph->nb_filters; i++) {
         AVFilterContext *filter = graph->filters[i];
         if (!strcmp(target, "all") || (filter->name && !strcmp(target, filter->name)) || !strcmp(target, filter->filter->name)) {
+            if (filter->internal->pipeline)
+                ff_filter_pipeline_wait(filter);
             r = avfilter_process_command(filter, cmd, arg, res, res_len, flags);
             if (r != AVERROR(ENOSYS)) {
                 if ((flags & AVFILTER_CMD_FLAG_ONE) || r < 0)
@@ -1324,6 +1379,8 @@ int avfilter_graph_queue_command(AVFilterGraph *graph, const char *target, const
         AVFilterContext *filter = graph->filters[i];
         if(filter && (!strcmp(target, "all") || !strcmp(target, filter->name) || !strcmp(target, filter->filter->name))){
             AVFilterCommand **queue = &filter->command_queue, *next;
+            if (filter->internal->pipeline)
+                ff_filter_pipeline_wait(filter);
             while (*queue && (*queue)->time <= ts)
                 queue = &(*queue)->next;
             next = *queue;
@@ -1438,17 +1495,48 @@ int avfilter_graph_request_oldest(AVFilterGraph *graph)
     return 0;
 }
 
+/**
+ * Tell if a source of the graph was asked for a frame it does not have yet.
+ */
+static int graph_needs_input(AVFilterGraph *graph)
+{
+    unsigned i, j;
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *filter = graph->filters[i];
+        if (filter->nb_inputs)
+            continue;
+        for (j = 0; j < filter->nb_outputs; j++)
+            if (filter->outputs[j]->frame_wanted_out &&
+                filter->outputs[j]->frame_blocked_in)
+                return 1;
+    }
+    return 0;
+}
+
 int ff_filter_graph_run_once(AVFilterGraph *graph)
 {
     AVFilterContext *filter;
     unsigned i;
+    int ret;
 
     av_assert0(graph->nb_filters);
-    filter = graph->filters[0];
-    for (i = 1; i < graph->nb_filters; i++)
-        if (graph->filters[i]->ready > filter->ready)
-            filter = graph->filters[i];
-    if (!filter->ready)
-        return AVERROR(EAGAIN);
+    if (graph->internal->pipeline)
+        ff_graph_pipeline_poll(graph, 0);
+    while (1) {
+        filter = graph->filters[0];
+        for (i = 1; i < graph->nb_filters; i++)
+            if (graph->filters[i]->ready > filter->ready)
+                filter = graph->filters[i];
+        if (filter->ready)
+            break;
+        /* Nothing to do until the pipeline threads output something, wait
+           for them unless the graph needs input to go on meanwhile. */
+        if (!graph->internal->pipeline || graph_needs_input(graph))
+            return AVERROR(EAGAIN);
+        ret = ff_graph_pipeline_poll(graph, 1);
+        if (ret < 0)
+            return ret;
+    }
     return ff_filter_activate(filter);
 }
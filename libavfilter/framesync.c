@@ -95,7 +95,11 @@ static void framesync_eof(FFFrameSync *fs)
 {
     fs->eof = 1;
     fs->frame_ready = 0;
-    ff_outlink_set_status(fs->parent->outputs[0], AVERROR_EOF, AV_NOPTS_VALUE);
+    /* with on_eof, the status is set by ff_framesync_activate() */
+    if (!fs->on_eof && !fs->eof_sent) {
+        ff_outlink_set_status(fs->parent->outputs[0], AVERROR_EOF, AV_NOPTS_VALUE);
+        fs->eof_sent = 1;
+    }
 }
 
 static void framesync_sync_level_update(FFFrameSync *fs)
@@ -348,6 +352,12 @@ int ff_framesync_activate(FFFrameSync *fs)
     ret = framesync_advance(fs);
     if (ret < 0)
         return ret;
+    if (fs->eof && !fs->eof_sent) {
+        ret = fs->on_eof(fs);
+        ff_outlink_set_status(fs->parent->outputs[0], AVERROR_EOF, AV_NOPTS_VALUE);
+        fs->eof_sent = 1;
+        return ret;
+    }
     if (fs->eof || !fs->frame_ready)
         return 0;
     ret = fs->on_event(fs);
@@ -171,6 +171,13 @@ typedef struct FFFrameSync {
      */
     int (*on_event)(struct FFFrameSync *fs);
 
+    /**
+     * Callback called when the output reaches EOF, before the EOF status is
+     * set on the output; filters which delay frames can send them there.
+     * Can be NULL.
+     */
+    int (*on_eof)(struct FFFrameSync *fs);
+
     /**
      * Opaque pointer, not used by the API
      */
@@ -197,6 +204,11 @@ typedef struct FFFrameSync {
      */
     uint8_t eof;
 
+    /**
+     * Flag indicating that the EOF status has been set on the output.
+     */
+    uint8_t eof_sent;
+
     /**
      * Pointer to array of inputs.
      */
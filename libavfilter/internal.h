@@ -143,16 +143,28 @@ struct AVFilterPad {
      * input pads only.
      */
     int needs_writable;
+
+    /**
+     * The frames output by the filter reference the buffers of the frames
+     * received on this pad, possibly with moved data pointers, so a border
+     * requested on its output link can be allocated upstream instead.
+     *
+     * input pads only.
+     */
+    int forwards_frames;
 };
 
 struct AVFilterGraphInternal {
     void *thread;
     avfilter_execute_func *thread_execute;
+    void *pipeline;
     FFFrameQueueGlobal frame_queues;
 };
 
 struct AVFilterInternal {
     avfilter_execute_func *execute;
+    /* pipeline stage when the filter runs on its own thread */
+    void *pipeline;
 };
 
 /**
@@ -361,6 +373,12 @@ int ff_request_frame(AVFilterLink *link);
  */
 int ff_filter_frame(AVFilterLink *link, AVFrame *frame);
 
+/**
+ * Pass a frame taken from the link FIFO to the filter_frame() callback of
+ * the destination filter.
+ */
+int ff_filter_frame_framed(AVFilterLink *link, AVFrame *frame);
+
 /**
  * Allocate a new filter context and return it.
  *
@@ -384,6 +402,16 @@ void ff_filter_graph_remove_filter(AVFilterGraph *graph, AVFilterContext *filter
  */
 #define FF_FILTER_FLAG_HWFRAME_AWARE (1 << 0)
 
+/**
+ * The filter can run on its own thread with AVFILTER_THREAD_PIPELINE:
+ * filter_frame() and request_frame() only use the filter private context
+ * and the frames they are given, and output through ff_filter_frame().
+ * Filters reconfiguring their output link once the graph is configured, from
+ * filter_frame() or process_command(), must not set it: the filter reading
+ * the link may be running on its own thread meanwhile.
+ */
+#define FF_FILTER_FLAG_PIPELINE (1 << 1)
+
 /**
  * Run one round of processing on a filter graph.
  */
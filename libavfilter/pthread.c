@@ -25,11 +25,17 @@
 
 #include "libavutil/common.h"
 #include "libavutil/cpu.h"
+#include "libavutil/fifo.h"
+#include "libavutil/frame.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
 #include "libavutil/slicethread.h"
 
+#define FF_INTERNAL_FIELDS 1
+#include "framequeue.h"
+
 #include "avfilter.h"
+#include "filters.h"
 #include "internal.h"
 #include "thread.h"
 
@@ -114,3 +120,368 @@ void ff_graph_thread_free(AVFilterGraph *graph)
         slice_thread_uninit(graph->internal->thread);
     av_freep(&graph->internal->thread);
 }
+
+typedef struct PipelineItem {
+    /* output frame, NULL at the end of an input frame */
+    AVFrame *frame;
+    /* what filter_frame() returned for the input frame */
+    int ret;
+} PipelineItem;
+
+typedef struct PipelineStage {
+    AVFilterContext *ctx;
+    pthread_t thread;
+    pthread_cond_t cond;
+    int thread_init;
+    /* AVFrame * given to the thread */
+    AVFifoBuffer *in;
+    /* PipelineItem produced by the thread */
+    AVFifoBuffer *out;
+    /* frames in or being filtered */
+    int nb_pending;
+    int error;
+    int exit;
+} PipelineStage;
+
+typedef struct PipelineContext {
+    /* protects the stages queues */
+    pthread_mutex_t lock;
+    /* signalled when a stage is done with something */
+    pthread_cond_t cond;
+    /* one per link, protecting its frame pool */
+    pthread_mutex_t *link_locks;
+    int nb_link_locks;
+    /* slice threading runs one filter at a time */
+    pthread_mutex_t execute_lock;
+    avfilter_execute_func *execute;
+
+    PipelineStage *stages;
+    int nb_stages;
+} PipelineContext;
+
+static int stage_queue_item(PipelineStage *s, PipelineItem *item)
+{
+    int ret;
+
+    if (!av_fifo_space(s->out)) {
+        ret = av_fifo_grow(s->out, av_fifo_size(s->out));
+        if (ret < 0)
+            return ret;
+    }
+    av_fifo_generic_write(s->out, item, sizeof(*item), NULL);
+    return 0;
+}
+
+static void *pipeline_worker(void *arg)
+{
+    PipelineStage   *s = arg;
+    PipelineContext *c = s->ctx->graph->internal->pipeline;
+    PipelineItem item  = { NULL };
+    AVFrame *frame;
+    int ret;
+
+    pthread_mutex_lock(&c->lock);
+    while (1) {
+        while (!s->exit && !av_fifo_size(s->in))
+            pthread_cond_wait(&s->cond, &c->lock);
+        if (s->exit)
+            break;
+        av_fifo_generic_read(s->in, &frame, sizeof(frame), NULL);
+        pthread_mutex_unlock(&c->lock);
+
+        item.ret = ff_filter_frame_framed(s->ctx->inputs[0], frame);
+
+        pthread_mutex_lock(&c->lock);
+        ret = stage_queue_item(s, &item);
+        if (ret < 0 && !s->error)
+            s->error = ret;
+        s->nb_pending--;
+        pthread_cond_broadcast(&c->cond);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    return NULL;
+}
+
+static int pipeline_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                            void *arg, int *ret, int nb_jobs)
+{
+    PipelineContext *c = ctx->graph->internal->pipeline;
+    int err;
+
+    pthread_mutex_lock(&c->execute_lock);
+    err = c->execute(ctx, func, arg, ret, nb_jobs);
+    pthread_mutex_unlock(&c->execute_lock);
+
+    return err;
+}
+
+static int pipeline_can_run(AVFilterContext *ctx)
+{
+    return ctx->thread_type & AVFILTER_THREAD_PIPELINE &&
+           !ctx->filter->activate &&
+           ctx->nb_inputs  == 1 && ctx->inputs[0]->type  == AVMEDIA_TYPE_VIDEO &&
+           ctx->nb_outputs == 1 && ctx->outputs[0]->type == AVMEDIA_TYPE_VIDEO;
+}
+
+int ff_graph_pipeline_init(AVFilterGraph *graph)
+{
+    PipelineContext *c;
+    int i, j, nb_stages = 0, nb_links = 0, ret;
+    int nb_threads = graph->nb_threads > 0 ? graph->nb_threads : av_cpu_count();
+
+    if (graph->internal->pipeline)
+        return 0;
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *ctx = graph->filters[i];
+        if (pipeline_can_run(ctx) && nb_stages < nb_threads)
+            nb_stages++;
+        else
+            ctx->thread_type &= ~AVFILTER_THREAD_PIPELINE;
+        nb_links += ctx->nb_outputs;
+    }
+    if (!nb_stages)
+        return 0;
+
+    c = av_mallocz(sizeof(*c));
+    if (!c)
+        return AVERROR(ENOMEM);
+    c->stages     = av_mallocz_array(nb_stages, sizeof(*c->stages));
+    c->link_locks = av_mallocz_array(nb_links, sizeof(*c->link_locks));
+    if (!c->stages || !c->link_locks) {
+        av_free(c->stages);
+        av_free(c->link_locks);
+        av_free(c);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->cond, NULL);
+    pthread_mutex_init(&c->execute_lock, NULL);
+    c->execute = graph->internal->thread_execute;
+    graph->internal->pipeline = c;
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *ctx = graph->filters[i];
+
+        for (j = 0; j < ctx->nb_outputs; j++) {
+            if (!ctx->outputs[j])
+                continue;
+            pthread_mutex_init(&c->link_locks[c->nb_link_locks], NULL);
+            ctx->outputs[j]->frame_pool_lock = &c->link_locks[c->nb_link_locks++];
+        }
+    }
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *ctx = graph->filters[i];
+        PipelineStage *s = &c->stages[c->nb_stages];
+
+        if (c->execute && ctx->internal->execute == c->execute)
+            ctx->internal->execute = pipeline_execute;
+        if (!(ctx->thread_type & AVFILTER_THREAD_PIPELINE))
+            continue;
+
+        s->ctx = ctx;
+        s->in  = av_fifo_alloc_array(FF_PIPELINE_QUEUE_SIZE, sizeof(AVFrame *));
+        s->out = av_fifo_alloc_array(FF_PIPELINE_QUEUE_SIZE, sizeof(PipelineItem));
+        c->nb_stages++;
+        if (!s->in || !s->out) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        pthread_cond_init(&s->cond, NULL);
+        ret = pthread_create(&s->thread, NULL, pipeline_worker, s);
+        if (ret) {
+            pthread_cond_destroy(&s->cond);
+            ret = AVERROR(ret);
+            goto fail;
+        }
+        s->thread_init = 1;
+        ctx->internal->pipeline = s;
+    }
+
+    av_log(graph, AV_LOG_VERBOSE, "Running %d filters on their own thread.\n",
+           c->nb_stages);
+
+    return 0;
+fail:
+    ff_graph_pipeline_free(graph);
+    return ret;
+}
+
+void ff_graph_pipeline_free(AVFilterGraph *graph)
+{
+    PipelineContext *c = graph->internal->pipeline;
+    PipelineItem item;
+    AVFrame *frame;
+    int i, j;
+
+    if (!c)
+        return;
+
+    for (i = 0; i < c->nb_stages; i++) {
+        PipelineStage *s = &c->stages[i];
+
+        if (s->thread_init) {
+            pthread_mutex_lock(&c->lock);
+            s->exit = 1;
+            pthread_cond_signal(&s->cond);
+            pthread_mutex_unlock(&c->lock);
+            pthread_join(s->thread, NULL);
+            pthread_cond_destroy(&s->cond);
+        }
+        while (s->in && av_fifo_size(s->in)) {
+            av_fifo_generic_read(s->in, &frame, sizeof(frame), NULL);
+            av_frame_free(&frame);
+        }
+        while (s->out && av_fifo_size(s->out)) {
+            av_fifo_generic_read(s->out, &item, sizeof(item), NULL);
+            av_frame_free(&item.frame);
+        }
+        av_fifo_freep(&s->in);
+        av_fifo_freep(&s->out);
+        s->ctx->internal->pipeline = NULL;
+        s->ctx->thread_type &= ~AVFILTER_THREAD_PIPELINE;
+    }
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        AVFilterContext *ctx = graph->filters[i];
+
+        if (ctx->internal->execute == pipeline_execute)
+            ctx->internal->execute = c->execute;
+        for (j = 0; j < ctx->nb_outputs; j++)
+            if (ctx->outputs[j])
+                ctx->outputs[j]->frame_pool_lock = NULL;
+    }
+
+    for (i = 0; i < c->nb_link_locks; i++)
+        pthread_mutex_destroy(&c->link_locks[i]);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->execute_lock);
+    av_freep(&c->link_locks);
+    av_freep(&c->stages);
+    av_freep(&graph->internal->pipeline);
+}
+
+int ff_graph_pipeline_poll(AVFilterGraph *graph, int wait)
+{
+    PipelineContext *c = graph->internal->pipeline;
+    int i, ready, pending;
+
+    pthread_mutex_lock(&c->lock);
+    while (1) {
+        ready = pending = 0;
+        for (i = 0; i < c->nb_stages; i++) {
+            PipelineStage *s = &c->stages[i];
+            if (av_fifo_size(s->out) || s->error) {
+                ff_filter_set_ready(s->ctx, 300);
+                ready = 1;
+            }
+            pending += s->nb_pending;
+        }
+        if (ready || !wait)
+            break;
+        if (!pending) {
+            pthread_mutex_unlock(&c->lock);
+            return AVERROR(EAGAIN);
+        }
+        pthread_cond_wait(&c->cond, &c->lock);
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    return 0;
+}
+
+void ff_link_pipeline_lock(AVFilterLink *link)
+{
+    if (link->frame_pool_lock)
+        pthread_mutex_lock(link->frame_pool_lock);
+}
+
+void ff_link_pipeline_unlock(AVFilterLink *link)
+{
+    if (link->frame_pool_lock)
+        pthread_mutex_unlock(link->frame_pool_lock);
+}
+
+int ff_filter_pipeline_submit(AVFilterContext *ctx, AVFrame *frame)
+{
+    PipelineContext *c = ctx->graph->internal->pipeline;
+    PipelineStage   *s = ctx->internal->pipeline;
+
+    pthread_mutex_lock(&c->lock);
+    while (s->nb_pending >= FF_PIPELINE_QUEUE_SIZE)
+        pthread_cond_wait(&c->cond, &c->lock);
+    av_fifo_generic_write(s->in, &frame, sizeof(frame), NULL);
+    s->nb_pending++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&c->lock);
+
+    return 0;
+}
+
+int ff_filter_pipeline_output(AVFilterLink *link, AVFrame *frame)
+{
+    PipelineContext *c = link->graph->internal->pipeline;
+    PipelineStage   *s = link->src->internal->pipeline;
+    PipelineItem item  = { frame };
+    int ret;
+
+    pthread_mutex_lock(&c->lock);
+    ret = stage_queue_item(s, &item);
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+
+    if (ret < 0)
+        av_frame_free(&frame);
+    return ret;
+}
+
+int ff_filter_pipeline_receive(AVFilterContext *ctx, AVFrame **frame, int *ret)
+{
+    PipelineContext *c = ctx->graph->internal->pipeline;
+    PipelineStage   *s = ctx->internal->pipeline;
+    PipelineItem item;
+    int got = 1;
+
+    pthread_mutex_lock(&c->lock);
+    if (av_fifo_size(s->out)) {
+        av_fifo_generic_read(s->out, &item, sizeof(item), NULL);
+        *frame = item.frame;
+        *ret   = item.ret;
+    } else if (s->error) {
+        *frame   = NULL;
+        *ret     = s->error;
+        s->error = 0;
+    } else {
+        got = 0;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    return got;
+}
+
+int ff_filter_pipeline_pending(AVFilterContext *ctx)
+{
+    PipelineContext *c = ctx->graph->internal->pipeline;
+    PipelineStage   *s = ctx->internal->pipeline;
+    int pending;
+
+    pthread_mutex_lock(&c->lock);
+    pending = s->nb_pending;
+    pthread_mutex_unlock(&c->lock);
+
+    return pending;
+}
+
+void ff_filter_pipeline_wait(AVFilterContext *ctx)
+{
+    PipelineContext *c = ctx->graph->internal->pipeline;
+    PipelineStage   *s = ctx->internal->pipeline;
+
+    pthread_mutex_lock(&c->lock);
+    while (s->nb_pending)
+        pthread_cond_wait(&c->cond, &c->lock);
+    pthread_mutex_unlock(&c->lock);
+}
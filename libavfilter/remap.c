@@ -0,0 +1,151 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Pixel remapping through a precomputed map, shared by the remap and
+ * lenscorrection filters.
+ */
+
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "remap.h"
+
+int ff_remap_map_alloc(RemapMap *map, int w, int h, enum RemapInterp interp)
+{
+    ff_remap_map_free(map);
+    map->w      = w;
+    map->h      = h;
+    map->interp = interp;
+    map->xy     = av_malloc_array(w, 2 * h * sizeof(*map->xy));
+    if (interp == REMAP_BILINEAR)
+        map->frac = av_malloc_array(w, 2 * h * sizeof(*map->frac));
+    if (!map->xy || (interp == REMAP_BILINEAR && !map->frac)) {
+        ff_remap_map_free(map);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+void ff_remap_map_free(RemapMap *map)
+{
+    av_freep(&map->xy);
+    av_freep(&map->frac);
+}
+
+#define DEFINE_REMAP(bits, type)                                                    \
+static av_always_inline void remap_nearest##bits(uint8_t *dstp, const uint8_t *srcp, \
+                                                 ptrdiff_t linesize,                \
+                                                 const int16_t *xy, int w,          \
+                                                 int step, int nb_components)       \
+{                                                                                   \
+    type *dst = (type *)dstp;                                                       \
+    const type *src = (const type *)srcp;                                           \
+    int x, c;                                                                       \
+                                                                                    \
+    for (x = 0; x < w; x++, xy += 2, dst += step) {                                 \
+        if (xy[0] >= 0) {                                                           \
+            const type *s = src + xy[1] * linesize + xy[0] * step;                  \
+            for (c = 0; c < nb_components; c++)                                     \
+                dst[c] = s[c];                                                      \
+        } else {                                                                    \
+            for (c = 0; c < nb_components; c++)                                     \
+                dst[c] = 0;                                                         \
+        }                                                                           \
+    }                                                                               \
+}                                                                                   \
+                                                                                    \
+static av_always_inline void remap_bilinear##bits(uint8_t *dstp, const uint8_t *srcp, \
+                                                  ptrdiff_t linesize,               \
+                                                  const int16_t *xy,                \
+                                                  const uint8_t *frac, int w,       \
+                                                  int step, int nb_components)      \
+{                                                                                   \
+    type *dst = (type *)dstp;                                                       \
+    const type *src = (const type *)srcp;                                           \
+    int x, c;                                                                       \
+                                                                                    \
+    for (x = 0; x < w; x++, xy += 2, frac += 2, dst += step) {                      \
+        if (xy[0] >= 0) {                                                           \
+            const type *s = src + xy[1] * linesize + xy[0] * step;                  \
+            const int fx = frac[0], fy = frac[1];                                   \
+            for (c = 0; c < nb_components; c++) {                                   \
+                const int top = s[c]            * (REMAP_FRAC_ONE - fx) +           \
+                                s[c + step]     * fx;                               \
+                const int bot = s[c + linesize] * (REMAP_FRAC_ONE - fx) +           \
+                                s[c + linesize + step] * fx;                        \
+                dst[c] = (top * (REMAP_FRAC_ONE - fy) + bot * fy +                  \
+                          (1 << (2 * REMAP_FRAC_BITS - 1))) >> (2 * REMAP_FRAC_BITS); \
+            }                                                                       \
+        } else {                                                                    \
+            for (c = 0; c < nb_components; c++)                                     \
+                dst[c] = 0;                                                         \
+        }                                                                           \
+    }                                                                               \
+}
+
+DEFINE_REMAP(8,  uint8_t)
+DEFINE_REMAP(16, uint16_t)
+
+static av_always_inline void remap_row(const RemapMap *map, uint8_t *dst, const uint8_t *src,
+                                       ptrdiff_t linesize, const int16_t *xy,
+                                       const uint8_t *frac, int w, int bps,
+                                       int step, int nb_components)
+{
+    if (map->interp == REMAP_NEAREST) {
+        if (bps == 1)
+            remap_nearest8 (dst, src, linesize, xy, w, step, nb_components);
+        else
+            remap_nearest16(dst, src, linesize, xy, w, step, nb_components);
+    } else {
+        if (bps == 1)
+            remap_bilinear8 (dst, src, linesize, xy, frac, w, step, nb_components);
+        else
+            remap_bilinear16(dst, src, linesize, xy, frac, w, step, nb_components);
+    }
+}
+
+void ff_remap_slice(const RemapMap *map,
+                    uint8_t *dst, ptrdiff_t dst_linesize,
+                    const uint8_t *src, ptrdiff_t src_linesize,
+                    int bps, int step, int nb_components, int y_start, int y_end)
+{
+    const ptrdiff_t linesize = src_linesize / bps;
+    int x, y, by;
+
+    for (by = y_start; by < y_end; by += REMAP_BLOCK_H) {
+        const int bh = FFMIN(REMAP_BLOCK_H, y_end - by);
+
+        for (x = 0; x < map->w; x += REMAP_BLOCK_W) {
+            const int bw = FFMIN(REMAP_BLOCK_W, map->w - x);
+
+            for (y = by; y < by + bh; y++) {
+                const int16_t *xy   = map->xy + 2 * (y * map->w + x);
+                const uint8_t *frac = map->frac ? map->frac + 2 * (y * map->w + x) : NULL;
+                uint8_t *d = dst + y * dst_linesize + x * step * bps;
+
+                if (step > 1)
+                    remap_row(map, d, src, linesize, xy, frac, bw,
+                              bps, step, nb_components);
+                else
+                    remap_row(map, d, src, linesize, xy, frac, bw, bps, 1, 1);
+            }
+        }
+    }
+}
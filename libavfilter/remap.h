@@ -0,0 +1,118 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_REMAP_H
+#define AVFILTER_REMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libavutil/attributes.h"
+
+#define REMAP_FRAC_BITS 7
+#define REMAP_FRAC_ONE  (1 << REMAP_FRAC_BITS)
+
+/* the output is processed in blocks of this size, for the locality of the
+ * source pixels when the map rotates or bends the picture */
+#define REMAP_BLOCK_W 128
+#define REMAP_BLOCK_H 16
+
+enum RemapInterp {
+    REMAP_NEAREST,
+    REMAP_BILINEAR,
+    NB_REMAP_INTERP
+};
+
+/**
+ * Source position of each pixel of an output plane, w entries per row.
+ *
+ * xy holds the x and y source coordinates of each pixel as packed int16
+ * pairs, or -1, -1 for pixels without source, which are set to 0.
+ * With bilinear interpolation, the pair is the top left pixel of the 2x2
+ * source block, and frac holds the weights of the right and of the bottom
+ * pixels, in 1/REMAP_FRAC_ONE units.
+ */
+typedef struct RemapMap {
+    int w, h;
+    enum RemapInterp interp;
+    int16_t *xy;
+    uint8_t *frac;
+} RemapMap;
+
+int ff_remap_map_alloc(RemapMap *map, int w, int h, enum RemapInterp interp);
+void ff_remap_map_free(RemapMap *map);
+
+/**
+ * Set the source of pixel i of the map to sx, sy in 1/REMAP_FRAC_ONE pixel
+ * units, in a source of src_w x src_h pixels. Positions outside of the
+ * source leave the pixel without source. Bilinear interpolation needs a
+ * source of at least 2x2 pixels.
+ */
+static av_always_inline void ff_remap_map_set(RemapMap *map, int i, int sx, int sy,
+                                              int src_w, int src_h)
+{
+    int16_t *xy = map->xy + 2 * i;
+
+    if (map->interp == REMAP_NEAREST) {
+        const int x = (sx + REMAP_FRAC_ONE / 2) >> REMAP_FRAC_BITS;
+        const int y = (sy + REMAP_FRAC_ONE / 2) >> REMAP_FRAC_BITS;
+
+        if (x >= 0 && x < src_w && y >= 0 && y < src_h) {
+            xy[0] = x;
+            xy[1] = y;
+        } else {
+            xy[0] = xy[1] = -1;
+        }
+    } else {
+        uint8_t *frac = map->frac + 2 * i;
+        int x = sx >> REMAP_FRAC_BITS, fx = sx & (REMAP_FRAC_ONE - 1);
+        int y = sy >> REMAP_FRAC_BITS, fy = sy & (REMAP_FRAC_ONE - 1);
+
+        if (sx < 0 || sy < 0 || x >= src_w || y >= src_h ||
+            (x == src_w - 1 && fx) || (y == src_h - 1 && fy)) {
+            xy[0] = xy[1] = -1;
+            frac[0] = frac[1] = 0;
+            return;
+        }
+        // the last column and row are read as the right and bottom pixels
+        if (x == src_w - 1) {
+            x--;
+            fx = REMAP_FRAC_ONE;
+        }
+        if (y == src_h - 1) {
+            y--;
+            fy = REMAP_FRAC_ONE;
+        }
+        xy[0]   = x;
+        xy[1]   = y;
+        frac[0] = fx;
+        frac[1] = fy;
+    }
+}
+
+/**
+ * Remap the rows [y_start, y_end) of a plane through map, in blocks of
+ * REMAP_BLOCK_W x REMAP_BLOCK_H pixels. Samples have bps (1 or 2) bytes, and
+ * each pixel has nb_components samples, step samples apart.
+ */
+void ff_remap_slice(const RemapMap *map,
+                    uint8_t *dst, ptrdiff_t dst_linesize,
+                    const uint8_t *src, ptrdiff_t src_linesize,
+                    int bps, int step, int nb_components, int y_start, int y_end);
+
+#endif /* AVFILTER_REMAP_H */
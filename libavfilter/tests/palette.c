@@ -0,0 +1,373 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Checks that the palettegen and paletteuse filters give the same output on
+ * any number of threads.
+ *
+ * With -b, generates a palette for 1080p frames and dithers them repeatedly,
+ * and reports the frame rate of each mode on one thread and on the given
+ * number of threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/adler32.h"
+#include "libavutil/cpu.h"
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/log.h"
+#include "libavutil/time.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+
+#define NB_FRAMES  10
+#define MAX_OUTPUT NB_FRAMES
+
+static const char *const palettegen_args[] = {
+    "stats_mode=full", "stats_mode=diff", "stats_mode=single",
+};
+
+static const char *const paletteuse_args[] = {
+    "dither=none",
+    "dither=bayer",
+    "dither=heckbert",
+    "dither=floyd_steinberg",
+    "dither=sierra2",
+    "dither=sierra2_4a",
+    "dither=none:diff_mode=rectangle",
+    "dither=sierra2_4a:diff_mode=rectangle",
+    "dither=floyd_steinberg:new=1",
+};
+
+typedef struct Output {
+    int nb_frames;
+    unsigned long checksum[MAX_OUTPUT];
+} Output;
+
+/* Gradients with a noisy square moving over them. */
+static AVFrame *frame_alloc(int w, int h, int n, AVLFG *lfg)
+{
+    AVFrame *frame = av_frame_alloc();
+    int x, y;
+
+    if (!frame)
+        return NULL;
+    frame->format = AV_PIX_FMT_RGB32;
+    frame->width  = w;
+    frame->height = h;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    for (y = 0; y < h; y++) {
+        uint32_t *line = (uint32_t *)(frame->data[0] + y * frame->linesize[0]);
+        for (x = 0; x < w; x++) {
+            const int r = x * 255 / w;
+            const int g = y * 255 / h;
+            const int b = (x + y + n * 4) & 0xff;
+            line[x] = 0xffU << 24 | r << 16 | g << 8 | b;
+            if (x - n * 8 >= 0 && x - n * 8 < w / 4 && y >= h / 4 && y < h / 2)
+                line[x] ^= av_lfg_get(lfg) & 0x1f1f1f;
+        }
+    }
+    return frame;
+}
+
+static unsigned long frame_checksum(const AVFrame *frame)
+{
+    int bytes = av_image_get_linesize(frame->format, frame->width, 0);
+    unsigned long checksum = 0;
+    int y;
+
+    for (y = 0; y < frame->height; y++)
+        checksum = av_adler32_update(checksum, frame->data[0] + y * frame->linesize[0], bytes);
+    if (frame->format == AV_PIX_FMT_PAL8)
+        checksum = av_adler32_update(checksum, frame->data[1], AVPALETTE_SIZE);
+    return checksum;
+}
+
+static int buffer_alloc(AVFilterGraph *graph, AVFilterContext **src, const char *name,
+                        const AVFrame *frame)
+{
+    char args[256];
+
+    snprintf(args, sizeof(args),
+             "video_size=%dx%d:pix_fmt=%d:time_base=1/25:pixel_aspect=1/1",
+             frame->width, frame->height, frame->format);
+    return avfilter_graph_create_filter(src, avfilter_get_by_name("buffer"),
+                                        name, args, NULL, graph);
+}
+
+/* Build src -> filter -> sink, with the palette as second input if given. */
+static AVFilterGraph *graph_alloc(const char *name, const char *args,
+                                  const AVFrame *frame, const AVFrame *palette,
+                                  int threads, AVFilterContext **src,
+                                  AVFilterContext **pal, AVFilterContext **sink)
+{
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVFilterContext *filter;
+
+    if (!graph)
+        return NULL;
+    graph->nb_threads = threads;
+
+    if (buffer_alloc(graph, src, "in", frame) < 0 ||
+        (palette && buffer_alloc(graph, pal, "palette", palette) < 0))
+        goto fail;
+    if (avfilter_graph_create_filter(&filter, avfilter_get_by_name(name),
+                                     name, args, NULL, graph) < 0 ||
+        avfilter_graph_create_filter(sink, avfilter_get_by_name("buffersink"),
+                                     "out", NULL, NULL, graph) < 0)
+        goto fail;
+    if (avfilter_link(*src, 0, filter, 0) < 0 ||
+        (palette && avfilter_link(*pal, 0, filter, 1) < 0) ||
+        avfilter_link(filter, 0, *sink, 0) < 0 ||
+        avfilter_graph_config(graph, NULL) < 0)
+        goto fail;
+
+    return graph;
+fail:
+    avfilter_graph_free(&graph);
+    return NULL;
+}
+
+static int receive_frames(AVFilterContext *sink, AVFrame *frame, Output *out,
+                          AVFrame *last)
+{
+    int ret;
+
+    while ((ret = av_buffersink_get_frame(sink, frame)) >= 0) {
+        if (out && out->nb_frames < MAX_OUTPUT)
+            out->checksum[out->nb_frames] = frame_checksum(frame);
+        if (out)
+            out->nb_frames++;
+        if (last) {
+            av_frame_unref(last);
+            av_frame_move_ref(last, frame);
+        } else {
+            av_frame_unref(frame);
+        }
+    }
+    return ret;
+}
+
+/*
+ * Filter n frames, cycling through the nb_frames given ones, and return the
+ * checksums of the output in out if not NULL, and the last output frame in
+ * last if not NULL.
+ */
+static int run(const char *name, const char *args, AVFrame **frames, int nb_frames,
+               int n, const AVFrame *palette, int threads, Output *out, AVFrame *last)
+{
+    AVFilterContext *src, *pal = NULL, *sink;
+    AVFilterGraph *graph;
+    AVFrame *frame = av_frame_alloc(), *in;
+    int i, ret;
+
+    graph = graph_alloc(name, args, frames[0], palette, threads, &src, &pal, &sink);
+    if (!graph || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if (out)
+        out->nb_frames = 0;
+
+    if (palette) {
+        ret = av_buffersrc_add_frame_flags(pal, (AVFrame *)palette,
+                                           AV_BUFFERSRC_FLAG_KEEP_REF);
+        if (ret >= 0)
+            ret = av_buffersrc_add_frame(pal, NULL);
+        if (ret < 0)
+            goto end;
+    }
+
+    for (i = 0; i < n; i++) {
+        in = av_frame_clone(frames[i % nb_frames]);
+        if (!in) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        in->pts = i;
+        ret = av_buffersrc_add_frame(src, in);
+        av_frame_free(&in);
+        if (ret < 0)
+            goto end;
+        ret = receive_frames(sink, frame, out, last);
+        if (ret != AVERROR(EAGAIN))
+            goto end;
+    }
+
+    ret = av_buffersrc_add_frame(src, NULL);
+    if (ret < 0)
+        goto end;
+    ret = receive_frames(sink, frame, out, last);
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+end:
+    av_frame_free(&frame);
+    avfilter_graph_free(&graph);
+    return ret;
+}
+
+static int output_cmp(const Output *a, const Output *b)
+{
+    return a->nb_frames != b->nb_frames ||
+           memcmp(a->checksum, b->checksum, FFMIN(a->nb_frames, MAX_OUTPUT) * sizeof(*a->checksum));
+}
+
+static int check(AVLFG *lfg)
+{
+    static const int nb_threads[] = { 3, 8 };
+    static Output ref, out;
+    AVFrame *frames[NB_FRAMES] = { NULL };
+    AVFrame *palette = av_frame_alloc();
+    int i, j, ret = 1;
+
+    for (i = 0; i < NB_FRAMES; i++)
+        if (!(frames[i] = frame_alloc(320, 181, i, lfg)))
+            goto end;
+    if (!palette)
+        goto end;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(palettegen_args); i++) {
+        if (run("palettegen", palettegen_args[i], frames, NB_FRAMES, NB_FRAMES,
+                NULL, 1, &ref, NULL) < 0 || !ref.nb_frames) {
+            fprintf(stderr, "palettegen %s: filtering failed\n", palettegen_args[i]);
+            goto end;
+        }
+        for (j = 0; j < FF_ARRAY_ELEMS(nb_threads); j++) {
+            if (run("palettegen", palettegen_args[i], frames, NB_FRAMES, NB_FRAMES,
+                    NULL, nb_threads[j], &out, NULL) < 0 || output_cmp(&ref, &out)) {
+                fprintf(stderr, "palettegen %s: output differs with %d threads\n",
+                        palettegen_args[i], nb_threads[j]);
+                goto end;
+            }
+        }
+    }
+
+    if (run("palettegen", "max_colors=64", frames, NB_FRAMES, NB_FRAMES,
+            NULL, 1, NULL, palette) < 0) {
+        fprintf(stderr, "palettegen: filtering failed\n");
+        goto end;
+    }
+    for (i = 0; i < FF_ARRAY_ELEMS(paletteuse_args); i++) {
+        if (run("paletteuse", paletteuse_args[i], frames, NB_FRAMES, NB_FRAMES,
+                palette, 1, &ref, NULL) < 0 || ref.nb_frames != NB_FRAMES) {
+            fprintf(stderr, "paletteuse %s: filtering failed\n", paletteuse_args[i]);
+            goto end;
+        }
+        for (j = 0; j < FF_ARRAY_ELEMS(nb_threads); j++) {
+            if (run("paletteuse", paletteuse_args[i], frames, NB_FRAMES, NB_FRAMES,
+                    palette, nb_threads[j], &out, NULL) < 0 || output_cmp(&ref, &out)) {
+                fprintf(stderr, "paletteuse %s: output differs with %d threads\n",
+                        paletteuse_args[i], nb_threads[j]);
+                goto end;
+            }
+        }
+    }
+
+    ret = 0;
+end:
+    for (i = 0; i < NB_FRAMES; i++)
+        av_frame_free(&frames[i]);
+    av_frame_free(&palette);
+    return ret;
+}
+
+static double bench_run(const char *name, const char *args, AVFrame **frames,
+                        int nb_frames, const AVFrame *palette, int threads,
+                        int iterations, AVFrame *last)
+{
+    int64_t t = av_gettime_relative();
+
+    if (run(name, args, frames, nb_frames, iterations, palette, threads, NULL, last) < 0)
+        return -1;
+    t = av_gettime_relative() - t;
+    return iterations * 1000000.0 / t;
+}
+
+static int bench(int iterations, int threads, AVLFG *lfg)
+{
+    static const char *const dithers[] = {
+        "dither=none", "dither=bayer", "dither=floyd_steinberg", "dither=sierra2_4a",
+    };
+    AVFrame *frames[4] = { NULL };
+    AVFrame *palette = av_frame_alloc();
+    double f1, fn;
+    int i, ret = 1;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(frames); i++)
+        if (!(frames[i] = frame_alloc(1920, 1080, i, lfg)))
+            goto end;
+    if (!palette)
+        goto end;
+
+    printf("rgb32 %dx%d, %d frames, fps on 1 and %d threads\n",
+           frames[0]->width, frames[0]->height, iterations, threads);
+
+    f1 = bench_run("palettegen", "", frames, FF_ARRAY_ELEMS(frames), NULL,
+                   1,       iterations, palette);
+    fn = bench_run("palettegen", "", frames, FF_ARRAY_ELEMS(frames), NULL,
+                   threads, iterations, NULL);
+    if (f1 < 0 || fn < 0)
+        goto end;
+    printf("%-10s %-16s %7.2f %7.2f\n", "palettegen", "", f1, fn);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(dithers); i++) {
+        f1 = bench_run("paletteuse", dithers[i], frames, FF_ARRAY_ELEMS(frames), palette,
+                       1,       iterations, NULL);
+        fn = bench_run("paletteuse", dithers[i], frames, FF_ARRAY_ELEMS(frames), palette,
+                       threads, iterations, NULL);
+        if (f1 < 0 || fn < 0)
+            goto end;
+        printf("%-10s %-16s %7.2f %7.2f\n", "paletteuse", dithers[i] + 7, f1, fn);
+    }
+
+    ret = 0;
+end:
+    for (i = 0; i < FF_ARRAY_ELEMS(frames); i++)
+        av_frame_free(&frames[i]);
+    av_frame_free(&palette);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    AVLFG lfg;
+
+    av_lfg_init(&lfg, 0xdeadbeef);
+    av_log_set_level(AV_LOG_WARNING);
+
+    if (!avfilter_get_by_name("palettegen")) {
+        fprintf(stderr, "palettegen filter not available\n");
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "-b"))
+        return bench(argc > 2 ? atoi(argv[2]) : 20,
+                     argc > 3 ? atoi(argv[3]) : av_cpu_count(), &lfg);
+
+    return check(&lfg);
+}
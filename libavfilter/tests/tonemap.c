@@ -0,0 +1,231 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Checks that the tonemap filter gives the same output on any number of
+ * threads.
+ *
+ * With -b, tone maps 4K frames repeatedly and reports the frame rate of
+ * each curve on one thread and on the given number of threads.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/cpu.h"
+#include "libavutil/frame.h"
+#include "libavutil/lfg.h"
+#include "libavutil/time.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+
+#define PEAK 10.0f
+
+static const char *const curves[] = {
+    "linear", "gamma", "clip", "reinhard", "hable", "mobius",
+};
+
+static AVFrame *frame_alloc(int w, int h, AVLFG *lfg)
+{
+    AVFrame *frame = av_frame_alloc();
+    int p, x, y;
+
+    if (!frame)
+        return NULL;
+    frame->format     = AV_PIX_FMT_GBRPF32;
+    frame->width      = w;
+    frame->height     = h;
+    frame->colorspace = AVCOL_SPC_BT2020_NCL;
+    frame->color_trc  = AVCOL_TRC_LINEAR;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+
+    for (p = 0; p < 3; p++) {
+        for (y = 0; y < h; y++) {
+            float *line = (float *)(frame->data[p] + y * frame->linesize[p]);
+            // mostly SDR range, with highlights up to the peak
+            for (x = 0; x < w; x++) {
+                float v = av_lfg_get(lfg) / (float)UINT32_MAX;
+                line[x] = v * v * v * PEAK;
+            }
+        }
+    }
+    return frame;
+}
+
+static AVFilterGraph *graph_alloc(const AVFrame *frame, const char *curve, int threads, AVFilterContext **src,
+                                  AVFilterContext **sink)
+{
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVFilterContext *tonemap;
+    char args[256];
+
+    if (!graph)
+        return NULL;
+    graph->nb_threads = threads;
+
+    snprintf(args, sizeof(args),
+             "video_size=%dx%d:pix_fmt=%d:time_base=1/25:pixel_aspect=1/1",
+             frame->width, frame->height, frame->format);
+    if (avfilter_graph_create_filter(src, avfilter_get_by_name("buffer"),
+                                     "in", args, NULL, graph) < 0)
+        goto fail;
+    snprintf(args, sizeof(args), "%s:peak=%f", curve, PEAK);
+    if (avfilter_graph_create_filter(&tonemap, avfilter_get_by_name("tonemap"),
+                                     "tonemap", args, NULL, graph) < 0 ||
+        avfilter_graph_create_filter(sink, avfilter_get_by_name("buffersink"),
+                                     "out", NULL, NULL, graph) < 0)
+        goto fail;
+    if (avfilter_link(*src, 0, tonemap, 0) < 0 ||
+        avfilter_link(tonemap, 0, *sink, 0) < 0 ||
+        avfilter_graph_config(graph, NULL) < 0)
+        goto fail;
+
+    return graph;
+fail:
+    avfilter_graph_free(&graph);
+    return NULL;
+}
+
+/* Tone map frame n times, keeping the last output in out. */
+static int run(const AVFrame *frame, const char *curve, int threads, int n,
+               AVFrame *out)
+{
+    AVFilterContext *src, *sink;
+    AVFilterGraph *graph;
+    int i, ret = 0;
+
+    graph = graph_alloc(frame, curve, threads, &src, &sink);
+    if (!graph)
+        return AVERROR(EINVAL);
+
+    for (i = 0; i < n && ret >= 0; i++) {
+        av_frame_unref(out);
+        ret = av_buffersrc_add_frame_flags(src, (AVFrame *)frame,
+                                           AV_BUFFERSRC_FLAG_KEEP_REF);
+        if (ret >= 0)
+            ret = av_buffersink_get_frame(sink, out);
+    }
+
+    avfilter_graph_free(&graph);
+    return ret;
+}
+
+static float frame_diff(const AVFrame *a, const AVFrame *b)
+{
+    float max_diff = 0;
+    int p, x, y;
+
+    for (p = 0; p < 3; p++) {
+        for (y = 0; y < a->height; y++) {
+            const float *la = (const float *)(a->data[p] + y * a->linesize[p]);
+            const float *lb = (const float *)(b->data[p] + y * b->linesize[p]);
+            for (x = 0; x < a->width; x++)
+                max_diff = FFMAX(max_diff, fabsf(la[x] - lb[x]));
+        }
+    }
+    return max_diff;
+}
+
+static int check(AVLFG *lfg)
+{
+    static const int nb_threads[] = { 3, 8 };
+    AVFrame *frame = frame_alloc(320, 181, lfg);
+    AVFrame *ref = av_frame_alloc(), *out = av_frame_alloc();
+    int i, j, ret = 1;
+
+    if (!frame || !ref || !out)
+        goto end;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(curves); i++) {
+        if (run(frame, curves[i], 1, 1, ref) < 0) {
+            fprintf(stderr, "%s: filtering failed\n", curves[i]);
+            goto end;
+        }
+        for (j = 0; j < FF_ARRAY_ELEMS(nb_threads); j++) {
+            if (run(frame, curves[i], nb_threads[j], 1, out) < 0 ||
+                frame_diff(ref, out) != 0.0f) {
+                fprintf(stderr, "%s: output differs with %d threads\n",
+                        curves[i], nb_threads[j]);
+                goto end;
+            }
+        }
+    }
+
+    ret = 0;
+end:
+    av_frame_free(&frame);
+    av_frame_free(&ref);
+    av_frame_free(&out);
+    return ret;
+}
+
+static double bench_run(const AVFrame *frame, const char *curve, int threads,
+                        int iterations, AVFrame *out)
+{
+    int64_t t = av_gettime_relative();
+
+    if (run(frame, curve, threads, iterations, out) < 0)
+        return -1;
+    t = av_gettime_relative() - t;
+    return iterations * 1000000.0 / t;
+}
+
+static int bench(int iterations, int threads, AVLFG *lfg)
+{
+    AVFrame *frame = frame_alloc(3840, 2160, lfg);
+    AVFrame *out = av_frame_alloc();
+    int i, ret = 1;
+
+    if (!frame || !out)
+        goto end;
+
+    printf("gbrpf32 %dx%d, %d frames, fps on 1 and %d threads\n",
+           frame->width, frame->height, iterations, threads);
+    for (i = 0; i < FF_ARRAY_ELEMS(curves); i++) {
+        double f1 = bench_run(frame, curves[i], 1,       iterations, out);
+        double fn = bench_run(frame, curves[i], threads, iterations, out);
+        if (f1 < 0 || fn < 0)
+            goto end;
+        printf("%-8s %7.2f %7.2f\n", curves[i], f1, fn);
+    }
+
+    ret = 0;
+end:
+    av_frame_free(&frame);
+    av_frame_free(&out);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    AVLFG lfg;
+
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    if (argc > 1 && !strcmp(argv[1], "-b"))
+        return bench(argc > 2 ? atoi(argv[2]) : 20,
+                     argc > 3 ? atoi(argv[3]) : av_cpu_count(), &lfg);
+
+    return check(&lfg);
+}
@@ -25,4 +25,69 @@ int ff_graph_thread_init(AVFilterGraph *graph);
 
 void ff_graph_thread_free(AVFilterGraph *graph);
 
+/**
+ * Number of frames a pipeline thread can be given before
+ * ff_filter_pipeline_submit() waits for it.
+ */
+#define FF_PIPELINE_QUEUE_SIZE 3
+
+/**
+ * Start a thread for every filter of a configured graph that can run on its
+ * own with AVFILTER_THREAD_PIPELINE.
+ */
+int ff_graph_pipeline_init(AVFilterGraph *graph);
+
+/**
+ * Stop the pipeline threads, dropping the frames they still hold.
+ */
+void ff_graph_pipeline_free(AVFilterGraph *graph);
+
+/**
+ * Mark the filters whose thread has output ready.
+ *
+ * @param wait if set and there is none, wait for one
+ * @return 0, or AVERROR(EAGAIN) if no thread has anything left to do
+ */
+int ff_graph_pipeline_poll(AVFilterGraph *graph, int wait);
+
+/**
+ * Serialize access to the frame pool of a link, which can be shared between
+ * threads when the graph has pipeline threads.
+ */
+void ff_link_pipeline_lock(AVFilterLink *link);
+void ff_link_pipeline_unlock(AVFilterLink *link);
+
+/**
+ * Give a frame of the filter input to its thread. Waits while the thread
+ * has FF_PIPELINE_QUEUE_SIZE frames already.
+ */
+int ff_filter_pipeline_submit(AVFilterContext *ctx, AVFrame *frame);
+
+/**
+ * Queue a frame output by the filter, to be sent on the link by
+ * ff_filter_pipeline_receive() on the thread running the graph.
+ */
+int ff_filter_pipeline_output(AVFilterLink *link, AVFrame *frame);
+
+/**
+ * Get the next result of the filter thread.
+ *
+ * @param frame set to an output frame, or to NULL at the end of an input
+ *              frame, in which case ret is set to what filter_frame()
+ *              returned for it
+ * @return 1 if a result was returned, 0 if there is none yet
+ */
+int ff_filter_pipeline_receive(AVFilterContext *ctx, AVFrame **frame, int *ret);
+
+/**
+ * @return the number of frames submitted to the filter thread and not done
+ *         yet, at most FF_PIPELINE_QUEUE_SIZE
+ */
+int ff_filter_pipeline_pending(AVFilterContext *ctx);
+
+/**
+ * Wait for the filter thread to be done with all the frames submitted.
+ */
+void ff_filter_pipeline_wait(AVFilterContext *ctx);
+
 #endif /* AVFILTER_THREAD_H */
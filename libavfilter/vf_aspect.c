@@ -169,9 +169,10 @@ AVFILTER_DEFINE_CLASS(setdar);
 
 static const AVFilterPad avfilter_vf_setdar_inputs[] = {
     {
-        .name         = "default",
-        .type         = AVMEDIA_TYPE_VIDEO,
-        .filter_frame = filter_frame,
+        .name            = "default",
+        .type            = AVMEDIA_TYPE_VIDEO,
+        .filter_frame    = filter_frame,
+        .forwards_frames = 1,
     },
     { NULL }
 };
@@ -233,9 +234,10 @@ AVFILTER_DEFINE_CLASS(setsar);
 
 static const AVFilterPad avfilter_vf_setsar_inputs[] = {
     {
-        .name         = "default",
-        .type         = AVMEDIA_TYPE_VIDEO,
-        .filter_frame = filter_frame,
+        .name            = "default",
+        .type            = AVMEDIA_TYPE_VIDEO,
+        .filter_frame    = filter_frame,
+        .forwards_frames = 1,
     },
     { NULL }
 };
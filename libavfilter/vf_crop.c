@@ -361,10 +361,11 @@ AVFILTER_DEFINE_CLASS(crop);
 
 static const AVFilterPad avfilter_vf_crop_inputs[] = {
     {
-        .name         = "default",
-        .type         = AVMEDIA_TYPE_VIDEO,
-        .filter_frame = filter_frame,
-        .config_props = config_input,
+        .name            = "default",
+        .type            = AVMEDIA_TYPE_VIDEO,
+        .filter_frame    = filter_frame,
+        .config_props    = config_input,
+        .forwards_frames = 1,
     },
     { NULL }
 };
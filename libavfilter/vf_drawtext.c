@@ -1522,4 +1522,5 @@ AVFilter ff_vf_drawtext = {
     .outputs       = avfilter_vf_drawtext_outputs,
     .process_command = command,
     .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags_internal = FF_FILTER_FLAG_PIPELINE,
 };
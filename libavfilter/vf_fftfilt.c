@@ -33,6 +33,7 @@
 #include "libavutil/eval.h"
 
 #define MAX_PLANES 4
+#define MAX_THREADS 32
 
 enum EvalMode {
     EVAL_MODE_INIT,
@@ -46,13 +47,16 @@ typedef struct FFTFILTContext {
     int eval_mode;
     int depth;
     int nb_planes;
+    int nb_threads;
     int planewidth[MAX_PLANES];
     int planeheight[MAX_PLANES];
 
-    RDFTContext *hrdft[MAX_PLANES];
-    RDFTContext *vrdft[MAX_PLANES];
-    RDFTContext *ihrdft[MAX_PLANES];
-    RDFTContext *ivrdft[MAX_PLANES];
+    /* the transforms use a scratch buffer of their context, so each job
+     * has its own */
+    RDFTContext *hrdft[MAX_THREADS][MAX_PLANES];
+    RDFTContext *vrdft[MAX_THREADS][MAX_PLANES];
+    RDFTContext *ihrdft[MAX_THREADS][MAX_PLANES];
+    RDFTContext *ivrdft[MAX_THREADS][MAX_PLANES];
     int rdft_hbits[MAX_PLANES];
     int rdft_vbits[MAX_PLANES];
     size_t rdft_hlen[MAX_PLANES];
@@ -65,10 +69,15 @@ typedef struct FFTFILTContext {
     AVExpr *weight_expr[MAX_PLANES];
     double *weight[MAX_PLANES];
 
-    void (*rdft_horizontal)(struct FFTFILTContext *s, AVFrame *in, int w, int h, int plane);
-    void (*irdft_horizontal)(struct FFTFILTContext *s, AVFrame *out, int w, int h, int plane);
+    avfilter_action_func *rdft_horizontal;
+    avfilter_action_func *irdft_horizontal;
 } FFTFILTContext;
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int plane;
+} ThreadData;
+
 static const char *const var_names[] = {   "X",   "Y",   "W",   "H",   "N", NULL        };
 enum                                   { VAR_X, VAR_Y, VAR_W, VAR_H, VAR_N, VAR_VARS_NB };
 
@@ -114,36 +123,98 @@ static void copy_rev (FFTSample *dest, int w, int w2)
 }
 
 /*Horizontal pass - RDFT*/
-static void rdft_horizontal8(FFTFILTContext *s, AVFrame *in, int w, int h, int plane)
+static int rdft_horizontal8(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    FFTFILTContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in;
+    const int plane = td->plane;
+    const int w = s->planewidth[plane];
+    const int h = s->planeheight[plane];
+    const int slice_start = (h *  jobnr   ) / nb_jobs;
+    const int slice_end   = (h * (jobnr+1)) / nb_jobs;
     int i, j;
 
-    for (i = 0; i < h; i++) {
+    for (i = slice_start; i < slice_end; i++) {
         for (j = 0; j < w; j++)
             s->rdft_hdata[plane][i * s->rdft_hlen[plane] + j] = *(in->data[plane] + in->linesize[plane] * i + j);
 
         copy_rev(s->rdft_hdata[plane] + i * s->rdft_hlen[plane], w, s->rdft_hlen[plane]);
     }
 
-    for (i = 0; i < h; i++)
-        av_rdft_calc(s->hrdft[plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
+    for (i = slice_start; i < slice_end; i++)
+        av_rdft_calc(s->hrdft[jobnr][plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
+
+    return 0;
 }
 
-static void rdft_horizontal16(FFTFILTContext *s, AVFrame *in, int w, int h, int plane)
+static int rdft_horizontal16(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    const uint16_t *src = (const uint16_t *)in->data[plane];
-    int linesize = in->linesize[plane] / 2;
+    FFTFILTContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int plane = td->plane;
+    const uint16_t *src = (const uint16_t *)td->in->data[plane];
+    const int linesize = td->in->linesize[plane] / 2;
+    const int w = s->planewidth[plane];
+    const int h = s->planeheight[plane];
+    const int slice_start = (h *  jobnr   ) / nb_jobs;
+    const int slice_end   = (h * (jobnr+1)) / nb_jobs;
     int i, j;
 
-    for (i = 0; i < h; i++) {
+    for (i = slice_start; i < slice_end; i++) {
         for (j = 0; j < w; j++)
             s->rdft_hdata[plane][i * s->rdft_hlen[plane] + j] = *(src + linesize * i + j);
 
         copy_rev(s->rdft_hdata[plane] + i * s->rdft_hlen[plane], w, s->rdft_hlen[plane]);
     }
 
-    for (i = 0; i < h; i++)
-        av_rdft_calc(s->hrdft[plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
+    for (i = slice_start; i < slice_end; i++)
+        av_rdft_calc(s->hrdft[jobnr][plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
+
+    return 0;
+}
+
+/**
+ * Vertical pass - RDFT, weighting of the spectrum and IRDFT, which only
+ * depend on the current column.
+ */
+static int filter_vertical(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    FFTFILTContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int plane = td->plane;
+    const int h = s->planeheight[plane];
+    // strips of 16 columns, to keep the jobs off each other's cache lines
+    const int hlen        = s->rdft_hlen[plane];
+    const int nb_strips   = (hlen + 15) >> 4;
+    const int slice_start = FFMIN(hlen, ((nb_strips *  jobnr   ) / nb_jobs) << 4);
+    const int slice_end   = FFMIN(hlen, ((nb_strips * (jobnr+1)) / nb_jobs) << 4);
+    int i, j;
+
+    for (i = slice_start; i < slice_end; i++) {
+        FFTSample *vdata = s->rdft_vdata[plane] + i * s->rdft_vlen[plane];
+        const double *weight = s->weight[plane] + i * s->rdft_vlen[plane];
+
+        for (j = 0; j < h; j++)
+            vdata[j] = s->rdft_hdata[plane][j * s->rdft_hlen[plane] + i];
+        copy_rev(vdata, h, s->rdft_vlen[plane]);
+
+        av_rdft_calc(s->vrdft[jobnr][plane], vdata);
+
+        /*Change user defined parameters*/
+        for (j = 0; j < s->rdft_vlen[plane]; j++)
+            vdata[j] *= weight[j];
+
+        if (!i)
+            vdata[0] += s->rdft_hlen[plane] * s->rdft_vlen[plane] * s->dc[plane];
+
+        av_rdft_calc(s->ivrdft[jobnr][plane], vdata);
+
+        for (j = 0; j < h; j++)
+            s->rdft_hdata[plane][j * s->rdft_hlen[plane] + i] = vdata[j];
+    }
+
+    return 0;
 }
 
 /*Vertical pass - RDFT*/
@@ -159,7 +230,7 @@ static void rdft_vertical(FFTFILTContext *s, int h, int plane)
     }
 
     for (i = 0; i < s->rdft_hlen[plane]; i++)
-        av_rdft_calc(s->vrdft[plane], s->rdft_vdata[plane] + i * s->rdft_vlen[plane]);
+        av_rdft_calc(s->vrdft[0][plane], s->rdft_vdata[plane] + i * s->rdft_vlen[plane]);
 }
 /*Vertical pass - IRDFT*/
 static void irdft_vertical(FFTFILTContext *s, int h, int plane)
@@ -167,7 +238,7 @@ static void irdft_vertical(FFTFILTContext *s, int h, int plane)
     int i, j;
 
     for (i = 0; i < s->rdft_hlen[plane]; i++)
-        av_rdft_calc(s->ivrdft[plane], s->rdft_vdata[plane] + i * s->rdft_vlen[plane]);
+        av_rdft_calc(s->ivrdft[0][plane], s->rdft_vdata[plane] + i * s->rdft_vlen[plane]);
 
     for (i = 0; i < s->rdft_hlen[plane]; i++)
         for (j = 0; j < h; j++)
@@ -176,37 +247,56 @@ static void irdft_vertical(FFTFILTContext *s, int h, int plane)
 }
 
 /*Horizontal pass - IRDFT*/
-static void irdft_horizontal8(FFTFILTContext *s, AVFrame *out, int w, int h, int plane)
+static int irdft_horizontal8(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
+    FFTFILTContext *s = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *out = td->out;
+    const int plane = td->plane;
+    const int w = s->planewidth[plane];
+    const int h = s->planeheight[plane];
+    const int slice_start = (h *  jobnr   ) / nb_jobs;
+    const int slice_end   = (h * (jobnr+1)) / nb_jobs;
     int i, j;
 
-    for (i = 0; i < h; i++)
-        av_rdft_calc(s->ihrdft[plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
+    for (i = slice_start; i < slice_end; i++)
+        av_rdft_calc(s->ihrdft[jobnr][plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
 
-    for (i = 0; i < h; i++)
+    for (i = slice_start; i < slice_end; i++)
         for (j = 0; j < w; j++)
             *(out->data[plane] + out->linesize[plane] * i + j) = av_clip(s->rdft_hdata[plane][i
                                                                          *s->rdft_hlen[plane] + j] * 4 /
                                                                          (s->rdft_hlen[plane] *
                                                                           s->rdft_vlen[plane]), 0, 255);
+
+    return 0;
 }
 
-static void irdft_horizontal16(FFTFILTContext *s, AVFrame *out, int w, int h, int plane)
+static int irdft_horizontal16(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    uint16_t *dst = (uint16_t *)out->data[plane];
-    int linesize = out->linesize[plane] / 2;
-    int max = (1 << s->depth) - 1;
+    FFTFILTContext *s = ctx->priv;
+    ThreadData *td = arg;
+    const int plane = td->plane;
+    uint16_t *dst = (uint16_t *)td->out->data[plane];
+    const int linesize = td->out->linesize[plane] / 2;
+    const int max = (1 << s->depth) - 1;
+    const int w = s->planewidth[plane];
+    const int h = s->planeheight[plane];
+    const int slice_start = (h *  jobnr   ) / nb_jobs;
+    const int slice_end   = (h * (jobnr+1)) / nb_jobs;
     int i, j;
 
-    for (i = 0; i < h; i++)
-        av_rdft_calc(s->ihrdft[plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
+    for (i = slice_start; i < slice_end; i++)
+        av_rdft_calc(s->ihrdft[jobnr][plane], s->rdft_hdata[plane] + i * s->rdft_hlen[plane]);
 
-    for (i = 0; i < h; i++)
+    for (i = slice_start; i < slice_end; i++)
         for (j = 0; j < w; j++)
             *(dst + linesize * i + j) = av_clip(s->rdft_hdata[plane][i
                                                 *s->rdft_hlen[plane] + j] * 4 /
                                                 (s->rdft_hlen[plane] *
                                                 s->rdft_vlen[plane]), 0, max);
+
+    return 0;
 }
 
 static av_cold int initialize(AVFilterContext *ctx)
@@ -266,7 +356,7 @@ static int config_props(AVFilterLink *inlink)
 {
     FFTFILTContext *s = inlink->dst->priv;
     const AVPixFmtDescriptor *desc;
-    int rdft_hbits, rdft_vbits, i, plane;
+    int rdft_hbits, rdft_vbits, i, j, plane;
 
     desc = av_pix_fmt_desc_get(inlink->format);
     s->depth = desc->comp[0].depth;
@@ -276,6 +366,7 @@ static int config_props(AVFilterLink *inlink)
     s->planeheight[0] = s->planeheight[3] = inlink->h;
 
     s->nb_planes = av_pix_fmt_count_planes(inlink->format);
+    s->nb_threads = FFMIN(ff_filter_get_nb_threads(inlink->dst), MAX_THREADS);
 
     for (i = 0; i < desc->nb_components; i++) {
         int w = s->planewidth[i];
@@ -288,10 +379,12 @@ static int config_props(AVFilterLink *inlink)
         if (!(s->rdft_hdata[i] = av_malloc_array(h, s->rdft_hlen[i] * sizeof(FFTSample))))
             return AVERROR(ENOMEM);
 
-        if (!(s->hrdft[i] = av_rdft_init(s->rdft_hbits[i], DFT_R2C)))
-            return AVERROR(ENOMEM);
-        if (!(s->ihrdft[i] = av_rdft_init(s->rdft_hbits[i], IDFT_C2R)))
-            return AVERROR(ENOMEM);
+        for (j = 0; j < s->nb_threads; j++) {
+            if (!(s->hrdft[j][i] = av_rdft_init(s->rdft_hbits[i], DFT_R2C)))
+                return AVERROR(ENOMEM);
+            if (!(s->ihrdft[j][i] = av_rdft_init(s->rdft_hbits[i], IDFT_C2R)))
+                return AVERROR(ENOMEM);
+        }
 
         /* RDFT - Array initialization for Vertical pass*/
         for (rdft_vbits = 1; 1 << rdft_vbits < h*10/9; rdft_vbits++);
@@ -300,10 +393,12 @@ static int config_props(AVFilterLink *inlink)
         if (!(s->rdft_vdata[i] = av_malloc_array(s->rdft_hlen[i], s->rdft_vlen[i] * sizeof(FFTSample))))
             return AVERROR(ENOMEM);
 
-        if (!(s->vrdft[i] = av_rdft_init(s->rdft_vbits[i], DFT_R2C)))
-            return AVERROR(ENOMEM);
-        if (!(s->ivrdft[i] = av_rdft_init(s->rdft_vbits[i], IDFT_C2R)))
-            return AVERROR(ENOMEM);
+        for (j = 0; j < s->nb_threads; j++) {
+            if (!(s->vrdft[j][i] = av_rdft_init(s->rdft_vbits[i], DFT_R2C)))
+                return AVERROR(ENOMEM);
+            if (!(s->ivrdft[j][i] = av_rdft_init(s->rdft_vbits[i], IDFT_C2R)))
+                return AVERROR(ENOMEM);
+        }
     }
 
     /*Luminance value - Array initialization*/
@@ -333,6 +428,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     AVFilterLink *outlink = inlink->dst->outputs[0];
     FFTFILTContext *s = ctx->priv;
     AVFrame *out;
+    ThreadData td;
     int i, j, plane;
 
     out = ff_get_video_buffer(outlink, inlink->w, inlink->h);
@@ -343,26 +439,37 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
     av_frame_copy_props(out, in);
 
+    td.in  = in;
+    td.out = out;
     for (plane = 0; plane < s->nb_planes; plane++) {
-        int w = s->planewidth[plane];
-        int h = s->planeheight[plane];
+        const int h = s->planeheight[plane];
 
         if (s->eval_mode == EVAL_MODE_FRAME)
             do_eval(s, inlink, plane);
 
-        s->rdft_horizontal(s, in, w, h, plane);
-        rdft_vertical(s, h, plane);
-
-        /*Change user defined parameters*/
-        for (i = 0; i < s->rdft_hlen[plane]; i++)
-            for (j = 0; j < s->rdft_vlen[plane]; j++)
-                s->rdft_vdata[plane][i * s->rdft_vlen[plane] + j] *=
-                  s->weight[plane][i * s->rdft_vlen[plane] + j];
-
-        s->rdft_vdata[plane][0] += s->rdft_hlen[plane] * s->rdft_vlen[plane] * s->dc[plane];
-
-        irdft_vertical(s, h, plane);
-        s->irdft_horizontal(s, out, w, h, plane);
+        td.plane = plane;
+        if (s->nb_threads > 1) {
+            ctx->internal->execute(ctx, s->rdft_horizontal, &td, NULL,
+                                   FFMIN(h, s->nb_threads));
+            ctx->internal->execute(ctx, filter_vertical, &td, NULL,
+                                   FFMIN((s->rdft_hlen[plane] + 15) >> 4, s->nb_threads));
+            ctx->internal->execute(ctx, s->irdft_horizontal, &td, NULL,
+                                   FFMIN(h, s->nb_threads));
+        } else {
+            s->rdft_horizontal(ctx, &td, 0, 1);
+            rdft_vertical(s, h, plane);
+
+            /*Change user defined parameters*/
+            for (i = 0; i < s->rdft_hlen[plane]; i++)
+                for (j = 0; j < s->rdft_vlen[plane]; j++)
+                    s->rdft_vdata[plane][i * s->rdft_vlen[plane] + j] *=
+                      s->weight[plane][i * s->rdft_vlen[plane] + j];
+
+            s->rdft_vdata[plane][0] += s->rdft_hlen[plane] * s->rdft_vlen[plane] * s->dc[plane];
+
+            irdft_vertical(s, h, plane);
+            s->irdft_horizontal(ctx, &td, 0, 1);
+        }
     }
 
     av_frame_free(&in);
@@ -372,16 +479,18 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 static av_cold void uninit(AVFilterContext *ctx)
 {
     FFTFILTContext *s = ctx->priv;
-    int i;
+    int i, j;
     for (i = 0; i < MAX_PLANES; i++) {
         av_free(s->rdft_hdata[i]);
         av_free(s->rdft_vdata[i]);
         av_expr_free(s->weight_expr[i]);
         av_free(s->weight[i]);
-        av_rdft_end(s->hrdft[i]);
-        av_rdft_end(s->ihrdft[i]);
-        av_rdft_end(s->vrdft[i]);
-        av_rdft_end(s->ivrdft[i]);
+        for (j = 0; j < MAX_THREADS; j++) {
+            av_rdft_end(s->hrdft[j][i]);
+            av_rdft_end(s->ihrdft[j][i]);
+            av_rdft_end(s->vrdft[j][i]);
+            av_rdft_end(s->ivrdft[j][i]);
+        }
     }
 }
 
@@ -438,5 +547,5 @@ AVFilter ff_vf_fftfilt = {
     .query_formats   = query_formats,
     .init            = initialize,
     .uninit          = uninit,
-    .flags           = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags           = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -154,6 +154,7 @@ static const AVFilterPad avfilter_vf_format_inputs[] = {
         .name             = "default",
         .type             = AVMEDIA_TYPE_VIDEO,
         .get_video_buffer = ff_null_get_video_buffer,
+        .forwards_frames  = 1,
     },
     { NULL }
 };
@@ -193,6 +194,7 @@ static const AVFilterPad avfilter_vf_noformat_inputs[] = {
         .name             = "default",
         .type             = AVMEDIA_TYPE_VIDEO,
         .get_video_buffer = ff_null_get_video_buffer,
+        .forwards_frames  = 1,
     },
     { NULL }
 };
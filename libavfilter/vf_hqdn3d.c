@@ -153,6 +153,157 @@ static int denoise_depth(HQDN3DContext *s,
     return 0;
 }
 
+/**
+ * With slice threading, the spatial filter is split in a horizontal pass,
+ * run by bands of rows, which only depends on the current row, and a
+ * vertical pass with the temporal filter, run by strips of columns, which
+ * only depends on the current column. The result is the same as the one of
+ * denoise_spatial().
+ */
+av_always_inline
+static void denoise_rows_depth(uint8_t *src, uint8_t *dst,
+                               uint16_t *hpass, uint16_t *frame_ant, int init,
+                               int w, int y_start, int y_end, int sstride, int dstride,
+                               int16_t *spatial, int16_t *temporal, int depth)
+{
+    long x, y;
+    uint32_t pixel_ant;
+    uint32_t tmp;
+    const int do_spatial = spatial[0];
+
+    spatial  += 256 << LUT_BITS;
+    temporal += 256 << LUT_BITS;
+
+    src       += y_start * sstride;
+    dst       += y_start * dstride;
+    hpass     += y_start * w;
+    frame_ant += y_start * w;
+
+    for (y = y_start; y < y_end; y++) {
+        if (init)
+            for (x = 0; x < w; x++)
+                frame_ant[x] = LOAD(x);
+
+        if (!do_spatial) {
+            for (x = 0; x < w; x++) {
+                frame_ant[x] = tmp = lowpass(frame_ant[x], LOAD(x), temporal, depth);
+                STORE(x, tmp);
+            }
+        } else if (!y) {
+            // as in denoise_spatial(), the first pixel of the first line is filtered too
+            pixel_ant = LOAD(0);
+            for (x = 0; x < w; x++)
+                hpass[x] = pixel_ant = lowpass(pixel_ant, LOAD(x), spatial, depth);
+        } else {
+            hpass[0] = pixel_ant = LOAD(0);
+            for (x = 1; x < w; x++)
+                hpass[x] = pixel_ant = lowpass(pixel_ant, LOAD(x), spatial, depth);
+        }
+        src       += sstride;
+        dst       += dstride;
+        hpass     += w;
+        frame_ant += w;
+    }
+}
+
+av_always_inline
+static void denoise_columns_depth(uint8_t *dst, const uint16_t *hpass,
+                                  uint16_t *line_ant, uint16_t *frame_ant,
+                                  int w, int h, int x_start, int x_end, int dstride,
+                                  int16_t *spatial, int16_t *temporal, int depth)
+{
+    long x, y;
+    uint32_t tmp;
+
+    spatial  += 256 << LUT_BITS;
+    temporal += 256 << LUT_BITS;
+
+    for (x = x_start; x < x_end; x++) {
+        line_ant[x] = tmp = hpass[x];
+        frame_ant[x] = tmp = lowpass(frame_ant[x], tmp, temporal, depth);
+        STORE(x, tmp);
+    }
+
+    for (y = 1; y < h; y++) {
+        dst       += dstride;
+        hpass     += w;
+        frame_ant += w;
+        for (x = x_start; x < x_end; x++) {
+            line_ant[x] = tmp = lowpass(line_ant[x], hpass[x], spatial, depth);
+            frame_ant[x] = tmp = lowpass(frame_ant[x], tmp, temporal, depth);
+            STORE(x, tmp);
+        }
+    }
+}
+
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int init;
+} ThreadData;
+
+static int denoise_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    HQDN3DContext *s = ctx->priv;
+    ThreadData *td = arg;
+    int c;
+
+    for (c = 0; c < 3; c++) {
+        const int w = AV_CEIL_RSHIFT(td->in->width,  (!!c * s->hsub));
+        const int h = AV_CEIL_RSHIFT(td->in->height, (!!c * s->vsub));
+        const int slice_start = (h *  jobnr   ) / nb_jobs;
+        const int slice_end   = (h * (jobnr+1)) / nb_jobs;
+
+#define DENOISE_ROWS(depth)                                                            \
+        denoise_rows_depth(td->in->data[c], td->out->data[c],                         \
+                           s->hpass[c], s->frame_prev[c], td->init,                   \
+                           w, slice_start, slice_end,                                 \
+                           td->in->linesize[c], td->out->linesize[c],                 \
+                           s->coefs[c ? CHROMA_SPATIAL : LUMA_SPATIAL],               \
+                           s->coefs[c ? CHROMA_TMP     : LUMA_TMP], depth)
+        switch (s->depth) {
+        case  8: DENOISE_ROWS( 8); break;
+        case  9: DENOISE_ROWS( 9); break;
+        case 10: DENOISE_ROWS(10); break;
+        case 16: DENOISE_ROWS(16); break;
+        }
+    }
+    return 0;
+}
+
+static int denoise_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    HQDN3DContext *s = ctx->priv;
+    ThreadData *td = arg;
+    int c;
+
+    for (c = 0; c < 3; c++) {
+        const int w = AV_CEIL_RSHIFT(td->in->width,  (!!c * s->hsub));
+        const int h = AV_CEIL_RSHIFT(td->in->height, (!!c * s->vsub));
+        // strips of 32 pixels, to keep the jobs off each other's cache lines
+        const int nb_strips   = (w + 31) >> 5;
+        const int slice_start = FFMIN(w, ((nb_strips *  jobnr   ) / nb_jobs) << 5);
+        const int slice_end   = FFMIN(w, ((nb_strips * (jobnr+1)) / nb_jobs) << 5);
+
+        if (!s->coefs[c ? CHROMA_SPATIAL : LUMA_SPATIAL][0])
+            continue;
+
+#define DENOISE_COLUMNS(depth)                                                         \
+        denoise_columns_depth(td->out->data[c], s->hpass[c],                          \
+                              s->line + c * td->in->width, s->frame_prev[c],          \
+                              w, h, slice_start, slice_end,                           \
+                              td->out->linesize[c],                                   \
+                              s->coefs[c ? CHROMA_SPATIAL : LUMA_SPATIAL],            \
+                              s->coefs[c ? CHROMA_TMP     : LUMA_TMP], depth)
+        switch (s->depth) {
+        case  8: DENOISE_COLUMNS( 8); break;
+        case  9: DENOISE_COLUMNS( 9); break;
+        case 10: DENOISE_COLUMNS(10); break;
+        case 16: DENOISE_COLUMNS(16); break;
+        }
+    }
+    return 0;
+}
+
 #define denoise(...)                                                          \
     do {                                                                      \
         int ret = AVERROR_BUG;                                                \
@@ -227,6 +378,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&s->frame_prev[0]);
     av_freep(&s->frame_prev[1]);
     av_freep(&s->frame_prev[2]);
+    av_freep(&s->hpass[0]);
+    av_freep(&s->hpass[1]);
+    av_freep(&s->hpass[2]);
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -271,10 +425,23 @@ static int config_input(AVFilterLink *inlink)
     s->vsub  = desc->log2_chroma_h;
     s->depth = desc->comp[0].depth;
 
-    s->line = av_malloc_array(inlink->w, sizeof(*s->line));
+    s->nb_threads = ff_filter_get_nb_threads(inlink->dst);
+
+    // one line per plane, for the vertical pass of the threaded filtering
+    s->line = av_malloc_array(inlink->w, (s->nb_threads > 1 ? 3 : 1) * sizeof(*s->line));
     if (!s->line)
         return AVERROR(ENOMEM);
 
+    if (s->nb_threads > 1) {
+        for (i = 0; i < 3; i++) {
+            s->hpass[i] = av_malloc_array(AV_CEIL_RSHIFT(inlink->w, !!i * s->hsub),
+                                          AV_CEIL_RSHIFT(inlink->h, !!i * s->vsub) *
+                                          sizeof(*s->hpass[i]));
+            if (!s->hpass[i])
+                return AVERROR(ENOMEM);
+        }
+    }
+
     for (i = 0; i < 4; i++) {
         s->coefs[i] = precalc_coefs(s->strength[i], s->depth);
         if (!s->coefs[i])
@@ -308,14 +475,37 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         av_frame_copy_props(out, in);
     }
 
-    for (c = 0; c < 3; c++) {
-        denoise(s, in->data[c], out->data[c],
-                s->line, &s->frame_prev[c],
-                AV_CEIL_RSHIFT(in->width,  (!!c * s->hsub)),
-                AV_CEIL_RSHIFT(in->height, (!!c * s->vsub)),
-                in->linesize[c], out->linesize[c],
-                s->coefs[c ? CHROMA_SPATIAL : LUMA_SPATIAL],
-                s->coefs[c ? CHROMA_TMP     : LUMA_TMP]);
+    if (s->nb_threads > 1) {
+        ThreadData td = { .in = in, .out = out, .init = !s->frame_prev[0] };
+
+        for (c = 0; c < 3 && td.init; c++) {
+            s->frame_prev[c] = av_malloc_array(AV_CEIL_RSHIFT(in->width,  (!!c * s->hsub)),
+                                               AV_CEIL_RSHIFT(in->height, (!!c * s->vsub)) *
+                                               sizeof(*s->frame_prev[c]));
+            if (!s->frame_prev[c]) {
+                av_freep(&s->frame_prev[0]);
+                av_freep(&s->frame_prev[1]);
+                av_frame_free(&out);
+                if (!direct)
+                    av_frame_free(&in);
+                return AVERROR(ENOMEM);
+            }
+        }
+
+        ctx->internal->execute(ctx, denoise_rows, &td, NULL,
+                               FFMIN(in->height, s->nb_threads));
+        ctx->internal->execute(ctx, denoise_columns, &td, NULL,
+                               FFMIN((in->width + 31) >> 5, s->nb_threads));
+    } else {
+        for (c = 0; c < 3; c++) {
+            denoise(s, in->data[c], out->data[c],
+                    s->line, &s->frame_prev[c],
+                    AV_CEIL_RSHIFT(in->width,  (!!c * s->hsub)),
+                    AV_CEIL_RSHIFT(in->height, (!!c * s->vsub)),
+                    in->linesize[c], out->linesize[c],
+                    s->coefs[c ? CHROMA_SPATIAL : LUMA_SPATIAL],
+                    s->coefs[c ? CHROMA_TMP     : LUMA_TMP]);
+        }
     }
 
     if (ctx->is_disabled) {
@@ -370,5 +560,6 @@ AVFilter ff_vf_hqdn3d = {
     .query_formats = query_formats,
     .inputs        = avfilter_vf_hqdn3d_inputs,
     .outputs       = avfilter_vf_hqdn3d_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_SLICE_THREADS,
+    .flags_internal = FF_FILTER_FLAG_PIPELINE,
 };
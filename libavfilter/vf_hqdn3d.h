@@ -33,9 +33,11 @@ typedef struct HQDN3DContext {
     int16_t *coefs[4];
     uint16_t *line;
     uint16_t *frame_prev[3];
+    uint16_t *hpass[3];         ///< horizontally filtered planes, with slice threading
     double strength[4];
     int hsub, vsub;
     int depth;
+    int nb_threads;
     void (*denoise_row[17])(uint8_t *src, uint8_t *dst, uint16_t *line_ant, uint16_t *frame_ant, ptrdiff_t w, int16_t *spatial, int16_t *temporal);
 } HQDN3DContext;
 
@@ -32,6 +32,7 @@
 
 #include "avfilter.h"
 #include "internal.h"
+#include "remap.h"
 #include "video.h"
 
 typedef struct LenscorrectionCtx {
@@ -40,8 +41,9 @@ typedef struct LenscorrectionCtx {
     unsigned int height;
     int hsub, vsub;
     int nb_planes;
+    int interp;
     double cx, cy, k1, k2;
-    int32_t *correction[4];
+    RemapMap map[2];    ///< luma and alpha, chroma
 } LenscorrectionCtx;
 
 #define FLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
@@ -50,6 +52,9 @@ static const AVOption lenscorrection_options[] = {
     { "cy",     "set relative center y", offsetof(LenscorrectionCtx, cy), AV_OPT_TYPE_DOUBLE, {.dbl=0.5}, 0, 1, .flags=FLAGS },
     { "k1",     "set quadratic distortion factor", offsetof(LenscorrectionCtx, k1), AV_OPT_TYPE_DOUBLE, {.dbl=0.0}, -1, 1, .flags=FLAGS },
     { "k2",     "set double quadratic distortion factor", offsetof(LenscorrectionCtx, k2), AV_OPT_TYPE_DOUBLE, {.dbl=0.0}, -1, 1, .flags=FLAGS },
+    { "i",      "set interpolation type", offsetof(LenscorrectionCtx, interp), AV_OPT_TYPE_INT, {.i64=REMAP_NEAREST}, 0, NB_REMAP_INTERP-1, .flags=FLAGS, "i" },
+        { "nearest",  "nearest neighbour",      0, AV_OPT_TYPE_CONST, {.i64=REMAP_NEAREST},  0, 0, .flags=FLAGS, "i" },
+        { "bilinear", "bilinear interpolation", 0, AV_OPT_TYPE_CONST, {.i64=REMAP_BILINEAR}, 0, 0, .flags=FLAGS, "i" },
     { NULL }
 };
 
@@ -57,40 +62,71 @@ AVFILTER_DEFINE_CLASS(lenscorrection);
 
 typedef struct ThreadData {
     AVFrame *in, *out;
-    int w, h;
-    int plane;
-    int xcenter, ycenter;
-    int32_t *correction;
 } ThreadData;
 
 static int filter_slice(AVFilterContext *ctx, void *arg, int job, int nb_jobs)
 {
-    ThreadData *td = (ThreadData*)arg;
+    LenscorrectionCtx *rect = ctx->priv;
+    ThreadData *td = arg;
     AVFrame *in = td->in;
     AVFrame *out = td->out;
+    int plane;
 
-    const int w = td->w, h = td->h;
-    const int xcenter = td->xcenter;
-    const int ycenter = td->ycenter;
-    const int start = (h *  job   ) / nb_jobs;
-    const int end   = (h * (job+1)) / nb_jobs;
-    const int plane = td->plane;
-    const int inlinesize = in->linesize[plane];
-    const int outlinesize = out->linesize[plane];
-    const uint8_t *indata = in->data[plane];
-    uint8_t *outrow = out->data[plane] + start * outlinesize;
-    int i;
-    for (i = start; i < end; i++, outrow += outlinesize) {
-        const int off_y = i - ycenter;
-        uint8_t *out = outrow;
-        int j;
-        for (j = 0; j < w; j++) {
-            const int off_x = j - xcenter;
-            const int64_t radius_mult = td->correction[j + i*w];
-            const int x = xcenter + ((radius_mult * off_x + (1<<23))>>24);
-            const int y = ycenter + ((radius_mult * off_y + (1<<23))>>24);
-            const char isvalid = x > 0 && x < w - 1 && y > 0 && y < h - 1;
-            *out++ =  isvalid ? indata[y * inlinesize + x] : 0;
+    for (plane = 0; plane < rect->nb_planes; plane++) {
+        const RemapMap *map = &rect->map[plane == 1 || plane == 2];
+        const int start = (map->h *  job   ) / nb_jobs;
+        const int end   = (map->h * (job+1)) / nb_jobs;
+
+        ff_remap_slice(map,
+                       out->data[plane], out->linesize[plane],
+                       in->data[plane], in->linesize[plane],
+                       1, 1, 1, start, end);
+    }
+    return 0;
+}
+
+/**
+ * Compute the correction map of a plane of w x h pixels.
+ */
+static int build_map(LenscorrectionCtx *rect, RemapMap *map, int w, int h)
+{
+    const int xcenter = rect->cx * w;
+    const int ycenter = rect->cy * h;
+    const int k1 = rect->k1 * (1<<24);
+    const int k2 = rect->k2 * (1<<24);
+    const int64_t r2inv = (4LL<<60) / (w * w + h * h);
+    // bilinear interpolation reads 2x2 blocks
+    const int interp = w < 2 || h < 2 ? REMAP_NEAREST : rect->interp;
+    int i, j, ret;
+
+    ret = ff_remap_map_alloc(map, w, h, interp);
+    if (ret < 0)
+        return ret;
+
+    for (j = 0; j < h; j++) {
+        const int off_y = j - ycenter;
+        const int off_y2 = off_y * off_y;
+        for (i = 0; i < w; i++) {
+            const int off_x = i - xcenter;
+            const int64_t r2 = ((off_x * off_x + off_y2) * r2inv + (1LL<<31)) >> 32;
+            const int64_t r4 = (r2 * r2 + (1<<27)) >> 28;
+            const int64_t radius_mult = (r2 * k1 + r4 * k2 + (1LL<<27) + (1LL<<52))>>28;
+
+            if (interp == REMAP_NEAREST) {
+                int16_t *xy = map->xy + 2 * (j * w + i);
+                const int x = xcenter + ((radius_mult * off_x + (1<<23))>>24);
+                const int y = ycenter + ((radius_mult * off_y + (1<<23))>>24);
+                const char isvalid = x > 0 && x < w - 1 && y > 0 && y < h - 1;
+
+                xy[0] = isvalid ? x : -1;
+                xy[1] = isvalid ? y : -1;
+            } else {
+                const int shift = 24 - REMAP_FRAC_BITS;
+                const int x = xcenter * REMAP_FRAC_ONE + ((radius_mult * off_x + (1<<(shift-1)))>>shift);
+                const int y = ycenter * REMAP_FRAC_ONE + ((radius_mult * off_y + (1<<(shift-1)))>>shift);
+
+                ff_remap_map_set(map, j * w + i, x, y, w, h);
+            }
         }
     }
     return 0;
@@ -118,9 +154,8 @@ static av_cold void uninit(AVFilterContext *ctx)
     LenscorrectionCtx *rect = ctx->priv;
     int i;
 
-    for (i = 0; i < FF_ARRAY_ELEMS(rect->correction); i++) {
-        av_freep(&rect->correction[i]);
-    }
+    for (i = 0; i < FF_ARRAY_ELEMS(rect->map); i++)
+        ff_remap_map_free(&rect->map[i]);
 }
 
 static int config_props(AVFilterLink *outlink)
@@ -129,11 +164,24 @@ static int config_props(AVFilterLink *outlink)
     LenscorrectionCtx *rect = ctx->priv;
     AVFilterLink *inlink = ctx->inputs[0];
     const AVPixFmtDescriptor *pixdesc = av_pix_fmt_desc_get(inlink->format);
+    int ret;
+
+    if (inlink->w > INT16_MAX || inlink->h > INT16_MAX) {
+        av_log(ctx, AV_LOG_ERROR, "Size %dx%d is too large\n", inlink->w, inlink->h);
+        return AVERROR(EINVAL);
+    }
+
     rect->hsub = pixdesc->log2_chroma_w;
     rect->vsub = pixdesc->log2_chroma_h;
     outlink->w = rect->width = inlink->w;
     outlink->h = rect->height = inlink->h;
     rect->nb_planes = av_pix_fmt_count_planes(inlink->format);
+
+    if ((ret = build_map(rect, &rect->map[0], rect->width, rect->height)) < 0 ||
+        (ret = build_map(rect, &rect->map[1], rect->width  >> rect->hsub,
+                                              rect->height >> rect->vsub)) < 0)
+        return ret;
+
     return 0;
 }
 
@@ -141,9 +189,8 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
     AVFilterLink *outlink = ctx->outputs[0];
-    LenscorrectionCtx *rect = (LenscorrectionCtx*)ctx->priv;
     AVFrame *out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
-    int plane;
+    ThreadData td;
 
     if (!out) {
         av_frame_free(&in);
@@ -152,49 +199,10 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 
     av_frame_copy_props(out, in);
 
-    for (plane = 0; plane < rect->nb_planes; ++plane) {
-        int hsub = plane == 1 || plane == 2 ? rect->hsub : 0;
-        int vsub = plane == 1 || plane == 2 ? rect->vsub : 0;
-        int hdiv = 1 << hsub;
-        int vdiv = 1 << vsub;
-        int w = rect->width / hdiv;
-        int h = rect->height / vdiv;
-        int xcenter = rect->cx * w;
-        int ycenter = rect->cy * h;
-        int k1 = rect->k1 * (1<<24);
-        int k2 = rect->k2 * (1<<24);
-        ThreadData td = {
-            .in = in,
-            .out  = out,
-            .w  = w,
-            .h  = h,
-            .xcenter = xcenter,
-            .ycenter = ycenter,
-            .plane = plane};
-
-        if (!rect->correction[plane]) {
-            int i,j;
-            const int64_t r2inv = (4LL<<60) / (w * w + h * h);
-
-            rect->correction[plane] = av_malloc_array(w, h * sizeof(**rect->correction));
-            if (!rect->correction[plane])
-                return AVERROR(ENOMEM);
-            for (j = 0; j < h; j++) {
-                const int off_y = j - ycenter;
-                const int off_y2 = off_y * off_y;
-                for (i = 0; i < w; i++) {
-                    const int off_x = i - xcenter;
-                    const int64_t r2 = ((off_x * off_x + off_y2) * r2inv + (1LL<<31)) >> 32;
-                    const int64_t r4 = (r2 * r2 + (1<<27)) >> 28;
-                    const int radius_mult = (r2 * k1 + r4 * k2 + (1LL<<27) + (1LL<<52))>>28;
-                    rect->correction[plane][j * w + i] = radius_mult;
-                }
-            }
-        }
-
-        td.correction = rect->correction[plane];
-        ctx->internal->execute(ctx, filter_slice, &td, NULL, FFMIN(h, ff_filter_get_nb_threads(ctx)));
-    }
+    td.in  = in;
+    td.out = out;
+    ctx->internal->execute(ctx, filter_slice, &td, NULL,
+                           FFMIN(outlink->h, ff_filter_get_nb_threads(ctx)));
 
     av_frame_free(&in);
     return ff_filter_frame(outlink, out);
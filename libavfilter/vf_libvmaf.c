@@ -36,6 +36,10 @@
 #include "internal.h"
 #include "video.h"
 
+/* Number of frame pairs do_vmaf() can hand over before it waits for the
+ * libvmaf thread. */
+#define VMAF_QUEUE_SIZE 4
+
 typedef struct LIBVMAFContext {
     const AVClass *class;
     FFFrameSync fs;
@@ -47,9 +51,9 @@ typedef struct LIBVMAFContext {
     pthread_mutex_t lock;
     pthread_cond_t cond;
     int eof;
-    AVFrame *gmain;
-    AVFrame *gref;
-    int frame_set;
+    AVFrame *queue_main[VMAF_QUEUE_SIZE];
+    AVFrame *queue_ref[VMAF_QUEUE_SIZE];
+    int queue_start, queue_nb;
     char *model_path;
     char *log_path;
     char *log_fmt;
@@ -87,20 +91,33 @@ FRAMESYNC_DEFINE_CLASS(libvmaf, LIBVMAFContext, fs);
                                       float *temp_data, int stride, void *ctx)  \
 {                                                                               \
     LIBVMAFContext *s = (LIBVMAFContext *) ctx;                                 \
-    int ret;                                                                    \
+    AVFrame *gref, *gmain;                                                      \
     \
     pthread_mutex_lock(&s->lock);                                               \
     \
-    while (!s->frame_set && !s->eof) {                                          \
+    while (!s->queue_nb && !s->eof) {                                           \
         pthread_cond_wait(&s->cond, &s->lock);                                  \
     }                                                                           \
     \
-    if (s->frame_set) {                                                         \
-        int ref_stride = s->gref->linesize[0];                                  \
-        int main_stride = s->gmain->linesize[0];                                \
+    if (!s->queue_nb) {                                                         \
+        pthread_mutex_unlock(&s->lock);                                         \
+        return 2;                                                               \
+    }                                                                           \
+    \
+    gref  = s->queue_ref[s->queue_start];                                       \
+    gmain = s->queue_main[s->queue_start];                                      \
+    s->queue_start = (s->queue_start + 1) % VMAF_QUEUE_SIZE;                    \
+    s->queue_nb--;                                                              \
+    \
+    pthread_cond_signal(&s->cond);                                              \
+    pthread_mutex_unlock(&s->lock);                                             \
+    \
+    {                                                                           \
+        int ref_stride = gref->linesize[0];                                     \
+        int main_stride = gmain->linesize[0];                                   \
         \
-        const type *ref_ptr = (const type *) s->gref->data[0];                  \
-        const type *main_ptr = (const type *) s->gmain->data[0];                \
+        const type *ref_ptr = (const type *) gref->data[0];                     \
+        const type *main_ptr = (const type *) gmain->data[0];                   \
         \
         float *ptr = ref_data;                                                  \
         \
@@ -128,18 +145,8 @@ FRAMESYNC_DEFINE_CLASS(libvmaf, LIBVMAFContext, fs);
         }                                                                       \
     }                                                                           \
     \
-    ret = !s->frame_set;                                                        \
-    \
-    av_frame_unref(s->gref);                                                    \
-    av_frame_unref(s->gmain);                                                   \
-    s->frame_set = 0;                                                           \
-    \
-    pthread_cond_signal(&s->cond);                                              \
-    pthread_mutex_unlock(&s->lock);                                             \
-    \
-    if (ret) {                                                                  \
-        return 2;                                                               \
-    }                                                                           \
+    av_frame_free(&gref);                                                       \
+    av_frame_free(&gmain);                                                      \
     \
     return 0;                                                                   \
 }
@@ -187,8 +194,8 @@ static int do_vmaf(FFFrameSync *fs)
 {
     AVFilterContext *ctx = fs->parent;
     LIBVMAFContext *s = ctx->priv;
-    AVFrame *master, *ref;
-    int ret;
+    AVFrame *master, *ref, *gmain, *gref;
+    int ret, idx;
 
     ret = ff_framesync_dualinput_get(fs, &master, &ref);
     if (ret < 0)
@@ -196,9 +203,20 @@ static int do_vmaf(FFFrameSync *fs)
     if (!ref)
         return ff_filter_frame(ctx->outputs[0], master);
 
+    /* The libvmaf thread reads the frames through these references, so
+     * nothing is copied and master is passed on right away. */
+    gref  = av_frame_clone(ref);
+    gmain = av_frame_clone(master);
+    if (!gref || !gmain) {
+        av_frame_free(&gref);
+        av_frame_free(&gmain);
+        av_frame_free(&master);
+        return AVERROR(ENOMEM);
+    }
+
     pthread_mutex_lock(&s->lock);
 
-    while (s->frame_set && !s->error) {
+    while (s->queue_nb == VMAF_QUEUE_SIZE && !s->error) {
         pthread_cond_wait(&s->cond, &s->lock);
     }
 
@@ -206,13 +224,16 @@ static int do_vmaf(FFFrameSync *fs)
         av_log(ctx, AV_LOG_ERROR,
                "libvmaf encountered an error, check log for details\n");
         pthread_mutex_unlock(&s->lock);
+        av_frame_free(&gref);
+        av_frame_free(&gmain);
+        av_frame_free(&master);
         return AVERROR(EINVAL);
     }
 
-    av_frame_ref(s->gref, ref);
-    av_frame_ref(s->gmain, master);
-
-    s->frame_set = 1;
+    idx = (s->queue_start + s->queue_nb) % VMAF_QUEUE_SIZE;
+    s->queue_ref[idx]  = gref;
+    s->queue_main[idx] = gmain;
+    s->queue_nb++;
 
     pthread_cond_signal(&s->cond);
     pthread_mutex_unlock(&s->lock);
@@ -224,8 +245,6 @@ static av_cold int init(AVFilterContext *ctx)
 {
     LIBVMAFContext *s = ctx->priv;
 
-    s->gref = av_frame_alloc();
-    s->gmain = av_frame_alloc();
     s->error = 0;
 
     pthread_mutex_init(&s->lock, NULL);
@@ -309,6 +328,7 @@ static int activate(AVFilterContext *ctx)
 static av_cold void uninit(AVFilterContext *ctx)
 {
     LIBVMAFContext *s = ctx->priv;
+    int i;
 
     ff_framesync_uninit(&s->fs);
 
@@ -319,8 +339,11 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     pthread_join(s->vmaf_thread, NULL);
 
-    av_frame_free(&s->gref);
-    av_frame_free(&s->gmain);
+    for (i = 0; i < s->queue_nb; i++) {
+        int idx = (s->queue_start + i) % VMAF_QUEUE_SIZE;
+        av_frame_free(&s->queue_ref[idx]);
+        av_frame_free(&s->queue_main[idx]);
+    }
 
     pthread_mutex_destroy(&s->lock);
     pthread_cond_destroy(&s->cond);
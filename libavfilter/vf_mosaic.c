@@ -0,0 +1,389 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Compose several video streams into one frame, each input being scaled
+ * into its own tile of the output.
+ */
+
+#include "libavutil/avstring.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+
+#include "avfilter.h"
+#include "drawutils.h"
+#include "formats.h"
+#include "internal.h"
+#include "framesync.h"
+#include "video.h"
+
+typedef struct MosaicTile {
+    int x, y, w, h;
+    struct SwsContext *sws;     ///< NULL if the input is copied as is
+    AVFrame *scaled;            ///< scaled input
+} MosaicTile;
+
+typedef struct MosaicContext {
+    const AVClass *class;
+    int nb_inputs;
+    char *layout;
+    int w, h;
+    uint8_t rgba_color[4];
+    char *flags_str;
+    int shortest;
+
+    MosaicTile *tiles;
+    int covered;                ///< tiles cover the whole output
+    FFDrawContext draw;
+    FFDrawColor color;
+
+    AVFrame **frames;
+    FFFrameSync fs;
+} MosaicContext;
+
+static int query_formats(AVFilterContext *ctx)
+{
+    return ff_set_common_formats(ctx, ff_draw_supported_pixel_formats(0));
+}
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    MosaicContext *s = ctx->priv;
+    int i, ret;
+
+    s->frames = av_calloc(s->nb_inputs, sizeof(*s->frames));
+    s->tiles  = av_calloc(s->nb_inputs, sizeof(*s->tiles));
+    if (!s->frames || !s->tiles)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < s->nb_inputs; i++) {
+        AVFilterPad pad = { 0 };
+
+        pad.type = AVMEDIA_TYPE_VIDEO;
+        pad.name = av_asprintf("input%d", i);
+        if (!pad.name)
+            return AVERROR(ENOMEM);
+
+        if ((ret = ff_insert_inpad(ctx, i, &pad)) < 0) {
+            av_freep(&pad.name);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/* Scale or copy one input into its tile; each job writes to its own
+ * part of the output only. libswscale may write past the end of the
+ * lines, which would reach the next tile, so scaled inputs go through
+ * a frame of the size of their tile. */
+static int draw_tile(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MosaicContext *s = ctx->priv;
+    const MosaicTile *t = &s->tiles[jobnr];
+    const AVFrame *in = s->frames[jobnr];
+    AVFrame *out = arg;
+    int p;
+
+    if (t->sws) {
+        sws_scale(t->sws, (const uint8_t * const *)in->data, in->linesize,
+                  0, in->height, t->scaled->data, t->scaled->linesize);
+        in = t->scaled;
+    }
+
+    for (p = 0; p < s->draw.nb_planes; p++)
+        av_image_copy_plane(out->data[p] + (t->y >> s->draw.vsub[p]) * out->linesize[p] +
+                            (t->x >> s->draw.hsub[p]) * s->draw.pixelstep[p],
+                            out->linesize[p], in->data[p], in->linesize[p],
+                            AV_CEIL_RSHIFT(t->w, s->draw.hsub[p]) * s->draw.pixelstep[p],
+                            AV_CEIL_RSHIFT(t->h, s->draw.vsub[p]));
+
+    return 0;
+}
+
+static int process_frame(FFFrameSync *fs)
+{
+    AVFilterContext *ctx = fs->parent;
+    AVFilterLink *outlink = ctx->outputs[0];
+    MosaicContext *s = fs->opaque;
+    AVFrame **in = s->frames;
+    AVFrame *out;
+    int i, ret;
+
+    for (i = 0; i < s->nb_inputs; i++) {
+        if ((ret = ff_framesync_get_frame(&s->fs, i, &in[i], 0)) < 0)
+            return ret;
+        if (in[i]->width  != ctx->inputs[i]->w ||
+            in[i]->height != ctx->inputs[i]->h) {
+            av_log(ctx, AV_LOG_ERROR, "Input %d changed size from %dx%d to %dx%d, "
+                   "which is not supported.\n", i, ctx->inputs[i]->w,
+                   ctx->inputs[i]->h, in[i]->width, in[i]->height);
+            return AVERROR(EINVAL);
+        }
+    }
+
+    out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+    if (!out)
+        return AVERROR(ENOMEM);
+    out->pts = av_rescale_q(s->fs.pts, s->fs.time_base, outlink->time_base);
+    out->sample_aspect_ratio = outlink->sample_aspect_ratio;
+
+    if (!s->covered)
+        ff_fill_rectangle(&s->draw, &s->color, out->data, out->linesize,
+                          0, 0, outlink->w, outlink->h);
+
+    ctx->internal->execute(ctx, draw_tile, out, NULL, s->nb_inputs);
+
+    return ff_filter_frame(outlink, out);
+}
+
+static int parse_layout(AVFilterContext *ctx)
+{
+    MosaicContext *s = ctx->priv;
+    char *layout, *p, *saveptr = NULL;
+    int i, ret = 0;
+
+    if (!s->layout) {
+        /* a grid of tiles of the size of the first input, or of the size
+         * which fills the output */
+        int cols = ceil(sqrt(s->nb_inputs));
+        int rows = (s->nb_inputs + cols - 1) / cols;
+        int w = s->w ? s->w / cols : ctx->inputs[0]->w;
+        int h = s->h ? s->h / rows : ctx->inputs[0]->h;
+
+        for (i = 0; i < s->nb_inputs; i++) {
+            s->tiles[i].x = i % cols * w;
+            s->tiles[i].y = i / cols * h;
+            s->tiles[i].w = w;
+            s->tiles[i].h = h;
+        }
+        return 0;
+    }
+
+    layout = av_strdup(s->layout);
+    if (!layout)
+        return AVERROR(ENOMEM);
+
+    p = layout;
+    for (i = 0; i < s->nb_inputs; i++) {
+        MosaicTile *t = &s->tiles[i];
+        char *arg = av_strtok(p, "|", &saveptr);
+        int n;
+
+        p = NULL;
+        if (!arg) {
+            av_log(ctx, AV_LOG_ERROR, "No tile given for input %d.\n", i);
+            ret = AVERROR(EINVAL);
+            break;
+        }
+
+        n = sscanf(arg, "%d_%d_%dx%d", &t->x, &t->y, &t->w, &t->h);
+        if (n == 2) {
+            t->w = ctx->inputs[i]->w;
+            t->h = ctx->inputs[i]->h;
+        } else if (n != 4 || t->x < 0 || t->y < 0 || t->w <= 0 || t->h <= 0) {
+            av_log(ctx, AV_LOG_ERROR, "Invalid tile '%s' for input %d.\n", arg, i);
+            ret = AVERROR(EINVAL);
+            break;
+        }
+    }
+
+    av_free(layout);
+    return ret;
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    MosaicContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    int64_t area = 0;
+    FFFrameSyncIn *in;
+    int i, j, ret;
+
+    if ((ret = ff_draw_init(&s->draw, outlink->format, 0)) < 0)
+        return ret;
+    ff_draw_color(&s->draw, &s->color, s->rgba_color);
+
+    if ((ret = parse_layout(ctx)) < 0)
+        return ret;
+
+    outlink->w = s->w;
+    outlink->h = s->h;
+    for (i = 0; i < s->nb_inputs; i++) {
+        MosaicTile *t = &s->tiles[i];
+
+        t->x = ff_draw_round_to_sub(&s->draw, 0, -1, t->x);
+        t->y = ff_draw_round_to_sub(&s->draw, 1, -1, t->y);
+        t->w = ff_draw_round_to_sub(&s->draw, 0, -1, t->w);
+        t->h = ff_draw_round_to_sub(&s->draw, 1, -1, t->h);
+        if (t->w <= 0 || t->h <= 0) {
+            av_log(ctx, AV_LOG_ERROR, "Tile of input %d is too small.\n", i);
+            return AVERROR(EINVAL);
+        }
+        if (!s->w)
+            outlink->w = FFMAX(outlink->w, t->x + t->w);
+        if (!s->h)
+            outlink->h = FFMAX(outlink->h, t->y + t->h);
+    }
+
+    for (i = 0; i < s->nb_inputs; i++) {
+        const MosaicTile *t = &s->tiles[i];
+
+        if (t->x + t->w > outlink->w || t->y + t->h > outlink->h) {
+            av_log(ctx, AV_LOG_ERROR, "Tile %dx%d at %d,%d of input %d does not "
+                   "fit in the %dx%d output.\n", t->w, t->h, t->x, t->y, i,
+                   outlink->w, outlink->h);
+            return AVERROR(EINVAL);
+        }
+        /* tiles are drawn concurrently */
+        for (j = 0; j < i; j++) {
+            const MosaicTile *u = &s->tiles[j];
+            if (t->x < u->x + u->w && u->x < t->x + t->w &&
+                t->y < u->y + u->h && u->y < t->y + t->h) {
+                av_log(ctx, AV_LOG_ERROR, "Tiles of inputs %d and %d overlap.\n", j, i);
+                return AVERROR(EINVAL);
+            }
+        }
+        area += (int64_t)t->w * t->h;
+    }
+    s->covered = area == (int64_t)outlink->w * outlink->h;
+
+    for (i = 0; i < s->nb_inputs; i++) {
+        AVFilterLink *link = ctx->inputs[i];
+        MosaicTile *t = &s->tiles[i];
+
+        sws_freeContext(t->sws);
+        t->sws = NULL;
+        av_frame_free(&t->scaled);
+        if (link->w == t->w && link->h == t->h)
+            continue;
+
+        t->scaled = av_frame_alloc();
+        if (!t->scaled)
+            return AVERROR(ENOMEM);
+        t->scaled->format = outlink->format;
+        t->scaled->width  = t->w;
+        t->scaled->height = t->h;
+        if ((ret = av_frame_get_buffer(t->scaled, 32)) < 0)
+            return ret;
+
+        t->sws = sws_alloc_context();
+        if (!t->sws)
+            return AVERROR(ENOMEM);
+        av_opt_set_int(t->sws, "srcw",       link->w,      0);
+        av_opt_set_int(t->sws, "srch",       link->h,      0);
+        av_opt_set_int(t->sws, "src_format", link->format, 0);
+        av_opt_set_int(t->sws, "dstw",       t->w,         0);
+        av_opt_set_int(t->sws, "dsth",       t->h,         0);
+        av_opt_set_int(t->sws, "dst_format", outlink->format, 0);
+        if ((ret = av_opt_set(t->sws, "sws_flags", s->flags_str, 0)) < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Invalid scaling flags '%s'.\n", s->flags_str);
+            return ret;
+        }
+        if ((ret = sws_init_context(t->sws, NULL, NULL)) < 0)
+            return ret;
+    }
+
+    outlink->time_base  = inlink->time_base;
+    outlink->frame_rate = inlink->frame_rate;
+    outlink->sample_aspect_ratio = inlink->sample_aspect_ratio;
+
+    if ((ret = ff_framesync_init(&s->fs, ctx, s->nb_inputs)) < 0)
+        return ret;
+
+    in = s->fs.in;
+    s->fs.opaque = s;
+    s->fs.on_event = process_frame;
+
+    for (i = 0; i < s->nb_inputs; i++) {
+        AVFilterLink *link = ctx->inputs[i];
+
+        in[i].time_base = link->time_base;
+        in[i].sync   = 1;
+        in[i].before = EXT_STOP;
+        in[i].after  = s->shortest ? EXT_STOP : EXT_INFINITY;
+    }
+
+    return ff_framesync_configure(&s->fs);
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    MosaicContext *s = ctx->priv;
+    int i;
+
+    ff_framesync_uninit(&s->fs);
+    av_freep(&s->frames);
+
+    if (s->tiles)
+        for (i = 0; i < s->nb_inputs; i++) {
+            sws_freeContext(s->tiles[i].sws);
+            av_frame_free(&s->tiles[i].scaled);
+        }
+    av_freep(&s->tiles);
+
+    for (i = 0; i < ctx->nb_inputs; i++)
+        av_freep(&ctx->input_pads[i].name);
+}
+
+static int activate(AVFilterContext *ctx)
+{
+    MosaicContext *s = ctx->priv;
+    return ff_framesync_activate(&s->fs);
+}
+
+#define OFFSET(x) offsetof(MosaicContext, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_FILTERING_PARAM
+static const AVOption mosaic_options[] = {
+    { "inputs", "set number of inputs", OFFSET(nb_inputs), AV_OPT_TYPE_INT, {.i64=2}, 1, INT_MAX, .flags = FLAGS },
+    { "layout", "set the tile of each input, as x_y[_wxh] separated by |", OFFSET(layout), AV_OPT_TYPE_STRING, {.str=NULL}, 0, 0, .flags = FLAGS },
+    { "size",   "set the output size", OFFSET(w), AV_OPT_TYPE_IMAGE_SIZE, {.str=NULL}, 0, 0, .flags = FLAGS },
+    { "s",      "set the output size", OFFSET(w), AV_OPT_TYPE_IMAGE_SIZE, {.str=NULL}, 0, 0, .flags = FLAGS },
+    { "fill",   "set the color of the area not covered by tiles", OFFSET(rgba_color), AV_OPT_TYPE_COLOR, {.str="black"}, 0, 0, .flags = FLAGS },
+    { "flags",  "set the scaling flags", OFFSET(flags_str), AV_OPT_TYPE_STRING, {.str="bilinear"}, 0, 0, .flags = FLAGS },
+    { "shortest", "force termination when the shortest input terminates", OFFSET(shortest), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, .flags = FLAGS },
+    { NULL },
+};
+
+AVFILTER_DEFINE_CLASS(mosaic);
+
+static const AVFilterPad outputs[] = {
+    {
+        .name          = "default",
+        .type          = AVMEDIA_TYPE_VIDEO,
+        .config_props  = config_output,
+    },
+    { NULL }
+};
+
+AVFilter ff_vf_mosaic = {
+    .name          = "mosaic",
+    .description   = NULL_IF_CONFIG_SMALL("Compose video inputs into tiles of one output."),
+    .priv_size     = sizeof(MosaicContext),
+    .priv_class    = &mosaic_class,
+    .query_formats = query_formats,
+    .outputs       = outputs,
+    .init          = init,
+    .uninit        = uninit,
+    .activate      = activate,
+    .flags         = AVFILTER_FLAG_DYNAMIC_INPUTS | AVFILTER_FLAG_SLICE_THREADS,
+};
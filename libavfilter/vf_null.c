@@ -28,8 +28,9 @@
 
 static const AVFilterPad avfilter_vf_null_inputs[] = {
     {
-        .name = "default",
-        .type = AVMEDIA_TYPE_VIDEO,
+        .name            = "default",
+        .type            = AVMEDIA_TYPE_VIDEO,
+        .forwards_frames = 1,
     },
     { NULL }
 };
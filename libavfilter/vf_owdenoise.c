@@ -43,6 +43,7 @@ typedef struct OWDenoiseContext {
     int linesize;
     int hsub, vsub;
     int pixel_depth;
+    int nb_threads;
 } OWDenoiseContext;
 
 #define OFFSET(x) offsetof(OWDenoiseContext, x)
@@ -139,10 +140,10 @@ static inline void compose(float *dst, const float *src_l, const float *src_h,
 
 static inline void decompose2D(float *dst_l, float *dst_h, const float *src,
                                int xlinesize, int ylinesize,
-                               int step, int w, int h)
+                               int step, int w, int start, int end)
 {
     int y, x;
-    for (y = 0; y < h; y++)
+    for (y = start; y < end; y++)
         for (x = 0; x < step; x++)
             decompose(dst_l + ylinesize*y + xlinesize*x,
                       dst_h + ylinesize*y + xlinesize*x,
@@ -152,10 +153,10 @@ static inline void decompose2D(float *dst_l, float *dst_h, const float *src,
 
 static inline void compose2D(float *dst, const float *src_l, const float *src_h,
                              int xlinesize, int ylinesize,
-                             int step, int w, int h)
+                             int step, int w, int start, int end)
 {
     int y, x;
-    for (y = 0; y < h; y++)
+    for (y = start; y < end; y++)
         for (x = 0; x < step; x++)
             compose(dst   + ylinesize*y + xlinesize*x,
                     src_l + ylinesize*y + xlinesize*x,
@@ -163,78 +164,66 @@ static inline void compose2D(float *dst, const float *src_l, const float *src_h,
                     step * xlinesize, (w - x + step - 1) / step);
 }
 
-static void decompose2D2(float *dst[4], float *src, float *temp[2],
-                         int linesize, int step, int w, int h)
-{
-    decompose2D(temp[0], temp[1], src,     1, linesize, step, w, h);
-    decompose2D( dst[0],  dst[1], temp[0], linesize, 1, step, h, w);
-    decompose2D( dst[2],  dst[3], temp[1], linesize, 1, step, h, w);
-}
-
-static void compose2D2(float *dst, float *src[4], float *temp[2],
-                       int linesize, int step, int w, int h)
-{
-    compose2D(temp[0],  src[0],  src[1], linesize, 1, step, h, w);
-    compose2D(temp[1],  src[2],  src[3], linesize, 1, step, h, w);
-    compose2D(dst,     temp[0], temp[1], 1, linesize, step, w, h);
-}
-
-static void filter(OWDenoiseContext *s,
-                   uint8_t       *dst, int dst_linesize,
-                   const uint8_t *src, int src_linesize,
-                   int width, int height, double strength)
+/**
+ * Each level of the transform is run as a pass on the rows, then as a pass on
+ * the columns, the jobs of a pass taking a band of rows or a strip of columns.
+ */
+typedef struct ThreadData {
+    uint8_t       *dst;
+    int            dst_linesize;
+    const uint8_t *src;
+    int            src_linesize;
+    int width, height;
+    int level;
+    double strength;
+} ThreadData;
+
+#define ROW_SLICE(td, jobnr, nb_jobs)                                         \
+    const int start = ((td)->height *  (jobnr)   ) / (nb_jobs);               \
+    const int end   = ((td)->height * ((jobnr)+1)) / (nb_jobs)
+
+// strips of 16 samples, to keep the jobs off each other's cache lines
+#define COLUMN_SLICE(td, jobnr, nb_jobs)                                      \
+    const int nb_strips = ((td)->width + 15) >> 4;                            \
+    const int start = FFMIN((td)->width, ((nb_strips *  (jobnr)   ) / (nb_jobs)) << 4); \
+    const int end   = FFMIN((td)->width, ((nb_strips * ((jobnr)+1)) / (nb_jobs)) << 4)
+
+static void import_rows(OWDenoiseContext *s, const ThreadData *td, int start, int end)
 {
-    int x, y, i, j, depth = s->depth;
-
-    while (1<<depth > width || 1<<depth > height)
-        depth--;
+    int x, y;
 
     if (s->pixel_depth <= 8) {
-        for (y = 0; y < height; y++)
-            for(x = 0; x < width; x++)
-                s->plane[0][0][y*s->linesize + x] = src[y*src_linesize + x];
+        for (y = start; y < end; y++)
+            for(x = 0; x < td->width; x++)
+                s->plane[0][0][y*s->linesize + x] = td->src[y*td->src_linesize + x];
     } else {
-        const uint16_t *src16 = (const uint16_t *)src;
+        const uint16_t *src16 = (const uint16_t *)td->src;
+        const int src_linesize = td->src_linesize / 2;
 
-        src_linesize /= 2;
-        for (y = 0; y < height; y++)
-            for(x = 0; x < width; x++)
+        for (y = start; y < end; y++)
+            for(x = 0; x < td->width; x++)
                 s->plane[0][0][y*s->linesize + x] = src16[y*src_linesize + x];
     }
+}
 
-    for (i = 0; i < depth; i++)
-        decompose2D2(s->plane[i + 1], s->plane[i][0], s->plane[0] + 1, s->linesize, 1<<i, width, height);
-
-    for (i = 0; i < depth; i++) {
-        for (j = 1; j < 4; j++) {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++) {
-                    double v = s->plane[i + 1][j][y*s->linesize + x];
-                    if      (v >  strength) v -= strength;
-                    else if (v < -strength) v += strength;
-                    else                    v  = 0;
-                    s->plane[i + 1][j][x + y*s->linesize] = v;
-                }
-            }
-        }
-    }
-    for (i = depth-1; i >= 0; i--)
-        compose2D2(s->plane[i][0], s->plane[i + 1], s->plane[0] + 1, s->linesize, 1<<i, width, height);
+static void export_rows(OWDenoiseContext *s, const ThreadData *td, int start, int end)
+{
+    int x, y, i;
 
     if (s->pixel_depth <= 8) {
-        for (y = 0; y < height; y++) {
-            for (x = 0; x < width; x++) {
+        for (y = start; y < end; y++) {
+            for (x = 0; x < td->width; x++) {
                 i = s->plane[0][0][y*s->linesize + x] + dither[x&7][y&7]*(1.0/64) + 1.0/128; // yes the rounding is insane but optimal :)
                 if ((unsigned)i > 255U) i = ~(i >> 31);
-                dst[y*dst_linesize + x] = i;
+                td->dst[y*td->dst_linesize + x] = i;
             }
         }
     } else {
-        uint16_t *dst16 = (uint16_t *)dst;
+        uint16_t *dst16 = (uint16_t *)td->dst;
+        const int dst_linesize = td->dst_linesize / 2;
 
-        dst_linesize /= 2;
-        for (y = 0; y < height; y++) {
-            for (x = 0; x < width; x++) {
+        for (y = start; y < end; y++) {
+            for (x = 0; x < td->width; x++) {
                 i = s->plane[0][0][y*s->linesize + x];
                 dst16[y*dst_linesize + x] = i;
             }
@@ -242,6 +231,115 @@ static void filter(OWDenoiseContext *s,
     }
 }
 
+static int decompose_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    OWDenoiseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    float **temp = s->plane[0] + 1;
+    ROW_SLICE(td, jobnr, nb_jobs);
+
+    if (!td->level)
+        import_rows(s, td, start, end);
+    decompose2D(temp[0], temp[1], s->plane[td->level][0], 1, s->linesize,
+                1 << td->level, td->width, start, end);
+    return 0;
+}
+
+static int decompose_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    OWDenoiseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    float **temp = s->plane[0] + 1;
+    float **dst  = s->plane[td->level + 1];
+    int x, y, j;
+    COLUMN_SLICE(td, jobnr, nb_jobs);
+
+    decompose2D(dst[0], dst[1], temp[0], s->linesize, 1,
+                1 << td->level, td->height, start, end);
+    decompose2D(dst[2], dst[3], temp[1], s->linesize, 1,
+                1 << td->level, td->height, start, end);
+
+    // the high bands are not decomposed further and can be thresholded now
+    for (j = 1; j < 4; j++) {
+        for (y = 0; y < td->height; y++) {
+            for (x = start; x < end; x++) {
+                double v = dst[j][y*s->linesize + x];
+                if      (v >  td->strength) v -= td->strength;
+                else if (v < -td->strength) v += td->strength;
+                else                        v  = 0;
+                dst[j][x + y*s->linesize] = v;
+            }
+        }
+    }
+    return 0;
+}
+
+static int compose_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    OWDenoiseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    float **temp = s->plane[0] + 1;
+    float **src  = s->plane[td->level + 1];
+    COLUMN_SLICE(td, jobnr, nb_jobs);
+
+    compose2D(temp[0], src[0], src[1], s->linesize, 1,
+              1 << td->level, td->height, start, end);
+    compose2D(temp[1], src[2], src[3], s->linesize, 1,
+              1 << td->level, td->height, start, end);
+    return 0;
+}
+
+static int compose_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    OWDenoiseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    float **temp = s->plane[0] + 1;
+    ROW_SLICE(td, jobnr, nb_jobs);
+
+    compose2D(s->plane[td->level][0], temp[0], temp[1], 1, s->linesize,
+              1 << td->level, td->width, start, end);
+    if (!td->level)
+        export_rows(s, td, start, end);
+    return 0;
+}
+
+static void filter(AVFilterContext *ctx,
+                   uint8_t       *dst, int dst_linesize,
+                   const uint8_t *src, int src_linesize,
+                   int width, int height, double strength)
+{
+    OWDenoiseContext *s = ctx->priv;
+    const int nb_row_jobs    = FFMIN(height, s->nb_threads);
+    const int nb_column_jobs = FFMIN((width + 15) >> 4, s->nb_threads);
+    ThreadData td = {
+        .dst = dst, .dst_linesize = dst_linesize,
+        .src = src, .src_linesize = src_linesize,
+        .width = width, .height = height,
+        .strength = strength,
+    };
+    int depth = s->depth;
+
+    while (1<<depth > width || 1<<depth > height)
+        depth--;
+
+    // a 1 pixel wide or high plane is left as is
+    if (!depth) {
+        if (dst != src)
+            av_image_copy_plane(dst, dst_linesize, src, src_linesize,
+                                width * ((s->pixel_depth + 7) >> 3), height);
+        return;
+    }
+
+    for (td.level = 0; td.level < depth; td.level++) {
+        ctx->internal->execute(ctx, decompose_rows,    &td, NULL, nb_row_jobs);
+        ctx->internal->execute(ctx, decompose_columns, &td, NULL, nb_column_jobs);
+    }
+    for (td.level = depth - 1; td.level >= 0; td.level--) {
+        ctx->internal->execute(ctx, compose_columns, &td, NULL, nb_column_jobs);
+        ctx->internal->execute(ctx, compose_rows,    &td, NULL, nb_row_jobs);
+    }
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -255,10 +353,10 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         out = in;
 
         if (s->luma_strength > 0)
-            filter(s, out->data[0], out->linesize[0], in->data[0], in->linesize[0], inlink->w, inlink->h, s->luma_strength);
+            filter(ctx, out->data[0], out->linesize[0], in->data[0], in->linesize[0], inlink->w, inlink->h, s->luma_strength);
         if (s->chroma_strength > 0) {
-            filter(s, out->data[1], out->linesize[1], in->data[1], in->linesize[1], cw,        ch,        s->chroma_strength);
-            filter(s, out->data[2], out->linesize[2], in->data[2], in->linesize[2], cw,        ch,        s->chroma_strength);
+            filter(ctx, out->data[1], out->linesize[1], in->data[1], in->linesize[1], cw,        ch,        s->chroma_strength);
+            filter(ctx, out->data[2], out->linesize[2], in->data[2], in->linesize[2], cw,        ch,        s->chroma_strength);
         }
     } else {
         out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
@@ -269,13 +367,13 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         av_frame_copy_props(out, in);
 
         if (s->luma_strength > 0) {
-            filter(s, out->data[0], out->linesize[0], in->data[0], in->linesize[0], inlink->w, inlink->h, s->luma_strength);
+            filter(ctx, out->data[0], out->linesize[0], in->data[0], in->linesize[0], inlink->w, inlink->h, s->luma_strength);
         } else {
             av_image_copy_plane(out->data[0], out->linesize[0], in ->data[0], in ->linesize[0], inlink->w, inlink->h);
         }
         if (s->chroma_strength > 0) {
-            filter(s, out->data[1], out->linesize[1], in->data[1], in->linesize[1], cw, ch, s->chroma_strength);
-            filter(s, out->data[2], out->linesize[2], in->data[2], in->linesize[2], cw, ch, s->chroma_strength);
+            filter(ctx, out->data[1], out->linesize[1], in->data[1], in->linesize[1], cw, ch, s->chroma_strength);
+            filter(ctx, out->data[2], out->linesize[2], in->data[2], in->linesize[2], cw, ch, s->chroma_strength);
         } else {
             av_image_copy_plane(out->data[1], out->linesize[1], in ->data[1], in ->linesize[1], inlink->w, inlink->h);
             av_image_copy_plane(out->data[2], out->linesize[2], in ->data[2], in ->linesize[2], inlink->w, inlink->h);
@@ -324,6 +422,7 @@ static int config_input(AVFilterLink *inlink)
     s->hsub = desc->log2_chroma_w;
     s->vsub = desc->log2_chroma_h;
     s->pixel_depth = desc->comp[0].depth;
+    s->nb_threads = ff_filter_get_nb_threads(inlink->dst);
 
     s->linesize = FFALIGN(inlink->w, 16);
     for (j = 0; j < 4; j++) {
@@ -373,5 +472,5 @@ AVFilter ff_vf_owdenoise = {
     .inputs        = owdenoise_inputs,
     .outputs       = owdenoise_outputs,
     .priv_class    = &owdenoise_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
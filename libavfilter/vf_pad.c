@@ -207,6 +207,11 @@ static int config_input(AVFilterLink *inlink)
         return AVERROR(EINVAL);
     }
 
+    /* let the frames reaching us be padded in place when they are
+     * allocated upstream, copying them is the fallback */
+    ff_video_link_request_border(inlink, s->x, s->y,
+                                 s->w - s->x - s->in_w, s->h - s->y - s->in_h);
+
     return 0;
 
 eval_fail:
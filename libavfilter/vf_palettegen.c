@@ -76,6 +76,10 @@ typedef struct PaletteGenContext {
     int nb_boxes;                           // number of boxes (increase will segmenting them)
     int palette_pushed;                     // if the palette frame is pushed into the outlink or not
     uint8_t transparency_color[4];          // background color for transparency
+
+    int nb_threads;
+    struct hist_node (*job_histograms)[HIST_SIZE]; // histogram of a band of the frame, one per job
+    int *job_ret;
 } PaletteGenContext;
 
 #define OFFSET(x) offsetof(PaletteGenContext, x)
@@ -403,9 +407,10 @@ static inline unsigned color_hash(uint32_t color)
 }
 
 /**
- * Locate the color in the hash table and increment its counter.
+ * Locate the color in the hash table and add count to its counter.
+ * Returns 1 if the color was not in the table yet.
  */
-static int color_inc(struct hist_node *hist, uint32_t color)
+static inline int color_add(struct hist_node *hist, uint32_t color, uint64_t count)
 {
     int i;
     const unsigned hash = color_hash(color);
@@ -415,7 +420,7 @@ static int color_inc(struct hist_node *hist, uint32_t color)
     for (i = 0; i < node->nb_entries; i++) {
         e = &node->entries[i];
         if (e->color == color) {
-            e->count++;
+            e->count += count;
             return 0;
         }
     }
@@ -425,7 +430,7 @@ static int color_inc(struct hist_node *hist, uint32_t color)
     if (!e)
         return AVERROR(ENOMEM);
     e->color = color;
-    e->count = 1;
+    e->count = count;
     return 1;
 }
 
@@ -433,18 +438,19 @@ static int color_inc(struct hist_node *hist, uint32_t color)
  * Update histogram when pixels differ from previous frame.
  */
 static int update_histogram_diff(struct hist_node *hist,
-                                 const AVFrame *f1, const AVFrame *f2)
+                                 const AVFrame *f1, const AVFrame *f2,
+                                 int y_start, int y_end)
 {
     int x, y, ret, nb_diff_colors = 0;
 
-    for (y = 0; y < f1->height; y++) {
+    for (y = y_start; y < y_end; y++) {
         const uint32_t *p = (const uint32_t *)(f1->data[0] + y*f1->linesize[0]);
         const uint32_t *q = (const uint32_t *)(f2->data[0] + y*f2->linesize[0]);
 
         for (x = 0; x < f1->width; x++) {
             if (p[x] == q[x])
                 continue;
-            ret = color_inc(hist, p[x]);
+            ret = color_add(hist, p[x], 1);
             if (ret < 0)
                 return ret;
             nb_diff_colors += ret;
@@ -456,15 +462,16 @@ static int update_histogram_diff(struct hist_node *hist,
 /**
  * Simple histogram of the frame.
  */
-static int update_histogram_frame(struct hist_node *hist, const AVFrame *f)
+static int update_histogram_frame(struct hist_node *hist, const AVFrame *f,
+                                  int y_start, int y_end)
 {
     int x, y, ret, nb_diff_colors = 0;
 
-    for (y = 0; y < f->height; y++) {
+    for (y = y_start; y < y_end; y++) {
         const uint32_t *p = (const uint32_t *)(f->data[0] + y*f->linesize[0]);
 
         for (x = 0; x < f->width; x++) {
-            ret = color_inc(hist, p[x]);
+            ret = color_add(hist, p[x], 1);
             if (ret < 0)
                 return ret;
             nb_diff_colors += ret;
@@ -473,6 +480,83 @@ static int update_histogram_frame(struct hist_node *hist, const AVFrame *f)
     return nb_diff_colors;
 }
 
+typedef struct ThreadData {
+    const AVFrame *in, *prev;
+    int nb_hists;
+} ThreadData;
+
+static int update_histogram_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    struct hist_node *hist = s->job_histograms[jobnr];
+    const int slice_start = (td->in->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->in->height * (jobnr+1)) / nb_jobs;
+    int i, ret;
+
+    for (i = 0; i < HIST_SIZE; i++)
+        hist[i].nb_entries = 0;
+    ret = td->prev ? update_histogram_diff(hist, td->prev, td->in, slice_start, slice_end)
+                   : update_histogram_frame(hist, td->in, slice_start, slice_end);
+    return FFMIN(ret, 0);
+}
+
+/**
+ * Add the band histograms to the main one, each job handling a range of
+ * hash buckets. The bands are merged in order so the colors end up in the
+ * buckets in the same order as when the frame is scanned on one thread.
+ * Returns the number of new colors in the range.
+ */
+static int merge_histograms(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int start = (HIST_SIZE *  jobnr   ) / nb_jobs;
+    const int end   = (HIST_SIZE * (jobnr+1)) / nb_jobs;
+    int h, i, j, ret, nb_diff_colors = 0;
+
+    for (h = start; h < end; h++) {
+        for (j = 0; j < td->nb_hists; j++) {
+            const struct hist_node *node = &s->job_histograms[j][h];
+
+            for (i = 0; i < node->nb_entries; i++) {
+                ret = color_add(s->histogram, node->entries[i].color,
+                                node->entries[i].count);
+                if (ret < 0)
+                    return ret;
+                nb_diff_colors += ret;
+            }
+        }
+    }
+    return nb_diff_colors;
+}
+
+static int update_histogram(AVFilterContext *ctx, const AVFrame *in)
+{
+    PaletteGenContext *s = ctx->priv;
+    ThreadData td = { .in = in, .prev = s->prev_frame };
+    const int nb_jobs = FFMIN(in->height, s->nb_threads);
+    int i, nb_diff_colors = 0;
+
+    if (nb_jobs <= 1)
+        return s->prev_frame ? update_histogram_diff(s->histogram, s->prev_frame, in, 0, in->height)
+                             : update_histogram_frame(s->histogram, in, 0, in->height);
+
+    ctx->internal->execute(ctx, update_histogram_slice, &td, s->job_ret, nb_jobs);
+    for (i = 0; i < nb_jobs; i++)
+        if (s->job_ret[i] < 0)
+            return s->job_ret[i];
+
+    td.nb_hists = nb_jobs;
+    ctx->internal->execute(ctx, merge_histograms, &td, s->job_ret, s->nb_threads);
+    for (i = 0; i < s->nb_threads; i++) {
+        if (s->job_ret[i] < 0)
+            return s->job_ret[i];
+        nb_diff_colors += s->job_ret[i];
+    }
+    return nb_diff_colors;
+}
+
 /**
  * Update the histogram for each passing frame. No frame will be pushed here.
  */
@@ -480,8 +564,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx = inlink->dst;
     PaletteGenContext *s = ctx->priv;
-    int ret = s->prev_frame ? update_histogram_diff(s->histogram, s->prev_frame, in)
-                            : update_histogram_frame(s->histogram, in);
+    int ret = update_histogram(ctx, in);
 
     if (ret > 0)
         s->nb_refs += ret;
@@ -535,18 +618,36 @@ static int request_frame(AVFilterLink *outlink)
  */
 static int config_output(AVFilterLink *outlink)
 {
+    AVFilterContext *ctx = outlink->src;
+    PaletteGenContext *s = ctx->priv;
+
     outlink->w = outlink->h = 16;
     outlink->sample_aspect_ratio = av_make_q(1, 1);
+
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    if (s->nb_threads > 1) {
+        s->job_histograms = av_calloc(s->nb_threads, sizeof(*s->job_histograms));
+        s->job_ret        = av_calloc(s->nb_threads, sizeof(*s->job_ret));
+        if (!s->job_histograms || !s->job_ret)
+            return AVERROR(ENOMEM);
+    }
     return 0;
 }
 
 static av_cold void uninit(AVFilterContext *ctx)
 {
-    int i;
+    int i, j;
     PaletteGenContext *s = ctx->priv;
 
     for (i = 0; i < HIST_SIZE; i++)
         av_freep(&s->histogram[i].entries);
+    if (s->job_histograms) {
+        for (j = 0; j < s->nb_threads; j++)
+            for (i = 0; i < HIST_SIZE; i++)
+                av_freep(&s->job_histograms[j][i].entries);
+        av_freep(&s->job_histograms);
+    }
+    av_freep(&s->job_ret);
     av_freep(&s->refs);
     av_frame_free(&s->prev_frame);
 }
@@ -579,4 +680,5 @@ AVFilter ff_vf_palettegen = {
     .inputs        = palettegen_inputs,
     .outputs       = palettegen_outputs,
     .priv_class    = &palettegen_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -77,13 +77,14 @@ struct cache_node {
 
 struct PaletteUseContext;
 
-typedef int (*set_frame_func)(struct PaletteUseContext *s, AVFrame *out, AVFrame *in,
+typedef int (*set_frame_func)(struct PaletteUseContext *s, struct cache_node *cache,
+                              AVFrame *out, AVFrame *in,
                               int x_start, int y_start, int width, int height);
 
 typedef struct PaletteUseContext {
     const AVClass *class;
     FFFrameSync fs;
-    struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+    struct cache_node (*cache)[CACHE_SIZE]; /* lookup cache, one per job */
     struct color_node map[AVPALETTE_COUNT]; /* 3D-Tree (KD-Tree with K=3) for reverse colormap */
     uint32_t palette[AVPALETTE_COUNT];
     int transparency_index; /* index in the palette of transparency. -1 if there is no transparency in the palette. */
@@ -98,6 +99,14 @@ typedef struct PaletteUseContext {
     AVFrame *last_in;
     AVFrame *last_out;
 
+    int nb_threads;
+    int slice_threads;      /* split frames in bands, for DITHERING_NONE */
+    int frame_threads;      /* process several frames at once */
+    AVFrame **queue_in;     /* frames waiting for frame threads */
+    AVFrame **queue_out;
+    int nb_queued;
+    int *job_ret;
+
     /* debug options */
     char *dot_filename;
     int color_search_method;
@@ -338,7 +347,8 @@ end:
  * Note: a, r, g, and b are the components of color, but are passed as well to avoid
  * recomputing them (they are generally computed by the caller for other uses).
  */
-static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
+static av_always_inline int color_get(PaletteUseContext *s, struct cache_node *cache,
+                                      uint32_t color,
                                       uint8_t a, uint8_t r, uint8_t g, uint8_t b,
                                       const enum color_search_method search_method)
 {
@@ -348,7 +358,7 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     const uint8_t ghash = g & ((1<<NBITS)-1);
     const uint8_t bhash = b & ((1<<NBITS)-1);
     const unsigned hash = rhash<<(NBITS*2) | ghash<<NBITS | bhash;
-    struct cache_node *node = &s->cache[hash];
+    struct cache_node *node = &cache[hash];
     struct cached_color *e;
 
     // first, check for transparency
@@ -372,7 +382,7 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color,
     return e->pal_entry;
 }
 
-static av_always_inline int get_dst_color_err(PaletteUseContext *s,
+static av_always_inline int get_dst_color_err(PaletteUseContext *s, struct cache_node *cache,
                                               uint32_t c, int *er, int *eg, int *eb,
                                               const enum color_search_method search_method)
 {
@@ -381,7 +391,7 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     const uint8_t g = c >>  8 & 0xff;
     const uint8_t b = c       & 0xff;
     uint32_t dstc;
-    const int dstx = color_get(s, c, a, r, g, b, search_method);
+    const int dstx = color_get(s, cache, c, a, r, g, b, search_method);
     if (dstx < 0)
         return dstx;
     dstc = s->palette[dstx];
@@ -391,7 +401,8 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     return dstx;
 }
 
-static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFrame *in,
+static av_always_inline int set_frame(PaletteUseContext *s, struct cache_node *cache,
+                                      AVFrame *out, AVFrame *in,
                                       int x_start, int y_start, int w, int h,
                                       enum dithering_mode dither,
                                       const enum color_search_method search_method)
@@ -418,7 +429,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = av_clip_uint8(r8 + d);
                 const uint8_t g = av_clip_uint8(g8 + d);
                 const uint8_t b = av_clip_uint8(b8 + d);
-                const int color = color_get(s, src[x], a8, r, g, b, search_method);
+                const int color = color_get(s, cache, src[x], a8, r, g, b, search_method);
 
                 if (color < 0)
                     return color;
@@ -426,7 +437,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_HECKBERT) {
                 const int right = x < w - 1, down = y < h - 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -438,7 +449,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_FLOYD_STEINBERG) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -452,7 +463,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_SIERRA2) {
                 const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
                 const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -471,7 +482,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_SIERRA2_4A) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb, search_method);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb, search_method);
 
                 if (color < 0)
                     return color;
@@ -486,7 +497,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t r = src[x] >> 16 & 0xff;
                 const uint8_t g = src[x] >>  8 & 0xff;
                 const uint8_t b = src[x]       & 0xff;
-                const int color = color_get(s, src[x], a, r, g, b, search_method);
+                const int color = color_get(s, cache, src[x], a, r, g, b, search_method);
 
                 if (color < 0)
                     return color;
@@ -894,9 +905,25 @@ static void set_processing_window(enum diff_mode diff_mode,
     *hp = height;
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int x, y, w, h;
+} ThreadData;
+
+static int set_frame_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int slice_start = td->y + (td->h *  jobnr   ) / nb_jobs;
+    const int slice_end   = td->y + (td->h * (jobnr+1)) / nb_jobs;
+
+    return s->set_frame(s, s->cache[jobnr], td->out, td->in,
+                        td->x, slice_start, td->w, slice_end - slice_start);
+}
+
 static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
 {
-    int x, y, w, h, ret;
+    int i, x, y, w, h, ret;
     AVFilterContext *ctx = inlink->dst;
     PaletteUseContext *s = ctx->priv;
     AVFilterLink *outlink = inlink->dst->outputs[0];
@@ -911,22 +938,34 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
 
     set_processing_window(s->diff_mode, s->last_in, in,
                           s->last_out, out, &x, &y, &w, &h);
-    av_frame_free(&s->last_in);
-    av_frame_free(&s->last_out);
-    s->last_in  = av_frame_clone(in);
-    s->last_out = av_frame_clone(out);
-    if (!s->last_in || !s->last_out ||
-        av_frame_make_writable(s->last_in) < 0) {
-        av_frame_free(&in);
-        av_frame_free(&out);
-        *outf = NULL;
-        return AVERROR(ENOMEM);
+    // the previous frames are only needed to find the difference
+    if (s->diff_mode != DIFF_MODE_NONE) {
+        av_frame_free(&s->last_in);
+        av_frame_free(&s->last_out);
+        s->last_in  = av_frame_clone(in);
+        s->last_out = av_frame_clone(out);
+        if (!s->last_in || !s->last_out ||
+            av_frame_make_writable(s->last_in) < 0) {
+            av_frame_free(&in);
+            av_frame_free(&out);
+            *outf = NULL;
+            return AVERROR(ENOMEM);
+        }
     }
 
     ff_dlog(ctx, "%dx%d rect: (%d;%d) -> (%d,%d) [area:%dx%d]\n",
             w, h, x, y, x+w, y+h, in->width, in->height);
 
-    ret = s->set_frame(s, out, in, x, y, w, h);
+    if (s->slice_threads && h > 1) {
+        ThreadData td = { .in = in, .out = out, .x = x, .y = y, .w = w, .h = h };
+        const int nb_jobs = FFMIN(h, s->nb_threads);
+
+        ctx->internal->execute(ctx, set_frame_slice, &td, s->job_ret, nb_jobs);
+        for (ret = 0, i = 0; i < nb_jobs && ret >= 0; i++)
+            ret = s->job_ret[i];
+    } else {
+        ret = s->set_frame(s, s->cache[0], out, in, x, y, w, h);
+    }
     if (ret < 0) {
         av_frame_free(&out);
         *outf = NULL;
@@ -940,18 +979,113 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     return 0;
 }
 
+static int apply_palette_frame(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    AVFrame *in  = s->queue_in[jobnr];
+    AVFrame *out = s->queue_out[jobnr];
+
+    return s->set_frame(s, s->cache[jobnr], out, in, 0, 0, in->width, in->height);
+}
+
+/**
+ * Dither all the queued frames at once, one per job, and send them in order.
+ */
+static int flush_queue(AVFilterContext *ctx)
+{
+    PaletteUseContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    int i, ret = 0;
+
+    if (!s->nb_queued)
+        return 0;
+
+    ctx->internal->execute(ctx, apply_palette_frame, NULL, s->job_ret, s->nb_queued);
+
+    for (i = 0; i < s->nb_queued; i++) {
+        AVFrame *in  = s->queue_in[i];
+        AVFrame *out = s->queue_out[i];
+
+        s->queue_in[i] = s->queue_out[i] = NULL;
+        if (ret >= 0)
+            ret = s->job_ret[i];
+        if (ret >= 0) {
+            memcpy(out->data[1], s->palette, AVPALETTE_SIZE);
+            if (s->calc_mean_err)
+                debug_mean_error(s, in, out, inlink->frame_count_out - s->nb_queued + i + 1);
+            ret = ff_filter_frame(ctx->outputs[0], out);
+        } else {
+            av_frame_free(&out);
+        }
+        av_frame_free(&in);
+    }
+    s->nb_queued = 0;
+    return ret;
+}
+
+static int queue_frame(AVFilterContext *ctx, AVFrame *in)
+{
+    PaletteUseContext *s = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
+    AVFrame *out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+
+    if (!out) {
+        av_frame_free(&in);
+        return AVERROR(ENOMEM);
+    }
+    av_frame_copy_props(out, in);
+
+    s->queue_in [s->nb_queued] = in;
+    s->queue_out[s->nb_queued] = out;
+    if (++s->nb_queued == s->nb_threads)
+        return flush_queue(ctx);
+    return 0;
+}
+
+static int flush_queue_eof(FFFrameSync *fs)
+{
+    return flush_queue(fs->parent);
+}
+
 static int config_output(AVFilterLink *outlink)
 {
     int ret;
     AVFilterContext *ctx = outlink->src;
     PaletteUseContext *s = ctx->priv;
 
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->cache   = av_calloc(s->nb_threads, sizeof(*s->cache));
+    s->job_ret = av_calloc(s->nb_threads, sizeof(*s->job_ret));
+    if (!s->cache || !s->job_ret)
+        return AVERROR(ENOMEM);
+
+    /* Without dithering every pixel is independent, so the frames are split
+     * in bands. Error diffusion has to go through a frame in order, so
+     * several frames are dithered at once instead, which needs them to not
+     * depend on the previous output nor on a new palette. Bayer dithering
+     * stays serial: its cache is looked up with the undithered color, so its
+     * output depends on the order of the pixels. */
+    if (s->nb_threads > 1) {
+        if (s->dither == DITHERING_NONE) {
+            s->slice_threads = 1;
+        } else if (s->dither != DITHERING_BAYER &&
+                   s->diff_mode == DIFF_MODE_NONE && !s->new) {
+            s->frame_threads = 1;
+            s->queue_in  = av_calloc(s->nb_threads, sizeof(*s->queue_in));
+            s->queue_out = av_calloc(s->nb_threads, sizeof(*s->queue_out));
+            if (!s->queue_in || !s->queue_out)
+                return AVERROR(ENOMEM);
+        }
+    }
+
     ret = ff_framesync_init_dualinput(&s->fs, ctx);
     if (ret < 0)
         return ret;
     s->fs.opt_repeatlast = 1; // only 1 frame in the palette
     s->fs.in[1].before = s->fs.in[1].after = EXT_INFINITY;
     s->fs.on_event = load_apply_palette;
+    if (s->frame_threads)
+        s->fs.on_eof = flush_queue_eof;
 
     outlink->w = ctx->inputs[0]->w;
     outlink->h = ctx->inputs[0]->h;
@@ -977,6 +1111,19 @@ static int config_input_palette(AVFilterLink *inlink)
     return 0;
 }
 
+static void free_caches(PaletteUseContext *s)
+{
+    int i, j;
+
+    if (!s->cache)
+        return;
+    for (j = 0; j < s->nb_threads; j++) {
+        for (i = 0; i < CACHE_SIZE; i++)
+            av_freep(&s->cache[j][i].entries);
+        memset(s->cache[j], 0, sizeof(s->cache[j]));
+    }
+}
+
 static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
 {
     int i, x, y;
@@ -988,9 +1135,7 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
     if (s->new) {
         memset(s->palette, 0, sizeof(s->palette));
         memset(s->map, 0, sizeof(s->map));
-        for (i = 0; i < CACHE_SIZE; i++)
-            av_freep(&s->cache[i].entries);
-        memset(s->cache, 0, sizeof(s->cache));
+        free_caches(s);
     }
 
     i = 0;
@@ -1030,6 +1175,13 @@ static int load_apply_palette(FFFrameSync *fs)
     if (!s->palette_loaded) {
         load_palette(s, second);
     }
+    if (s->frame_threads) {
+        ret = queue_frame(ctx, master);
+        // no frame was sent yet, come back for the next input
+        if (ret >= 0 && s->nb_queued)
+            ff_filter_set_ready(ctx, 100);
+        return ret;
+    }
     ret = apply_palette(inlink, master, &out);
     if (ret < 0)
         goto error;
@@ -1041,10 +1193,12 @@ error:
 }
 
 #define DEFINE_SET_FRAME(color_search, name, value)                             \
-static int set_frame_##name(PaletteUseContext *s, AVFrame *out, AVFrame *in,    \
+static int set_frame_##name(PaletteUseContext *s, struct cache_node *cache,     \
+                            AVFrame *out, AVFrame *in,                          \
                             int x_start, int y_start, int w, int h)             \
 {                                                                               \
-    return set_frame(s, out, in, x_start, y_start, w, h, value, color_search);  \
+    return set_frame(s, cache, out, in, x_start, y_start, w, h, value,          \
+                     color_search);                                             \
 }
 
 #define DEFINE_SET_FRAME_COLOR_SEARCH(color_search, color_search_macro)                                 \
@@ -1111,8 +1265,15 @@ static av_cold void uninit(AVFilterContext *ctx)
     PaletteUseContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
-    for (i = 0; i < CACHE_SIZE; i++)
-        av_freep(&s->cache[i].entries);
+    free_caches(s);
+    av_freep(&s->cache);
+    av_freep(&s->job_ret);
+    for (i = 0; i < s->nb_queued; i++) {
+        av_frame_free(&s->queue_in[i]);
+        av_frame_free(&s->queue_out[i]);
+    }
+    av_freep(&s->queue_in);
+    av_freep(&s->queue_out);
     av_frame_free(&s->last_in);
     av_frame_free(&s->last_out);
 }
@@ -1149,4 +1310,5 @@ AVFilter ff_vf_paletteuse = {
     .inputs        = paletteuse_inputs,
     .outputs       = paletteuse_outputs,
     .priv_class    = &paletteuse_class,
+    .flags         = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -34,6 +34,9 @@
  *
  * Algorithm digest:
  * Target_frame[y][x] = Source_frame[ ymap[y][x] ][ [xmap[y][x] ];
+ *
+ * The map frames are converted to a RemapMap when they change, and the
+ * pixels are then remapped through it.
  */
 
 #include "libavutil/imgutils.h"
@@ -43,24 +46,32 @@
 #include "formats.h"
 #include "framesync.h"
 #include "internal.h"
+#include "remap.h"
 #include "video.h"
 
 typedef struct RemapContext {
     const AVClass *class;
+    int interp;
+    int frac_bits;
     int nb_planes;
     int nb_components;
     int step;
+    int bps;
+    int nb_threads;
     FFFrameSync fs;
 
-    void (*remap)(struct RemapContext *s, const AVFrame *in,
-                  const AVFrame *xin, const AVFrame *yin,
-                  AVFrame *out);
+    RemapMap map;
+    AVFrame *xmap_ref, *ymap_ref;   ///< map frames the map was built from
 } RemapContext;
 
 #define OFFSET(x) offsetof(RemapContext, x)
 #define FLAGS AV_OPT_FLAG_FILTERING_PARAM|AV_OPT_FLAG_VIDEO_PARAM
 
 static const AVOption remap_options[] = {
+    { "interp", "set interpolation method", OFFSET(interp), AV_OPT_TYPE_INT, {.i64=REMAP_NEAREST}, 0, NB_REMAP_INTERP-1, FLAGS, "interp" },
+        { "nearest",  "nearest neighbour",      0, AV_OPT_TYPE_CONST, {.i64=REMAP_NEAREST},  0, 0, FLAGS, "interp" },
+        { "bilinear", "bilinear interpolation", 0, AV_OPT_TYPE_CONST, {.i64=REMAP_BILINEAR}, 0, 0, FLAGS, "interp" },
+    { "frac_bits", "set the number of fractional bits of the map values", OFFSET(frac_bits), AV_OPT_TYPE_INT, {.i64=0}, 0, REMAP_FRAC_BITS, FLAGS },
     { NULL }
 };
 
@@ -116,139 +127,47 @@ fail:
     return ret;
 }
 
+typedef struct ThreadData {
+    const AVFrame *in, *xin, *yin;
+    AVFrame *out;
+    int build_map;
+} ThreadData;
+
 /**
- * remap_planar algorithm expects planes of same size
- * pixels are copied from source to target using :
- * Target_frame[y][x] = Source_frame[ ymap[y][x] ][ [xmap[y][x] ];
+ * Convert the rows [y_start, y_end) of the map frames to the precomputed map.
  */
-static void remap_planar(RemapContext *s, const AVFrame *in,
-                         const AVFrame *xin, const AVFrame *yin,
-                         AVFrame *out)
+static void build_map(RemapContext *s, const ThreadData *td, int y_start, int y_end)
 {
-    const int xlinesize = xin->linesize[0] / 2;
-    const int ylinesize = yin->linesize[0] / 2;
-    int x , y, plane;
-
-    for (plane = 0; plane < s->nb_planes ; plane++) {
-        uint8_t *dst         = out->data[plane];
-        const int dlinesize  = out->linesize[plane];
-        const uint8_t *src   = in->data[plane];
-        const int slinesize  = in->linesize[plane];
-        const uint16_t *xmap = (const uint16_t *)xin->data[0];
-        const uint16_t *ymap = (const uint16_t *)yin->data[0];
-
-        for (y = 0; y < out->height; y++) {
-            for (x = 0; x < out->width; x++) {
-                if (ymap[x] < in->height && xmap[x] < in->width) {
-                    dst[x] = src[ymap[x] * slinesize + xmap[x]];
-                } else {
-                    dst[x] = 0;
-                }
-            }
-            dst  += dlinesize;
-            xmap += xlinesize;
-            ymap += ylinesize;
-        }
-    }
-}
+    const int shift = REMAP_FRAC_BITS - s->frac_bits;
+    int x, y;
 
-static void remap_planar16(RemapContext *s, const AVFrame *in,
-                           const AVFrame *xin, const AVFrame *yin,
-                           AVFrame *out)
-{
-    const int xlinesize = xin->linesize[0] / 2;
-    const int ylinesize = yin->linesize[0] / 2;
-    int x , y, plane;
-
-    for (plane = 0; plane < s->nb_planes ; plane++) {
-        uint16_t *dst        = (uint16_t *)out->data[plane];
-        const int dlinesize  = out->linesize[plane] / 2;
-        const uint16_t *src  = (const uint16_t *)in->data[plane];
-        const int slinesize  = in->linesize[plane] / 2;
-        const uint16_t *xmap = (const uint16_t *)xin->data[0];
-        const uint16_t *ymap = (const uint16_t *)yin->data[0];
-
-        for (y = 0; y < out->height; y++) {
-            for (x = 0; x < out->width; x++) {
-                if (ymap[x] < in->height && xmap[x] < in->width) {
-                    dst[x] = src[ymap[x] * slinesize + xmap[x]];
-                } else {
-                    dst[x] = 0;
-                }
-            }
-            dst  += dlinesize;
-            xmap += xlinesize;
-            ymap += ylinesize;
-        }
-    }
-}
+    for (y = y_start; y < y_end; y++) {
+        const uint16_t *xmap = (const uint16_t *)(td->xin->data[0] + y * td->xin->linesize[0]);
+        const uint16_t *ymap = (const uint16_t *)(td->yin->data[0] + y * td->yin->linesize[0]);
 
-/**
- * remap_packed algorithm expects pixels with both padded bits (step) and
- * number of components correctly set.
- * pixels are copied from source to target using :
- * Target_frame[y][x] = Source_frame[ ymap[y][x] ][ [xmap[y][x] ];
- */
-static void remap_packed(RemapContext *s, const AVFrame *in,
-                         const AVFrame *xin, const AVFrame *yin,
-                         AVFrame *out)
-{
-    uint8_t *dst = out->data[0];
-    const uint8_t *src  = in->data[0];
-    const int dlinesize = out->linesize[0];
-    const int slinesize = in->linesize[0];
-    const int xlinesize = xin->linesize[0] / 2;
-    const int ylinesize = yin->linesize[0] / 2;
-    const uint16_t *xmap = (const uint16_t *)xin->data[0];
-    const uint16_t *ymap = (const uint16_t *)yin->data[0];
-    const int step = s->step;
-    int c, x, y;
-
-    for (y = 0; y < out->height; y++) {
-        for (x = 0; x < out->width; x++) {
-            for (c = 0; c < s->nb_components; c++) {
-                if (ymap[x] < in->height && xmap[x] < in->width) {
-                    dst[x * step + c] = src[ymap[x] * slinesize + xmap[x] * step + c];
-                } else {
-                    dst[x * step + c] = 0;
-                }
-            }
-        }
-        dst  += dlinesize;
-        xmap += xlinesize;
-        ymap += ylinesize;
+        for (x = 0; x < s->map.w; x++)
+            ff_remap_map_set(&s->map, y * s->map.w + x, xmap[x] << shift, ymap[x] << shift,
+                             td->in->width, td->in->height);
     }
 }
 
-static void remap_packed16(RemapContext *s, const AVFrame *in,
-                           const AVFrame *xin, const AVFrame *yin,
-                           AVFrame *out)
+static int remap_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    uint16_t *dst = (uint16_t *)out->data[0];
-    const uint16_t *src  = (const uint16_t *)in->data[0];
-    const int dlinesize = out->linesize[0] / 2;
-    const int slinesize = in->linesize[0] / 2;
-    const int xlinesize = xin->linesize[0] / 2;
-    const int ylinesize = yin->linesize[0] / 2;
-    const uint16_t *xmap = (const uint16_t *)xin->data[0];
-    const uint16_t *ymap = (const uint16_t *)yin->data[0];
-    const int step = s->step / 2;
-    int c, x, y;
-
-    for (y = 0; y < out->height; y++) {
-        for (x = 0; x < out->width; x++) {
-            for (c = 0; c < s->nb_components; c++) {
-                if (ymap[x] < in->height && xmap[x] < in->width) {
-                    dst[x * step + c] = src[ymap[x] * slinesize + xmap[x] * step + c];
-                } else {
-                    dst[x * step + c] = 0;
-                }
-            }
-        }
-        dst  += dlinesize;
-        xmap += xlinesize;
-        ymap += ylinesize;
-    }
+    RemapContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int slice_start = (td->out->height *  jobnr   ) / nb_jobs;
+    const int slice_end   = (td->out->height * (jobnr+1)) / nb_jobs;
+    int plane;
+
+    if (td->build_map)
+        build_map(s, td, slice_start, slice_end);
+
+    for (plane = 0; plane < s->nb_planes; plane++)
+        ff_remap_slice(&s->map,
+                       td->out->data[plane], td->out->linesize[plane],
+                       td->in->data[plane], td->in->linesize[plane],
+                       s->bps, s->step, s->nb_components, slice_start, slice_end);
+    return 0;
 }
 
 static int config_input(AVFilterLink *inlink)
@@ -257,24 +176,23 @@ static int config_input(AVFilterLink *inlink)
     RemapContext *s = ctx->priv;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
 
+    if (inlink->w > INT16_MAX || inlink->h > INT16_MAX) {
+        av_log(ctx, AV_LOG_ERROR, "Source size %dx%d is too large\n",
+               inlink->w, inlink->h);
+        return AVERROR(EINVAL);
+    }
+
     s->nb_planes = av_pix_fmt_count_planes(inlink->format);
-    s->nb_components = desc->nb_components;
+    s->bps = desc->comp[0].depth > 8 ? 2 : 1;
 
-    if (desc->comp[0].depth == 8) {
-        if (s->nb_planes > 1 || s->nb_components == 1) {
-            s->remap = remap_planar;
-        } else {
-            s->remap = remap_packed;
-        }
+    if (s->nb_planes > 1 || desc->nb_components == 1) {
+        s->nb_components = 1;
+        s->step          = 1;
     } else {
-        if (s->nb_planes > 1 || s->nb_components == 1) {
-            s->remap = remap_planar16;
-        } else {
-            s->remap = remap_packed16;
-        }
+        s->nb_components = desc->nb_components;
+        s->step          = (av_get_padded_bits_per_pixel(desc) >> 3) / s->bps;
     }
 
-    s->step = av_get_padded_bits_per_pixel(desc) >> 3;
     return 0;
 }
 
@@ -284,6 +202,7 @@ static int process_frame(FFFrameSync *fs)
     RemapContext *s = fs->opaque;
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out, *in, *xpic, *ypic;
+    ThreadData td;
     int ret;
 
     if ((ret = ff_framesync_get_frame(&s->fs, 0, &in,   0)) < 0 ||
@@ -301,7 +220,29 @@ static int process_frame(FFFrameSync *fs)
             return AVERROR(ENOMEM);
         av_frame_copy_props(out, in);
 
-        s->remap(s, in, xpic, ypic, out);
+        td.in  = in;
+        td.xin = xpic;
+        td.yin = ypic;
+        td.out = out;
+        /* the map streams are usually a single picture repeated, holding a
+         * reference keeps the buffer from being reused for another map */
+        td.build_map = !s->xmap_ref ||
+                       s->xmap_ref->data[0] != xpic->data[0] ||
+                       s->ymap_ref->data[0] != ypic->data[0];
+        if (td.build_map) {
+            av_frame_free(&s->xmap_ref);
+            av_frame_free(&s->ymap_ref);
+            s->xmap_ref = av_frame_clone(xpic);
+            s->ymap_ref = av_frame_clone(ypic);
+            if (!s->xmap_ref || !s->ymap_ref) {
+                av_frame_free(&s->xmap_ref);
+                av_frame_free(&s->ymap_ref);
+                av_frame_free(&out);
+                return AVERROR(ENOMEM);
+            }
+        }
+        ctx->internal->execute(ctx, remap_slice, &td, NULL,
+                               FFMIN(outlink->h, s->nb_threads));
     }
     out->pts = av_rescale_q(in->pts, s->fs.time_base, outlink->time_base);
 
@@ -333,6 +274,15 @@ static int config_output(AVFilterLink *outlink)
     outlink->sample_aspect_ratio = srclink->sample_aspect_ratio;
     outlink->frame_rate = srclink->frame_rate;
 
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    // bilinear interpolation reads 2x2 blocks
+    ret = ff_remap_map_alloc(&s->map, outlink->w, outlink->h,
+                             srclink->w < 2 || srclink->h < 2 ? REMAP_NEAREST : s->interp);
+    if (ret < 0)
+        return ret;
+    av_frame_free(&s->xmap_ref);
+    av_frame_free(&s->ymap_ref);
+
     ret = ff_framesync_init(&s->fs, ctx, 3);
     if (ret < 0)
         return ret;
@@ -368,6 +318,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     RemapContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
+    ff_remap_map_free(&s->map);
+    av_frame_free(&s->xmap_ref);
+    av_frame_free(&s->ymap_ref);
 }
 
 static const AVFilterPad remap_inputs[] = {
@@ -406,5 +359,5 @@ AVFilter ff_vf_remap = {
     .inputs        = remap_inputs,
     .outputs       = remap_outputs,
     .priv_class    = &remap_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -418,4 +418,5 @@ AVFilter ff_vf_transpose = {
     .inputs        = avfilter_vf_transpose_inputs,
     .outputs       = avfilter_vf_transpose_outputs,
     .flags         = AVFILTER_FLAG_SLICE_THREADS,
+    .flags_internal = FF_FILTER_FLAG_PIPELINE,
 };
@@ -52,6 +52,8 @@ typedef struct VagueDenoiserContext {
     float *in;
     float *out;
     float *tmp;
+    int line_size;      ///< size of the in, out and tmp lines of each job
+    int nb_threads;
 
     int hlowsize[4][32];
     int hhighsize[4][32];
@@ -60,7 +62,8 @@ typedef struct VagueDenoiserContext {
 
     void (*thresholding)(float *block, const int width, const int height,
                          const int stride, const float threshold,
-                         const float percent, const int nsteps);
+                         const float percent, const int nsteps,
+                         const int start, const int end);
 } VagueDenoiserContext;
 
 #define OFFSET(x) offsetof(VagueDenoiserContext, x)
@@ -144,10 +147,13 @@ static int config_input(AVFilterLink *inlink)
     s->planewidth[1]  = s->planewidth[2]  = AV_CEIL_RSHIFT(inlink->w, desc->log2_chroma_w);
     s->planewidth[0]  = s->planewidth[3]  = inlink->w;
 
+    s->nb_threads = ff_filter_get_nb_threads(inlink->dst);
+    s->line_size  = 32 + FFMAX(inlink->w, inlink->h);
+
     s->block = av_malloc_array(inlink->w * inlink->h, sizeof(*s->block));
-    s->in    = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->in));
-    s->out   = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->out));
-    s->tmp   = av_malloc_array(32 + FFMAX(inlink->w, inlink->h), sizeof(*s->tmp));
+    s->in    = av_malloc_array(s->line_size, s->nb_threads * sizeof(*s->in));
+    s->out   = av_malloc_array(s->line_size, s->nb_threads * sizeof(*s->out));
+    s->tmp   = av_malloc_array(s->line_size, s->nb_threads * sizeof(*s->tmp));
 
     if (!s->block || !s->in || !s->out || !s->tmp)
         return AVERROR(ENOMEM);
@@ -328,12 +334,14 @@ static void invert_step(const float *input, float *output, float *temp, const in
 
 static void hard_thresholding(float *block, const int width, const int height,
                               const int stride, const float threshold,
-                              const float percent, const int unused)
+                              const float percent, const int unused,
+                              const int start, const int end)
 {
     const float frac = 1.f - percent * 0.01f;
     int y, x;
 
-    for (y = 0; y < height; y++) {
+    block += start * stride;
+    for (y = start; y < end; y++) {
         for (x = 0; x < width; x++) {
             if (FFABS(block[x]) <= threshold)
                 block[x] *= frac;
@@ -343,7 +351,8 @@ static void hard_thresholding(float *block, const int width, const int height,
 }
 
 static void soft_thresholding(float *block, const int width, const int height, const int stride,
-                              const float threshold, const float percent, const int nsteps)
+                              const float threshold, const float percent, const int nsteps,
+                              const int start, const int end)
 {
     const float frac = 1.f - percent * 0.01f;
     const float shift = threshold * 0.01f * percent;
@@ -356,7 +365,8 @@ static void soft_thresholding(float *block, const int width, const int height, c
         h = (h + 1) >> 1;
     }
 
-    for (y = 0; y < height; y++) {
+    block += start * stride;
+    for (y = start; y < end; y++) {
         const int x0 = (y < h) ? w : 0;
         for (x = x0; x < width; x++) {
             const float temp = FFABS(block[x]);
@@ -371,14 +381,16 @@ static void soft_thresholding(float *block, const int width, const int height, c
 
 static void qian_thresholding(float *block, const int width, const int height,
                               const int stride, const float threshold,
-                              const float percent, const int unused)
+                              const float percent, const int unused,
+                              const int start, const int end)
 {
     const float percent01 = percent * 0.01f;
     const float tr2 = threshold * threshold * percent01;
     const float frac = 1.f - percent01;
     int y, x;
 
-    for (y = 0; y < height; y++) {
+    block += start * stride;
+    for (y = start; y < end; y++) {
         for (x = 0; x < width; x++) {
             const float temp = FFABS(block[x]);
             if (temp <= threshold) {
@@ -392,23 +404,219 @@ static void qian_thresholding(float *block, const int width, const int height,
     }
 }
 
-static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
+/**
+ * Each step of the transform is run as a pass on the rows, then as a pass on
+ * the columns, with td->lines lines of td->size samples, the jobs of a pass
+ * taking a band of rows or a strip of columns.
+ */
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int plane;
+    int lines;
+    int size;
+} ThreadData;
+
+#define ROW_SLICE(td, jobnr, nb_jobs)                                         \
+    const int start = ((td)->lines *  (jobnr)   ) / (nb_jobs);                \
+    const int end   = ((td)->lines * ((jobnr)+1)) / (nb_jobs)
+
+// strips of 16 columns, to keep the jobs off each other's cache lines
+#define COLUMN_SLICE(td, jobnr, nb_jobs)                                      \
+    const int nb_strips = ((td)->lines + 15) >> 4;                            \
+    const int start = FFMIN((td)->lines, ((nb_strips *  (jobnr)   ) / (nb_jobs)) << 4); \
+    const int end   = FFMIN((td)->lines, ((nb_strips * ((jobnr)+1)) / (nb_jobs)) << 4)
+
+static int import_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int p = td->plane;
+    const int width = s->planewidth[p];
+    ROW_SLICE(td, jobnr, nb_jobs);
+    float *output = s->block + start * width;
+    int x, y;
+
+    if (s->depth <= 8) {
+        const uint8_t *srcp8 = td->in->data[p] + start * td->in->linesize[p];
+
+        for (y = start; y < end; y++) {
+            for (x = 0; x < width; x++)
+                output[x] = srcp8[x];
+            srcp8 += td->in->linesize[p];
+            output += width;
+        }
+    } else {
+        const uint16_t *srcp16 = (const uint16_t *)(td->in->data[p] + start * td->in->linesize[p]);
+
+        for (y = start; y < end; y++) {
+            for (x = 0; x < width; x++)
+                output[x] = srcp16[x];
+            srcp16 += td->in->linesize[p] / 2;
+            output += width;
+        }
+    }
+    return 0;
+}
+
+static int export_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int p = td->plane;
+    const int width = s->planewidth[p];
+    ROW_SLICE(td, jobnr, nb_jobs);
+    const float *input = s->block + start * width;
+    int x, y;
+
+    if (s->depth <= 8) {
+        uint8_t *dstp8 = td->out->data[p] + start * td->out->linesize[p];
+
+        for (y = start; y < end; y++) {
+            for (x = 0; x < width; x++)
+                dstp8[x] = av_clip_uint8(input[x] + 0.5f);
+            input += width;
+            dstp8 += td->out->linesize[p];
+        }
+    } else {
+        uint16_t *dstp16 = (uint16_t *)(td->out->data[p] + start * td->out->linesize[p]);
+
+        for (y = start; y < end; y++) {
+            for (x = 0; x < width; x++)
+                dstp16[x] = av_clip(input[x] + 0.5f, 0, s->peak);
+            input += width;
+            dstp16 += td->out->linesize[p] / 2;
+        }
+    }
+    return 0;
+}
+
+static int threshold_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int width = s->planewidth[td->plane];
+    ROW_SLICE(td, jobnr, nb_jobs);
+
+    s->thresholding(s->block, width, td->lines, width, s->threshold, s->percent, s->nsteps,
+                    start, end);
+    return 0;
+}
+
+static int transform_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int width = s->planewidth[td->plane];
+    float *in  = s->in  + jobnr * s->line_size;
+    float *out = s->out + jobnr * s->line_size;
+    ROW_SLICE(td, jobnr, nb_jobs);
+    float *input = s->block + start * width;
+    int j;
+
+    for (j = start; j < end; j++) {
+        copy(input, in + NPAD, td->size);
+        transform_step(in, out, td->size, (td->size + 1) >> 1, s);
+        copy(out + NPAD, input, td->size);
+        input += width;
+    }
+    return 0;
+}
+
+static int transform_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int p, y, x, i, j;
+    VagueDenoiserContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int width = s->planewidth[td->plane];
+    float *in  = s->in  + jobnr * s->line_size;
+    float *out = s->out + jobnr * s->line_size;
+    COLUMN_SLICE(td, jobnr, nb_jobs);
+    float *input = s->block + start;
+    int j;
+
+    for (j = start; j < end; j++) {
+        copyv(input, width, in + NPAD, td->size);
+        transform_step(in, out, td->size, (td->size + 1) >> 1, s);
+        copyh(out + NPAD, input, width, td->size);
+        input++;
+    }
+    return 0;
+}
+
+static int invert_columns(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int width = s->planewidth[td->plane];
+    float *in  = s->in  + jobnr * s->line_size;
+    float *out = s->out + jobnr * s->line_size;
+    float *tmp = s->tmp + jobnr * s->line_size;
+    COLUMN_SLICE(td, jobnr, nb_jobs);
+    float *idx3 = s->block + start;
+    int i;
+
+    for (i = start; i < end; i++) {
+        copyv(idx3, width, in + NPAD, td->size);
+        invert_step(in, out, tmp, td->size, s);
+        copyh(out + NPAD, idx3, width, td->size);
+        idx3++;
+    }
+    return 0;
+}
+
+static int invert_rows(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int width = s->planewidth[td->plane];
+    float *in  = s->in  + jobnr * s->line_size;
+    float *out = s->out + jobnr * s->line_size;
+    float *tmp = s->tmp + jobnr * s->line_size;
+    ROW_SLICE(td, jobnr, nb_jobs);
+    float *idx3 = s->block + start * width;
+    int i;
+
+    for (i = start; i < end; i++) {
+        copy(idx3, in + NPAD, td->size);
+        invert_step(in, out, tmp, td->size, s);
+        copy(out + NPAD, idx3, td->size);
+        idx3 += width;
+    }
+    return 0;
+}
+
+static void run_rows(AVFilterContext *ctx, avfilter_action_func *func,
+                     ThreadData *td, int lines, int size)
+{
+    VagueDenoiserContext *s = ctx->priv;
+
+    td->lines = lines;
+    td->size  = size;
+    ctx->internal->execute(ctx, func, td, NULL, FFMIN(lines, s->nb_threads));
+}
+
+static void run_columns(AVFilterContext *ctx, avfilter_action_func *func,
+                        ThreadData *td, int lines, int size)
+{
+    VagueDenoiserContext *s = ctx->priv;
+
+    td->lines = lines;
+    td->size  = size;
+    ctx->internal->execute(ctx, func, td, NULL, FFMIN((lines + 15) >> 4, s->nb_threads));
+}
+
+static void filter(AVFilterContext *ctx, AVFrame *in, AVFrame *out)
+{
+    VagueDenoiserContext *s = ctx->priv;
+    ThreadData td = { .in = in, .out = out };
+    int p;
 
     for (p = 0; p < s->nb_planes; p++) {
         const int height = s->planeheight[p];
         const int width = s->planewidth[p];
-        const uint8_t *srcp8 = in->data[p];
-        const uint16_t *srcp16 = (const uint16_t *)in->data[p];
-        uint8_t *dstp8 = out->data[p];
-        uint16_t *dstp16 = (uint16_t *)out->data[p];
-        float *output = s->block;
         int h_low_size0 = width;
         int v_low_size0 = height;
         int nsteps_transform = s->nsteps;
         int nsteps_invert = s->nsteps;
-        const float *input = s->block;
 
         if (!((1 << p) & s->planes)) {
             av_image_copy_plane(out->data[p], out->linesize[p], in->data[p], in->linesize[p],
@@ -416,89 +624,34 @@ static void filter(VagueDenoiserContext *s, AVFrame *in, AVFrame *out)
             continue;
         }
 
-        if (s->depth <= 8) {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    output[x] = srcp8[x];
-                srcp8 += in->linesize[p];
-                output += width;
-            }
-        } else {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    output[x] = srcp16[x];
-                srcp16 += in->linesize[p] / 2;
-                output += width;
-            }
-        }
+        td.plane = p;
+        run_rows(ctx, import_rows, &td, height, width);
 
         while (nsteps_transform--) {
-            int low_size = (h_low_size0 + 1) >> 1;
-            float *input = s->block;
-            for (j = 0; j < v_low_size0; j++) {
-                copy(input, s->in + NPAD, h_low_size0);
-                transform_step(s->in, s->out, h_low_size0, low_size, s);
-                copy(s->out + NPAD, input, h_low_size0);
-                input += width;
-            }
-
-            low_size = (v_low_size0 + 1) >> 1;
-            input = s->block;
-            for (j = 0; j < h_low_size0; j++) {
-                copyv(input, width, s->in + NPAD, v_low_size0);
-                transform_step(s->in, s->out, v_low_size0, low_size, s);
-                copyh(s->out + NPAD, input, width, v_low_size0);
-                input++;
-            }
+            run_rows   (ctx, transform_rows,    &td, v_low_size0, h_low_size0);
+            run_columns(ctx, transform_columns, &td, h_low_size0, v_low_size0);
 
             h_low_size0 = (h_low_size0 + 1) >> 1;
             v_low_size0 = (v_low_size0 + 1) >> 1;
         }
 
-        s->thresholding(s->block, width, height, width, s->threshold, s->percent, s->nsteps);
+        run_rows(ctx, threshold_rows, &td, height, width);
 
         while (nsteps_invert--) {
             const int idx = s->vlowsize[p][nsteps_invert]  + s->vhighsize[p][nsteps_invert];
             const int idx2 = s->hlowsize[p][nsteps_invert] + s->hhighsize[p][nsteps_invert];
-            float * idx3 = s->block;
-            for (i = 0; i < idx2; i++) {
-                copyv(idx3, width, s->in + NPAD, idx);
-                invert_step(s->in, s->out, s->tmp, idx, s);
-                copyh(s->out + NPAD, idx3, width, idx);
-                idx3++;
-            }
 
-            idx3 = s->block;
-            for (i = 0; i < idx; i++) {
-                copy(idx3, s->in + NPAD, idx2);
-                invert_step(s->in, s->out, s->tmp, idx2, s);
-                copy(s->out + NPAD, idx3, idx2);
-                idx3 += width;
-            }
+            run_columns(ctx, invert_columns, &td, idx2, idx);
+            run_rows   (ctx, invert_rows,    &td, idx,  idx2);
         }
 
-        if (s->depth <= 8) {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    dstp8[x] = av_clip_uint8(input[x] + 0.5f);
-                input += width;
-                dstp8 += out->linesize[p];
-            }
-        } else {
-            for (y = 0; y < height; y++) {
-                for (x = 0; x < width; x++)
-                    dstp16[x] = av_clip(input[x] + 0.5f, 0, s->peak);
-                input += width;
-                dstp16 += out->linesize[p] / 2;
-            }
-        }
+        run_rows(ctx, export_rows, &td, height, width);
     }
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
     AVFilterContext *ctx  = inlink->dst;
-    VagueDenoiserContext *s = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out;
     int direct = av_frame_is_writable(in);
@@ -515,7 +668,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
         av_frame_copy_props(out, in);
     }
 
-    filter(s, in, out);
+    filter(ctx, in, out);
 
     if (!direct)
         av_frame_free(&in);
@@ -581,5 +734,5 @@ AVFilter ff_vf_vaguedenoiser = {
     .query_formats = query_formats,
     .inputs        = vaguedenoiser_inputs,
     .outputs       = vaguedenoiser_outputs,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
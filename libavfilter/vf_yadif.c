@@ -562,4 +562,5 @@ AVFilter ff_vf_yadif = {
     .inputs        = avfilter_vf_yadif_inputs,
     .outputs       = avfilter_vf_yadif_outputs,
     .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_INTERNAL | AVFILTER_FLAG_SLICE_THREADS,
+    .flags_internal = FF_FILTER_FLAG_PIPELINE,
 };
@@ -28,6 +28,10 @@
 #include "libavutil/hwcontext.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+
+#define FF_INTERNAL_FIELDS 1
+#include "framequeue.h"
 
 #include "avfilter.h"
 #include "internal.h"
@@ -41,13 +45,34 @@ AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h)
     return ff_get_video_buffer(link->dst->outputs[0], w, h);
 }
 
+void ff_video_link_request_border(AVFilterLink *link,
+                                  int left, int top, int right, int bottom)
+{
+    AVFilterContext *src = link->src;
+
+    link->alloc_border[0] = FFMAX(link->alloc_border[0], left);
+    link->alloc_border[1] = FFMAX(link->alloc_border[1], top);
+    link->alloc_border[2] = FFMAX(link->alloc_border[2], right);
+    link->alloc_border[3] = FFMAX(link->alloc_border[3], bottom);
+
+    /* the data pointers of the frames may be moved inside of the buffers
+     * on the way, as crop does, which only adds room around the picture */
+    if (src->nb_inputs == 1 && src->nb_outputs == 1 && src->inputs[0] &&
+        src->inputs[0]->type == AVMEDIA_TYPE_VIDEO &&
+        src->input_pads[0].forwards_frames)
+        ff_video_link_request_border(src->inputs[0], left, top, right, bottom);
+}
+
 AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
 {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(link->format);
     AVFrame *frame = NULL;
+    int border[4] = { 0 };
     int pool_width = 0;
     int pool_height = 0;
     int pool_align = 0;
     enum AVPixelFormat pool_format = AV_PIX_FMT_NONE;
+    int i;
 
     if (link->hw_frames_ctx &&
         ((AVHWFramesContext*)link->hw_frames_ctx->data)->format == link->format) {
@@ -64,16 +89,34 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
         return frame;
     }
 
+    if (desc && (link->alloc_border[0] | link->alloc_border[1] |
+                 link->alloc_border[2] | link->alloc_border[3]) &&
+        !(desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_PSEUDOPAL |
+                         AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM))) {
+        /* keep the picture aligned and the chroma planes in step */
+        border[0] = FFALIGN(link->alloc_border[0], BUFFER_ALIGN << desc->log2_chroma_w);
+        border[1] = FFALIGN(link->alloc_border[1], 1 << desc->log2_chroma_h);
+        border[2] = FFALIGN(link->alloc_border[2], 1 << desc->log2_chroma_w);
+        border[3] = FFALIGN(link->alloc_border[3], 1 << desc->log2_chroma_h);
+        if (w > INT_MAX - border[0] - border[2] ||
+            h > INT_MAX - border[1] - border[3])
+            return NULL;
+    }
+    w += border[0] + border[2];
+    h += border[1] + border[3];
+
+    ff_link_pipeline_lock(link);
+
     if (!link->frame_pool) {
         link->frame_pool = ff_frame_pool_video_init(av_buffer_allocz, w, h,
                                                     link->format, BUFFER_ALIGN);
         if (!link->frame_pool)
-            return NULL;
+            goto fail;
     } else {
         if (ff_frame_pool_get_video_config(link->frame_pool,
                                            &pool_width, &pool_height,
                                            &pool_format, &pool_align) < 0) {
-            return NULL;
+            goto fail;
         }
 
         if (pool_width != w || pool_height != h ||
@@ -83,14 +126,30 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
             link->frame_pool = ff_frame_pool_video_init(av_buffer_allocz, w, h,
                                                         link->format, BUFFER_ALIGN);
             if (!link->frame_pool)
-                return NULL;
+                goto fail;
         }
     }
 
     frame = ff_frame_pool_get(link->frame_pool);
+fail:
+    ff_link_pipeline_unlock(link);
     if (!frame)
         return NULL;
 
+    if (border[0] || border[1] || border[2] || border[3]) {
+        int max_step[4];
+
+        av_image_fill_max_pixsteps(max_step, NULL, desc);
+        for (i = 0; i < 4 && frame->data[i]; i++) {
+            int hsub = i == 1 || i == 2 ? desc->log2_chroma_w : 0;
+            int vsub = i == 1 || i == 2 ? desc->log2_chroma_h : 0;
+            frame->data[i] += (border[0] >> hsub) * max_step[i] +
+                              (border[1] >> vsub) * frame->linesize[i];
+        }
+        frame->width  = w - border[0] - border[2];
+        frame->height = h - border[1] - border[3];
+    }
+
     frame->sample_aspect_ratio = link->sample_aspect_ratio;
 
     return frame;
@@ -102,7 +161,10 @@ AVFrame *ff_get_video_buffer(AVFilterLink *link, int w, int h)
 
     FF_TPRINTF_START(NULL, get_video_buffer); ff_tlog_link(NULL, link, 0);
 
-    if (link->dstpad->get_video_buffer)
+    /* The callback would use the state of a filter running on another
+       thread. */
+    if (link->dstpad->get_video_buffer &&
+        !link->src->internal->pipeline && !link->dst->internal->pipeline)
         ret = link->dstpad->get_video_buffer(link, w, h);
 
     if (!ret)
@@ -38,4 +38,17 @@ AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h);
  */
 AVFrame *ff_get_video_buffer(AVFilterLink *link, int w, int h);
 
+/**
+ * Ask for the frames allocated on link to have room for a border around
+ * the picture, so that the destination filter can extend them without
+ * copying, as pad does. The request is forwarded upstream through the
+ * filters whose input pad sets forwards_frames.
+ *
+ * This is only a hint: frames allocated by other means, or by a
+ * get_video_buffer() callback, may lack the border. It must be called
+ * while configuring the links.
+ */
+void ff_video_link_request_border(AVFilterLink *link,
+                                  int left, int top, int right, int bottom);
+
 #endif /* AVFILTER_VIDEO_H */
@@ -18,6 +18,7 @@
 
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <drm.h>
@@ -28,6 +29,36 @@
 #include "hwcontext_drm.h"
 #include "hwcontext_internal.h"
 #include "imgutils.h"
+#include "thread.h"
+
+/**
+ * Mappings are kept around once the frame has been unmapped, so that mapping
+ * the same buffer again (as happens with pooled decoder output) costs a
+ * single fstat() instead of an mmap()/munmap() pair and the page faults of
+ * a fresh mapping. The dma-buf inode identifies the buffer, an fd closed and
+ * reused for another buffer misses. An idle mapping keeps its buffer alive,
+ * so the cache is small and the least recently used idle entry goes first.
+ */
+#define DRM_MAP_CACHE_SIZE 32
+
+typedef struct DRMMapCacheEntry {
+    void   *address;
+    size_t  length;
+    int     prot;
+    int     fd;
+    dev_t   dev;
+    ino_t   ino;
+    // Number of mapped frames using the entry.
+    int     refcount;
+    uint64_t last_use;
+} DRMMapCacheEntry;
+
+typedef struct DRMFramesContext {
+    AVMutex lock;
+    int     lock_init;
+    uint64_t use_count;
+    DRMMapCacheEntry cache[DRM_MAP_CACHE_SIZE];
+} DRMFramesContext;
 
 
 static void drm_device_free(AVHWDeviceContext *hwdev)
@@ -85,21 +116,152 @@ static int drm_get_buffer(AVHWFramesContext *hwfc, AVFrame *frame)
     return 0;
 }
 
+static int drm_frames_init(AVHWFramesContext *hwfc)
+{
+    DRMFramesContext *priv = hwfc->internal->priv;
+    int err;
+
+    err = ff_mutex_init(&priv->lock, NULL);
+    if (err)
+        return AVERROR(err);
+    priv->lock_init = 1;
+
+    return 0;
+}
+
+static void drm_frames_uninit(AVHWFramesContext *hwfc)
+{
+    DRMFramesContext *priv = hwfc->internal->priv;
+    int i;
+
+    // Mapped frames hold a reference to the frames context, so every
+    // entry is idle by now.
+    for (i = 0; i < DRM_MAP_CACHE_SIZE; i++) {
+        DRMMapCacheEntry *entry = &priv->cache[i];
+        av_assert0(!entry->refcount);
+        if (entry->address)
+            munmap(entry->address, entry->length);
+        entry->address = NULL;
+    }
+
+    if (priv->lock_init)
+        ff_mutex_destroy(&priv->lock);
+    priv->lock_init = 0;
+}
+
 typedef struct DRMMapping {
     // Address and length of each mmap()ed region.
     int nb_regions;
     void *address[AV_DRM_MAX_PLANES];
     size_t length[AV_DRM_MAX_PLANES];
+    // Cache entry holding the region, NULL if it is mapped on its own.
+    DRMMapCacheEntry *entry[AV_DRM_MAX_PLANES];
 } DRMMapping;
 
+/**
+ * Map an object, from the cache if it is there already. On success the
+ * region is recorded at index i of map.
+ */
+static int drm_map_object(AVHWFramesContext *hwfc, DRMMapping *map, int i,
+                          const AVDRMObjectDescriptor *object, int prot)
+{
+    DRMFramesContext *priv = hwfc->internal->priv;
+    DRMMapCacheEntry *entry = NULL, *victim = NULL;
+    struct stat st;
+    void *addr;
+    int j, err;
+
+    if (!priv->lock_init || fstat(object->fd, &st) < 0) {
+        // Not cacheable, map it on its own.
+        addr = mmap(NULL, object->size, prot, MAP_SHARED, object->fd, 0);
+        if (addr == MAP_FAILED)
+            return AVERROR(errno);
+        map->address[i] = addr;
+        map->length[i]  = object->size;
+        return 0;
+    }
+
+    ff_mutex_lock(&priv->lock);
+
+    for (j = 0; j < DRM_MAP_CACHE_SIZE; j++) {
+        DRMMapCacheEntry *e = &priv->cache[j];
+        if (!e->address) {
+            if (!victim || victim->address)
+                victim = e;
+            continue;
+        }
+        if (e->fd == object->fd && e->dev == st.st_dev &&
+            e->ino == st.st_ino && e->length == object->size &&
+            e->prot == prot) {
+            entry = e;
+            break;
+        }
+        if (!e->refcount && (!victim || (victim->address &&
+                                         e->last_use < victim->last_use)))
+            victim = e;
+    }
+
+    if (!entry) {
+        addr = mmap(NULL, object->size, prot, MAP_SHARED, object->fd, 0);
+        if (addr == MAP_FAILED) {
+            err = AVERROR(errno);
+            ff_mutex_unlock(&priv->lock);
+            return err;
+        }
+
+        if (!victim) {
+            // Every entry is in use, keep this one out of the cache.
+            ff_mutex_unlock(&priv->lock);
+            map->address[i] = addr;
+            map->length[i]  = object->size;
+            return 0;
+        }
+
+        if (victim->address)
+            munmap(victim->address, victim->length);
+        entry = victim;
+        entry->address  = addr;
+        entry->length   = object->size;
+        entry->prot     = prot;
+        entry->fd       = object->fd;
+        entry->dev      = st.st_dev;
+        entry->ino      = st.st_ino;
+        entry->refcount = 0;
+    }
+
+    entry->refcount++;
+    entry->last_use = ++priv->use_count;
+
+    ff_mutex_unlock(&priv->lock);
+
+    map->address[i] = entry->address;
+    map->length[i]  = entry->length;
+    map->entry[i]   = entry;
+    return 0;
+}
+
+static void drm_unmap_regions(AVHWFramesContext *hwfc, DRMMapping *map)
+{
+    DRMFramesContext *priv = hwfc->internal->priv;
+    int i;
+
+    for (i = 0; i < map->nb_regions; i++) {
+        if (map->entry[i]) {
+            ff_mutex_lock(&priv->lock);
+            map->entry[i]->refcount--;
+            ff_mutex_unlock(&priv->lock);
+        } else if (map->address[i]) {
+            munmap(map->address[i], map->length[i]);
+        }
+    }
+}
+
 static void drm_unmap_frame(AVHWFramesContext *hwfc,
                             HWMapDescriptor *hwmap)
 {
     DRMMapping *map = hwmap->priv;
-    int i;
 
-    for (i = 0; i < map->nb_regions; i++)
-        munmap(map->address[i], map->length[i]);
+    drm_unmap_regions(hwfc, map);
 
     av_free(map);
 }
@@ -111,7 +273,6 @@ static int drm_map_frame(AVHWFramesContext *hwfc,
     DRMMapping *map;
     int err, i, p, plane;
     int mmap_prot;
-    void *addr;
 
     map = av_mallocz(sizeof(*map));
     if (!map)
@@ -125,19 +286,14 @@ static int drm_map_frame(AVHWFramesContext *hwfc,
 
     av_assert0(desc->nb_objects <= AV_DRM_MAX_PLANES);
     for (i = 0; i < desc->nb_objects; i++) {
-        addr = mmap(NULL, desc->objects[i].size, mmap_prot, MAP_SHARED,
-                    desc->objects[i].fd, 0);
-        if (addr == MAP_FAILED) {
-            err = AVERROR(errno);
+        err = drm_map_object(hwfc, map, i, &desc->objects[i], mmap_prot);
+        if (err < 0) {
             av_log(hwfc, AV_LOG_ERROR, "Failed to map DRM object %d to "
-                   "memory: %d.\n", desc->objects[i].fd, errno);
+                   "memory: %d.\n", desc->objects[i].fd, AVUNERROR(err));
             goto fail;
         }
-
-        map->address[i] = addr;
-        map->length[i]  = desc->objects[i].size;
+        map->nb_regions = i + 1;
     }
-    map->nb_regions = i;
 
     plane = 0;
     for (i = 0; i < desc->nb_layers; i++) {
@@ -163,10 +319,7 @@ static int drm_map_frame(AVHWFramesContext *hwfc,
     return 0;
 
 fail:
-    for (i = 0; i < desc->nb_objects; i++) {
-        if (map->address[i])
-            munmap(map->address[i], map->length[i]);
-    }
+    drm_unmap_regions(hwfc, map);
     av_free(map);
     return err;
 }
@@ -276,8 +429,12 @@ const HWContextType ff_hwcontext_type_drm = {
 
     .device_hwctx_size      = sizeof(AVDRMDeviceContext),
 
+    .frames_priv_size       = sizeof(DRMFramesContext),
+
     .device_create          = &drm_device_create,
 
+    .frames_init            = &drm_frames_init,
+    .frames_uninit          = &drm_frames_uninit,
     .frames_get_buffer      = &drm_get_buffer,
 
     .transfer_get_formats   = &drm_transfer_get_formats,
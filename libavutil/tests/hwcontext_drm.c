@@ -0,0 +1,307 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Tests the mapping cache of the DRM frames context on memfd backed
+ * frames, which behave like dma-bufs as far as mmap() is concerned.
+ *
+ * With -b, maps a pool of frames repeatedly and reports the time, page
+ * faults and mmap()/munmap() calls per frame.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <drm_fourcc.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/frame.h"
+#include "libavutil/hwcontext.h"
+#include "libavutil/hwcontext_drm.h"
+#include "libavutil/time.h"
+
+#define WIDTH  1920
+#define HEIGHT 1080
+#define FRAME_SIZE (WIDTH * HEIGHT * 3 / 2)
+#define POOL_SIZE  8
+
+#if defined(SYS_mmap) && (defined(__x86_64__) || defined(__aarch64__))
+#define COUNT_SYSCALLS 1
+
+static int nb_mmap, nb_munmap;
+
+/* Count the calls made by libavutil by interposing the libc functions. */
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+    nb_mmap++;
+    return (void *)syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+}
+
+int munmap(void *addr, size_t length)
+{
+    nb_munmap++;
+    return syscall(SYS_munmap, addr, length);
+}
+#else
+#define COUNT_SYSCALLS 0
+#endif
+
+static int memfd_alloc(size_t size)
+{
+#ifdef SYS_memfd_create
+    int fd = syscall(SYS_memfd_create, "hwcontext_drm", 0);
+#else
+    int fd = -1;
+#endif
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void frame_free(void *opaque, uint8_t *data)
+{
+    AVDRMFrameDescriptor *desc = (AVDRMFrameDescriptor *)data;
+
+    close(desc->objects[0].fd);
+    av_free(desc);
+}
+
+static AVBufferRef *frame_alloc(void *opaque, int size)
+{
+    AVDRMFrameDescriptor *desc;
+    AVDRMLayerDescriptor *layer;
+    AVBufferRef *ref;
+
+    desc = av_mallocz(sizeof(*desc));
+    if (!desc)
+        return NULL;
+
+    desc->nb_objects = 1;
+    desc->objects[0].fd   = memfd_alloc(FRAME_SIZE);
+    desc->objects[0].size = FRAME_SIZE;
+    desc->objects[0].format_modifier = DRM_FORMAT_MOD_INVALID;
+    if (desc->objects[0].fd < 0) {
+        av_free(desc);
+        return NULL;
+    }
+
+    desc->nb_layers = 1;
+    layer = &desc->layers[0];
+    layer->format    = DRM_FORMAT_NV12;
+    layer->nb_planes = 2;
+    layer->planes[0].offset = 0;
+    layer->planes[0].pitch  = WIDTH;
+    layer->planes[1].offset = WIDTH * HEIGHT;
+    layer->planes[1].pitch  = WIDTH;
+
+    ref = av_buffer_create((uint8_t *)desc, sizeof(*desc), frame_free,
+                           NULL, 0);
+    if (!ref)
+        frame_free(NULL, (uint8_t *)desc);
+    return ref;
+}
+
+static AVBufferRef *frames_alloc(AVBufferRef *device, AVBufferPool **pool)
+{
+    AVBufferRef *frames_ref;
+    AVHWFramesContext *frames;
+
+    frames_ref = av_hwframe_ctx_alloc(device);
+    if (!frames_ref)
+        return NULL;
+
+    frames = (AVHWFramesContext *)frames_ref->data;
+    frames->format    = AV_PIX_FMT_DRM_PRIME;
+    frames->sw_format = AV_PIX_FMT_NV12;
+    frames->width     = WIDTH;
+    frames->height    = HEIGHT;
+    frames->pool = *pool = av_buffer_pool_init2(sizeof(AVDRMFrameDescriptor),
+                                                NULL, frame_alloc, NULL);
+
+    if (!*pool || av_hwframe_ctx_init(frames_ref) < 0)
+        av_buffer_unref(&frames_ref);
+    return frames_ref;
+}
+
+static int map_frame(AVFrame *map, const AVFrame *frame, int flags)
+{
+    av_frame_unref(map);
+    map->format = AV_PIX_FMT_NV12;
+    return av_hwframe_map(map, frame, flags);
+}
+
+static int test_cache(AVBufferRef *frames_ref)
+{
+    AVFrame *frame = av_frame_alloc(), *map = av_frame_alloc();
+    AVDRMFrameDescriptor *desc;
+    uint8_t *addr;
+    int old_fd, ret = 1;
+
+    if (!frame || !map || av_hwframe_get_buffer(frames_ref, frame, 0) < 0)
+        goto end;
+
+    if (map_frame(map, frame, AV_HWFRAME_MAP_WRITE) < 0)
+        goto end;
+    memset(map->data[0], 0x42, WIDTH);
+    addr = map->data[0];
+
+    if (map_frame(map, frame, AV_HWFRAME_MAP_WRITE) < 0)
+        goto end;
+    if (map->data[0] != addr) {
+        fprintf(stderr, "second mapping was not served from the cache\n");
+        goto end;
+    }
+
+    if (map_frame(map, frame, AV_HWFRAME_MAP_READ) < 0)
+        goto end;
+    if (map->data[0][0] != 0x42 || map->data[0][WIDTH - 1] != 0x42) {
+        fprintf(stderr, "read mapping does not see written data\n");
+        goto end;
+    }
+    av_frame_unref(map);
+
+    /* Replace the buffer behind the fd with a new one: the cached mapping
+     * of the old buffer must not be returned for the new one. */
+    desc = (AVDRMFrameDescriptor *)frame->data[0];
+    old_fd = desc->objects[0].fd;
+    close(old_fd);
+    desc->objects[0].fd = memfd_alloc(FRAME_SIZE);
+    if (desc->objects[0].fd != old_fd) {
+        fprintf(stderr, "fd %d was not reused\n", old_fd);
+        goto end;
+    }
+
+    if (map_frame(map, frame, AV_HWFRAME_MAP_READ) < 0)
+        goto end;
+    if (map->data[0][0] != 0) {
+        fprintf(stderr, "stale mapping returned for a reused fd\n");
+        goto end;
+    }
+
+    ret = 0;
+end:
+    av_frame_free(&map);
+    av_frame_free(&frame);
+    return ret;
+}
+
+static int bench(AVBufferRef *frames_ref, int iterations)
+{
+    AVFrame *frames[POOL_SIZE] = { NULL };
+    AVFrame *map = av_frame_alloc();
+    struct rusage r0, r1;
+    int64_t t;
+    int i, j, ret = 1;
+
+    if (!map)
+        return 1;
+    for (i = 0; i < POOL_SIZE; i++) {
+        frames[i] = av_frame_alloc();
+        if (!frames[i] || av_hwframe_get_buffer(frames_ref, frames[i], 0) < 0)
+            goto end;
+    }
+
+#if COUNT_SYSCALLS
+    nb_mmap = nb_munmap = 0;
+#endif
+    getrusage(RUSAGE_SELF, &r0);
+    t = av_gettime_relative();
+
+    for (i = 0; i < iterations; i++) {
+        AVFrame *frame = frames[i % POOL_SIZE];
+        if (map_frame(map, frame, AV_HWFRAME_MAP_READ | AV_HWFRAME_MAP_WRITE) < 0)
+            goto end;
+        // Touch every page, as a consumer of the frame would.
+        for (j = 0; j < FRAME_SIZE; j += 4096)
+            map->data[0][j]++;
+        av_frame_unref(map);
+    }
+
+    t = av_gettime_relative() - t;
+    getrusage(RUSAGE_SELF, &r1);
+
+    printf("%d frames of %dx%d, pool of %d\n", iterations, WIDTH, HEIGHT,
+           POOL_SIZE);
+    printf("time:         %.2f us/frame\n", (double)t / iterations);
+    printf("minor faults: %.2f /frame\n",
+           (double)(r1.ru_minflt - r0.ru_minflt) / iterations);
+#if COUNT_SYSCALLS
+    printf("mmap:         %.2f /frame\n", (double)nb_mmap   / iterations);
+    printf("munmap:       %.2f /frame\n", (double)nb_munmap / iterations);
+#else
+    printf("mmap:         n/a\n");
+    printf("munmap:       n/a\n");
+#endif
+
+    ret = 0;
+end:
+    for (i = 0; i < POOL_SIZE; i++)
+        av_frame_free(&frames[i]);
+    av_frame_free(&map);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    AVBufferRef *device_ref, *frames_ref = NULL;
+    AVBufferPool *pool = NULL;
+    AVDRMDeviceContext *hwctx;
+    int fd, ret = 1;
+
+    device_ref = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_DRM);
+    if (!device_ref)
+        return 1;
+    // No device is needed to map frames.
+    hwctx = ((AVHWDeviceContext *)device_ref->data)->hwctx;
+    hwctx->fd = -1;
+    if (av_hwdevice_ctx_init(device_ref) < 0)
+        goto end;
+
+    // memfd is not available everywhere, nothing to test then.
+    fd = memfd_alloc(FRAME_SIZE);
+    if (fd < 0) {
+        ret = 0;
+        goto end;
+    }
+    close(fd);
+
+    frames_ref = frames_alloc(device_ref, &pool);
+    if (!frames_ref)
+        goto end;
+
+    if (argc > 1 && !strcmp(argv[1], "-b"))
+        ret = bench(frames_ref, argc > 2 ? atoi(argv[2]) : 10000);
+    else
+        ret = test_cache(frames_ref);
+
+end:
+    av_buffer_unref(&frames_ref);
+    // The pool was supplied by us, so it is ours to free.
+    av_buffer_pool_uninit(&pool);
+    av_buffer_unref(&device_ref);
+    return ret;
+}
@@ -88,6 +88,37 @@ void av_thread_message_queue_set_free_func(AVThreadMessageQueue *mq,
 #endif
 }
 
+int av_thread_message_queue_grow(AVThreadMessageQueue *mq, unsigned nelem)
+{
+#if HAVE_THREADS
+    int ret;
+
+    if (nelem > INT_MAX / mq->elsize)
+        return AVERROR(EINVAL);
+    pthread_mutex_lock(&mq->lock);
+    ret = av_fifo_grow(mq->fifo, nelem * mq->elsize);
+    if (ret >= 0)
+        pthread_cond_broadcast(&mq->cond_send);
+    pthread_mutex_unlock(&mq->lock);
+    return ret;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+int av_thread_message_queue_nb_elems(AVThreadMessageQueue *mq)
+{
+#if HAVE_THREADS
+    int ret;
+    pthread_mutex_lock(&mq->lock);
+    ret = av_fifo_size(mq->fifo);
+    pthread_mutex_unlock(&mq->lock);
+    return ret / mq->elsize;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 void av_thread_message_queue_free(AVThreadMessageQueue **mq)
 {
 #if HAVE_THREADS
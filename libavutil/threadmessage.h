@@ -95,6 +95,23 @@ void av_thread_message_queue_set_err_recv(AVThreadMessageQueue *mq,
 void av_thread_message_queue_set_free_func(AVThreadMessageQueue *mq,
                                            void (*free_func)(void *msg));
 
+/**
+ * Enlarge the queue so that it can hold at least nelem more messages than
+ * the ones it currently holds. The queue may be enlarged more than requested.
+ *
+ * @return 0 on success, a negative AVERROR on failure, in which case the
+ *         queue is unchanged
+ */
+int av_thread_message_queue_grow(AVThreadMessageQueue *mq, unsigned nelem);
+
+/**
+ * Return the current number of messages in the queue.
+ *
+ * @return the current number of messages or AVERROR(ENOSYS) if lavu was built
+ *         without thread support
+ */
+int av_thread_message_queue_nb_elems(AVThreadMessageQueue *mq);
+
 /**
  * Flush the message queue
  *
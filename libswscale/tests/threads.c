@@ -0,0 +1,266 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Checks that slice threaded scaling gives the same output as scaling on
+ * a single thread.
+ *
+ * With -b, scales 4K yuv422p10 to 1080p yuv420p repeatedly and reports the
+ * time per frame on one thread and on the given number of threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/cpu.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/time.h"
+#include "libswscale/swscale.h"
+#include "libswscale/swscale_internal.h"
+
+typedef struct Picture {
+    uint8_t *data[4];
+    int linesize[4];
+    int w, h;
+    enum AVPixelFormat format;
+} Picture;
+
+static const struct {
+    int src_w, src_h;
+    enum AVPixelFormat src_format;
+    int dst_w, dst_h;
+    enum AVPixelFormat dst_format;
+    int flags;
+} tests[] = {
+    { 1280, 720, AV_PIX_FMT_YUV420P,     640, 360, AV_PIX_FMT_YUV420P, SWS_BICUBIC  },
+    {  352, 288, AV_PIX_FMT_YUV420P,     704, 576, AV_PIX_FMT_RGB24,   SWS_BILINEAR },
+    {  720, 576, AV_PIX_FMT_RGB24,       352, 290, AV_PIX_FMT_YUV420P, SWS_LANCZOS  },
+    { 1920, 1080, AV_PIX_FMT_YUV422P10,  1280, 720, AV_PIX_FMT_NV12,   SWS_BICUBIC  },
+    {  640, 480, AV_PIX_FMT_YUVA420P,    320, 241, AV_PIX_FMT_YUVA444P, SWS_AREA    },
+    {  320, 240, AV_PIX_FMT_GRAY8,       800, 600, AV_PIX_FMT_YUV420P, SWS_SPLINE   },
+};
+
+static int picture_alloc(Picture *pic, int w, int h, enum AVPixelFormat format)
+{
+    pic->w      = w;
+    pic->h      = h;
+    pic->format = format;
+    return av_image_alloc(pic->data, pic->linesize, w, h, format, 32);
+}
+
+static void picture_free(Picture *pic)
+{
+    av_freep(&pic->data[0]);
+}
+
+static void picture_fill(Picture *pic, AVLFG *lfg)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pic->format);
+    int p, x, y;
+
+    for (p = 0; p < 4 && pic->data[p]; p++) {
+        int bytes = av_image_get_linesize(pic->format, pic->w, p);
+        int h     = p == 1 || p == 2 ? AV_CEIL_RSHIFT(pic->h, desc->log2_chroma_h) : pic->h;
+        for (y = 0; y < h; y++) {
+            uint8_t *line = pic->data[p] + y * pic->linesize[p];
+            for (x = 0; x < bytes; x++)
+                line[x] = av_lfg_get(lfg);
+            /* keep high bit depth samples in range */
+            if (desc->comp[0].depth > 8 && !(desc->flags & AV_PIX_FMT_FLAG_BE))
+                for (x = 1; x < bytes; x += 2)
+                    line[x] &= (1 << (desc->comp[0].depth - 8)) - 1;
+        }
+    }
+}
+
+static int picture_cmp(const Picture *a, const Picture *b)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(a->format);
+    int p, y;
+
+    for (p = 0; p < 4 && a->data[p]; p++) {
+        int bytes = av_image_get_linesize(a->format, a->w, p);
+        int h     = p == 1 || p == 2 ? AV_CEIL_RSHIFT(a->h, desc->log2_chroma_h) : a->h;
+        for (y = 0; y < h; y++)
+            if (memcmp(a->data[p] + y * a->linesize[p],
+                       b->data[p] + y * b->linesize[p], bytes))
+                return 1;
+    }
+    return 0;
+}
+
+static struct SwsContext *context_alloc(int src_w, int src_h, enum AVPixelFormat src_format,
+                                        int dst_w, int dst_h, enum AVPixelFormat dst_format,
+                                        int flags, int threads)
+{
+    struct SwsContext *sws = sws_alloc_context();
+
+    if (!sws)
+        return NULL;
+
+    av_opt_set_int(sws, "srcw",       src_w,      0);
+    av_opt_set_int(sws, "srch",       src_h,      0);
+    av_opt_set_int(sws, "src_format", src_format, 0);
+    av_opt_set_int(sws, "dstw",       dst_w,      0);
+    av_opt_set_int(sws, "dsth",       dst_h,      0);
+    av_opt_set_int(sws, "dst_format", dst_format, 0);
+    av_opt_set_int(sws, "sws_flags",  flags,      0);
+    av_opt_set_int(sws, "threads",    threads,    0);
+
+    if (sws_init_context(sws, NULL, NULL) < 0) {
+        sws_freeContext(sws);
+        return NULL;
+    }
+    return sws;
+}
+
+static int scale(struct SwsContext *sws, const Picture *src, Picture *dst)
+{
+    return sws_scale(sws, (const uint8_t * const *)src->data, src->linesize,
+                     0, src->h, dst->data, dst->linesize);
+}
+
+static int check(int i, int threads, int extra_flags, AVLFG *lfg)
+{
+    struct SwsContext *ref_sws = NULL, *sws = NULL;
+    Picture src = { { NULL } }, ref = { { NULL } }, dst = { { NULL } };
+    int flags = tests[i].flags | extra_flags;
+    int ret = 1;
+
+    ref_sws = context_alloc(tests[i].src_w, tests[i].src_h, tests[i].src_format,
+                            tests[i].dst_w, tests[i].dst_h, tests[i].dst_format,
+                            flags, 1);
+    sws     = context_alloc(tests[i].src_w, tests[i].src_h, tests[i].src_format,
+                            tests[i].dst_w, tests[i].dst_h, tests[i].dst_format,
+                            flags, threads);
+    if (!ref_sws || !sws)
+        goto end;
+
+    if (picture_alloc(&src, tests[i].src_w, tests[i].src_h, tests[i].src_format) < 0 ||
+        picture_alloc(&ref, tests[i].dst_w, tests[i].dst_h, tests[i].dst_format) < 0 ||
+        picture_alloc(&dst, tests[i].dst_w, tests[i].dst_h, tests[i].dst_format) < 0)
+        goto end;
+    picture_fill(&src, lfg);
+
+    /* scale twice, the second picture must not depend on the first */
+    if (scale(ref_sws, &src, &ref) != ref.h ||
+        scale(sws,     &src, &dst) != dst.h ||
+        scale(sws,     &src, &dst) != dst.h) {
+        fprintf(stderr, "test %d: scaling failed\n", i);
+        goto end;
+    }
+
+    if (HAVE_THREADS && sws->nb_slice_ctx < 2) {
+        fprintf(stderr, "test %d: not threaded\n", i);
+        goto end;
+    }
+    if (picture_cmp(&ref, &dst)) {
+        fprintf(stderr, "test %d: %s %dx%d -> %s %dx%d with %d threads and flags 0x%x differs\n", i,
+                av_get_pix_fmt_name(tests[i].src_format), tests[i].src_w, tests[i].src_h,
+                av_get_pix_fmt_name(tests[i].dst_format), tests[i].dst_w, tests[i].dst_h,
+                threads, flags);
+        goto end;
+    }
+
+    ret = 0;
+end:
+    picture_free(&src);
+    picture_free(&ref);
+    picture_free(&dst);
+    sws_freeContext(ref_sws);
+    sws_freeContext(sws);
+    return ret;
+}
+
+static double bench_run(const Picture *src, Picture *dst, int threads, int iterations)
+{
+    struct SwsContext *sws;
+    int64_t t;
+    int i;
+
+    sws = context_alloc(src->w, src->h, src->format, dst->w, dst->h, dst->format,
+                        SWS_BICUBIC, threads);
+    if (!sws)
+        return -1;
+
+    scale(sws, src, dst);
+    t = av_gettime_relative();
+    for (i = 0; i < iterations; i++)
+        scale(sws, src, dst);
+    t = av_gettime_relative() - t;
+
+    sws_freeContext(sws);
+    return t / 1000.0 / iterations;
+}
+
+static int bench(int iterations, int threads, AVLFG *lfg)
+{
+    Picture src = { { NULL } }, dst = { { NULL } };
+    double t1, tn;
+    int ret = 1;
+
+    if (picture_alloc(&src, 3840, 2160, AV_PIX_FMT_YUV422P10) < 0 ||
+        picture_alloc(&dst, 1920, 1080, AV_PIX_FMT_YUV420P) < 0)
+        goto end;
+    picture_fill(&src, lfg);
+
+    t1 = bench_run(&src, &dst, 1,       iterations);
+    tn = bench_run(&src, &dst, threads, iterations);
+    if (t1 < 0 || tn < 0)
+        goto end;
+
+    printf("%s %dx%d -> %s %dx%d, %d frames\n",
+           av_get_pix_fmt_name(src.format), src.w, src.h,
+           av_get_pix_fmt_name(dst.format), dst.w, dst.h, iterations);
+    printf("1 thread:   %.2f ms/frame\n", t1);
+    printf("%d threads: %.2f ms/frame (x%.2f)\n", threads, tn, t1 / tn);
+
+    ret = 0;
+end:
+    picture_free(&src);
+    picture_free(&dst);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    static const int nb_threads[] = { 2, 3, 8 };
+    // with and without the exact C vertical scaler
+    static const int extra_flags[] = { SWS_ACCURATE_RND | SWS_BITEXACT, 0 };
+    AVLFG lfg;
+    int i, j, k;
+
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    if (argc > 1 && !strcmp(argv[1], "-b"))
+        return bench(argc > 2 ? atoi(argv[2]) : 50,
+                     argc > 3 ? atoi(argv[3]) : av_cpu_count(), &lfg);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(tests); i++)
+        for (j = 0; j < FF_ARRAY_ELEMS(nb_threads); j++)
+            for (k = 0; k < FF_ARRAY_ELEMS(extra_flags); k++)
+                if (check(i, nb_threads[j], extra_flags[k], &lfg))
+                    return 1;
+
+    return 0;
+}
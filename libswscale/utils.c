@@ -852,6 +852,7 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
     const AVPixFmtDescriptor *desc_dst;
     const AVPixFmtDescriptor *desc_src;
     int need_reinit = 0;
+    int i;
 
     handle_formats(c);
     desc_dst = av_pix_fmt_desc_get(c->dstFormat);
@@ -977,6 +978,11 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
 
     fill_rgb2yuv_table(c, table, dstRange);
 
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_setColorspaceDetails(c->slice_ctx[i], inv_table, srcRange,
+                                 table, dstRange, brightness, contrast,
+                                 saturation);
+
     return 0;
 }
 
@@ -1150,6 +1156,58 @@ static enum AVPixelFormat alphaless_fmt(enum AVPixelFormat fmt)
     }
 }
 
+/* Below this, bands spend more time on the vertical filter overlap
+ * than they save. */
+#define MIN_BAND_HEIGHT 16
+
+static av_cold int context_init_threaded(SwsContext *c,
+                                         SwsFilter *srcFilter,
+                                         SwsFilter *dstFilter)
+{
+    int nb_threads = c->nb_threads ? c->nb_threads : av_cpu_count();
+    int nb_bands, i, ret;
+
+    /* error diffusion carries the error from one line to the next */
+    if (!HAVE_THREADS || nb_threads <= 1 || c->dither == SWS_DITHER_ED)
+        return 0;
+
+    nb_bands = FFMIN(nb_threads, c->dstH / MIN_BAND_HEIGHT);
+    if (nb_bands <= 1)
+        return 0;
+
+    ret = avpriv_slicethread_create(&c->slicethread, c, ff_sws_slice_worker,
+                                    NULL, nb_bands);
+    if (ret < 0)
+        return ret;
+
+    c->slice_ctx = av_mallocz_array(nb_bands, sizeof(*c->slice_ctx));
+    if (!c->slice_ctx)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < nb_bands; i++) {
+        SwsContext *slice = sws_alloc_context();
+        if (!slice)
+            return AVERROR(ENOMEM);
+        c->slice_ctx[c->nb_slice_ctx++] = slice;
+
+        ret = av_opt_copy(slice, c);
+        if (ret < 0)
+            return ret;
+        slice->nb_threads = 1;
+
+        ret = sws_init_context(slice, srcFilter, dstFilter);
+        if (ret < 0)
+            return ret;
+        sws_setColorspaceDetails(slice, c->srcColorspaceTable, c->srcRange,
+                                 c->dstColorspaceTable, c->dstRange,
+                                 c->brightness, c->contrast, c->saturation);
+    }
+
+    av_log(c, AV_LOG_VERBOSE, "Scaling in %d bands\n", nb_bands);
+
+    return 0;
+}
+
 av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
                              SwsFilter *dstFilter)
 {
@@ -1802,7 +1860,11 @@ av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
     }
 
     c->swscale = ff_getSwsFunc(c);
-    return ff_init_filters(c);
+    ret = ff_init_filters(c);
+    if (ret < 0)
+        return ret;
+
+    return context_init_threaded(c, srcFilter, dstFilter);
 fail: // FIXME replace things by appropriate error codes
     if (ret == RETCODE_USE_CASCADE)  {
         int tmpW = sqrt(srcW * (int64_t)dstW);
@@ -2287,6 +2349,11 @@ void sws_freeContext(SwsContext *c)
     if (!c)
         return;
 
+    avpriv_slicethread_free(&c->slicethread);
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_freeContext(c->slice_ctx[i]);
+    av_freep(&c->slice_ctx);
+
     for (i = 0; i < 4; i++)
         av_freep(&c->dither_error[i]);
 
@@ -0,0 +1,216 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * Filter graph pipeline threading test: the output must be the same with
+ * and without AVFILTER_THREAD_PIPELINE.
+ */
+
+#include <stdio.h>
+
+#include "libavutil/adler32.h"
+#include "libavutil/frame.h"
+#include "libavutil/pixdesc.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavfilter/buffersrc.h"
+
+#define WIDTH      320
+#define HEIGHT     240
+#define NB_FRAMES  40
+#define MAX_OUTPUT (4 * NB_FRAMES)
+
+/* yadif doubles the frame rate; scale, pad and crop are run on the graph
+ * thread */
+static const char *filters = "yadif=mode=send_field,scale=160:120,gblur,"
+                             "pad=176:144:8:12,unsharp,hflip,crop=160:128";
+
+typedef struct Output {
+    int64_t pts;
+    unsigned long checksum;
+} Output;
+
+static void fill_frame(AVFrame *frame, int n)
+{
+    int x, y;
+
+    for (y = 0; y < HEIGHT; y++)
+        for (x = 0; x < WIDTH; x++)
+            frame->data[0][y * frame->linesize[0] + x] =
+                (x * 3 + y * 5 + n * 7) ^ ((x * y) >> 4);
+    for (y = 0; y < HEIGHT / 2; y++) {
+        for (x = 0; x < WIDTH / 2; x++) {
+            frame->data[1][y * frame->linesize[1] + x] = x + n * 3;
+            frame->data[2][y * frame->linesize[2] + x] = y * 2 - n;
+        }
+    }
+    frame->pts = n;
+    frame->interlaced_frame = 1;
+    frame->top_field_first  = n & 1;
+}
+
+static int receive_frames(AVFilterContext *sink, AVFrame *frame,
+                          Output *out, int *nb_out)
+{
+    const AVPixFmtDescriptor *desc;
+    int ret, p, y;
+
+    while ((ret = av_buffersink_get_frame(sink, frame)) >= 0) {
+        unsigned long checksum = 0;
+
+        desc = av_pix_fmt_desc_get(frame->format);
+        for (p = 0; p < 3; p++) {
+            int w = p ? AV_CEIL_RSHIFT(frame->width,  desc->log2_chroma_w) : frame->width;
+            int h = p ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+            for (y = 0; y < h; y++)
+                checksum = av_adler32_update(checksum,
+                                             frame->data[p] + y * frame->linesize[p], w);
+        }
+        if (*nb_out < MAX_OUTPUT) {
+            out[*nb_out].pts      = frame->pts;
+            out[*nb_out].checksum = checksum;
+        }
+        (*nb_out)++;
+        av_frame_unref(frame);
+    }
+    return ret;
+}
+
+static int run_graph(int thread_type, Output *out, int *nb_out)
+{
+    AVFilterGraph *graph;
+    AVFilterContext *src = NULL, *sink = NULL;
+    AVFilterInOut *inputs = NULL, *outputs = NULL;
+    AVFrame *in = NULL, *frame = NULL;
+    char args[128];
+    int ret, n;
+
+    *nb_out = 0;
+
+    graph = avfilter_graph_alloc();
+    if (!graph)
+        return AVERROR(ENOMEM);
+    graph->thread_type = thread_type;
+    graph->nb_threads  = 8;
+
+    snprintf(args, sizeof(args),
+             "video_size=%dx%d:pix_fmt=%d:time_base=1/25:pixel_aspect=1/1",
+             WIDTH, HEIGHT, AV_PIX_FMT_YUV420P);
+    ret = avfilter_graph_create_filter(&src, avfilter_get_by_name("buffer"),
+                                       "in", args, NULL, graph);
+    if (ret < 0)
+        goto end;
+    ret = avfilter_graph_create_filter(&sink, avfilter_get_by_name("buffersink"),
+                                       "out", NULL, NULL, graph);
+    if (ret < 0)
+        goto end;
+
+    outputs = avfilter_inout_alloc();
+    inputs  = avfilter_inout_alloc();
+    if (!outputs || !inputs) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    outputs->name       = av_strdup("in");
+    outputs->filter_ctx = src;
+    inputs->name        = av_strdup("out");
+    inputs->filter_ctx  = sink;
+
+    ret = avfilter_graph_parse_ptr(graph, filters, &inputs, &outputs, NULL);
+    if (ret < 0)
+        goto end;
+    ret = avfilter_graph_config(graph, NULL);
+    if (ret < 0)
+        goto end;
+
+    in    = av_frame_alloc();
+    frame = av_frame_alloc();
+    if (!in || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    in->format = AV_PIX_FMT_YUV420P;
+    in->width  = WIDTH;
+    in->height = HEIGHT;
+    ret = av_frame_get_buffer(in, 32);
+    if (ret < 0)
+        goto end;
+
+    for (n = 0; n < NB_FRAMES; n++) {
+        ret = av_frame_make_writable(in);
+        if (ret < 0)
+            goto end;
+        fill_frame(in, n);
+        ret = av_buffersrc_add_frame_flags(src, in, AV_BUFFERSRC_FLAG_KEEP_REF |
+                                                    AV_BUFFERSRC_FLAG_PUSH);
+        if (ret < 0)
+            goto end;
+        ret = receive_frames(sink, frame, out, nb_out);
+        if (ret != AVERROR(EAGAIN))
+            goto end;
+    }
+
+    ret = av_buffersrc_add_frame(src, NULL);
+    if (ret < 0)
+        goto end;
+    ret = receive_frames(sink, frame, out, nb_out);
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+end:
+    av_frame_free(&in);
+    av_frame_free(&frame);
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    avfilter_graph_free(&graph);
+    return ret;
+}
+
+int main(void)
+{
+    static Output ref[MAX_OUTPUT], out[MAX_OUTPUT];
+    int nb_ref, nb_out, i, ret;
+
+    ret = run_graph(AVFILTER_THREAD_SLICE, ref, &nb_ref);
+    if (ret < 0) {
+        fprintf(stderr, "Serial run failed: %s\n", av_err2str(ret));
+        return 1;
+    }
+    ret = run_graph(AVFILTER_THREAD_SLICE | AVFILTER_THREAD_PIPELINE, out, &nb_out);
+    if (ret < 0) {
+        fprintf(stderr, "Pipeline run failed: %s\n", av_err2str(ret));
+        return 1;
+    }
+
+    if (nb_out != nb_ref || nb_ref > MAX_OUTPUT) {
+        fprintf(stderr, "Got %d frames instead of %d\n", nb_out, nb_ref);
+        return 1;
+    }
+    for (i = 0; i < nb_ref; i++) {
+        if (out[i].pts != ref[i].pts || out[i].checksum != ref[i].checksum) {
+            fprintf(stderr, "Frame %d differs: pts %"PRId64" checksum %08lx "
+                    "instead of pts %"PRId64" checksum %08lx\n", i,
+                    out[i].pts, out[i].checksum, ref[i].pts, ref[i].checksum);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * H264 RKVDEC hwaccel test.
+ *
+ * Decodes through the h264_rkvdec hwaccel and prints the same checksums as
+ * api-h264, so the output can be compared with the software decoder. Unless
+ * RKVDEC_DEVICE is set, the software emulated device is used so the test
+ * runs without the hardware. Decode latencies and throughput go to stderr.
+ */
+
+#include <stdlib.h>
+
+#include "libavutil/adler32.h"
+#include "libavutil/hwcontext.h"
+#include "libavutil/hwcontext_drm.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/time.h"
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+
+#define NB_BUCKETS 16
+
+static int64_t latency_hist[NB_BUCKETS];
+
+static enum AVPixelFormat get_format(AVCodecContext *ctx, const enum AVPixelFormat *fmt)
+{
+    for (; *fmt != AV_PIX_FMT_NONE; fmt++)
+        if (*fmt == AV_PIX_FMT_DRM_PRIME)
+            return *fmt;
+    av_log(ctx, AV_LOG_ERROR, "DRM_PRIME output not offered\n");
+    return AV_PIX_FMT_NONE;
+}
+
+static int create_device(AVBufferRef **device)
+{
+    AVDRMDeviceContext *hwctx;
+    int ret;
+
+    *device = av_hwdevice_ctx_alloc(AV_HWDEVICE_TYPE_DRM);
+    if (!*device)
+        return AVERROR(ENOMEM);
+
+    // the decoder allocates its own buffers, no DRM node is needed
+    hwctx = ((AVHWDeviceContext*)(*device)->data)->hwctx;
+    hwctx->fd = -1;
+
+    ret = av_hwdevice_ctx_init(*device);
+    if (ret < 0)
+        av_buffer_unref(device);
+    return ret;
+}
+
+/* deinterleave the NV12 picture to the layout api-h264 checksums */
+static int frame_checksum(AVCodecContext *ctx, AVFrame *hw, AVFrame *sw,
+                          uint8_t *buf, int buf_size, unsigned long *checksum)
+{
+    uint8_t *dst[4];
+    int linesize[4];
+    int ret, x, y;
+
+    av_frame_unref(sw);
+    sw->format = AV_PIX_FMT_NV12;
+    ret = av_hwframe_transfer_data(sw, hw, 0);
+    if (ret < 0)
+        return ret;
+
+    ret = av_image_fill_arrays(dst, linesize, buf, AV_PIX_FMT_YUV420P,
+                               ctx->width, ctx->height, 1);
+    if (ret < 0)
+        return ret;
+
+    av_image_copy_plane(dst[0], linesize[0], sw->data[0], sw->linesize[0],
+                        ctx->width, ctx->height);
+    for (y = 0; y < AV_CEIL_RSHIFT(ctx->height, 1); y++) {
+        const uint8_t *uv = sw->data[1] + y * sw->linesize[1];
+        for (x = 0; x < AV_CEIL_RSHIFT(ctx->width, 1); x++) {
+            dst[1][y * linesize[1] + x] = uv[2 * x];
+            dst[2][y * linesize[2] + x] = uv[2 * x + 1];
+        }
+    }
+
+    *checksum = av_adler32_update(0, buf, buf_size);
+    return buf_size;
+}
+
+static void print_stats(int nb_frames, int64_t elapsed)
+{
+    int i;
+
+    fprintf(stderr, "%d frames in %"PRId64" us, %.2f fps\n", nb_frames, elapsed,
+            elapsed ? nb_frames * 1000000.0 / elapsed : 0.0);
+    fprintf(stderr, "decode call latency:\n");
+    for (i = 0; i < NB_BUCKETS; i++)
+        if (latency_hist[i])
+            fprintf(stderr, "  < %6d us: %"PRId64"\n", 1 << (i + 1), latency_hist[i]);
+}
+
+static int video_decode(const char *input_filename)
+{
+    AVCodec *codec = NULL;
+    AVCodecContext *ctx = NULL;
+    AVFormatContext *fmt_ctx = NULL;
+    AVBufferRef *device = NULL;
+    AVFrame *fr = NULL, *sw = NULL;
+    uint8_t *byte_buffer = NULL;
+    AVPacket pkt;
+    int video_stream, byte_buffer_size, nb_frames = 0;
+    int i = 0, end_of_stream = 0;
+    int64_t start, t;
+    int result;
+
+    av_init_packet(&pkt);
+
+    result = avformat_open_input(&fmt_ctx, input_filename, NULL, NULL);
+    if (result < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Can't open file\n");
+        return result;
+    }
+
+    result = avformat_find_stream_info(fmt_ctx, NULL);
+    if (result < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Can't get stream info\n");
+        goto end;
+    }
+
+    video_stream = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (video_stream < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Can't find video stream in input file\n");
+        result = video_stream;
+        goto end;
+    }
+
+    result = create_device(&device);
+    if (result < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Can't create DRM device\n");
+        goto end;
+    }
+
+    ctx = avcodec_alloc_context3(codec);
+    fr  = av_frame_alloc();
+    sw  = av_frame_alloc();
+    if (!ctx || !fr || !sw) {
+        result = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    result = avcodec_parameters_to_context(ctx, fmt_ctx->streams[video_stream]->codecpar);
+    if (result < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Can't copy decoder context\n");
+        goto end;
+    }
+
+    ctx->get_format    = get_format;
+    ctx->hw_device_ctx = av_buffer_ref(device);
+
+    result = avcodec_open2(ctx, codec, NULL);
+    if (result < 0) {
+        av_log(ctx, AV_LOG_ERROR, "Can't open decoder\n");
+        goto end;
+    }
+
+    byte_buffer_size = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, ctx->width, ctx->height, 1);
+    byte_buffer = av_malloc(byte_buffer_size);
+    if (!byte_buffer) {
+        result = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    printf("#tb %d: %d/%d\n", video_stream, fmt_ctx->streams[video_stream]->time_base.num,
+           fmt_ctx->streams[video_stream]->time_base.den);
+
+    start = av_gettime_relative();
+    while (!end_of_stream) {
+        if (av_read_frame(fmt_ctx, &pkt) < 0)
+            end_of_stream = 1;
+        if (!end_of_stream && pkt.stream_index != video_stream) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+        if (!end_of_stream && pkt.pts == AV_NOPTS_VALUE)
+            pkt.pts = pkt.dts = i;
+        i++;
+
+        t = av_gettime_relative();
+        result = avcodec_send_packet(ctx, end_of_stream ? NULL : &pkt);
+        av_packet_unref(&pkt);
+        if (result < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error decoding frame\n");
+            goto end;
+        }
+
+        while ((result = avcodec_receive_frame(ctx, fr)) >= 0) {
+            unsigned long checksum;
+            int size;
+
+            if (fr->decode_error_flags) {
+                av_log(NULL, AV_LOG_ERROR, "Frame %d failed to decode\n", nb_frames);
+                result = AVERROR_INVALIDDATA;
+                goto end;
+            }
+            size = frame_checksum(ctx, fr, sw, byte_buffer, byte_buffer_size, &checksum);
+            if (size < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Can't retrieve frame\n");
+                result = size;
+                goto end;
+            }
+            printf("%d, %10"PRId64", %10"PRId64", %8"PRId64", %8d, 0x%08lx\n", video_stream,
+                   fr->pts, fr->pkt_dts, fr->pkt_duration, size, checksum);
+            av_frame_unref(fr);
+            nb_frames++;
+        }
+        if (result != AVERROR(EAGAIN) && result != AVERROR_EOF)
+            goto end;
+
+        t = av_gettime_relative() - t;
+        latency_hist[FFMIN(av_log2(t | 1), NB_BUCKETS - 1)]++;
+    }
+    result = 0;
+
+    print_stats(nb_frames, av_gettime_relative() - start);
+
+end:
+    av_packet_unref(&pkt);
+    av_frame_free(&fr);
+    av_frame_free(&sw);
+    avcodec_free_context(&ctx);
+    av_buffer_unref(&device);
+    avformat_close_input(&fmt_ctx);
+    av_freep(&byte_buffer);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        av_log(NULL, AV_LOG_ERROR, "Incorrect input\n");
+        return 1;
+    }
+
+    setenv("RKVDEC_DEVICE", "soft", 0);
+
+    if (video_decode(argv[1]) < 0)
+        return 1;
+
+    return 0;
+}
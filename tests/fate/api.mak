@@ -12,6 +12,11 @@ FATE_API_SAMPLES_LIBAVFORMAT-$(call DEMDEC, H264, H264) += fate-api-h264
 fate-api-h264: $(APITESTSDIR)/api-h264-test$(EXESUF)
 fate-api-h264: CMD = run $(APITESTSDIR)/api-h264-test $(TARGET_SAMPLES)/h264-conformance/SVA_NL2_E.264
 
+FATE_API_SAMPLES_LIBAVFORMAT-$(call ALLYES, H264_DEMUXER H264_RKVDEC_HWACCEL) += fate-api-h264-rkvdec
+fate-api-h264-rkvdec: $(APITESTSDIR)/api-h264-rkvdec-test$(EXESUF)
+fate-api-h264-rkvdec: CMD = run $(APITESTSDIR)/api-h264-rkvdec-test $(TARGET_SAMPLES)/h264-conformance/SVA_NL2_E.264
+fate-api-h264-rkvdec: REF = $(SRC_PATH)/tests/ref/fate/api-h264
+
 FATE_API_LIBAVFORMAT-$(call DEMDEC, FLV, FLV) += fate-api-seek
 fate-api-seek: $(APITESTSDIR)/api-seek-test$(EXESUF) fate-lavf-flv_fmt
 fate-api-seek: CMD = run $(APITESTSDIR)/api-seek-test $(TARGET_PATH)/tests/data/lavf/lavf.flv 0 720
@@ -30,6 +35,11 @@ fate-api-threadmessage: $(APITESTSDIR)/api-threadmessage-test$(EXESUF)
 fate-api-threadmessage: CMD = run $(APITESTSDIR)/api-threadmessage-test 3 10 30 50 2 20 40
 fate-api-threadmessage: CMP = null
 
+FATE_API-$(call ALLYES, YADIF_FILTER SCALE_FILTER GBLUR_FILTER PAD_FILTER UNSHARP_FILTER HFLIP_FILTER CROP_FILTER) += fate-api-filter-pipeline
+fate-api-filter-pipeline: $(APITESTSDIR)/api-filter-pipeline-test$(EXESUF)
+fate-api-filter-pipeline: CMD = run $(APITESTSDIR)/api-filter-pipeline-test
+fate-api-filter-pipeline: CMP = null
+
 FATE_API_SAMPLES-$(CONFIG_AVFORMAT) += $(FATE_API_SAMPLES_LIBAVFORMAT-yes)
 
 ifdef SAMPLES
@@ -41,6 +41,11 @@ fate-ffmpeg-filter_colorkey: CMD = framecrc -idct simple -fflags +bitexact -flag
 FATE_FFMPEG-$(CONFIG_COLOR_FILTER) += fate-ffmpeg-lavfi
 fate-ffmpeg-lavfi: CMD = framecrc -lavfi color=d=1:r=5 -fflags +bitexact
 
+FATE_FFMPEG-$(call ALLYES, TESTSRC_FILTER SPLIT_FILTER SCALE_FILTER MPEG4_ENCODER AEVALSRC_FILTER PCM_S16LE_ENCODER) += fate-ffmpeg-stage_threads
+fate-ffmpeg-stage_threads: CMD = framecrc -stage_threads -stage_queue_size 2 \
+  -filter_complex "testsrc=d=1:r=10,split[v0][v1]\;[v1]scale=80:60[v2]\;aevalsrc=sin(440*2*PI*t):d=1[a]" \
+  -map "[v0]" -map "[v2]" -map "[a]" -c:v mpeg4 -bf 2 -c:a pcm_s16le -flags +bitexact -fflags +bitexact -sws_flags +accurate_rnd+bitexact
+
 FATE_SAMPLES_FFMPEG-$(CONFIG_RAWVIDEO_DEMUXER) += fate-force_key_frames
 fate-force_key_frames: tests/data/vsynth_lena.yuv
 fate-force_key_frames: CMD = enc_dec \
@@ -55,6 +55,16 @@ fate-mpeg12framerate: libavcodec/tests/mpeg12framerate$(EXESUF)
 fate-mpeg12framerate: CMD = run libavcodec/tests/mpeg12framerate
 fate-mpeg12framerate: REF = /dev/null
 
+FATE_LIBAVCODEC-$(CONFIG_RKVDEC) += fate-rkvdec
+fate-rkvdec: libavcodec/tests/rkvdec$(EXESUF)
+fate-rkvdec: CMD = run libavcodec/tests/rkvdec
+fate-rkvdec: CMP = null
+
+FATE_LIBAVCODEC-$(CONFIG_H264_RKMPP_ENCODER) += fate-rkmppenc
+fate-rkmppenc: libavcodec/tests/rkmppenc$(EXESUF)
+fate-rkmppenc: CMD = run libavcodec/tests/rkmppenc
+fate-rkmppenc: CMP = null
+
 FATE_LIBAVCODEC-yes += fate-libavcodec-options
 fate-libavcodec-options: libavcodec/tests/options$(EXESUF)
 fate-libavcodec-options: CMD = run libavcodec/tests/options
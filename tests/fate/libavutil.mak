@@ -82,6 +82,11 @@ FATE_LIBAVUTIL += fate-hash
 fate-hash: libavutil/tests/hash$(EXESUF)
 fate-hash: CMD = run libavutil/tests/hash
 
+FATE_LIBAVUTIL-$(CONFIG_LIBDRM) += fate-hwcontext_drm
+fate-hwcontext_drm: libavutil/tests/hwcontext_drm$(EXESUF)
+fate-hwcontext_drm: CMD = run libavutil/tests/hwcontext_drm
+fate-hwcontext_drm: CMP = null
+
 FATE_LIBAVUTIL += fate-hmac
 fate-hmac: libavutil/tests/hmac$(EXESUF)
 fate-hmac: CMD = run libavutil/tests/hmac